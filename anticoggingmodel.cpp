@@ -0,0 +1,377 @@
+/*
+    Copyright 2016 - 2024 Benjamin Vedder	benjamin@vedder.se
+
+    This file is part of VESC Tool.
+
+    VESC Tool is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    VESC Tool is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+#include "anticoggingmodel.h"
+#include "fftw3wrapper.h"
+#include "vbytearray.h"
+
+#include <cmath>
+#include <QtConcurrent/QtConcurrent>
+
+int AnticoggingModel::Series::harmonics() const
+{
+    return cosCoeffs.size();
+}
+
+/**
+ * @brief AnticoggingModel::Series::value
+ * Evaluate the series. The harmonics are generated by rotating a phasor,
+ * so only one sine and one cosine are computed no matter how many
+ * harmonics there are.
+ */
+double AnticoggingModel::Series::value(double angleRad) const
+{
+    double c1 = cos(angleRad);
+    double s1 = sin(angleRad);
+    double ck = 1.0;
+    double sk = 0.0;
+    double res = offset;
+
+    for (int k = 0;k < cosCoeffs.size();k++) {
+        double cNext = ck * c1 - sk * s1;
+        sk = sk * c1 + ck * s1;
+        ck = cNext;
+        res += cosCoeffs.at(k) * ck + sinCoeffs.at(k) * sk;
+    }
+
+    return res;
+}
+
+AnticoggingModel::AnticoggingModel()
+{
+
+}
+
+/**
+ * @brief AnticoggingModel::addRun
+ * Add a calibration run. The run is fitted by the next call to fit.
+ *
+ * @param current
+ * The current the run was made at. Runs are sorted by current.
+ *
+ * @param speed
+ * The speed the run was made at, only kept for reference.
+ *
+ * @param forward
+ * Samples in forward direction, evenly spaced over one revolution.
+ *
+ * @param reverse
+ * Samples in reverse direction, same length as forward.
+ */
+void AnticoggingModel::addRun(double current, double speed, const QVector<double> &forward, const QVector<double> &reverse)
+{
+    Run r;
+    r.current = current;
+    r.speed = speed;
+    r.forward = forward;
+    r.reverse = reverse;
+    insertRun(r);
+}
+
+void AnticoggingModel::clear()
+{
+    mRuns.clear();
+}
+
+int AnticoggingModel::runCount() const
+{
+    return mRuns.size();
+}
+
+AnticoggingModel::Run AnticoggingModel::run(int index) const
+{
+    return mRuns.at(index);
+}
+
+/**
+ * @brief AnticoggingModel::fit
+ * Fit the common and differential mode series of all runs, one run per
+ * thread.
+ *
+ * @param cmBins
+ * Number of Fourier bins, including the offset, to keep for the common mode.
+ *
+ * @param dmBins
+ * Number of Fourier bins to keep for the differential mode.
+ */
+void AnticoggingModel::fit(int cmBins, int dmBins)
+{
+    QtConcurrent::blockingMap(mRuns, [cmBins, dmBins](Run &r) {
+        int len = qMin(r.forward.size(), r.reverse.size());
+        QVector<double> commonMode(len), diffMode(len);
+
+        for (int i = 0;i < len;i++) {
+            commonMode[i] = (r.forward.at(i) + r.reverse.at(i)) / 2.0;
+            diffMode[i] = (r.forward.at(i) - r.reverse.at(i)) / 2.0;
+        }
+
+        r.commonMode = fitSeries(commonMode, cmBins);
+        r.diffMode = fitSeries(diffMode, dmBins);
+    });
+}
+
+/**
+ * @brief AnticoggingModel::fitSeries
+ * Least squares fit of a truncated Fourier series to samples evenly spaced
+ * over one revolution. For evenly spaced samples that is the same as
+ * keeping the first bins of the FFT.
+ *
+ * @param samples
+ * The samples.
+ *
+ * @param bins
+ * Number of bins to keep, including the offset.
+ *
+ * @return
+ * The series.
+ */
+AnticoggingModel::Series AnticoggingModel::fitSeries(const QVector<double> &samples, int bins)
+{
+    Series res;
+
+    int len = samples.size();
+    if (len == 0) {
+        return res;
+    }
+
+    FFT fft(len);
+    std::copy(samples.constBegin(), samples.constEnd(), fft.input());
+    fft.execute();
+    const fftw_complex *spectrum = fft.output();
+
+    bins = qBound(1, bins, len / 2 + 1);
+    res.offset = spectrum[0][0] / double(len);
+    res.cosCoeffs.resize(bins - 1);
+    res.sinCoeffs.resize(bins - 1);
+
+    for (int k = 1;k < bins;k++) {
+        if (len % 2 == 0 && k == len / 2) {
+            // The Nyquist bin only has a cosine and is not mirrored
+            res.cosCoeffs[k - 1] = spectrum[k][0] / double(len);
+            res.sinCoeffs[k - 1] = 0.0;
+        } else {
+            res.cosCoeffs[k - 1] = 2.0 * spectrum[k][0] / double(len);
+            res.sinCoeffs[k - 1] = -2.0 * spectrum[k][1] / double(len);
+        }
+    }
+
+    return res;
+}
+
+/**
+ * @brief AnticoggingModel::evaluate
+ * Evaluate the fitted model.
+ *
+ * @param angleDeg
+ * Rotor angle in degrees.
+ *
+ * @param forward
+ * Direction, true for forward.
+ *
+ * @param current
+ * Current to interpolate the runs at. Outside of the range of the runs
+ * the closest run is used.
+ *
+ * @return
+ * The q-axis current to compensate with.
+ */
+double AnticoggingModel::evaluate(double angleDeg, bool forward, double current) const
+{
+    if (mRuns.isEmpty()) {
+        return 0.0;
+    }
+
+    double angleRad = angleDeg * M_PI / 180.0;
+    auto runValue = [angleRad, forward](const Run &r) {
+        double cm = r.commonMode.value(angleRad);
+        double dm = r.diffMode.value(angleRad);
+        return forward ? cm + dm : cm - dm;
+    };
+
+    int lower, upper;
+    double ratio;
+    bracket(current, lower, upper, ratio);
+
+    double v0 = runValue(mRuns.at(lower));
+    if (upper == lower) {
+        return v0;
+    }
+
+    return v0 + ratio * (runValue(mRuns.at(upper)) - v0);
+}
+
+/**
+ * @brief AnticoggingModel::table
+ * Evaluate the model at evenly spaced angles, e.g. to generate the table
+ * the firmware uses.
+ */
+QVector<double> AnticoggingModel::table(bool forward, int points, double current) const
+{
+    QVector<double> res(points);
+    for (int i = 0;i < points;i++) {
+        res[i] = evaluate(360.0 * double(i) / double(points), forward, current);
+    }
+    return res;
+}
+
+/**
+ * @brief AnticoggingModel::coeffTable
+ * Serialize the model at a current. The format is the number of common and
+ * differential mode harmonics as uint16, followed by the offset, the cosine
+ * coefficients and the sine coefficients of the common mode and then of the
+ * differential mode, encoded the same way as the dense table.
+ */
+QByteArray AnticoggingModel::coeffTable(double current) const
+{
+    Series cm, dm;
+    seriesAt(current, cm, dm);
+
+    VByteArray vb;
+    vb.vbAppendUint16(cm.harmonics());
+    vb.vbAppendUint16(dm.harmonics());
+
+    for (const auto &s: {cm, dm}) {
+        vb.vbAppendDouble32Auto(s.offset);
+        for (auto c: s.cosCoeffs) {
+            vb.vbAppendDouble32Auto(c);
+        }
+        for (auto c: s.sinCoeffs) {
+            vb.vbAppendDouble32Auto(c);
+        }
+    }
+
+    return vb;
+}
+
+/**
+ * @brief AnticoggingModel::loadCoeffTable
+ * Add a run from a table created by coeffTable.
+ *
+ * @return
+ * true if the table was valid.
+ */
+bool AnticoggingModel::loadCoeffTable(QByteArray data, double current, double speed)
+{
+    VByteArray vb(data);
+    if (vb.size() < 4) {
+        return false;
+    }
+
+    int cmHarmonics = vb.vbPopFrontUint16();
+    int dmHarmonics = vb.vbPopFrontUint16();
+
+    if (vb.size() != 4 * (2 + 2 * cmHarmonics + 2 * dmHarmonics)) {
+        return false;
+    }
+
+    auto readSeries = [&vb](int harmonics) {
+        Series s;
+        s.offset = vb.vbPopFrontDouble32Auto();
+        s.cosCoeffs.resize(harmonics);
+        s.sinCoeffs.resize(harmonics);
+        for (int i = 0;i < harmonics;i++) {
+            s.cosCoeffs[i] = vb.vbPopFrontDouble32Auto();
+        }
+        for (int i = 0;i < harmonics;i++) {
+            s.sinCoeffs[i] = vb.vbPopFrontDouble32Auto();
+        }
+        return s;
+    };
+
+    Run r;
+    r.current = current;
+    r.speed = speed;
+    r.commonMode = readSeries(cmHarmonics);
+    r.diffMode = readSeries(dmHarmonics);
+    insertRun(r);
+
+    return true;
+}
+
+void AnticoggingModel::insertRun(const Run &r)
+{
+    int ind = 0;
+    while (ind < mRuns.size() && mRuns.at(ind).current <= r.current) {
+        ind++;
+    }
+
+    mRuns.insert(ind, r);
+}
+
+/**
+ * @brief AnticoggingModel::bracket
+ * Find the runs to interpolate between at a current. Outside of the range
+ * of the runs lower and upper are the same run. Requires at least one run.
+ */
+void AnticoggingModel::bracket(double current, int &lower, int &upper, double &ratio) const
+{
+    upper = 0;
+    while (upper < mRuns.size() && mRuns.at(upper).current < current) {
+        upper++;
+    }
+
+    ratio = 0.0;
+
+    if (upper == 0 || upper == mRuns.size()) {
+        upper = qMin(upper, mRuns.size() - 1);
+        lower = upper;
+        return;
+    }
+
+    lower = upper - 1;
+    ratio = (current - mRuns.at(lower).current) /
+            (mRuns.at(upper).current - mRuns.at(lower).current);
+}
+
+void AnticoggingModel::seriesAt(double current, Series &commonMode, Series &diffMode) const
+{
+    commonMode = Series();
+    diffMode = Series();
+
+    if (mRuns.isEmpty()) {
+        return;
+    }
+
+    int lower, upper;
+    double ratio;
+    bracket(current, lower, upper, ratio);
+
+    commonMode = blend(mRuns.at(lower).commonMode, mRuns.at(upper).commonMode, ratio);
+    diffMode = blend(mRuns.at(lower).diffMode, mRuns.at(upper).diffMode, ratio);
+}
+
+AnticoggingModel::Series AnticoggingModel::blend(const Series &a, const Series &b, double ratio)
+{
+    Series res;
+    int harmonics = qMax(a.harmonics(), b.harmonics());
+    res.offset = a.offset + ratio * (b.offset - a.offset);
+    res.cosCoeffs.resize(harmonics);
+    res.sinCoeffs.resize(harmonics);
+
+    for (int k = 0;k < harmonics;k++) {
+        double ca = k < a.harmonics() ? a.cosCoeffs.at(k) : 0.0;
+        double cb = k < b.harmonics() ? b.cosCoeffs.at(k) : 0.0;
+        double sa = k < a.harmonics() ? a.sinCoeffs.at(k) : 0.0;
+        double sb = k < b.harmonics() ? b.sinCoeffs.at(k) : 0.0;
+        res.cosCoeffs[k] = ca + ratio * (cb - ca);
+        res.sinCoeffs[k] = sa + ratio * (sb - sa);
+    }
+
+    return res;
+}
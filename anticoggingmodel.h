@@ -0,0 +1,86 @@
+/*
+    Copyright 2016 - 2024 Benjamin Vedder	benjamin@vedder.se
+
+    This file is part of VESC Tool.
+
+    VESC Tool is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    VESC Tool is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+#ifndef ANTICOGGINGMODEL_H
+#define ANTICOGGINGMODEL_H
+
+#include <QVector>
+#include <QByteArray>
+
+/**
+ * @brief The AnticoggingModel class
+ * Harmonic model of anticogging calibration data. Every calibration run
+ * holds the q-axis current measured over one mechanical revolution in both
+ * directions. The common mode (cogging torque) and the differential mode
+ * (friction) of each run are approximated by truncated Fourier series, so
+ * that a few hundred coefficients replace the 3600 point tables.
+ *
+ * Keeping the first N bins of the Fourier series gives the same curve as
+ * the FFT low-pass filter of the calibration page with cutoff N. Runs taken
+ * at different currents are interpolated linearly between, which gives a
+ * model over rotor angle and current.
+ */
+class AnticoggingModel
+{
+public:
+    struct Series {
+        double offset = 0.0;
+        QVector<double> cosCoeffs;
+        QVector<double> sinCoeffs;
+
+        int harmonics() const;
+        double value(double angleRad) const;
+    };
+
+    struct Run {
+        double current;
+        double speed;
+        QVector<double> forward;
+        QVector<double> reverse;
+        Series commonMode;
+        Series diffMode;
+    };
+
+    AnticoggingModel();
+
+    void addRun(double current, double speed, const QVector<double> &forward, const QVector<double> &reverse);
+    void clear();
+    int runCount() const;
+    Run run(int index) const;
+
+    void fit(int cmBins, int dmBins);
+    static Series fitSeries(const QVector<double> &samples, int bins);
+
+    double evaluate(double angleDeg, bool forward, double current = 0.0) const;
+    QVector<double> table(bool forward, int points = 3600, double current = 0.0) const;
+
+    QByteArray coeffTable(double current = 0.0) const;
+    bool loadCoeffTable(QByteArray data, double current = 0.0, double speed = 0.0);
+
+private:
+    QVector<Run> mRuns;
+
+    void insertRun(const Run &r);
+    void bracket(double current, int &lower, int &upper, double &ratio) const;
+    void seriesAt(double current, Series &commonMode, Series &diffMode) const;
+    static Series blend(const Series &a, const Series &b, double ratio);
+
+};
+
+#endif // ANTICOGGINGMODEL_H
@@ -0,0 +1,1181 @@
+/*
+    Copyright 2016 - 2024 Benjamin Vedder	benjamin@vedder.se
+
+    This file is part of VESC Tool.
+
+    VESC Tool is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    VESC Tool is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+#include <QtTest>
+#include <QDirIterator>
+#include <QApplication>
+#include <QQmlEngine>
+#include <QQmlComponent>
+#include <QAbstractEventDispatcher>
+#include <QRandomGenerator>
+#include <cmath>
+#include <algorithm>
+#include "packet.h"
+#include "vbytearray.h"
+#include "commands.h"
+#include "configparams.h"
+#include "configstore.h"
+#include "digitalfiltering.h"
+#include "anticoggingmodel.h"
+#include "codeloader.h"
+#include "utility.h"
+#include "vescinterface.h"
+#include "iothread.h"
+#include "virtualvesc.h"
+#include "packetcapture.h"
+#include "heatshrink/heatshrinkif.h"
+#include "lzokay/lzokay.hpp"
+
+namespace {
+// Firmware upload chunk size, as in VescInterface::fwUpload
+const int fwChunkSize = 384;
+
+// A firmware image that is bundled with the application
+const char firmwarePath[] = "://res/firmwares_bms/12s7p/vesc_default.bin";
+
+QByteArray valuesPayload()
+{
+    // A COMM_GET_VALUES reply as sent by the firmware
+    VByteArray vb;
+    vb.vbAppendUint8(COMM_GET_VALUES);
+    vb.vbAppendDouble16(35.2, 1e1);
+    vb.vbAppendDouble16(48.7, 1e1);
+    vb.vbAppendDouble32(12.34, 1e2);
+    vb.vbAppendDouble32(8.91, 1e2);
+    vb.vbAppendDouble32(0.52, 1e2);
+    vb.vbAppendDouble32(12.31, 1e2);
+    vb.vbAppendDouble16(0.423, 1e3);
+    vb.vbAppendDouble32(15230.0, 1e0);
+    vb.vbAppendDouble16(48.1, 1e1);
+    vb.vbAppendDouble32(1.2345, 1e4);
+    vb.vbAppendDouble32(0.1021, 1e4);
+    vb.vbAppendDouble32(55.612, 1e4);
+    vb.vbAppendDouble32(4.2231, 1e4);
+    vb.vbAppendInt32(123456);
+    vb.vbAppendInt32(234567);
+    vb.vbAppendInt8(FAULT_CODE_NONE);
+    vb.vbAppendDouble32(123.456, 1e6);
+    vb.vbAppendUint8(12);
+    vb.vbAppendDouble16(35.1, 1e1);
+    vb.vbAppendDouble16(35.3, 1e1);
+    vb.vbAppendDouble16(35.0, 1e1);
+    vb.vbAppendDouble32(1.234, 1e3);
+    vb.vbAppendDouble32(20.456, 1e3);
+    vb.vbAppendUint8(0);
+    return vb;
+}
+
+QByteArray logPayload()
+{
+    // A COMM_LOG_DATA_F32 packet with one sample of 32 log fields, as sent
+    // by LispBM scripts that log at a high rate
+    VByteArray vb;
+    vb.vbAppendUint8(COMM_LOG_DATA_F32);
+    vb.vbAppendInt16(0);
+    for (int i = 0;i < 32;i++) {
+        vb.vbAppendDouble32Auto(double(i) * 1.2345 + 0.5);
+    }
+    return vb;
+}
+
+QByteArray repeatFrames(const QByteArray &payload, int num)
+{
+    QByteArray frame = Packet::framePacket(payload);
+    QByteArray res;
+    res.reserve(frame.size() * num);
+    for (int i = 0;i < num;i++) {
+        res.append(frame);
+    }
+    return res;
+}
+
+QVector<double> testSignal(int len)
+{
+    QVector<double> signal(len);
+    for (int i = 0;i < len;i++) {
+        signal[i] = sin(double(i) * 0.05) + 0.3 * sin(double(i) * 0.71) + 0.1 * cos(double(i) * 2.3);
+    }
+    return signal;
+}
+
+// Points per direction of an anticogging calibration run
+const int anticoggingPoints = 3600;
+
+AnticoggingModel anticoggingCalibration()
+{
+    // Cogging with 12 slots, friction that grows with the current and noise
+    QRandomGenerator rand(1234);
+    AnticoggingModel model;
+    for (int r = 0;r < 8;r++) {
+        double current = 2.0 + 2.0 * r;
+        QVector<double> fwd(anticoggingPoints), rev(anticoggingPoints);
+        for (int i = 0;i < anticoggingPoints;i++) {
+            double a = 2.0 * M_PI * double(i) / double(anticoggingPoints);
+            double cogging = 0.4 * sin(12.0 * a) + 0.1 * sin(24.0 * a + 0.3) +
+                    0.02 * current * cos(36.0 * a) + 0.05 * sin(a);
+            double friction = 0.05 + 0.003 * current;
+            double noise = 0.01 * (rand.generateDouble() - 0.5);
+            fwd[i] = cogging + friction + noise;
+            rev[i] = cogging - friction + noise;
+        }
+        model.addRun(current, 500.0 + 100.0 * r, fwd, rev);
+    }
+    return model;
+}
+
+QByteArray randomData(int size, quint32 seed)
+{
+    QRandomGenerator rand(seed);
+    QByteArray data(size, 0);
+    for (int i = 0;i < size;i++) {
+        data[i] = char(rand.bounded(256));
+    }
+    return data;
+}
+
+void runToIdle()
+{
+    QAbstractEventDispatcher *d = QAbstractEventDispatcher::instance();
+    for (int i = 0;i < 1000;i++) {
+        QCoreApplication::sendPostedEvents();
+        if (!d || !d->processEvents(QEventLoop::AllEvents)) {
+            break;
+        }
+    }
+}
+}
+
+/**
+ * @brief The ProtocolBenchmarks class
+ * Benchmarks of the hot paths of the protocol stack with realistic
+ * payloads: telemetry and log data packets, motor and app configurations, a firmware
+ * image, sampled data and a VESC package. Also the anticogging model and
+ * applying a received motor configuration with the editors of the mobile UI,
+ * and transfers to a virtual VESC on simulated links.
+ *
+ * serialLatency needs a VESC connected over USB and is skipped otherwise.
+ * captureReplay feeds the capture file given in the VESC_CAPTURE environment
+ * variable, or a generated one.
+ */
+class ProtocolBenchmarks : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+
+    void packetFrame_data();
+    void packetFrame();
+    void packetDecode_data();
+    void packetDecode();
+
+    void vbAppendValues();
+    void vbPopValues();
+    void commandsValues();
+    void commandsLogData();
+
+    void confSerialize_data();
+    void confSerialize();
+    void confDeserialize_data();
+    void confDeserialize();
+    void confCompressedXml();
+
+    void heatshrinkEncode();
+    void heatshrinkDecode();
+    void lzoCompressChunks();
+    void lzoDecompressChunks();
+
+    void filterSignal_data();
+    void filterSignal();
+    void filterPath_data();
+    void filterPath();
+    void fftWithShift();
+    void spectrumPath_data();
+    void spectrumPath();
+
+    void anticoggingFit_data();
+    void anticoggingFit();
+    void anticoggingEvaluate_data();
+    void anticoggingEvaluate();
+
+    void configLoadUi_data();
+    void configLoadUi();
+
+    void virtualVescLink_data();
+    void virtualVescLink();
+
+    void serialLatency_data();
+    void serialLatency();
+    void captureReplay_data();
+    void captureReplay();
+
+    void packVescPackage();
+    void unpackVescPackage();
+
+private:
+    QByteArray mValues;
+    QByteArray mLogData;
+    ConfigParams mMcConfig;
+    ConfigParams mAppConfig;
+    QByteArray mMcconfBlob;
+    QByteArray mAppconfBlob;
+    QByteArray mFirmware;
+    QByteArray mFirmwareHs;
+    QVector<QByteArray> mFirmwareLzo;
+    VescPackage mPackage;
+    QByteArray mPackageData;
+    VescInterface *mVesc;
+    Utility mUtility;
+
+};
+
+void ProtocolBenchmarks::initTestCase()
+{
+    mValues = valuesPayload();
+    mLogData = logPayload();
+
+    auto fw = Utility::configLatestSupported();
+    QVERIFY(ConfigStore::bundled().loadParams(fw.first, fw.second, ConfigStore::CONFIG_MCCONF, &mMcConfig));
+    QVERIFY(ConfigStore::bundled().loadParams(fw.first, fw.second, ConfigStore::CONFIG_APPCONF, &mAppConfig));
+
+    VByteArray vb;
+    mMcConfig.serialize(vb);
+    mMcconfBlob = vb;
+    vb.clear();
+    mAppConfig.serialize(vb);
+    mAppconfBlob = vb;
+
+    QFile fwFile(firmwarePath);
+    QVERIFY(fwFile.open(QIODevice::ReadOnly));
+    mFirmware = fwFile.readAll();
+    fwFile.close();
+
+    HeatshrinkIf hs;
+    mFirmwareHs = hs.encode(mFirmware);
+
+    for (int pos = 0;pos < mFirmware.size();pos += fwChunkSize) {
+        int sz = qMin(fwChunkSize, mFirmware.size() - pos);
+        QByteArray out(int(lzokay::compress_worst_size(std::size_t(sz))), 0);
+        std::size_t outLen = 0;
+        QVERIFY(lzokay::compress((const uint8_t*)mFirmware.constData() + pos, std::size_t(sz),
+                                 (uint8_t*)out.data(), std::size_t(out.size()), outLen) ==
+                lzokay::EResult::Success);
+        out.resize(int(outLen));
+        mFirmwareLzo.append(out);
+    }
+
+    // The Lisp examples and a QML page make up a typical package
+    QDirIterator it(":/res/Lisp/Examples", QDirIterator::Subdirectories);
+    while (it.hasNext()) {
+        QFile f(it.next());
+        if (f.open(QIODevice::ReadOnly)) {
+            mPackage.lispData.append(f.readAll());
+        }
+    }
+
+    QFile qmlFile("://res/qml/Examples/Meters.qml");
+    if (qmlFile.open(QIODevice::ReadOnly)) {
+        mPackage.qmlFile = QString::fromUtf8(qmlFile.readAll());
+    }
+
+    mPackage.name = "Benchmark Package";
+    mPackage.description = "Lisp examples and a QML page";
+    QVERIFY(!mPackage.lispData.isEmpty());
+
+    CodeLoader loader;
+    mPackageData = loader.packVescPackage(mPackage);
+
+    // As in the mobile UI
+    mVesc = new VescInterface(this);
+    mVesc->fwConfig()->loadParamsXml("://res/config/fw.xml");
+    Utility::configLoadLatest(mVesc);
+
+    qmlRegisterType<Commands>("Vedder.vesc.commands", 1, 0, "Commands");
+    qmlRegisterType<ConfigParams>("Vedder.vesc.configparams", 1, 0, "ConfigParams");
+    qmlRegisterType<ConfigParamWatcher>("Vedder.vesc.configparams", 1, 0, "ConfigParamWatcher");
+    qmlRegisterSingletonInstance("Vedder.vesc.vescinterface", 1, 0, "VescIf", mVesc);
+    qmlRegisterSingletonInstance("Vedder.vesc.utility", 1, 0, "Utility", &mUtility);
+}
+
+void ProtocolBenchmarks::packetFrame_data()
+{
+    QTest::addColumn<int>("size");
+    QTest::newRow("command") << 8;
+    QTest::newRow("values") << mValues.size();
+    QTest::newRow("log data") << mLogData.size();
+    QTest::newRow("file chunk") << 400;
+    QTest::newRow("config") << mMcconfBlob.size();
+}
+
+void ProtocolBenchmarks::packetFrame()
+{
+    QFETCH(int, size);
+    QByteArray payload = mMcconfBlob.leftJustified(size, 'x', true);
+
+    QBENCHMARK {
+        QByteArray frame = Packet::framePacket(payload);
+        Q_UNUSED(frame)
+    }
+}
+
+void ProtocolBenchmarks::packetDecode_data()
+{
+    QTest::addColumn<QByteArray>("stream");
+    QTest::addColumn<int>("readSize");
+    QTest::addColumn<int>("packets");
+
+    // Telemetry over USB arrives in small reads, file transfers and
+    // configurations in larger ones
+    QTest::newRow("values") << repeatFrames(mValues, 200) << 64 << 200;
+    QTest::newRow("log data") << repeatFrames(mLogData, 200) << 64 << 200;
+    QTest::newRow("file chunks") << repeatFrames(mMcconfBlob.leftJustified(400, 'x', true), 50) << 4096 << 50;
+    QTest::newRow("config") << repeatFrames(mMcconfBlob, 10) << 4096 << 10;
+}
+
+void ProtocolBenchmarks::packetDecode()
+{
+    QFETCH(QByteArray, stream);
+    QFETCH(int, readSize);
+    QFETCH(int, packets);
+
+    Packet packet;
+    int decoded = 0;
+    connect(&packet, &Packet::packetReceived, [&decoded](QByteArray &data) {
+        (void)data;
+        decoded++;
+    });
+
+    QBENCHMARK {
+        packet.resetState();
+        for (int pos = 0;pos < stream.size();pos += readSize) {
+            packet.processData(stream.mid(pos, readSize));
+        }
+    }
+
+    QVERIFY(decoded > 0);
+    QCOMPARE(decoded % packets, 0);
+}
+
+void ProtocolBenchmarks::vbAppendValues()
+{
+    QBENCHMARK {
+        QByteArray payload = valuesPayload();
+        Q_UNUSED(payload)
+    }
+}
+
+void ProtocolBenchmarks::vbPopValues()
+{
+    double sum = 0.0;
+
+    QBENCHMARK {
+        VByteArray vb(mValues);
+        vb.vbPopFrontUint8();
+        for (int i = 0;i < 2;i++) sum += vb.vbPopFrontDouble16(1e1);
+        for (int i = 0;i < 4;i++) sum += vb.vbPopFrontDouble32(1e2);
+        sum += vb.vbPopFrontDouble16(1e3);
+        sum += vb.vbPopFrontDouble32(1e0);
+        sum += vb.vbPopFrontDouble16(1e1);
+        for (int i = 0;i < 4;i++) sum += vb.vbPopFrontDouble32(1e4);
+        for (int i = 0;i < 2;i++) sum += vb.vbPopFrontInt32();
+        sum += vb.vbPopFrontInt8();
+        sum += vb.vbPopFrontDouble32(1e6);
+        sum += vb.vbPopFrontUint8();
+        for (int i = 0;i < 3;i++) sum += vb.vbPopFrontDouble16(1e1);
+        for (int i = 0;i < 2;i++) sum += vb.vbPopFrontDouble32(1e3);
+        sum += vb.vbPopFrontUint8();
+    }
+
+    QVERIFY(sum != 0.0);
+}
+
+void ProtocolBenchmarks::commandsValues()
+{
+    Commands commands;
+    int received = 0;
+    connect(&commands, &Commands::valuesReceived, [&received](MC_VALUES values, unsigned int mask) {
+        (void)values;
+        (void)mask;
+        received++;
+    });
+
+    QBENCHMARK {
+        commands.processPacket(mValues);
+    }
+
+    QVERIFY(received > 0);
+}
+
+void ProtocolBenchmarks::commandsLogData()
+{
+    Commands commands;
+    int samples = 0;
+    connect(&commands, &Commands::logSamples, [&samples](int fieldStart, QVector<double> data) {
+        (void)fieldStart;
+        samples += data.size();
+    });
+
+    QBENCHMARK {
+        commands.processPacket(mLogData);
+    }
+
+    QVERIFY(samples > 0);
+}
+
+void ProtocolBenchmarks::confSerialize_data()
+{
+    QTest::addColumn<bool>("isMc");
+    QTest::newRow("mcconf") << true;
+    QTest::newRow("appconf") << false;
+}
+
+void ProtocolBenchmarks::confSerialize()
+{
+    QFETCH(bool, isMc);
+    ConfigParams &conf = isMc ? mMcConfig : mAppConfig;
+
+    QBENCHMARK {
+        VByteArray vb;
+        conf.serialize(vb);
+    }
+}
+
+void ProtocolBenchmarks::confDeserialize_data()
+{
+    confSerialize_data();
+}
+
+void ProtocolBenchmarks::confDeserialize()
+{
+    QFETCH(bool, isMc);
+    ConfigParams &conf = isMc ? mMcConfig : mAppConfig;
+    const QByteArray &blob = isMc ? mMcconfBlob : mAppconfBlob;
+    bool ok = true;
+
+    QBENCHMARK {
+        VByteArray vb(blob);
+        ok = conf.deSerialize(vb) && ok;
+    }
+
+    QVERIFY(ok);
+}
+
+void ProtocolBenchmarks::confCompressedXml()
+{
+    // As stored for configuration backups
+    QBENCHMARK {
+        QString data = mMcConfig.saveCompressed("mcconf");
+        mMcConfig.loadCompressed(data, "mcconf");
+    }
+}
+
+void ProtocolBenchmarks::heatshrinkEncode()
+{
+    HeatshrinkIf hs;
+
+    QBENCHMARK {
+        QByteArray out = hs.encode(mFirmware);
+        Q_UNUSED(out)
+    }
+}
+
+void ProtocolBenchmarks::heatshrinkDecode()
+{
+    HeatshrinkIf hs;
+    QByteArray out;
+
+    QBENCHMARK {
+        out = hs.decode(mFirmwareHs);
+    }
+
+    QCOMPARE(out, mFirmware);
+}
+
+void ProtocolBenchmarks::lzoCompressChunks()
+{
+    QByteArray out(int(lzokay::compress_worst_size(fwChunkSize)), 0);
+
+    QBENCHMARK {
+        for (int pos = 0;pos < mFirmware.size();pos += fwChunkSize) {
+            int sz = qMin(fwChunkSize, mFirmware.size() - pos);
+            std::size_t outLen = 0;
+            lzokay::compress((const uint8_t*)mFirmware.constData() + pos, std::size_t(sz),
+                             (uint8_t*)out.data(), std::size_t(out.size()), outLen);
+        }
+    }
+}
+
+void ProtocolBenchmarks::lzoDecompressChunks()
+{
+    QByteArray out(fwChunkSize, 0);
+    QByteArray res;
+
+    QBENCHMARK {
+        res.clear();
+        for (const auto &c: mFirmwareLzo) {
+            std::size_t outLen = 0;
+            lzokay::decompress((const uint8_t*)c.constData(), std::size_t(c.size()),
+                               (uint8_t*)out.data(), std::size_t(out.size()), outLen);
+            res.append(out.constData(), int(outLen));
+        }
+    }
+
+    QCOMPARE(res, mFirmware);
+}
+
+void ProtocolBenchmarks::filterSignal_data()
+{
+    QTest::addColumn<int>("taps");
+    QTest::newRow("16 taps") << 16;
+    QTest::newRow("64 taps") << 64;
+    QTest::newRow("256 taps") << 256;
+}
+
+void ProtocolBenchmarks::filterSignal()
+{
+    QFETCH(int, taps);
+
+    // The length of a typical sampled data capture
+    auto signal = testSignal(8000);
+    auto filter = DigitalFiltering::generateFirFilter(0.1, DigitalFiltering::whichPowerOfTwo(uint(taps)), true);
+
+    QBENCHMARK {
+        auto res = DigitalFiltering::filterSignal(signal, filter);
+        Q_UNUSED(res)
+    }
+}
+
+void ProtocolBenchmarks::filterPath_data()
+{
+    QTest::addColumn<int>("samples");
+    QTest::addColumn<int>("taps");
+    QTest::addColumn<bool>("useFft");
+
+    // The sample counts and filter lengths of the sampled data page, to
+    // check where filterSignal switches to the FFT path
+    for (int samples: {500, 2000}) {
+        for (int taps: {16, 32, 64, 128, 1024}) {
+            for (bool useFft: {false, true}) {
+                QTest::newRow(QString("%1 x %2 %3").arg(samples).arg(taps).
+                              arg(useFft ? "fft" : "direct").toLocal8Bit().constData())
+                        << samples << taps << useFft;
+            }
+        }
+    }
+}
+
+void ProtocolBenchmarks::filterPath()
+{
+    QFETCH(int, samples);
+    QFETCH(int, taps);
+    QFETCH(bool, useFft);
+
+    auto signal = testSignal(samples);
+    auto filter = DigitalFiltering::generateFirFilter(0.1, DigitalFiltering::whichPowerOfTwo(uint(taps)), true);
+
+    auto resDirect = DigitalFiltering::filterSignalDirect(signal, filter);
+    auto resFft = DigitalFiltering::filterSignalFft(signal, filter);
+    QCOMPARE(resFft.size(), resDirect.size());
+    for (int i = 0;i < resDirect.size();i++) {
+        QVERIFY(fabs(resDirect.at(i) - resFft.at(i)) < 1e-6);
+    }
+
+    QBENCHMARK {
+        auto res = useFft ? DigitalFiltering::filterSignalFft(signal, filter) :
+                            DigitalFiltering::filterSignalDirect(signal, filter);
+        Q_UNUSED(res)
+    }
+}
+
+void ProtocolBenchmarks::fftWithShift()
+{
+    // Shorter than the result, so the signal is zero padded and not modified
+    auto signal = testSignal(8000);
+
+    QBENCHMARK {
+        auto res = DigitalFiltering::fftWithShift(signal, 13);
+        Q_UNUSED(res)
+    }
+}
+
+void ProtocolBenchmarks::spectrumPath_data()
+{
+    QTest::addColumn<int>("samples");
+    QTest::addColumn<int>("bits");
+    QTest::addColumn<bool>("cached");
+
+    // The current spectra and the filter response
+    struct SpectrumCase {
+        int samples;
+        int bits;
+    };
+
+    for (auto c: {SpectrumCase{1000, 16}, SpectrumCase{2000, 16},
+         SpectrumCase{64, 10}, SpectrumCase{1024, 14}}) {
+        for (bool cached: {false, true}) {
+            QTest::newRow(QString("%1 -> %2 bits %3").arg(c.samples).arg(c.bits).
+                          arg(cached ? "cached r2c" : "radix-2").toLocal8Bit().constData())
+                    << c.samples << c.bits << cached;
+        }
+    }
+}
+
+void ProtocolBenchmarks::spectrumPath()
+{
+    QFETCH(int, samples);
+    QFETCH(int, bits);
+    QFETCH(bool, cached);
+
+    auto signal = testSignal(samples);
+    int len = 1 << bits;
+    QVector<double> real(len), imag(len);
+
+    // The radix-2 transform as fftWithShift did it before the real-input
+    // transform was cached
+    auto radix2 = [&]() {
+        int sizeDiffHalf = (len - samples) / 2;
+        for (int i = 0;i < len;i++) {
+            real[i] = (i >= sizeDiffHalf && i < samples + sizeDiffHalf) ?
+                        signal[i - sizeDiffHalf] : 0.0;
+            imag[i] = 0.0;
+        }
+        DigitalFiltering::fftshift(real.data(), len);
+        DigitalFiltering::fft(0, bits, real.data(), imag.data());
+        QVector<double> res(len);
+        for (int i = 0;i < len;i++) {
+            res[i] = fabs(real[i]) / double(samples);
+        }
+        return res;
+    };
+
+    auto resRadix2 = radix2();
+    auto resCached = DigitalFiltering::fftWithShift(signal, bits, true);
+    QCOMPARE(resCached.size(), resRadix2.size());
+    for (int i = 0;i < len;i++) {
+        QVERIFY(fabs(resRadix2.at(i) - resCached.at(i)) < 1e-6);
+    }
+
+    QBENCHMARK {
+        auto res = cached ? DigitalFiltering::fftWithShift(signal, bits, true) : radix2();
+        Q_UNUSED(res)
+    }
+}
+
+void ProtocolBenchmarks::anticoggingFit_data()
+{
+    QTest::addColumn<bool>("parallel");
+    QTest::newRow("serial") << false;
+    QTest::newRow("parallel") << true;
+}
+
+void ProtocolBenchmarks::anticoggingFit()
+{
+    QFETCH(bool, parallel);
+
+    AnticoggingModel model = anticoggingCalibration();
+    QVector<AnticoggingModel::Run> runs;
+    for (int i = 0;i < model.runCount();i++) {
+        runs.append(model.run(i));
+    }
+
+    QBENCHMARK {
+        if (parallel) {
+            model.fit(500, 50);
+        } else {
+            for (const auto &r: runs) {
+                AnticoggingModel::fitSeries(r.forward, 500);
+                AnticoggingModel::fitSeries(r.reverse, 50);
+            }
+        }
+    }
+}
+
+void ProtocolBenchmarks::anticoggingEvaluate_data()
+{
+    QTest::addColumn<int>("cmBins");
+    QTest::addColumn<int>("dmBins");
+
+    // No bins for a lookup in the dense table the model replaces
+    QTest::newRow("dense table") << 0 << 0;
+    QTest::newRow("500/50 bins") << 500 << 50;
+    QTest::newRow("100/20 bins") << 100 << 20;
+    QTest::newRow("50/10 bins") << 50 << 10;
+    QTest::newRow("10/5 bins") << 10 << 5;
+}
+
+void ProtocolBenchmarks::anticoggingEvaluate()
+{
+    QFETCH(int, cmBins);
+    QFETCH(int, dmBins);
+
+    AnticoggingModel::Run first = anticoggingCalibration().run(0);
+    AnticoggingModel model;
+    model.addRun(first.current, first.speed, first.forward, first.reverse);
+    model.fit(500, 50);
+    QVector<double> dense = model.table(true, anticoggingPoints, first.current);
+    if (cmBins > 0) {
+        model.fit(cmBins, dmBins);
+    }
+
+    QRandomGenerator rand(1234);
+    QVector<double> angles(1 << 14);
+    for (auto &a: angles) {
+        a = rand.bounded(360.0);
+    }
+
+    double sum = 0.0;
+
+    QBENCHMARK {
+        if (cmBins > 0) {
+            for (auto a: angles) {
+                sum += model.evaluate(a, true, first.current);
+            }
+        } else {
+            for (auto a: angles) {
+                sum += dense.at(int(a * double(anticoggingPoints) / 360.0) % anticoggingPoints);
+            }
+        }
+    }
+
+    QVERIFY(std::isfinite(sum));
+}
+
+void ProtocolBenchmarks::configLoadUi_data()
+{
+    QTest::addColumn<QString>("listeners");
+    QTest::newRow("none") << "none";
+
+    // One QML listener per parameter that gets all changes of its type,
+    // which is how the editors were notified before ConfigParamWatcher
+    QTest::newRow("broadcast paramChanged") << "broadcast";
+
+    // An editor of the mobile UI for every parameter
+    QTest::newRow("editors") << "editors";
+}
+
+void ProtocolBenchmarks::configLoadUi()
+{
+    QFETCH(QString, listeners);
+
+    // From receiving a COMM_GET_MCCONF reply until the event loop is idle
+    // again. Two configurations where every parameter differs are used in
+    // turn, so that each load changes all of them.
+    ConfigParams *conf = mVesc->mcConfig();
+    QStringList names = conf->getSerializeOrder();
+
+    ConfigParams other;
+    other = *conf;
+
+    VByteArray confA, confB;
+    confA.vbAppendUint8(COMM_GET_MCCONF);
+    conf->serialize(confA);
+
+    for (const auto &name: names) {
+        ConfigParam *p = other.getParam(name);
+        switch (p->type) {
+        case CFG_T_DOUBLE:
+            p->valDouble = p->valDouble == p->minDouble ? p->maxDouble : p->minDouble;
+            break;
+
+        case CFG_T_INT:
+            p->valInt = p->valInt == p->minInt ? p->maxInt : p->minInt;
+            break;
+
+        case CFG_T_QSTRING:
+            p->valString += "_";
+            break;
+
+        default:
+            p->valInt ^= 1;
+            break;
+        }
+    }
+
+    confB.vbAppendUint8(COMM_GET_MCCONF);
+    other.serialize(confB);
+
+    QQmlEngine engine;
+    QObject broadcast;
+    QScopedPointer<QObject> root;
+
+    if (listeners == "broadcast") {
+        for (const auto &name: names) {
+            QString type = "Double";
+            if (conf->isParamInt(name) || conf->isParamBitfield(name)) {
+                type = "Int";
+            } else if (conf->isParamEnum(name)) {
+                type = "Enum";
+            } else if (conf->isParamBool(name)) {
+                type = "Bool";
+            } else if (conf->isParamQString(name)) {
+                type = "QString";
+            }
+
+            QQmlComponent comp(&engine);
+            comp.setData(QString("import QtQuick 2.7\n"
+                                 "Connections {\n"
+                                 "    property string paramName: \"%1\"\n"
+                                 "    property var value\n"
+                                 "    function onParamChanged%2(src, name, newParam) {\n"
+                                 "        if (name === paramName) {\n"
+                                 "            value = newParam\n"
+                                 "        }\n"
+                                 "    }\n"
+                                 "}\n").arg(name, type).toUtf8(), QUrl());
+
+            QObject *o = comp.beginCreate(engine.rootContext());
+            QVERIFY2(o, qPrintable(comp.errorString()));
+            o->setParent(&broadcast);
+            o->setProperty("target", QVariant::fromValue<QObject*>(conf));
+            comp.completeCreate();
+        }
+    } else if (listeners == "editors") {
+        // The editors are created the same way as on the configuration pages
+        QQmlComponent comp(&engine);
+        comp.setData("import QtQuick 2.7\n"
+                     "import Vedder.vesc.vescinterface 1.0\n"
+                     "Item {\n"
+                     "    property var vesc: VescIf\n"
+                     "    ParamEditors { id: editors }\n"
+                     "    function createEditors(names) {\n"
+                     "        for (var i = 0;i < names.length;i++) {\n"
+                     "            editors.createEditorMc(this, names[i])\n"
+                     "        }\n"
+                     "    }\n"
+                     "}\n", QUrl("qrc:/mobile/ConfigLoadBenchmark.qml"));
+
+        root.reset(comp.create());
+        QVERIFY2(root, qPrintable(comp.errorString()));
+        QMetaObject::invokeMethod(root.data(), "createEditors", Q_ARG(QVariant, QVariant(names)));
+    }
+
+    runToIdle();
+    bool useA = true;
+
+    QBENCHMARK {
+        mVesc->commands()->processPacket(useA ? confA : confB);
+        useA = !useA;
+        runToIdle();
+    }
+}
+
+void ProtocolBenchmarks::packVescPackage()
+{
+    CodeLoader loader;
+
+    QBENCHMARK {
+        QByteArray data = loader.packVescPackage(mPackage);
+        Q_UNUSED(data)
+    }
+}
+
+void ProtocolBenchmarks::unpackVescPackage()
+{
+    CodeLoader loader;
+    VescPackage pkg;
+
+    QBENCHMARK {
+        pkg = loader.unpackVescPackage(mPackageData);
+    }
+
+    QVERIFY(pkg.loadOk);
+    QCOMPARE(pkg.lispData, mPackage.lispData);
+}
+
+void ProtocolBenchmarks::virtualVescLink_data()
+{
+    QTest::addColumn<int>("latencyMs");
+    QTest::addColumn<int>("bytesPerSecond");
+    QTest::addColumn<double>("lossRate");
+    QTest::addColumn<QString>("operation");
+
+    struct Link {
+        const char *name;
+        int latencyMs;
+        int bytesPerSecond;
+        double lossRate;
+    };
+
+    const Link links[] = {
+        {"ideal", 0, 0, 0.0},
+        {"USB", 1, 1000000, 0.0},
+        {"BLE", 15, 10000, 0.0},
+        {"lossy", 5, 100000, 0.02}
+    };
+
+    for (const auto &link: links) {
+        for (QString op: {"connect", "values", "file write", "file read", "lisp upload", "firmware upload"}) {
+            QTest::newRow(QString("%1 %2").arg(link.name, op).toLocal8Bit().constData())
+                    << link.latencyMs << link.bytesPerSecond << link.lossRate << op;
+        }
+    }
+}
+
+void ProtocolBenchmarks::virtualVescLink()
+{
+    QFETCH(int, latencyMs);
+    QFETCH(int, bytesPerSecond);
+    QFETCH(double, lossRate);
+    QFETCH(QString, operation);
+
+    const QByteArray fileData = randomData(32 * 1024, 1);
+    const QByteArray lispData = randomData(16 * 1024, 2);
+    const QByteArray fwData = randomData(32 * 1024, 3);
+
+    VirtualVesc sim;
+    sim.setLatencyMs(latencyMs);
+    sim.setBandwidth(bytesPerSecond);
+    sim.setLossRate(lossRate);
+    QVERIFY(sim.listen());
+
+    VescInterface vesc;
+    vesc.fwConfig()->loadParamsXml("://res/config/fw.xml");
+    Utility::configLoadLatest(&vesc);
+
+    auto connectSim = [&]() {
+        vesc.connectTcp("127.0.0.1", sim.port());
+        return Utility::waitSignal(vesc.connectSequence(), SIGNAL(finished()), 30000);
+    };
+
+    bool ok = true;
+
+    if (operation == "connect") {
+        QBENCHMARK_ONCE {
+            ok = connectSim();
+        }
+    } else {
+        QVERIFY(connectSim());
+    }
+
+    if (operation == "values") {
+        // Replies can be lost on the lossy link
+        int replies = 0;
+        QBENCHMARK {
+            vesc.commands()->getValues();
+            if (Utility::waitSignal(vesc.commands(), SIGNAL(valuesReceived(MC_VALUES,unsigned int)), 1000)) {
+                replies++;
+            }
+        }
+        ok = replies > 0;
+    } else if (operation == "file write") {
+        QBENCHMARK {
+            ok = vesc.commands()->fileBlockWrite("/bench.bin", fileData) && ok;
+        }
+    } else if (operation == "file read") {
+        QVERIFY(vesc.commands()->fileBlockWrite("/bench.bin", fileData));
+        QBENCHMARK {
+            ok = vesc.commands()->fileBlockRead("/bench.bin") == fileData && ok;
+        }
+    } else if (operation == "lisp upload") {
+        CodeLoader loader;
+        loader.setVesc(&vesc);
+        QBENCHMARK {
+            ok = loader.lispErase(lispData.size() + 6) && loader.lispUpload(VByteArray(lispData)) && ok;
+        }
+    } else if (operation == "firmware upload") {
+        // The upload ends with a jump to the bootloader and a delay before
+        // disconnecting, so the time is taken when the last chunk is written.
+        QElapsedTimer t;
+        qint64 fwMs = -1;
+        auto conn = connect(&vesc, &VescInterface::fwUploadStatus,
+                            [&t, &fwMs](const QString &status, double progress, bool isOngoing) {
+            (void)progress;
+            (void)isOngoing;
+            if (status == "Upload done") {
+                fwMs = t.elapsed();
+            }
+        });
+
+        QByteArray fw = fwData;
+        t.start();
+        ok = vesc.fwUpload(fw, false, false, false) && sim.newAppData().mid(6) == fwData && fwMs >= 0;
+        disconnect(conn);
+        QTest::setBenchmarkResult(qreal(fwMs), QTest::WalltimeMilliseconds);
+    }
+
+    qDebug().noquote() << sim.statsString();
+    vesc.disconnectPort();
+    QVERIFY(ok);
+}
+
+void ProtocolBenchmarks::serialLatency_data()
+{
+    // How many milliseconds of every 16 ms frame the GUI thread is kept
+    // busy, like heavy plotting does
+    QTest::addColumn<int>("loadMs");
+    QTest::newRow("idle GUI") << 0;
+    QTest::newRow("GUI load 12 ms / 16 ms") << 12;
+}
+
+void ProtocolBenchmarks::serialLatency()
+{
+    QFETCH(int, loadMs);
+
+    // From requesting COMM_GET_VALUES until the reply has been decoded on
+    // the I/O thread and until it has been handled on the GUI thread
+    if (!mVesc->autoconnect() || !mVesc->ioThread()->isSerialOpen()) {
+        mVesc->disconnectPort();
+        QSKIP("No VESC connected over USB");
+    }
+
+    QTimer loadTimer;
+    loadTimer.setInterval(16);
+    connect(&loadTimer, &QTimer::timeout, [loadMs]() {
+        QElapsedTimer t;
+        t.start();
+        while (t.elapsed() < loadMs) {
+            // Simulated plotting
+        }
+    });
+
+    QVector<double> decoded;
+    QVector<double> handled;
+    qint64 txNs = 0;
+    bool rx = false;
+
+    auto conn = connect(mVesc->commands(), &Commands::valuesReceived,
+                        [&](MC_VALUES val, unsigned int mask) {
+        (void)val;
+        (void)mask;
+        if (!rx) {
+            decoded.append(double(mVesc->ioThread()->currentPacketRxTime() - txNs) / 1e6);
+            handled.append(double(IoThread::timestampNs() - txNs) / 1e6);
+            rx = true;
+        }
+    });
+
+    if (loadMs > 0) {
+        loadTimer.start();
+    }
+
+    for (int i = 0;i < 100;i++) {
+        rx = false;
+        txNs = IoThread::timestampNs();
+        mVesc->commands()->getValues();
+        Utility::waitSignal(mVesc->commands(), SIGNAL(valuesReceived(MC_VALUES, unsigned int)), 1000);
+        Utility::sleepWithEventLoop(7);
+    }
+
+    loadTimer.stop();
+    disconnect(conn);
+    mVesc->disconnectPort();
+
+    QVERIFY(!handled.isEmpty());
+
+    auto stats = [](QVector<double> v) {
+        std::sort(v.begin(), v.end());
+        double sum = 0.0;
+        for (auto d: v) {
+            sum += d;
+        }
+
+        return QString("min %1 avg %2 p95 %3 max %4 ms").
+                arg(v.first(), 0, 'f', 2).
+                arg(sum / double(v.size()), 0, 'f', 2).
+                arg(v.at(int(double(v.size() - 1) * 0.95)), 0, 'f', 2).
+                arg(v.last(), 0, 'f', 2);
+    };
+
+    qDebug().noquote() << "Decoded:" << stats(decoded);
+    qDebug().noquote() << "Handled:" << stats(handled);
+    qDebug().noquote() << "Coalesced telemetry packets:" << mVesc->ioThread()->coalescedPackets();
+
+    double sum = 0.0;
+    for (auto d: handled) {
+        sum += d;
+    }
+    QTest::setBenchmarkResult(sum / double(handled.size()), QTest::WalltimeMilliseconds);
+}
+
+void ProtocolBenchmarks::captureReplay_data()
+{
+    QTest::addColumn<bool>("withCommands");
+    QTest::newRow("Packet") << false;
+    QTest::newRow("Packet + Commands") << true;
+}
+
+void ProtocolBenchmarks::captureReplay()
+{
+    QFETCH(bool, withCommands);
+
+    // Without a capture, one is made of telemetry and log data arriving
+    // in USB-sized reads, with requests in between
+    QString path = qEnvironmentVariable("VESC_CAPTURE");
+    QTemporaryDir dir;
+    if (path.isEmpty()) {
+        QVERIFY(dir.isValid());
+        path = dir.filePath("bench.vcap");
+
+        PacketCapture cap;
+        QVERIFY(cap.open(path, QStringList() << "USB"));
+        QByteArray stream = repeatFrames(mValues, 500) + repeatFrames(mLogData, 500);
+        for (int pos = 0;pos < stream.size();pos += 64) {
+            if (pos % 640 == 0) {
+                cap.record(0, true, Packet::framePacket(QByteArray(1, char(COMM_GET_VALUES))));
+            }
+            cap.record(0, false, stream.mid(pos, 64));
+        }
+        cap.close();
+    }
+
+    QVector<PacketCapture::Record> records;
+    QVERIFY(PacketCapture::load(path, records));
+
+    QVector<QByteArray> inbound;
+    for (const auto &r: records) {
+        if (!r.outbound) {
+            inbound.append(r.data);
+        }
+    }
+
+    // Framing only, or framing and Commands as in VescInterface
+    Packet packet;
+    Commands commands;
+    int packets = 0;
+    connect(&packet, &Packet::packetReceived, [&](QByteArray &data) {
+        packets++;
+        if (withCommands) {
+            commands.processPacket(data);
+        }
+    });
+
+    QBENCHMARK {
+        packet.resetState();
+        for (const auto &d: inbound) {
+            packet.processData(d);
+        }
+    }
+
+    QVERIFY(packets > 0);
+}
+
+int main(int argc, char *argv[])
+{
+    // The editors of the configuration benchmark are never shown
+    if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM")) {
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    }
+
+    QApplication app(argc, argv);
+    ProtocolBenchmarks bench;
+    QTEST_SET_MAIN_SOURCE_PATH
+    return QTest::qExec(&bench, argc, argv);
+}
+
+#include "benchmarks.moc"
@@ -0,0 +1,24 @@
+#-------------------------------------------------
+#
+# Micro-benchmarks of the protocol stack
+#
+#-------------------------------------------------
+
+# Build and run from a separate directory, e.g.
+#   mkdir build_bench && cd build_bench
+#   qmake ../benchmarks/benchmarks.pro && make -j8
+#   ./vesc_tool_benchmarks
+#
+# The results can be written in a machine-readable format with the QtTest
+# output options, e.g. as XML for tracking between releases:
+#   ./vesc_tool_benchmarks -o results.xml,xml
+# or as CSV with one line per benchmark:
+#   ./vesc_tool_benchmarks -o results.csv,csv
+# Add -iterations n to run a fixed number of iterations, or -callgrind to
+# count instructions with valgrind.
+
+include(../vesc_tool_testlib.pri)
+
+TARGET = vesc_tool_benchmarks
+
+SOURCES += $$PWD/benchmarks.cpp
@@ -0,0 +1,549 @@
+/*
+    Copyright 2016 - 2024 Benjamin Vedder	benjamin@vedder.se
+
+    This file is part of VESC Tool.
+
+    VESC Tool is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    VESC Tool is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+#include "boardsetup.h"
+#include "vescinterface.h"
+#include "utility.h"
+#include <QDirIterator>
+#include <QFile>
+#include <QMap>
+#include <cmath>
+
+BoardSetup::BoardSetup(VescInterface *vesc, ConfigParams *mcTarget,
+                       ConfigParams *appTarget, QObject *parent) : QObject(parent)
+{
+    mVesc = vesc;
+    mMcTarget = mcTarget;
+    mAppTarget = appTarget;
+    mCanTimeout = false;
+    mIsDual = false;
+    mNumVescs = 0;
+    mAppEnumOld = 0;
+
+    connect(mVesc->commands(), &Commands::pingCanRx, this, [this](QVector<int> devs, bool isTimeout) {
+        mCanTimeout = isTimeout;
+        if (!isTimeout) {
+            mCanIds = devs;
+        }
+    });
+}
+
+QString BoardSetup::resultMsg() const
+{
+    return mResultMsg;
+}
+
+QVector<int> BoardSetup::canIds() const
+{
+    return mCanIds;
+}
+
+int BoardSetup::numVescs() const
+{
+    return mNumVescs;
+}
+
+QString BoardSetup::hwName() const
+{
+    return mHwName;
+}
+
+bool BoardSetup::serialConnect(const QString &port)
+{
+    mVesc->commands()->setSendCan(false);
+    if (mVesc->connectSerial(port, 115200)) {
+        Utility::waitSignal(mVesc, SIGNAL(fwRxChanged(bool, bool)), 5000);
+    }
+
+    if (!mVesc->isPortConnected()) {
+        mResultMsg = "Could not connect USB. Make sure the unit is powered on, connected to the computer, "
+                     "and the correct Serial port is selected.";
+    }
+
+    return mVesc->isPortConnected();
+}
+
+bool BoardSetup::canScan()
+{
+    mCanTimeout = true;
+    if (mVesc->isPortConnected()) {
+        mVesc->commands()->pingCan();
+        Utility::waitSignal(mVesc->commands(), SIGNAL(pingCanRx(QVector<int>, bool)), 10000);
+    }
+
+    if (mCanTimeout) {
+        mResultMsg = "CAN scan timed out. Make sure the unit is powered on and connected to the computer.";
+        return false;
+    }
+
+    mVesc->commands()->setSendCan(false);
+    if (!readAppConf("Failed to read app config during CAN Scan.")) {
+        return false;
+    }
+
+    mHwName = mVesc->getFirmwareNow().split("Hw: ").last();
+    mHwName = mHwName.split("\n").first();
+    if (mHwName.contains("STORMCORE") || mHwName.contains("UNITY")) {
+        mIsDual = true;
+        mNumVescs = (mCanIds.size() + 1) / 2;
+    } else {
+        mIsDual = false;
+        mNumVescs = mCanIds.size() + 1;
+    }
+
+    QString canTxt("CAN IDs: " + QString::number(mVesc->appConfig()->getParamInt("controller_id")));
+    for (int id: mCanIds) {
+        canTxt += ", " + QString::number(id);
+    }
+    canTxt += " (" + QString::number(mCanIds.size() + 1) + " motors total)";
+    emit statusText(canTxt);
+
+    return true;
+}
+
+bool BoardSetup::bootloaderUpload()
+{
+    QFile file("://res/bootloaders/generic.bin");
+    if (!file.open(QIODevice::ReadOnly) || file.size() > 400000) {
+        mResultMsg = "Something is wrong with the included bootloader file in this software.";
+        return false;
+    }
+
+    QByteArray data = file.readAll();
+    if (!mVesc->fwUpload(data, true, mNumVescs > 1)) {
+        mResultMsg = "The bootloader upload timed out. Please try the routine again, you may need to "
+                     "update the firmware first seperatley from the VESC tool.";
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief BoardSetup::firmwareUpload
+ * Upload the included default firmware for the hardware found by canScan,
+ * wait for the reboot and connect to port again.
+ */
+bool BoardSetup::firmwareUpload(const QString &port)
+{
+    QString fwPath;
+    QDirIterator it("://res/firmwares");
+    while (it.hasNext()) {
+        QFileInfo fi(it.next());
+        QStringList names = fi.fileName().split("_o_");
+        if (fi.isDir() && (mHwName.isEmpty() || names.contains(mHwName, Qt::CaseInsensitive))) {
+            fwPath = fi.absoluteFilePath() + "/VESC_default.bin";
+        }
+    }
+
+    if (fwPath.isEmpty()) {
+        mResultMsg = "No included firmware for hardware " + mHwName;
+        return false;
+    }
+
+    QFile file(fwPath);
+    if (!file.open(QIODevice::ReadOnly) || file.size() > 400000) {
+        mResultMsg = "Something is wrong with the included firmware file for your hardware in this software.";
+        return false;
+    }
+
+    QByteArray data = file.readAll();
+    if (!mVesc->fwUpload(data, false, mNumVescs > 1)) {
+        mResultMsg = "The firmware upload timed out. Please try the routine again, you may need to "
+                     "update the firmware first seperatley from the VESC tool.";
+        return false;
+    }
+
+    for (int j = 15;j > 0;j--) {
+        emit statusText(QString("Waiting for Reboot: %1 s").arg(j));
+        Utility::sleepWithEventLoop(1000);
+    }
+
+    if (!serialConnect(port)) {
+        mResultMsg = "Unit did not reconnect after firmware upload.";
+        return false;
+    }
+
+    emit statusText("Firmware Uploaded Succesfully and Reconnected");
+    return true;
+}
+
+/**
+ * @brief BoardSetup::focDetection
+ * Disable the app, write the motor configuration from mcXmlPath to all
+ * VESCs, run FOC detection on all of them and check that the detected
+ * parameters are within tolerance of the target motor configuration.
+ * restoreApp enables the app again.
+ */
+bool BoardSetup::focDetection(const QString &mcXmlPath, double tolerance)
+{
+    mVesc->commands()->setSendCan(false);
+    mVesc->ignoreCanChange(true);
+    if (!readAppConf("Failed to read app config during motor setup routine.")) {
+        return false;
+    }
+
+    mAppEnumOld = mVesc->appConfig()->getParamEnum("app_to_use");
+    mVesc->appConfig()->updateParamEnum("app_to_use", 0); // set to use no app
+    Utility::sleepWithEventLoop(100);
+    mVesc->commands()->setAppConf();
+    if (!waitAck(2000)) {
+        mResultMsg = "Failed to write app config during motor routine.";
+        return false;
+    }
+
+    if (!mVesc->mcConfig()->loadXml(mcXmlPath, "MCConfiguration")) {
+        mResultMsg = "motor XML read failed during FOC calibration";
+        return false;
+    }
+
+    emit statusText("Writing Default Configs");
+    mVesc->commands()->setSendCan(false);
+    mVesc->commands()->setMcconf(false);
+    waitAck(2000);
+
+    for (int id: mCanIds) {
+        mVesc->commands()->setSendCan(true, id);
+        mVesc->commands()->setMcconf();
+        waitAck(2000);
+    }
+    mVesc->ignoreCanChange(false);
+    mVesc->commands()->setSendCan(false);
+
+    Utility::sleepWithEventLoop(1000);
+    emit statusText("Running FOC Detection");
+    double maxLoss = pow(mMcTarget->getParamDouble("l_current_max"), 2.0) *
+            mMcTarget->getParamDouble("foc_motor_r");
+    QString res = Utility::detectAllFoc(mVesc, true,
+                                        maxLoss,
+                                        mMcTarget->getParamDouble("l_in_current_min"),
+                                        mMcTarget->getParamDouble("l_in_current_max"),
+                                        mMcTarget->getParamDouble("foc_openloop_rpm"),
+                                        mMcTarget->getParamDouble("foc_sl_erpm"));
+    if (!res.startsWith("Success!")) {
+        mResultMsg = res;
+        return false;
+    }
+
+    emit statusText("Checking Detected Values for Accuracy");
+    mVesc->ignoreCanChange(true);
+
+    for (int i = -1;i < mCanIds.size();i++) {
+        QString canid;
+        if (i < 0) {
+            canid = "Master";
+            mVesc->commands()->setSendCan(false);
+        } else {
+            canid = QString::number(mCanIds.at(i));
+            mVesc->commands()->setSendCan(true, mCanIds.at(i));
+        }
+
+        mVesc->commands()->getMcconf();
+        Utility::waitSignal(mVesc->mcConfig(), SIGNAL(updated()), 5000);
+
+        if (mcConfigOutsideParamBounds("foc_motor_r", tolerance)) {
+            mResultMsg = "Motor Resistance of CAN ID " + canid + " is outside the tolerance for the target value." +
+                    " Check your motors and winding connections. The measured resistance was " +
+                    QString::number(mVesc->mcConfig()->getParamDouble("foc_motor_r") * 1.0e3) + " mOhm";
+            return false;
+        }
+
+        if (mcConfigOutsideParamBounds("foc_motor_l", tolerance)) {
+            mResultMsg = "Motor Inductance of CAN ID " + canid + " is outside the tolerance for the target value." +
+                    " Check your motors and winding connections. The measured inductance was " +
+                    QString::number(mVesc->mcConfig()->getParamDouble("foc_motor_l") * 1.0e6) + " uH";
+            return false;
+        }
+
+        if (mcConfigOutsideParamBounds("foc_motor_flux_linkage", tolerance)) {
+            mResultMsg = "Motor Flux Linkage of CAN ID " + canid + " is outside the tolerance for the target value." +
+                    " Check your motors and winding connections and ensure the motors are able to spin freely." +
+                    " The measured flux linkage was " +
+                    QString::number(mVesc->mcConfig()->getParamDouble("foc_motor_flux_linkage") * 1.0e3) + " mWb";
+            return false;
+        }
+
+        if (mVesc->mcConfig()->getParamEnum("foc_sensor_mode") != mMcTarget->getParamEnum("foc_sensor_mode")) {
+            mResultMsg = "Motor Sensors of CAN ID " + canid + " does not match the target setting." +
+                    " Ensure that the sensors are plugged in and wired correctly.";
+            return false;
+        }
+    }
+
+    mVesc->ignoreCanChange(false);
+    mVesc->commands()->setSendCan(false);
+    emit statusText("Detection Completed Succesfully");
+    return true;
+}
+
+/**
+ * @brief BoardSetup::motorDirection
+ * Wait until every motor has been turned forward by hand and set the
+ * direction and current limits of every VESC accordingly.
+ *
+ * @param keepWaiting
+ * Called with the progress of each motor while waiting. Return false and
+ * set abortMsg to stop, e.g. when the user cancels or after a timeout.
+ */
+bool BoardSetup::motorDirection(std::function<bool(const QString &status, QString &abortMsg)> keepWaiting)
+{
+    QVector<int> tachStart;
+    QVector<int> tachEnd;
+    QVector<int> canIdsVesc;
+    FW_RX_PARAMS params;
+
+    mVesc->ignoreCanChange(true);
+
+    for (int id: mCanIds) {
+        mVesc->commands()->setSendCan(true, id);
+        if (Utility::getFwVersionBlocking(mVesc, &params) && params.hwType == HW_TYPE_VESC) {
+            canIdsVesc.append(id);
+        }
+    }
+
+    // All tachometers are read with a single request fanned out over CAN
+    const unsigned int tachMask = uint32_t(1) << 13;
+    QMap<int, MC_VALUES> tach = Utility::getMcValuesBlockingAll(mVesc, canIdsVesc, tachMask, 2000);
+    for (int i = -1;i < canIdsVesc.size();i++) {
+        int id = i < 0 ? -1 : canIdsVesc.at(i);
+        if (!tach.contains(id)) {
+            mResultMsg = "Failed to read tachometer value during motor direction routine.";
+            return false;
+        }
+        tachStart.append(tach.value(id).tachometer);
+        tachEnd.append(tach.value(id).tachometer);
+    }
+
+    bool allHaveTurned = false;
+
+    while (!allHaveTurned) {
+        QString status = "Spin each motor in the forward direction to continue.\n";
+        bool turned = true;
+
+        Utility::sleepWithEventLoop(10);
+        tach = Utility::getMcValuesBlockingAll(mVesc, canIdsVesc, tachMask, 100);
+
+        for (int i = -1;i < canIdsVesc.size();i++) {
+            int id = i < 0 ? -1 : canIdsVesc.at(i);
+            if (tach.contains(id)) {
+                tachEnd[i + 1] = tach.value(id).tachometer;
+            }
+
+            int tachDiff = tachStart.at(i + 1) - tachEnd.at(i + 1);
+            turned &= (abs(tachDiff) >= 50);
+            status += QString("motor %1: %2% ").arg(i + 2).
+                    arg(qMin(abs(2 * tachDiff), 100), 3, 10, QLatin1Char(' '));
+        }
+
+        QString abortMsg;
+        if (!turned && !keepWaiting(status, abortMsg)) {
+            mResultMsg = abortMsg;
+            return false;
+        }
+
+        if (!mVesc->isPortConnected()) {
+            mResultMsg = "Disconnected during direction calibration.";
+            return false;
+        }
+
+        allHaveTurned = turned;
+    }
+
+    double motorCurrentMin = mMcTarget->getParamDouble("l_current_min");
+    double motorCurrentMax = mMcTarget->getParamDouble("l_current_max");
+    double motorCurrentInMin = mMcTarget->getParamDouble("l_in_current_min");
+    double motorCurrentInMax = mMcTarget->getParamDouble("l_in_current_max");
+
+    for (int i = -1;i < canIdsVesc.size();i++) {
+        if (i < 0) {
+            mVesc->commands()->setSendCan(false);
+        } else {
+            mVesc->commands()->setSendCan(true, canIdsVesc.at(i));
+        }
+
+        Utility::sleepWithEventLoop(100);
+        mVesc->commands()->getMcconf();
+        if (!Utility::waitSignal(mVesc->mcConfig(), SIGNAL(updated()), 5000)) {
+            mResultMsg = "Failed to read config during motor direction routine.";
+            return false;
+        }
+
+        bool invertMotor = (tachStart.at(i + 1) - tachEnd.at(i + 1)) > 0;
+        mVesc->mcConfig()->updateParamBool("m_invert_direction", invertMotor);
+        mVesc->mcConfig()->updateParamDouble("l_current_min", motorCurrentMin);
+        mVesc->mcConfig()->updateParamDouble("l_current_max", motorCurrentMax);
+        mVesc->mcConfig()->updateParamDouble("l_in_current_min", motorCurrentInMin);
+        mVesc->mcConfig()->updateParamDouble("l_in_current_max", motorCurrentInMax);
+        mVesc->commands()->setMcconf(false);
+
+        if (!waitAck(2000)) {
+            mResultMsg = "Failed to write config during motor direction routine.";
+            return false;
+        }
+    }
+
+    mVesc->ignoreCanChange(false);
+    mVesc->commands()->setSendCan(false);
+    emit statusText("Motor Directions Set");
+    return true;
+}
+
+/**
+ * @brief BoardSetup::restoreApp
+ * Enable the app that focDetection disabled again. Not needed when the app
+ * configuration is applied afterwards.
+ */
+bool BoardSetup::restoreApp()
+{
+    mVesc->commands()->setSendCan(false);
+    if (!readAppConf("Failed to read app config after motor setup routine.")) {
+        return false;
+    }
+
+    mVesc->appConfig()->updateParamEnum("app_to_use", mAppEnumOld);
+    mVesc->commands()->setAppConf();
+    if (!waitAck(2000)) {
+        mResultMsg = "Failed to write app config after motor routine.";
+        return false;
+    }
+
+    return true;
+}
+
+bool BoardSetup::applySlaveAppSettings(const QString &appXmlPath)
+{
+    mVesc->commands()->setSendCan(false);
+    if (!readAppConf("Failed to read app config during slave setup routine.")) {
+        return false;
+    }
+
+    int masterId = mVesc->appConfig()->getParamInt("controller_id");
+    mVesc->appConfig()->updateParamEnum("app_to_use", 0);
+    mVesc->commands()->setAppConf();
+    if (!waitAck(5000)) {
+        mResultMsg = "Failed to write master config during slave app routine.";
+        return false;
+    }
+
+    if (!mVesc->appConfig()->loadXml(appXmlPath, "APPConfiguration")) {
+        mResultMsg = "app XML read failed during App Setup";
+        return false;
+    }
+
+    mVesc->appConfig()->updateParamEnum("app_to_use", 3); // set to use uart
+    mVesc->appConfig()->updateParamEnum("can_mode", 0); // set to use vesc CAN
+    mVesc->appConfig()->updateParamEnum("can_baud_rate", 2); // 500K baud
+    mVesc->appConfig()->updateParamEnum("send_can_status", 5); // send all CAN status'
+    mVesc->appConfig()->updateParamInt("send_can_status_rate_hz", 50); // 50 Hz
+    // Slaves are always on, so that they don't time out separately and the master controls shutdown
+    mVesc->appConfig()->updateParamEnum("shutdown_mode", 1);
+
+    mVesc->ignoreCanChange(true);
+    for (int id: mCanIds) {
+        // Writing the app config twice to the same dual controller is fine,
+        // but the second motor of the master is skipped.
+        bool isSecondMasterId = mIsDual && ((masterId + 1) == id);
+        if (!isSecondMasterId) {
+            mVesc->commands()->setSendCan(true, id);
+            mVesc->appConfig()->updateParamInt("controller_id", id);
+            Utility::sleepWithEventLoop(100);
+            mVesc->commands()->setAppConf();
+            if (!waitAck(2000)) {
+                mResultMsg = "Failed to write config during slave app routine.";
+                return false;
+            }
+        }
+    }
+    mVesc->commands()->setSendCan(false);
+    mVesc->ignoreCanChange(false);
+    return true;
+}
+
+bool BoardSetup::applyMasterAppSettings(const QString &appXmlPath)
+{
+    mVesc->commands()->setSendCan(false);
+    if (!readAppConf("Failed to read app config during master setup routine.")) {
+        return false;
+    }
+
+    int masterId = mVesc->appConfig()->getParamInt("controller_id");
+
+    if (!mVesc->appConfig()->loadXml(appXmlPath, "APPConfiguration")) {
+        mResultMsg = "app XML read failed during App Setup";
+        return false;
+    }
+
+    mVesc->appConfig()->updateParamEnum("send_can_status", 0); // don't send CAN status on master
+    mVesc->appConfig()->updateParamInt("controller_id", masterId);
+
+    QString successMsg;
+
+    switch (mAppTarget->getParamEnum("app_to_use")) {
+    case 4: // ppm and uart
+    case 1: // ppm
+        mVesc->appConfig()->updateParamBool("app_ppm_conf.multi_esc", true);
+        successMsg = "PPM Remote Config Applied";
+        break;
+    case 3: // uart
+        // if uart only on master assume a uart based chuk remote
+        mVesc->appConfig()->updateParamBool("app_chuk_conf.multi_esc", true);
+        successMsg = "UART Remote Config Applied";
+        break;
+    case 2: // adc
+        mVesc->appConfig()->updateParamBool("app_adc_conf.multi_esc", true);
+        successMsg = "ADC Config Applied";
+        break;
+    default:
+        mResultMsg = "Your app type is not compatible with this setup tool currently.";
+        return false;
+    }
+
+    mVesc->commands()->setSendCan(false);
+    mVesc->commands()->setAppConf();
+    if (!waitAck(2000)) {
+        mResultMsg = "Failed to write config during master app routine.";
+        return false;
+    }
+
+    emit statusText(successMsg);
+    return true;
+}
+
+bool BoardSetup::waitAck(int timeoutMs)
+{
+    return Utility::waitSignal(mVesc->commands(), SIGNAL(ackReceived(QString)), timeoutMs);
+}
+
+bool BoardSetup::readAppConf(const QString &errorMsg)
+{
+    mVesc->commands()->getAppConf();
+    if (!Utility::waitSignal(mVesc->appConfig(), SIGNAL(updated()), 5000)) {
+        mResultMsg = errorMsg;
+        return false;
+    }
+
+    return true;
+}
+
+bool BoardSetup::mcConfigOutsideParamBounds(QString paramName, double tolerance)
+{
+    double detectedParam = mVesc->mcConfig()->getParamDouble(paramName);
+    double targetParam = mMcTarget->getParamDouble(paramName);
+    return fabs(detectedParam - targetParam) > tolerance * targetParam;
+}
@@ -0,0 +1,85 @@
+/*
+    Copyright 2016 - 2024 Benjamin Vedder	benjamin@vedder.se
+
+    This file is part of VESC Tool.
+
+    VESC Tool is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    VESC Tool is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+#ifndef BOARDSETUP_H
+#define BOARDSETUP_H
+
+#include <QObject>
+#include <QVector>
+#include <QString>
+#include <functional>
+
+class VescInterface;
+class ConfigParams;
+
+/**
+ * @brief The BoardSetup class
+ * The steps of the end-of-line board setup, without any user interface.
+ * BoardSetupWindow runs them for the selected port and shows the result of
+ * every step, ProductionStation runs them on several ports in parallel.
+ *
+ * Every step returns false on failure, with the reason in resultMsg.
+ * Progress and the result of successful steps are given with statusText.
+ */
+class BoardSetup : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit BoardSetup(VescInterface *vesc, ConfigParams *mcTarget,
+                        ConfigParams *appTarget, QObject *parent = nullptr);
+
+    QString resultMsg() const;
+    QVector<int> canIds() const;
+    int numVescs() const;
+    QString hwName() const;
+
+    bool serialConnect(const QString &port);
+    bool canScan();
+    bool bootloaderUpload();
+    bool firmwareUpload(const QString &port);
+    bool focDetection(const QString &mcXmlPath, double tolerance);
+    bool motorDirection(std::function<bool(const QString &status, QString &abortMsg)> keepWaiting);
+    bool restoreApp();
+    bool applySlaveAppSettings(const QString &appXmlPath);
+    bool applyMasterAppSettings(const QString &appXmlPath);
+
+signals:
+    void statusText(QString text);
+
+private:
+    VescInterface *mVesc;
+    ConfigParams *mMcTarget;
+    ConfigParams *mAppTarget;
+
+    QString mResultMsg;
+    QVector<int> mCanIds;
+    bool mCanTimeout;
+    bool mIsDual;
+    int mNumVescs;
+    QString mHwName;
+    int mAppEnumOld;
+
+    bool waitAck(int timeoutMs);
+    bool readAppConf(const QString &errorMsg);
+    bool mcConfigOutsideParamBounds(QString paramName, double tolerance);
+
+};
+
+#endif // BOARDSETUP_H
@@ -11,10 +11,15 @@
 #include <QDirIterator>
 #include <QDesktopServices>
 #include <QProgressDialog>
+#include <QDialog>
+#include <QVBoxLayout>
+#include <QPushButton>
+#include <QHeaderView>
 #include "parametereditor.h"
 #include "startupwizard.h"
 #include "widgets/helpdialog.h"
 #include "utility.h"
+#include "configstore.h"
 #include "widgets/paramdialog.h"
 #include "widgets/detectallfocdialog.h"
 
@@ -34,6 +39,40 @@ BoardSetupWindow::BoardSetupWindow(QWidget *parent) :
     mKeyLeft = false;
     mKeyRight = false;
 
+    mLine = new ProductionLine(this);
+    mLineDialog = nullptr;
+    mLineTable = nullptr;
+    mLineReport = nullptr;
+
+    connect(mLine, &ProductionLine::stationStep, [this](int station, int step, int state, QString text) {
+        int col = step >= 0 ? step : ProductionStation::STEP_COUNT;
+        QTableWidgetItem *item = mLineTable->item(station, col);
+        if (!item) {
+            return;
+        }
+
+        item->setText(text);
+        if (step >= 0) {
+            item->setBackground(state == ProductionLine::STATE_OK ? QColor("lightGreen") :
+                                state == ProductionLine::STATE_FAILED ? QColor("red") : QColor("yellow"));
+            item->setForeground(QColor("black"));
+        }
+    });
+    connect(mLine, &ProductionLine::stationFinished, [this](int station, bool ok, QString msg) {
+        QTableWidgetItem *item = mLineTable->item(station, ProductionStation::STEP_COUNT);
+        if (item) {
+            item->setText(ok ? "Done" : msg);
+            item->setBackground(ok ? QColor("lightGreen") : QColor("red"));
+            item->setForeground(QColor("black"));
+        }
+        mLineReport->setPlainText(mLine->timingReport());
+    });
+    connect(mLine, &ProductionLine::allFinished, [this]() {
+        qDebug().noquote() << mLine->timingReport();
+        ui->startAllButton->setEnabled(true);
+        ui->startButton->setEnabled(true);
+    });
+
 
     connect(mTimer, SIGNAL(timeout()),
             this, SLOT(timerSlot()));
@@ -41,8 +80,6 @@ BoardSetupWindow::BoardSetupWindow(QWidget *parent) :
             this, SLOT(showStatusInfo(QString,bool)));
     connect(mVesc, SIGNAL(messageDialog(QString,QString,bool,bool)),
             this, SLOT(showMessageDialog(QString,QString,bool,bool)));
-    connect(mVesc->commands(), SIGNAL(pingCanRx(QVector<int>,bool)),
-            this, SLOT(pingCanRx(QVector<int>,bool)));
     connect(mVesc, SIGNAL(fwUploadStatus(QString,double,bool)),
             this, SLOT(fwUploadStatus(QString,double,bool)));
     connect(mVesc->commands(), SIGNAL(valuesReceived(MC_VALUES,unsigned int)),
@@ -72,9 +109,18 @@ BoardSetupWindow::BoardSetupWindow(QWidget *parent) :
     mMcConfig_Target = new ConfigParams(this);
     mAppConfig_Target = new ConfigParams(this);
     QPair<int, int> latestSupported = Utility::configLatestSupported();
-    QString FW_Ver =  QString::number(latestSupported.first) + "." + QStringLiteral("%1").arg(latestSupported.second, 2, 10, QLatin1Char('0'));
-    mMcConfig_Target->loadParamsXml("://res/config/" + FW_Ver + "/parameters_mcconf.xml");
-    mAppConfig_Target->loadParamsXml("://res/config/" + FW_Ver + "/parameters_appconf.xml");
+    ConfigStore::bundled().loadParams(latestSupported.first, latestSupported.second,
+                                      ConfigStore::CONFIG_MCCONF, mMcConfig_Target);
+    ConfigStore::bundled().loadParams(latestSupported.first, latestSupported.second,
+                                      ConfigStore::CONFIG_APPCONF, mAppConfig_Target);
+
+    mSetup = new BoardSetup(mVesc, mMcConfig_Target, mAppConfig_Target, this);
+    mStepLabel = nullptr;
+    connect(mSetup, &BoardSetup::statusText, [this](QString text) {
+        if (mStepLabel) {
+            mStepLabel->setText(text);
+        }
+    });
 
 
     QDirIterator dir(QDir::currentPath(),QStringList() << "app_settings*.xml", QDir::NoFilter ,QDirIterator::Subdirectories);
@@ -191,6 +237,7 @@ void BoardSetupWindow::on_startButton_clicked()
     ui->motorConfigEdit->setEnabled(false);
     ui->motorTolSlider->setEnabled(false);
     ui->startButton->setEnabled(false);
+    ui->startAllButton->setEnabled(false);
     ui->serialRefreshButton->setEnabled(false);
     ui->serialPortBox->setEnabled(false);
     ui->bleFirmwareButton->setEnabled(false);
@@ -270,7 +317,7 @@ void BoardSetupWindow::on_startButton_clicked()
     }
 
     if(ui->appCheckBox->isChecked()){
-        if(num_VESCs>1){
+        if(mSetup->numVescs()>1){
             res = tryApplySlaveAppSettings();
             if(!res){
                 resetRoutine();
@@ -298,6 +345,103 @@ void BoardSetupWindow::on_startButton_clicked()
     resetRoutine();
 }
 
+void BoardSetupWindow::on_startAllButton_clicked()
+{
+    QStringList ports;
+    for (int i = 0;i < ui->serialPortBox->count();i++) {
+        ports.append(ui->serialPortBox->itemData(i).toString());
+    }
+
+    if (ports.isEmpty()) {
+        showMessageDialog(tr("Production Line"), tr("No serial ports found."), false, false);
+        return;
+    }
+
+    if (ui->motorDetectionCheckBox->isChecked()) {
+        QMessageBox::StandardButton reply;
+        reply = QMessageBox::information(this,
+                                         tr("Production Line Started"),
+                                         tr("The board setup will run on %1 ports with motor calibration enabled.").arg(ports.size()) +
+                                         tr(" Please ensure the motors and wheels of all boards are able to free-spin without") +
+                                         tr(" interference before pressing OK."),
+                                         QMessageBox::Ok|QMessageBox::Cancel);
+        if (reply != QMessageBox::Ok) {
+            return;
+        }
+    }
+
+    ProductionStation::Options options;
+    options.mcXmlPath = ui->motorDetectionCheckBox->isChecked() ? mcXmlPath : QString();
+    options.appXmlPath = ui->appCheckBox->isChecked() ? appXmlPath : QString();
+    options.uploadBootloader = ui->bootloaderCheckBox->isChecked();
+    options.motorTolerance = motorTolerance();
+    options.directionTimeoutMs = 120000;
+
+    ui->startAllButton->setEnabled(false);
+    ui->startButton->setEnabled(false);
+    showLineDashboard(ports);
+    mLine->start(ports, options);
+}
+
+double BoardSetupWindow::motorTolerance()
+{
+    double tolerance = ui->motorTolSlider->value();
+    if (ui->motorTolSlider->value() < 100) {
+        tolerance /= 100.0;
+    } else {
+        tolerance *= 100.0;
+    }
+    return tolerance;
+}
+
+void BoardSetupWindow::showLineDashboard(const QStringList &ports)
+{
+    if (!mLineDialog) {
+        mLineDialog = new QDialog(this);
+        mLineDialog->setWindowTitle(tr("Production Line"));
+        mLineDialog->resize(1100, 500);
+
+        mLineTable = new QTableWidget(mLineDialog);
+        mLineTable->setEditTriggers(QAbstractItemView::NoEditTriggers);
+        mLineTable->horizontalHeader()->setSectionResizeMode(QHeaderView::ResizeToContents);
+
+        mLineReport = new QPlainTextEdit(mLineDialog);
+        mLineReport->setReadOnly(true);
+        mLineReport->setMaximumHeight(180);
+
+        QPushButton *cancelButton = new QPushButton(tr("Cancel All"), mLineDialog);
+        connect(cancelButton, &QPushButton::clicked, [this]() {
+            mLine->cancel();
+        });
+
+        QVBoxLayout *layout = new QVBoxLayout(mLineDialog);
+        layout->addWidget(mLineTable);
+        layout->addWidget(mLineReport);
+        layout->addWidget(cancelButton);
+    }
+
+    QStringList headers;
+    for (int i = 0;i < ProductionStation::STEP_COUNT;i++) {
+        headers.append(ProductionStation::stepName(i));
+    }
+    headers.append(tr("Status"));
+
+    mLineTable->clear();
+    mLineTable->setColumnCount(headers.size());
+    mLineTable->setRowCount(ports.size());
+    mLineTable->setHorizontalHeaderLabels(headers);
+    mLineTable->setVerticalHeaderLabels(ports);
+
+    for (int r = 0;r < ports.size();r++) {
+        for (int c = 0;c < headers.size();c++) {
+            mLineTable->setItem(r, c, new QTableWidgetItem());
+        }
+    }
+
+    mLineReport->clear();
+    mLineDialog->show();
+}
+
 void BoardSetupWindow::resetRoutine(){
     //showMessageDialog(tr("Test Results"),
     //                  tr(testResultMsg.toUtf8()),
@@ -311,9 +455,7 @@ void BoardSetupWindow::resetRoutine(){
     ui->startButton->setEnabled(true);
     ui->usbConnectLabel->setStyleSheet("");
 
-    is_Dual = false;
-    num_VESCs = 0;
-    HW_Name = "";
+    mStepLabel = nullptr;
 
     ui->appConfigButton->setEnabled(true);
     ui->motorConfigButton->setEnabled(true);
@@ -321,6 +463,7 @@ void BoardSetupWindow::resetRoutine(){
     ui->appConfigEdit->setEnabled(true);
     ui->motorConfigEdit->setEnabled(true);
     ui->startButton->setEnabled(true);
+    ui->startAllButton->setEnabled(true);
     ui->serialRefreshButton->setEnabled(true);
     ui->serialPortBox->setEnabled(true);
     ui->bleFirmwareButton->setEnabled(true);
@@ -354,157 +497,55 @@ void BoardSetupWindow::resetRoutine(){
 }
 
 bool BoardSetupWindow::trySerialConnect(){
-    bool res;
-    mVesc->commands()->setSendCan(false);
-    res = mVesc->connectSerial(ui->serialPortBox->currentData().toString(), 115200);
+    bool res = mSetup->serialConnect(ui->serialPortBox->currentData().toString());
     if(res){
-        Utility::waitSignal(mVesc, SIGNAL(fwRxChanged(bool, bool)), 5000);
-    }
-    if(mVesc->isPortConnected()){
         ui->usbConnectLabel->setStyleSheet("QLabel { background-color : lightGreen; color : black; }");
     }else{
         ui->usbConnectLabel->setStyleSheet("QLabel { background-color : red; color : black; }");
-        testResultMsg = "Could not connect USB. Make sure the unit is powered on, connected to the computer, and the correct Serial port is selected.";
+        testResultMsg = mSetup->resultMsg();
         testResult = false;
     }
-    return mVesc->isPortConnected();
+    return res;
 }
 
 bool BoardSetupWindow::tryCANScan(){
-    bool res = false;
-    if(mVesc->isPortConnected()){
-        mVesc->commands()->pingCan();
-        Utility::waitSignal(mVesc->commands(), SIGNAL(pingCanRx(QVector<int>, bool)), 10000);
-    }
-    if(CAN_Timeout){
-        res = false;
-        ui->CANScanLabel->setStyleSheet("QLabel { background-color : lightGreen; color : black; }");
-        testResultMsg = "Could not connect USB. Make sure the unit is powered on, connected to the computer, and the correct Serial port is selected.";
-        testResult = false;
-    }else{
-        res = true;
-        mVesc->commands()->setSendCan(false);
-        mVesc->commands()->getAppConf();
-        if(!Utility::waitSignal(mVesc->appConfig(), SIGNAL(updated()), 5000)){
-            ui->CANScanLabel->setStyleSheet("QLabel { background-color : red; color : black; }");
-            testResultMsg = "Failed to read app config during CAN Scan.";
-            return false;
-        }
-        int this_ID = mVesc->appConfig()->getParamInt("controller_id");
-        QString canTxt("CAN IDs: " + QString::number(this_ID));
-        for(int i = 0; i < CAN_IDs.size(); i++){
-            canTxt = canTxt + ", " + QString::number(CAN_IDs.at(i));
-        }
-        canTxt = canTxt + " (" + QString::number(CAN_IDs.size() + 1) + " motors total)";
-        ui->CANScanLabel->setText(canTxt);
+    mStepLabel = ui->CANScanLabel;
+    bool res = mSetup->canScan();
+    if(res){
         ui->CANScanLabel->setStyleSheet("QLabel { background-color : lightGreen; color : black; }");
-    }
-    HW_Name = mVesc->getFirmwareNow().split("Hw: ").last();
-    HW_Name = HW_Name.split("\n").first();
-    if(HW_Name.contains("STORMCORE")|| HW_Name.contains("UNITY")){
-        is_Dual = true;
-        num_VESCs = (CAN_IDs.size() + 1)/2;
-        qDebug() << "num vescs" << num_VESCs;
     }else{
-        is_Dual = false;
-        num_VESCs = CAN_IDs.size() + 1;
+        ui->CANScanLabel->setStyleSheet("QLabel { background-color : red; color : black; }");
+        testResultMsg = mSetup->resultMsg();
+        testResult = false;
     }
     return res;
 }
 
-bool BoardSetupWindow::tryBootloaderUpload(){   
-    QString FW_Path;
-    QFile file;
-    file.setFileName("://res/bootloaders/generic.bin");
+bool BoardSetupWindow::tryBootloaderUpload(){
     is_Bootloader = true;
-    if (!file.open(QIODevice::ReadOnly)) {
-        QMessageBox::critical(this,
-                              tr("Upload Error"),
-                              tr("Could not open file. Make sure that the path is valid."));
-        testResultMsg = "Something is wrong with the included bootloader file in this software.";
-        testResult = false;
-        return false;
-    }
-    if (file.size() > 400000) {
-        QMessageBox::critical(this,
-                              tr("Upload Error"),
-                              tr("The selected file is too large to be a firmware."));
-        testResultMsg = "The included bootloader file is too large.";
-        testResult = false;
-        return false;
-    }
-    QByteArray data = file.readAll();
-
-    bool fwRes = mVesc->fwUpload(data, is_Bootloader, num_VESCs > 1);
-    if(fwRes){
+    bool res = mSetup->bootloaderUpload();
+    if(res){
         ui->bootloaderLabel->setStyleSheet("QLabel { background-color : lightGreen; color : black; }");
     }else{
         ui->bootloaderLabel->setStyleSheet("QLabel { background-color : red; color : black; }");
-        testResultMsg = "The bootloader upload timed out. Please try the routine again, you may need to update the firmware first seperatley from the VESC tool.";
+        testResultMsg = mSetup->resultMsg();
         testResult = false;
     }
-    return fwRes;
+    return res;
 }
 
 bool BoardSetupWindow::tryFirmwareUpload(){
-    QString FW_Path;
-    QDirIterator it("://res/firmwares");
-    while (it.hasNext()) {
-        QFileInfo fi(it.next());
-        QStringList names = fi.fileName().split("_o_");
-        if (fi.isDir() && (HW_Name.isEmpty() || names.contains(HW_Name, Qt::CaseInsensitive))) {
-            FW_Path = fi.absoluteFilePath() +  "/VESC_default.bin";
-        }
-    }
-    bool fwRes = false;
     is_Bootloader = false;
-    QFile file;
-    if(!FW_Path.isEmpty()){
-        file.setFileName(FW_Path);
-        if (!file.open(QIODevice::ReadOnly)) {
-            QMessageBox::critical(this,
-                                  tr("Upload Error"),
-                                  tr("Could not open file. Make sure that the path is valid."));
-            testResultMsg = "Something is wrong with the included firmware file for your hardware in this software.";
-            testResult = false;
-            return false;
-        }
-        if (file.size() > 400000) {
-            QMessageBox::critical(this,
-                                  tr("Upload Error"),
-                                  tr("The selected file is too large to be a firmware."));
-            testResultMsg = "The included firmware file is too large.";
-            testResult = false;
-            return false;
-        }
-        QByteArray data = file.readAll();
-
-        fwRes = mVesc->fwUpload(data, is_Bootloader, num_VESCs > 1);
-        if(!fwRes){
-            ui->firmwareLabel->setStyleSheet("QLabel { background-color : red; color : black; }");
-            testResultMsg = "The firmware upload timed out. Please try the routine again, you may need to update the firmware first seperatley from the VESC tool.";
-            return false;
-        }
-    }else{
-        // Didn't find any supported default firmwares
-        ui->bootloaderLabel->setStyleSheet("QLabel { background-color : red; color : black; }");
-        testResultMsg = "The firmware file path is non-existent.";
-        return false;
-    }
-    for(int j = 15; j>-1; j--){
-        ui->firmwareLabel->setText("Waiting for Reboot: " + QString::number(j)  + " s");
-        Utility::sleepWithEventLoop(1000);
-    }
-    bool reconnected = trySerialConnect();
-    if(reconnected){
-        ui->firmwareLabel->setText("Firmware Uploaded Succesfully and Reconnected");
+    mStepLabel = ui->firmwareLabel;
+    bool res = mSetup->firmwareUpload(ui->serialPortBox->currentData().toString());
+    if(res){
         ui->firmwareLabel->setStyleSheet("QLabel { background-color : lightGreen; color : black; }");
     }else{
-        ui->firmwareLabel->setText("Unit did not reconnect after firmware upload.");
         ui->firmwareLabel->setStyleSheet("QLabel { background-color : red; color : black; }");
+        testResultMsg = mSetup->resultMsg();
         testResult = false;
     }
-    return reconnected;
+    return res;
 }
 
 bool BoardSetupWindow::tryBleFirmwareUpload(){
@@ -512,266 +553,57 @@ bool BoardSetupWindow::tryBleFirmwareUpload(){
 }
 
 
-bool BoardSetupWindow::tryFOCCalibration(){    
-    mVesc->commands()->setSendCan(false);
-    mVesc->ignoreCanChange(true);
-    mVesc->commands()->getAppConf();
-    if(!Utility::waitSignal(mVesc->appConfig(), SIGNAL(updated()), 5000)){
-        ui->motorDetectionLabel->setStyleSheet("QLabel { background-color : red; color : black; }");
-        testResultMsg = "Failed to read app config during motor setup routine.";
-        return false;
-    }
-    app_enum_old = mVesc->appConfig()->getParamEnum("app_to_use");
-    mVesc->appConfig()->updateParamEnum("app_to_use",0); // set to use no app
-    Utility::sleepWithEventLoop(100);
-    mVesc->commands()->setAppConf();
-    if(!Utility::waitSignal(mVesc->commands(), SIGNAL(ackReceived(QString)), 2000)){
-        ui->appSetupLabel->setStyleSheet("QLabel { background-color : red; color : black; }");
-        testResultMsg = "Failed to write app config during motor routine.";
-        return false;
-    }
-
-
-
-
-
-    bool xml_res = mVesc->mcConfig()->loadXml(mcXmlPath, "MCConfiguration");
-    if(!xml_res){
-        ui->motorDetectionLabel->setStyleSheet("QLabel { background-color : red; color : black; }");
-        testResultMsg = "motor XML read failed during FOC calibration";
-        return false;
-    }
-    mVesc->ignoreCanChange(true);
-    ui->motorDetectionLabel->setText("Writing Default Configs");
-    mVesc->commands()->setSendCan(false);
-    mVesc->commands()->setMcconf(false);
-    Utility::waitSignal(mVesc->commands(), SIGNAL(ackReceived(QString)), 2000);
-
-    for(int i = 0; i < CAN_IDs.size(); i++){
-        mVesc->commands()->setSendCan(true, CAN_IDs.at(i));
-        mVesc->commands()->setMcconf();
-        Utility::waitSignal(mVesc->commands(), SIGNAL(ackReceived(QString)), 2000);
-    }
-    mVesc->ignoreCanChange(false);
-    mVesc->commands()->setSendCan(false);
-
-    Utility::sleepWithEventLoop(1000);
-    ui->motorDetectionLabel->setText("Running FOC Detection");
-    double max_loss = pow(mMcConfig_Target->getParamDouble("l_current_max"),2.0) * mMcConfig_Target->getParamDouble("foc_motor_r");
-    qDebug() << "max loss" << max_loss;
-    mVesc->mcConfig();
-    QString res = Utility::detectAllFoc(mVesc, true,
-                                        max_loss,
-                                        mMcConfig_Target->getParamDouble("l_in_current_min"),
-                                        mMcConfig_Target->getParamDouble("l_in_current_max"),
-                                        mMcConfig_Target->getParamDouble("foc_openloop_rpm"),
-                                        mMcConfig_Target->getParamDouble("foc_sl_erpm"));
-    if(!res.startsWith("Success!")){
-        ui->motorDetectionLabel->setStyleSheet("QLabel { background-color : red; color : black; }");
-        return false;
-    }
-    ui->motorDetectionLabel->setText("Checking Detected Values for Accuracy");
-    mVesc->ignoreCanChange(true);
-    float tolerance = (float) ui->motorTolSlider->value();
-    if(ui->motorTolSlider->value() < 100){
-        tolerance /= 100.0;
+bool BoardSetupWindow::tryFOCCalibration(){
+    mStepLabel = ui->motorDetectionLabel;
+    bool res = mSetup->focDetection(mcXmlPath, motorTolerance());
+    if(res){
+        ui->motorDetectionLabel->setStyleSheet("QLabel { background-color : lightGreen; color : black; }");
     }else{
-        tolerance *= 100.0;
-    }
-
-    for(int i = -1; i < CAN_IDs.size(); i++){
-        QString canid;
-        if(i == -1){
-            canid = "Master";
-            mVesc->commands()->setSendCan(false);
-        }  else{
-            canid = QString::number(CAN_IDs.at(i));
-            mVesc->commands()->setSendCan(true, CAN_IDs.at(i));
-        }
-        mVesc->commands()->getMcconf();
-        Utility::waitSignal(mVesc->mcConfig(), SIGNAL(updated()), 5000);
-
-        if(mcConfigOutsideParamBounds("foc_motor_r",tolerance )){
-            ui->motorDetectionLabel->setStyleSheet("QLabel { background-color : red; color : black; }");
-            testResultMsg = "Motor Resistance of CAN ID " + canid + " is outside the tolerance for the target value." +
-                    " Check your motors and winding connections. The measured resistance was " +
-                    QString::number(mVesc->mcConfig()->getParamDouble("foc_motor_r")*1.0e3)+" mOhm";
-            return false;
-        }
-
-        if(mcConfigOutsideParamBounds("foc_motor_l",tolerance )){
-            ui->motorDetectionLabel->setStyleSheet("QLabel { background-color : red; color : black; }");
-            testResultMsg = "Motor Inductance of CAN ID " + canid + " is outside the tolerance for the target value." +
-                    " Check your motors and winding connections. The measured inductance was " +
-                    QString::number(mVesc->mcConfig()->getParamDouble("foc_motor_l")*1.0e6)+" uH";
-            return false;
-        }
-
-        if(mcConfigOutsideParamBounds("foc_motor_flux_linkage",tolerance)){
-            ui->motorDetectionLabel->setStyleSheet("QLabel { background-color : red; color : black; }");
-            testResultMsg = "Motor Flux Linkage of CAN ID " + canid + " is outside the tolerance for the target value." +
-                    " Check your motors and winding connections and ensure the motors are able to spin freely. The measured flux linkage was " +
-                    QString::number(mVesc->mcConfig()->getParamDouble("foc_motor_flux_linkage")*1.0e3)+" mWb";
-            return false;
-        }
-        if(mVesc->mcConfig()->getParamEnum("foc_sensor_mode") != mMcConfig_Target->getParamEnum("foc_sensor_mode")){
-            ui->motorDetectionLabel->setStyleSheet("QLabel { background-color : red; color : black; }");
-            testResultMsg = "Motor Sensors of CAN ID " + canid + " does not match the target setting." +
-                    " Ensure that the sensors are plugged in and wired correctly.";
-            return false;
-        }
+        ui->motorDetectionLabel->setStyleSheet("QLabel { background-color : red; color : black; }");
+        testResultMsg = mSetup->resultMsg();
+        testResult = false;
     }
-    mVesc->ignoreCanChange(false);
-    mVesc->commands()->setSendCan(false);
-    ui->motorDetectionLabel->setText("Detection Completed Succesfully");
-    ui->motorDetectionLabel->setStyleSheet("QLabel { background-color : lightGreen; color : black; }");
-    return true;
+    return res;
 }
 
 bool BoardSetupWindow::tryMotorDirection(){
-    int tach_start[16];
-    int tach_end[16];
-    QString directionStatus;
-    directionStatus = tr("Spin each motor in the forward direction to continue.\n");
-    mVesc->ignoreCanChange(true);
-    QVector<int> CAN_IDs_VESC;
-    FW_RX_PARAMS params;
-    for(int i = -1; i < CAN_IDs.size(); i++){
-        if(i<0){
-            mVesc->commands()->setSendCan(false);
-        }else{
-            mVesc->commands()->setSendCan(true, CAN_IDs.at(i));
-        }
-        bool res = Utility::getFwVersionBlocking(mVesc, &params);
-        if(i > 0 &&res && params.hwType == HW_TYPE_VESC){
-            CAN_IDs_VESC.append(CAN_IDs.at(i));
-        }
-    }
-    for(int i = -1; i < CAN_IDs_VESC.size(); i++){
-        if(i<0){
-            mVesc->commands()->setSendCan(false);
-        }else{
-            mVesc->commands()->setSendCan(true, CAN_IDs_VESC.at(i));
-        }
-
-        mVesc->commands()->getValues();
-        if(!Utility::waitSignal(mVesc->commands(), SIGNAL(valuesReceived(MC_VALUES, unsigned int)), 2000)){
-            ui->motorDirectionLabel->setStyleSheet("QLabel { background-color : red; color : black; }");
-            testResultMsg = "Failed to read tachometer value during motor direction routine.";
-            return false;
-        }
-        tach_start[i+1] = values_now.tachometer;
-        directionStatus += "  0% ";
-    }
-    bool allHaveTurned = false;
+    mStepLabel = ui->motorDirectionLabel;
 
     QMessageBox* msgBox = new QMessageBox( this );
     msgBox->setWindowTitle( tr("Spin Motors") );
-    msgBox->setText(directionStatus);
+    msgBox->setText(tr("Spin each motor in the forward direction to continue.\n"));
     msgBox->addButton(QMessageBox::Cancel);
     msgBox->setModal( true );
-    msgBox->open(this, SLOT(msgBoxClosed(QAbstractButton*)));
-    mVesc->ignoreCanChange(true);
-    while(!allHaveTurned){
-        directionStatus = tr("Spin each motor in the forward direction to continue.\n");
-        bool turned = true;
-        for(int i = -1; i < CAN_IDs_VESC.size(); i++){
-
-            if(i<0){
-                mVesc->commands()->setSendCan(false);
-            }else{
-                mVesc->commands()->setSendCan(true, CAN_IDs_VESC.at(i));
-            }
-            Utility::sleepWithEventLoop(10);
-            mVesc->commands()->getValues();
-            if(Utility::waitSignal(mVesc->commands(), SIGNAL(valuesReceived(MC_VALUES, unsigned int)), 100)){
-                tach_end[i+1] = values_now.tachometer;
-            }
-            int tachDiff = tach_start[i+1] - tach_end[i+1];
-            turned &= (abs(tachDiff) >= 50);
-            int percent = abs(2*tachDiff);
-            percent = percent>100?100:percent;
-            QString number = "motor " + QString::number(i+2) + ": " +
-                    QStringLiteral("%1").arg(percent, 3, 10, QLatin1Char(' '))+ "% ";
-            // number = QString::number(tach_end[i+1]) +" " + QString::number(tach_start[i+1]) + " ";
-            directionStatus += number;
-        }
+    msgBox->open();
 
-        msgBox->setText(directionStatus);
+    bool res = mSetup->motorDirection([msgBox](const QString &status, QString &abortMsg) {
+        msgBox->setText(status);
         if(!msgBox->isVisible()){
-            ui->motorDirectionLabel->setStyleSheet("QLabel { background-color : red; color : black; }");
-            testResultMsg = "Direction routine canceled by the user.";
+            abortMsg = "Direction routine canceled by the user.";
             return false;
         }
-        if(!mVesc->isPortConnected()){
-            ui->motorDirectionLabel->setStyleSheet("QLabel { background-color : red; color : black; }");
-            testResultMsg = "Disconnected during direction calibration.";
-            msgBox->close();
-            msgBox->deleteLater();
-            return false;
-        }
-        allHaveTurned = turned;
-    }
-    mVesc->ignoreCanChange(true);
+        return true;
+    });
+
     msgBox->close();
     msgBox->deleteLater();
-    double motor_current_min = mMcConfig_Target->getParamDouble("l_current_min");
-    double motor_current_max = mMcConfig_Target->getParamDouble("l_current_max");
-    double motor_current_in_min = mMcConfig_Target->getParamDouble("l_in_current_min");
-    double motor_current_in_max = mMcConfig_Target->getParamDouble("l_in_current_max");
-    for(int i = -1; i < CAN_IDs_VESC.size(); i++){
-        if(i<0){
-            mVesc->commands()->setSendCan(false);
-        }else{
-            mVesc->commands()->setSendCan(true, CAN_IDs_VESC.at(i));
-        }
-        Utility::sleepWithEventLoop(100);
-        mVesc->commands()->getMcconf();
-        if(!Utility::waitSignal(mVesc->mcConfig(), SIGNAL(updated()), 5000)){
-            ui->motorDirectionLabel->setStyleSheet("QLabel { background-color : red; color : black; }");
-            testResultMsg = "Failed to read config during motor direction routine.";
-            return false;
-        }
 
-        bool invert_motor = ((tach_start[i+1] - tach_end[i+1]) > 0);
-        mVesc->mcConfig()->updateParamBool("m_invert_direction", invert_motor);
-        mVesc->mcConfig()->updateParamDouble("l_current_min", motor_current_min);
-        mVesc->mcConfig()->updateParamDouble("l_current_max", motor_current_max);
-        mVesc->mcConfig()->updateParamDouble("l_in_current_min", motor_current_in_min);
-        mVesc->mcConfig()->updateParamDouble("l_in_current_max", motor_current_in_max);
-        mVesc->commands()->setMcconf(false);
-
-        if(!Utility::waitSignal(mVesc->commands(), SIGNAL(ackReceived(QString)), 2000)){
-            ui->motorDirectionLabel->setStyleSheet("QLabel { background-color : red; color : black; }");
-            testResultMsg = "Failed to write config during during motor direction routine.";
-            return false;
-        }
+    if(res){
+        ui->motorDirectionLabel->setStyleSheet("QLabel { background-color : lightGreen; color : black; }");
+    }else{
+        ui->motorDirectionLabel->setStyleSheet("QLabel { background-color : red; color : black; }");
+        testResultMsg = mSetup->resultMsg();
+        testResult = false;
     }
-
-    ui->motorDirectionLabel->setStyleSheet("QLabel { background-color : lightGreen; color : black; }");
-    ui->motorDirectionLabel->setText("Motor Directions Set");
-
-
-    return true;
+    return res;
 }
 
-bool BoardSetupWindow::tryTestMotorParameters(){   
-
-
-
+bool BoardSetupWindow::tryTestMotorParameters(){
     if(!ui->appCheckBox->isChecked()){
-        mVesc->commands()->setSendCan(false);
-        mVesc->commands()->getAppConf();
-        if(!Utility::waitSignal(mVesc->appConfig(), SIGNAL(updated()), 5000)){
-            ui->motorDetectionLabel->setStyleSheet("QLabel { background-color : red; color : black; }");
-            testResultMsg = "Failed to read app config after motor setup routine.";
-            return false;
-        }
-        mVesc->appConfig()->updateParamEnum("app_to_use",app_enum_old); // set to use no app
-        mVesc->commands()->setAppConf();
-        if(!Utility::waitSignal(mVesc->commands(), SIGNAL(ackReceived(QString)), 2000)){
-            ui->appSetupLabel->setStyleSheet("QLabel { background-color : red; color : black; }");
-            testResultMsg = "Failed to write app config after motor routine.";
+        if(!mSetup->restoreApp()){
+            ui->motorTestLabel->setStyleSheet("QLabel { background-color : red; color : black; }");
+            testResultMsg = mSetup->resultMsg();
+            testResult = false;
             return false;
         }
     }
@@ -779,130 +611,27 @@ bool BoardSetupWindow::tryTestMotorParameters(){
 }
 
 bool BoardSetupWindow::tryApplySlaveAppSettings(){
-
-    // I wrote this little bit to determine if it was the second or motor or not for dual drivers and then
-    // realized it didn't really matter since it's ok to double write app config.
-    //
-    int master_ID = 0;
-    mVesc->commands()->setSendCan(false);
-    mVesc->commands()->getAppConf();
-    if(!Utility::waitSignal(mVesc->appConfig(), SIGNAL(updated()), 5000)){
+    mStepLabel = ui->appSetupLabel;
+    if(!mSetup->applySlaveAppSettings(appXmlPath)){
         ui->appSetupLabel->setStyleSheet("QLabel { background-color : red; color : black; }");
-        testResultMsg = "Failed to read app config during slave setup routine.";
-        return false;
-    }
-    master_ID = mVesc->appConfig()->getParamInt("controller_id");   
-    mVesc->appConfig()->updateParamEnum("app_to_use",0); // set to use uart
-    mVesc->commands()->setAppConf();
-    if(!Utility::waitSignal(mVesc->commands(), SIGNAL(ackReceived(QString)), 5000)){
-        ui->appSetupLabel->setStyleSheet("QLabel { background-color : red; color : black; }");
-        testResultMsg = "Failed to write master config during slave app routine.";
-        return false;
-    }
-
-    bool xml_res = mVesc->appConfig()->loadXml(appXmlPath, "APPConfiguration");
-    if(!xml_res){
-        ui->appSetupLabel->setStyleSheet("QLabel { background-color : red; color : black; }");
-        testResultMsg = "app XML read failed during App Setup";
+        testResultMsg = mSetup->resultMsg();
+        testResult = false;
         return false;
     }
-
-
-    mVesc->appConfig()->updateParamEnum("app_to_use",3); // set to use uart
-    mVesc->appConfig()->updateParamEnum("can_mode",0); // set to use vesc CAN
-    mVesc->appConfig()->updateParamEnum("can_baud_rate",2); // 500K baud
-    mVesc->appConfig()->updateParamEnum("send_can_status",5); // send all CAN status'
-    mVesc->appConfig()->updateParamInt("send_can_status_rate_hz",50); // 50 Hz
-    mVesc->appConfig()->updateParamEnum("shutdown_mode",1); // set slaves to always on so they don't time out seperatley and master controls shutdown
-
-
-    //    for(int i = 0; i < CAN_IDs.size(); i = i + 1){
-    //
-    //        is_second_motor_id |= ((master_ID + 1) == CAN_IDs.at(i));
-    //        if(i>0){
-    //            is_second_motor_id |= ((CAN_IDs.at(i) - CAN_IDs.at(i - 1) + 256) % 256 == 1);
-    //        }
-    //        is_second_motor_id &= is_Dual;
-    //        is_second_motor_id = false;
-    //        if(!is_second_motor_id){
-    //        }
-
-    mVesc->ignoreCanChange(true);
-    for(int i = 0; i < CAN_IDs.size(); i = i + 1){
-        bool is_second_master_id = is_Dual && ((master_ID + 1) == CAN_IDs.at(i));
-        if(!is_second_master_id)
-        {
-            mVesc->commands()->setSendCan(true, CAN_IDs.at(i));
-            mVesc->appConfig()->updateParamInt("controller_id", CAN_IDs.at(i));
-            Utility::sleepWithEventLoop(100);
-            mVesc->commands()->setAppConf();
-            if(!Utility::waitSignal(mVesc->commands(), SIGNAL(ackReceived(QString)), 2000)){
-                ui->appSetupLabel->setStyleSheet("QLabel { background-color : red; color : black; }");
-                testResultMsg = "Failed to write config during slave app routine.";
-                return false;
-            }
-        }
-    }
-    mVesc->commands()->setSendCan(false);
-    mVesc->ignoreCanChange(false);
     return true;
 }
 
 bool BoardSetupWindow::tryApplyMasterAppSettings(){
-    int master_ID = 0;
-    mVesc->commands()->setSendCan(false);
-    mVesc->commands()->getAppConf();
-    if(!Utility::waitSignal(mVesc->appConfig(), SIGNAL(updated()), 5000)){
-        ui->appSetupLabel->setStyleSheet("QLabel { background-color : red; color : black; }");
-        testResultMsg = "Failed to read app config during slave setup routine.";
-        return false;
-    }
-    master_ID = mVesc->appConfig()->getParamInt("controller_id");
-
-    bool xml_res = mVesc->appConfig()->loadXml(appXmlPath, "APPConfiguration");
-    if(!xml_res){
-        ui->appSetupLabel->setStyleSheet("QLabel { background-color : red; color : black; }");
-        testResultMsg = "app XML read failed during App Setup";
-        return false;
-    }
-    mVesc->appConfig()->updateParamEnum("send_can_status",0); // don't send CAN status on master
-    mVesc->appConfig()->updateParamInt("controller_id",master_ID); // don't send CAN status on master
-
-    QString success_msg = "";
-
-    switch(mAppConfig_Target->getParamEnum("app_to_use")){
-    case 4: //ppm and uart
-
-    case 1: //ppm
-        mVesc->appConfig()->updateParamBool("app_ppm_conf.multi_esc",true);
-        success_msg = "PPM Remote Config Applied";
-        break;
-    case 3: //uart
-        // if uart only on master assume a uart based chuk remote
-        mVesc->appConfig()->updateParamBool("app_chuk_conf.multi_esc",true);
-        success_msg = "UART Remote Config Applied";
-        break;
-    case 2: //adc
-        mVesc->appConfig()->updateParamBool("app_adc_conf.multi_esc",true);
-        success_msg = "ADC Config Applied";
-        break;
-    default:
-        ui->appSetupLabel->setStyleSheet("QLabel { background-color : red; color : black; }");
-        testResultMsg = "Your app type is not compatible with this setup tool currently.";
-        return false;
-    }
-
-    mVesc->commands()->setSendCan(false);
-    mVesc->commands()->setAppConf();
-    if(!Utility::waitSignal(mVesc->commands(), SIGNAL(ackReceived(QString)), 2000)){
+    mStepLabel = ui->appSetupLabel;
+    bool res = mSetup->applyMasterAppSettings(appXmlPath);
+    if(res){
+        ui->appSetupLabel->setStyleSheet("QLabel { background-color : lightGreen; color : black; }");
+    }else{
         ui->appSetupLabel->setStyleSheet("QLabel { background-color : red; color : black; }");
-        testResultMsg = "Failed to write config during master app routine.";
-        return false;
+        testResultMsg = mSetup->resultMsg();
+        testResult = false;
     }
-
-    ui->appSetupLabel->setStyleSheet("QLabel { background-color : lightGreen; color : black; }");
-    ui->appSetupLabel->setText(success_msg);
-    return true;
+    return res;
 }
 
 bool BoardSetupWindow::tryRemoteTest(){
@@ -914,13 +643,6 @@ bool BoardSetupWindow::tryFinalDiagnostics(){
     return true;
 }
 
-bool BoardSetupWindow::mcConfigOutsideParamBounds(QString paramName, double tolerance) {
-    qDebug() << "tolerance" << tolerance;
-    double detectedParam = mVesc->mcConfig()->getParamDouble(paramName);
-    double targetParam = mMcConfig_Target->getParamDouble(paramName);
-    return abs(detectedParam - targetParam) > tolerance*targetParam;
-}
-
 void BoardSetupWindow::mcConfigCheckResult(QStringList paramsNotSet)
 {
     if (!paramsNotSet.isEmpty()) {
@@ -1109,9 +831,7 @@ void BoardSetupWindow::loadAppConfXML(QString path){
         QString str;
 
         ui->appTab->addParamRow(mAppConfig_Target, "app_to_use");
-        foreach(QObject *p, ui->appTab->children().at(0)->children()){
-            p->setProperty("enabled",false);
-        }
+        ui->appTab->setEditorsEnabled(false);
         ui->appCheckBox->setCheckable(true);
         ui->appCheckBox->setCheckState(Qt::Checked);
 
@@ -1161,9 +881,7 @@ void BoardSetupWindow::loadMotorConfXML(QString path){
         ui->motorTab->addParamRow(mMcConfig_Target, "l_battery_cut_end");
         ui->motorConfigEdit->setText(path);
 
-        foreach(QObject *p, ui->motorTab->children().at(0)->children()){
-            p->setProperty("enabled",false);
-        }
+        ui->motorTab->setEditorsEnabled(false);
         ui->motorDetectionCheckBox->setCheckable(true);
         ui->motorDetectionCheckBox->setCheckState(Qt::Checked);
     } else {
@@ -1175,14 +893,6 @@ void BoardSetupWindow::loadMotorConfXML(QString path){
 
 }
 
-void BoardSetupWindow::pingCanRx(QVector<int> devs, bool isTimeout)
-{
-    CAN_Timeout = isTimeout;
-    if(!isTimeout){
-        CAN_IDs = devs;
-    }
-}
-
 void BoardSetupWindow::fwUploadStatus(const QString &status, double progress, bool isOngoing)
 {
     if(is_Bootloader){
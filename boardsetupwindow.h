@@ -7,7 +7,11 @@
 #include <QProcess>
 #include <QSettings>
 #include <QMap>
+#include <QTableWidget>
+#include <QPlainTextEdit>
 #include "vescinterface.h"
+#include "productionline.h"
+#include "boardsetup.h"
 #include "widgets/pagelistitem.h"
 
 namespace Ui {
@@ -27,7 +31,6 @@ private slots:
      void showStatusInfo(QString info, bool isGood);
      void showMessageDialog(const QString &title, const QString &msg, bool isGood, bool richText);
      void mcConfigCheckResult(QStringList paramsNotSet);
-     void pingCanRx(QVector<int> devs, bool isTimeout);
      void fwUploadStatus(const QString &status, double progress, bool isOngoing);
     // void loadMotorConfig(QString &path);
     // void loadAppConfig(QString &path);
@@ -37,6 +40,7 @@ private slots:
      void on_bleFirmwareButton_clicked();
      void on_serialRefreshButton_clicked();
      void on_startButton_clicked();
+     void on_startAllButton_clicked();
      void on_bootloaderCheckBox_stateChanged();
      void on_motorDetectionCheckBox_stateChanged();
      void on_motorTolSlider_valueChanged(int value);
@@ -56,17 +60,13 @@ private:
     VescInterface *mVesc;
     QTimer *mTimer;
     QLabel *mStatusLabel;
-    QVector<int> CAN_IDs;
-    bool CAN_Timeout;
     bool is_Bootloader;
-    bool is_Dual;
-    int num_VESCs;
-    QString HW_Name;
     MC_VALUES values_now;
-    int app_enum_old = 0;
 
     ConfigParams *mMcConfig_Target;
     ConfigParams *mAppConfig_Target;
+    BoardSetup *mSetup;
+    QLabel *mStepLabel;
 
     int mStatusInfoTime;
     bool mKeyLeft;
@@ -76,10 +76,17 @@ private:
     ConfigParams mcConfig_Target;
     QMap<QString, int> mPageNameIdList;
 
+    ProductionLine *mLine;
+    QDialog *mLineDialog;
+    QTableWidget *mLineTable;
+    QPlainTextEdit *mLineReport;
+
     void uploadFw(bool allOverCan);
     void loadAppConfXML(QString path);
     void loadMotorConfXML(QString path);
     void resetRoutine();
+    double motorTolerance();
+    void showLineDashboard(const QStringList &ports);
 
     bool trySerialConnect();
     bool tryBootloaderUpload();
@@ -93,7 +100,6 @@ private:
     bool tryApplyMasterAppSettings();
     bool tryRemoteTest();
     bool tryFinalDiagnostics();
-    bool mcConfigOutsideParamBounds(QString paramName, double tolerance);
 
 
 };
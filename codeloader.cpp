@@ -54,29 +54,13 @@ bool CodeLoader::lispErase(int size)
         return false;
     }
 
-    auto waitEraseRes = [this]() {
-        int res = -10;
-
-        QEventLoop loop;
-        QTimer timeoutTimer;
-        timeoutTimer.setSingleShot(true);
-        timeoutTimer.start(8000);
-        auto conn = connect(mVesc->commands(), &Commands::lispEraseCodeRx,
-                            [&res,&loop](bool erRes) {
-            res = erRes ? 1 : -1;
-            loop.quit();
-        });
-
-        connect(&timeoutTimer, SIGNAL(timeout()), &loop, SLOT(quit()));
-        loop.exec();
-
-        disconnect(conn);
-        return res;
-    };
-
-    mVesc->commands()->lispEraseCode(size);
+    auto reply = mVesc->commands()->lispEraseCodeRequest(size);
+    int erRes = -10;
+    if (reply->waitForFinished()) {
+        erRes = (!reply->data().isEmpty() && reply->data().at(0)) ? 1 : -1;
+    }
+    reply->deleteLater();
 
-    int erRes = waitEraseRes();
     if (erRes != 1) {
         QString msg = tr("Unknown failure");
 
@@ -326,33 +310,20 @@ bool CodeLoader::lispUpload(VByteArray vb)
         return false;
     }
 
-    auto waitWriteRes = [this]() {
-        int res = -10;
-
-        QEventLoop loop;
-        QTimer timeoutTimer;
-        timeoutTimer.setSingleShot(true);
-        timeoutTimer.start(1000);
-        auto conn = connect(mVesc->commands(), &Commands::lispWriteCodeRx,
-                            [&res,&loop](bool erRes, quint32 offset) {
-            (void)offset;
-            res = erRes ? 1 : -1;
-            loop.quit();
-        });
-
-        connect(&timeoutTimer, SIGNAL(timeout()), &loop, SLOT(quit()));
-        loop.exec();
-
-        disconnect(conn);
-        return res;
-    };
-
-    auto writeChunk = [this, waitWriteRes](QByteArray data, quint32 offset) {
+    // The request itself resends on timeouts. A write that the VESC rejects
+    // is sent again as well, up to five times.
+    auto writeChunk = [this](QByteArray data, quint32 offset) {
         int tries = 5;
         int res = -10;
         while (tries > 0) {
-            mVesc->commands()->lispWriteCode(data, offset);
-            if ((res = waitWriteRes()) >= 0) {
+            auto reply = mVesc->commands()->lispWriteCodeRequest(data, offset);
+            res = -10;
+            if (reply->waitForFinished()) {
+                res = (!reply->data().isEmpty() && reply->data().at(0)) ? 1 : -1;
+            }
+            reply->deleteLater();
+
+            if (res != -1) {
                 return res;
             }
             tries--;
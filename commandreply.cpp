@@ -0,0 +1,139 @@
+/*
+    Copyright 2016 - 2024 Benjamin Vedder	benjamin@vedder.se
+
+    This file is part of VESC Tool.
+
+    VESC Tool is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    VESC Tool is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+#include "commandreply.h"
+#include <QEventLoop>
+
+CommandReply::CommandReply(int command, std::function<void()> send,
+                           std::function<bool(VByteArray)> match,
+                           int timeoutMs, int tries, QObject *parent) : QObject(parent)
+{
+    mCommand = command;
+    mSend = send;
+    mMatch = match;
+    mTimeoutMs = timeoutMs;
+    mTriesLeft = qMax(tries, 1);
+    mTries = 0;
+    mState = REPLY_PENDING;
+    mSentMs = 0;
+    mElapsed.start();
+}
+
+bool CommandReply::isFinished() const
+{
+    return mState != REPLY_PENDING;
+}
+
+bool CommandReply::isOk() const
+{
+    return mState == REPLY_OK;
+}
+
+CommandReply::REPLY_STATE CommandReply::state() const
+{
+    return mState;
+}
+
+/**
+ * @brief CommandReply::data
+ * The payload of the reply, without the command ID.
+ */
+QByteArray CommandReply::data() const
+{
+    return mData;
+}
+
+int CommandReply::command() const
+{
+    return mCommand;
+}
+
+int CommandReply::tries() const
+{
+    return mTries;
+}
+
+qint64 CommandReply::elapsedMs() const
+{
+    return mElapsed.elapsed();
+}
+
+/**
+ * @brief CommandReply::waitForFinished
+ * Block until the reply has finished, while running the event loop so
+ * that packets keep being processed. This is what the blocking helpers in
+ * Commands and the QML scripts use.
+ *
+ * @return
+ * True if a reply was received.
+ */
+bool CommandReply::waitForFinished()
+{
+    if (!isFinished()) {
+        QEventLoop loop;
+        connect(this, SIGNAL(finished()), &loop, SLOT(quit()));
+        loop.exec();
+    }
+
+    return isOk();
+}
+
+void CommandReply::cancel()
+{
+    finish(REPLY_CANCELED);
+}
+
+/**
+ * @brief CommandReply::then
+ * Call func when the reply has finished, or right away if it already has.
+ */
+void CommandReply::then(std::function<void(CommandReply *reply)> func)
+{
+    if (isFinished()) {
+        func(this);
+    } else {
+        connect(this, &CommandReply::finished, [this, func]() {
+            func(this);
+        });
+    }
+}
+
+void CommandReply::send()
+{
+    mTries++;
+    mTriesLeft--;
+    mSentMs = mElapsed.elapsed();
+    mSend();
+}
+
+bool CommandReply::isTimedOut() const
+{
+    return (mElapsed.elapsed() - mSentMs) > mTimeoutMs;
+}
+
+void CommandReply::finish(REPLY_STATE state, const QByteArray &data)
+{
+    if (isFinished()) {
+        return;
+    }
+
+    mState = state;
+    mData = data;
+    emit finished();
+}
@@ -0,0 +1,91 @@
+/*
+    Copyright 2016 - 2024 Benjamin Vedder	benjamin@vedder.se
+
+    This file is part of VESC Tool.
+
+    VESC Tool is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    VESC Tool is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+#ifndef COMMANDREPLY_H
+#define COMMANDREPLY_H
+
+#include <QObject>
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <functional>
+#include "vbytearray.h"
+
+/**
+ * @brief The CommandReply class
+ * Handle to a request sent with Commands::request. Commands matches
+ * received packets to the pending requests by command ID and, for replies
+ * that carry one, by offset or index, so that many requests can be in
+ * flight at the same time. A request without a reply within its timeout is
+ * sent again, and finishes with REPLY_TIMEOUT when it runs out of tries.
+ *
+ * As with QNetworkReply, the caller owns the reply and should delete it
+ * with deleteLater when done with it.
+ */
+class CommandReply : public QObject
+{
+    Q_OBJECT
+
+public:
+    typedef enum {
+        REPLY_PENDING = 0,
+        REPLY_OK,
+        REPLY_TIMEOUT,
+        REPLY_CANCELED
+    } REPLY_STATE;
+
+    Q_INVOKABLE bool isFinished() const;
+    Q_INVOKABLE bool isOk() const;
+    REPLY_STATE state() const;
+    Q_INVOKABLE QByteArray data() const;
+    int command() const;
+    int tries() const;
+    qint64 elapsedMs() const;
+
+    Q_INVOKABLE bool waitForFinished();
+    Q_INVOKABLE void cancel();
+    void then(std::function<void(CommandReply *reply)> func);
+
+signals:
+    void finished();
+
+private:
+    friend class Commands;
+
+    CommandReply(int command, std::function<void()> send,
+                 std::function<bool(VByteArray)> match,
+                 int timeoutMs, int tries, QObject *parent);
+
+    int mCommand;
+    std::function<void()> mSend;
+    std::function<bool(VByteArray)> mMatch;
+    int mTimeoutMs;
+    int mTriesLeft;
+    int mTries;
+    REPLY_STATE mState;
+    QByteArray mData;
+    QElapsedTimer mElapsed;
+    qint64 mSentMs;
+
+    void send();
+    bool isTimedOut() const;
+    void finish(REPLY_STATE state, const QByteArray &data = QByteArray());
+
+};
+
+#endif // COMMANDREPLY_H
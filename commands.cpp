@@ -18,9 +18,9 @@
     */
 
 #include "commands.h"
+#include "commandreply.h"
 #include "qelapsedtimer.h"
 #include <QDebug>
-#include <QEventLoop>
 #include <ranges>
 
 Commands::Commands(QObject *parent) : QObject(parent)
@@ -37,6 +37,8 @@ Commands::Commands(QObject *parent) : QObject(parent)
     mTimer->setInterval(10);
     mTimer->start();
 
+    mLinkStats = new LinkStats(this);
+
     mMcConfig = nullptr;
     mAppConfig = nullptr;
 
@@ -103,9 +105,16 @@ int Commands::getCanSendId()
 
 void Commands::processPacket(QByteArray data)
 {
+    QElapsedTimer decodeTimer;
+    decodeTimer.start();
+
     VByteArray vb(data);
     COMM_PACKET_ID id = COMM_PACKET_ID(vb.vbPopFrontUint8());
 
+    if (!mRequests.isEmpty()) {
+        dispatchReply(id, vb);
+    }
+
     switch (id) {
     case COMM_FW_VERSION: {
         mTimeoutFwVer = 0;
@@ -1020,15 +1029,7 @@ void Commands::processPacket(QByteArray data)
 
     case COMM_FILE_LIST: {
         auto hasMore = vb.vbPopFrontInt8();
-        QList<FILE_LIST_ENTRY> files;
-        while (vb.size() > 0) {
-            FILE_LIST_ENTRY f;
-            f.isDir = vb.vbPopFrontInt8();
-            f.size = vb.vbPopFrontInt32();
-            f.name = vb.vbPopFrontString();
-            files.append(f);
-        }
-        emit fileListRx(hasMore, files);
+        emit fileListRx(hasMore, fileListFromReply(vb));
     } break;
 
     case COMM_FILE_READ: {
@@ -1151,6 +1152,8 @@ void Commands::processPacket(QByteArray data)
     default:
         break;
     }
+
+    mLinkStats->recordRx(id, data.size(), decodeTimer.nsecsElapsed());
 }
 
 void Commands::getFwVersion()
@@ -1778,6 +1781,38 @@ void Commands::getValuesSelective(unsigned int mask)
     emitData(vb);
 }
 
+/**
+ * @brief Commands::getValuesSelectiveAll
+ * Request COMM_GET_VALUES_SELECTIVE from the local VESC and from all given
+ * CAN IDs at once, without waiting for the replies in between. The
+ * replies all arrive through valuesReceived, so bit 17 (vesc_id) is always
+ * added to the mask to tell them apart. Unlike getValuesSelective this does
+ * not change or depend on the CAN forwarding state.
+ *
+ * @param canIds
+ * CAN IDs to forward the request to.
+ *
+ * @param mask
+ * Values to request.
+ *
+ * @param includeLocal
+ * Also send the request to the VESC that is connected directly.
+ */
+void Commands::getValuesSelectiveAll(QVector<int> canIds, unsigned int mask, bool includeLocal)
+{
+    VByteArray vb;
+    vb.vbAppendInt8(COMM_GET_VALUES_SELECTIVE);
+    vb.vbAppendUint32(mask | (uint32_t(1) << 17));
+
+    if (includeLocal) {
+        emitDataTo(vb, -1);
+    }
+
+    for (auto id: canIds) {
+        emitDataTo(vb, id);
+    }
+}
+
 void Commands::getValuesSetupSelective(unsigned int mask)
 {
     if (mTimeoutValuesSetup > 0) {
@@ -1823,6 +1858,33 @@ void Commands::detectAllFoc(bool detect_can, double max_power_loss, double min_c
     emitData(vb);
 }
 
+/**
+ * @brief Commands::detectAllFocCan
+ * Start FOC detection on a single VESC only, regardless of the CAN
+ * forwarding state. The result is reported through detectAllFocReceived,
+ * without the ID of the VESC it came from.
+ *
+ * @param canId
+ * CAN ID of the VESC, or -1 for the VESC that is connected directly.
+ */
+void Commands::detectAllFocCan(int canId, double max_power_loss, double min_current_in,
+                               double max_current_in, double openloop_rpm, double sl_erpm)
+{
+    if (mMaxPowerLossBug) {
+        max_power_loss /= 2.0;
+    }
+
+    VByteArray vb;
+    vb.vbAppendInt8(COMM_DETECT_APPLY_ALL_FOC);
+    vb.vbAppendInt8(false);
+    vb.vbAppendDouble32(max_power_loss, 1e3);
+    vb.vbAppendDouble32(min_current_in, 1e3);
+    vb.vbAppendDouble32(max_current_in, 1e3);
+    vb.vbAppendDouble32(openloop_rpm, 1e3);
+    vb.vbAppendDouble32(sl_erpm, 1e3);
+    emitDataTo(vb, canId);
+}
+
 void Commands::pingCan()
 {
     if (mTimeoutPingCan > 0) {
@@ -2333,34 +2395,64 @@ void Commands::focAnticoggingReadBackCalData(ANTICOGGING_BLOCK_TRANSMISSION_STAT
 
 void Commands::timerSlot()
 {
-    if (mTimeoutFwVer > 0) mTimeoutFwVer--;
-    if (mTimeoutMcconf > 0) {
-        mTimeoutMcconf--;
-        if (mTimeoutMcconf == 0) {
-            mCheckNextMcConfig = false;
+    // Returns true when the timeout runs out
+    auto tick = [this](int &timeout, int command) {
+        if (timeout > 0) {
+            timeout--;
+            if (timeout == 0) {
+                mLinkStats->recordTimeout(command);
+                return true;
+            }
         }
+        return false;
+    };
+
+    tick(mTimeoutFwVer, COMM_FW_VERSION);
+    if (tick(mTimeoutMcconf, COMM_GET_MCCONF)) {
+        mCheckNextMcConfig = false;
     }
-    if (mTimeoutAppconf > 0) mTimeoutAppconf--;
-    if (mTimeoutValues > 0) mTimeoutValues--;
-    if (mTimeoutValuesSetup > 0) mTimeoutValuesSetup--;
-    if (mTimeoutImuData > 0) mTimeoutImuData--;
-    if (mTimeoutDecPpm > 0) mTimeoutDecPpm--;
-    if (mTimeoutDecAdc > 0) mTimeoutDecAdc--;
-    if (mTimeoutDecChuk > 0) mTimeoutDecChuk--;
-    if (mTimeoutDecBalance > 0) mTimeoutDecBalance--;
-    if (mTimeoutPingCan > 0) {
-        mTimeoutPingCan--;
-        if (mTimeoutPingCan == 0) {
-            emit pingCanRx(QVector<int>(), true);
-            qWarning() << "CAN ping timed out";
+    tick(mTimeoutAppconf, COMM_GET_APPCONF);
+    tick(mTimeoutValues, COMM_GET_VALUES);
+    tick(mTimeoutValuesSetup, COMM_GET_VALUES_SETUP);
+    tick(mTimeoutImuData, COMM_GET_IMU_DATA);
+    tick(mTimeoutDecPpm, COMM_GET_DECODED_PPM);
+    tick(mTimeoutDecAdc, COMM_GET_DECODED_ADC);
+    tick(mTimeoutDecChuk, COMM_GET_DECODED_CHUK);
+    tick(mTimeoutDecBalance, COMM_GET_DECODED_BALANCE);
+    if (tick(mTimeoutPingCan, COMM_PING_CAN)) {
+        emit pingCanRx(QVector<int>(), true);
+        qWarning() << "CAN ping timed out";
+    }
+    tick(mTimeoutCustomConf, COMM_GET_CUSTOM_CONFIG);
+    tick(mTimeoutBmsVal, COMM_BMS_GET_VALUES);
+    tick(mTimeoutStats, COMM_GET_STATS);
+
+    for (int i = 0;i < mRequests.size();i++) {
+        CommandReply *reply = mRequests.at(i);
+
+        if (!reply || reply->isFinished()) {
+            mRequests.removeAt(i--);
+            continue;
+        }
+
+        if (reply->isTimedOut()) {
+            mLinkStats->recordTimeout(reply->mCommand);
+            if (reply->mTriesLeft > 0) {
+                mLinkStats->recordRetry(reply->mCommand);
+                reply->send();
+            } else {
+                reply->finish(CommandReply::REPLY_TIMEOUT);
+            }
         }
     }
-    if (mTimeoutCustomConf > 0) mTimeoutCustomConf--;
-    if (mTimeoutBmsVal > 0) mTimeoutBmsVal--;
-    if (mTimeoutStats > 0) mTimeoutStats--;
 }
 
 void Commands::emitData(QByteArray data)
+{
+    emitDataTo(data, mSendCan ? mCanId : -1);
+}
+
+void Commands::emitDataTo(QByteArray data, int canId)
 {
     // Only allow firmware commands in limited mode
     if (mIsLimitedMode && data.at(0) > COMM_WRITE_NEW_APP_DATA) {
@@ -2379,14 +2471,22 @@ void Commands::emitData(QByteArray data)
         }
     }
 
-    if (mSendCan) {
-        data.prepend((char)mCanId);
+    int command = quint8(data.at(0));
+
+    if (canId >= 0) {
+        data.prepend((char)canId);
         data.prepend((char)COMM_FORWARD_CAN);
     }
 
+    mLinkStats->recordTx(command, data.size(), canId >= 0);
     emit dataToSend(data);
 }
 
+LinkStats *Commands::linkStats() const
+{
+    return mLinkStats;
+}
+
 double Commands::getFileSpeed() const
 {
     return mFileSpeed;
@@ -2407,61 +2507,177 @@ void Commands::setMaxPowerLossBug(bool maxPowerLossBug)
     mMaxPowerLossBug = maxPowerLossBug;
 }
 
-QVariantList Commands::fileBlockList(QString path)
+/**
+ * @brief Commands::request
+ * Send a request and get a reply handle for it. Many requests can be in
+ * flight at the same time, as every packet is given to the oldest pending
+ * request with the same command ID that matches it.
+ *
+ * @param replyCommand
+ * The command ID of the reply.
+ *
+ * @param send
+ * Sends the request, called again on every retry.
+ *
+ * @param match
+ * Tells if a reply, without its command ID, belongs to this request, e.g.
+ * by comparing the offset in it. Leave empty to take any reply with the
+ * command ID.
+ *
+ * @param timeoutMs
+ * Time to wait for a reply before sending again.
+ *
+ * @param tries
+ * How many times to send the request before giving up.
+ *
+ * @return
+ * The reply, owned by the caller.
+ */
+CommandReply *Commands::request(int replyCommand, std::function<void ()> send,
+                                std::function<bool (VByteArray)> match,
+                                int timeoutMs, int tries)
 {
-    mFileShouldCancel = false;
-
-    auto waitRes = [this](QList<FILE_LIST_ENTRY> &filesNow) {
-        bool res = false;
-        bool more = false;
-
-        QEventLoop loop;
-        QTimer timeoutTimer;
-        timeoutTimer.setSingleShot(true);
-        timeoutTimer.start(1500);
-        auto conn = connect(this, &Commands::fileListRx,
-                            [&res,&loop,&filesNow,&more](bool hasMore, QList<FILE_LIST_ENTRY> files) {
-            filesNow.append(files);
-            res = true;
-            more = hasMore;
-            loop.quit();
-        });
-
-        connect(&timeoutTimer, SIGNAL(timeout()), &loop, SLOT(quit()));
-        loop.exec();
-
-        disconnect(conn);
-        return qMakePair(res, more);
-    };
+    CommandReply *reply = new CommandReply(replyCommand, send, match, timeoutMs, tries, this);
+    mRequests.append(reply);
+    reply->send();
+    return reply;
+}
 
-    auto waitResRetry = [waitRes,path,this](QList<FILE_LIST_ENTRY> &filesNow) {
-        QString from = "";
-        if (!filesNow.isEmpty()) {
-            from = filesNow.last().name;
-        }
+CommandReply *Commands::fileListRequest(QString path, QString from, int tries)
+{
+    return request(COMM_FILE_LIST, [this, path, from]() {
         fileList(path, from);
-        auto res = waitRes(filesNow);
-        int retries = 3;
-        while (!res.first && retries > 0) {
-            fileList(path, from);
-            res = waitRes(filesNow);
-            retries--;
+    }, nullptr, 1500, tries);
+}
+
+CommandReply *Commands::fileReadRequest(QString path, qint32 offset, int tries)
+{
+    return request(COMM_FILE_READ, [this, path, offset]() {
+        fileRead(path, offset);
+    }, [offset](VByteArray vb) {
+        return vb.vbPopFrontInt32() == offset;
+    }, 1500, tries);
+}
+
+CommandReply *Commands::fileWriteRequest(QString path, qint32 offset, qint32 size, QByteArray data, int tries)
+{
+    return request(COMM_FILE_WRITE, [this, path, offset, size, data]() {
+        fileWrite(path, offset, size, data);
+    }, [offset](VByteArray vb) {
+        return vb.vbPopFrontInt32() == offset;
+    }, 1500, tries);
+}
+
+CommandReply *Commands::fileMkdirRequest(QString path, int tries)
+{
+    return request(COMM_FILE_MKDIR, [this, path]() {
+        fileMkdir(path);
+    }, nullptr, 1500, tries);
+}
+
+CommandReply *Commands::fileRemoveRequest(QString path, int tries)
+{
+    return request(COMM_FILE_REMOVE, [this, path]() {
+        fileRemove(path);
+    }, nullptr, 1500, tries);
+}
+
+CommandReply *Commands::bmReadMemRequest(uint32_t addr, quint16 size, int timeoutMs, int tries)
+{
+    return request(COMM_BM_MEM_READ, [this, addr, size]() {
+        bmReadMem(addr, size);
+    }, nullptr, timeoutMs, tries);
+}
+
+CommandReply *Commands::bmWriteFlashRequest(uint32_t addr, QByteArray data, int timeoutMs, int tries)
+{
+    return request(COMM_BM_WRITE_FLASH, [this, addr, data]() {
+        bmWriteFlash(addr, data);
+    }, nullptr, timeoutMs, tries);
+}
+
+CommandReply *Commands::lispEraseCodeRequest(int size, int timeoutMs)
+{
+    return request(COMM_LISP_ERASE_CODE, [this, size]() {
+        lispEraseCode(size);
+    }, nullptr, timeoutMs, 1);
+}
+
+CommandReply *Commands::lispWriteCodeRequest(QByteArray data, quint32 offset, int timeoutMs, int tries)
+{
+    return request(COMM_LISP_WRITE_CODE, [this, data, offset]() {
+        lispWriteCode(data, offset);
+    }, [offset](VByteArray vb) {
+        vb.vbPopFrontInt8();
+        return vb.vbPopFrontUint32() == offset;
+    }, timeoutMs, tries);
+}
+
+CommandReply *Commands::focAnticoggingDownloadCalDataRequest(ANTICOGGING_BLOCK_TRANSMISSION_STATE state, uint32_t offset,
+                                                             QByteArray payload, int timeoutMs, int tries)
+{
+    return request(COMM_WRITE_ANTICOGGING, [this, state, offset, payload]() mutable {
+        focAnticoggingDownloadCalData(state, offset, std::ranges::subrange<char*>(payload.begin(), payload.end()));
+    }, [](VByteArray vb) {
+        return vb.vbPopFrontUint8() == AC_BLOCK_ACK;
+    }, timeoutMs, tries);
+}
+
+CommandReply *Commands::focAnticoggingReadBackCalDataRequest(ANTICOGGING_BLOCK_TRANSMISSION_STATE state, uint32_t offset,
+                                                             uint32_t len, int timeoutMs, int tries)
+{
+    // The reply carries the block state, but not the offset
+    return request(COMM_READ_ANTICOGGING, [this, state, offset, len]() {
+        focAnticoggingReadBackCalData(state, offset, len);
+    }, [state](VByteArray vb) {
+        return vb.vbPopFrontUint8() == state;
+    }, timeoutMs, tries);
+}
+
+/**
+ * @brief Commands::cancelRequests
+ * Cancel all pending requests, e.g. when the connection is lost.
+ */
+void Commands::cancelRequests()
+{
+    auto requests = mRequests;
+    mRequests.clear();
+
+    for (auto reply: requests) {
+        if (reply) {
+            reply->cancel();
         }
-        return res;
-    };
+    }
+}
+
+QVariantList Commands::fileBlockList(QString path)
+{
+    mFileShouldCancel = false;
 
     QList<FILE_LIST_ENTRY> files;
-    auto res = waitResRetry(files);
+    bool ok = false;
+    bool more = true;
+
+    while (more) {
+        QString from = files.isEmpty() ? "" : files.last().name;
+        CommandReply *reply = fileListRequest(path, from);
+        ok = reply->waitForFinished();
+        VByteArray vb(reply->data());
+        reply->deleteLater();
+
+        if (!ok) {
+            break;
+        }
 
-    while (res.second) {
-        res = waitResRetry(files);
+        more = vb.vbPopFrontInt8();
+        files.append(fileListFromReply(vb));
 
         if (mFileShouldCancel) {
             break;
         }
     }
 
-    if (!res.first) {
+    if (!ok) {
         qWarning() << "Could not list files";
     }
 
@@ -2482,63 +2698,88 @@ QByteArray Commands::fileBlockRead(QString path)
 {
     mFileShouldCancel = false;
 
-    auto waitRes = [this](QByteArray &dataNow, qint32 offsetNow) {
-        qint32 sizeRet = -1.0;
-
-        QEventLoop loop;
-        QTimer timeoutTimer;
-        timeoutTimer.setSingleShot(true);
-        timeoutTimer.start(1500);
-        auto conn = connect(this, &Commands::fileReadRx,
-                            [&sizeRet,&loop,&dataNow,&offsetNow]
-                            (qint32 offset, qint32 size, QByteArray data) {
-            if (offset == offsetNow) {
-                sizeRet = size;
-                dataNow.append(data);
-            } else {
-                qWarning() << "Wrong offset";
-            }
-            loop.quit();
-        });
+    // Reads that are in flight at the same time
+    const int window = 4;
 
-        connect(&timeoutTimer, SIGNAL(timeout()), &loop, SLOT(quit()));
-        loop.exec();
+    QElapsedTimer t;
+    t.start();
 
-        disconnect(conn);
-        return sizeRet;
-    };
+    // The first reply gives the file size and the chunk size
+    CommandReply *reply = fileReadRequest(path, 0);
+    bool ok = reply->waitForFinished();
+    VByteArray vb(reply->data());
+    reply->deleteLater();
+
+    if (!ok) {
+        qWarning() << "Could not read file";
+        return QByteArray();
+    }
 
-    auto waitResRetry = [waitRes,path,this](QByteArray &dataNow, qint32 offsetNow) {
-        fileRead(path, offsetNow);
-        auto res = waitRes(dataNow, offsetNow);
-        int retries = 3;
-        while (res < 0 && retries > 0) {
-            fileRead(path, offsetNow);
-            res = waitRes(dataNow, offsetNow);
-            retries--;
+    vb.vbPopFrontInt32();
+    qint32 size = vb.vbPopFrontInt32();
+    QByteArray data = vb;
+    int chunkSize = data.size();
+
+    QMap<qint32, CommandReply*> pending;
+    auto cancelPending = [&pending]() {
+        for (auto r: pending) {
+            r->cancel();
+            r->deleteLater();
         }
-        return res;
+        pending.clear();
     };
 
-    QElapsedTimer t;
-    t.start();
+    qint32 next = data.size();
+    while (data.size() < size) {
+        mFilePercentage = (double(data.size()) / double(size)) * 100.0;
+        mFileSpeed = (double(data.size()) / double(t.elapsed())) * 1000.0;
+        emit fileProgress(data.size(), size, mFilePercentage, mFileSpeed);
 
-    QByteArray data;
-    auto res = waitResRetry(data, 0);
+        while (chunkSize > 0 && pending.size() < window && next < size) {
+            pending.insert(next, fileReadRequest(path, next));
+            next += chunkSize;
+        }
 
-    while (res >= 0 && data.size() < res) {
-        mFilePercentage = (double(data.size()) / double(res)) * 100.0;
-        mFileSpeed = (double(data.size()) / double(t.elapsed())) * 1000.0;
-        emit fileProgress(data.size(), res, mFilePercentage, mFileSpeed);
-        res = waitResRetry(data, data.size());
+        if (pending.isEmpty()) {
+            break;
+        }
+
+        // Replies are used in order, as the data is appended
+        qint32 offset = pending.firstKey();
+        reply = pending.take(offset);
+        ok = reply->waitForFinished();
+        vb = VByteArray(reply->data());
+        reply->deleteLater();
 
         if (mFileShouldCancel) {
+            cancelPending();
             return QByteArray();
+        }
+
+        if (!ok || offset != data.size()) {
             break;
         }
+
+        vb.vbPopFrontInt32();
+        vb.vbPopFrontInt32();
+
+        if (vb.isEmpty()) {
+            break;
+        }
+
+        data.append(vb);
+
+        // A short chunk moves the offsets of the reads in flight
+        if (vb.size() != chunkSize && data.size() < size) {
+            cancelPending();
+            chunkSize = vb.size();
+            next = data.size();
+        }
     }
 
-    if (res < 0) {
+    cancelPending();
+
+    if (data.size() < size) {
         qWarning() << "Could not read file";
         return QByteArray();
     }
@@ -2550,36 +2791,17 @@ bool Commands::fileBlockWrite(QString path, QByteArray data)
 {
     mFileShouldCancel = false;
 
-    auto waitRes = [this]() {
+    // Rejected writes are retried as well
+    auto writeRetry = [path,this](qint32 offsetNow, qint32 size, QByteArray dataNow) {
         bool res = false;
-
-        QEventLoop loop;
-        QTimer timeoutTimer;
-        timeoutTimer.setSingleShot(true);
-        timeoutTimer.start(1500);
-        auto conn = connect(this, &Commands::fileWriteRx,
-                            [&res,&loop]
-                            (qint32 offset, bool ok) {
-            (void)offset;
-            res = ok;
-            loop.quit();
-        });
-
-        connect(&timeoutTimer, SIGNAL(timeout()), &loop, SLOT(quit()));
-        loop.exec();
-        disconnect(conn);
-
-        return res;
-    };
-
-    auto waitResRetry = [waitRes,path,this](qint32 offsetNow, qint32 size, QByteArray dataNow) {
-        fileWrite(path, offsetNow, size, dataNow);
-        auto res = waitRes();
-        int retries = 3;
-        while (!res && retries > 0) {
-            fileWrite(path, offsetNow, size, dataNow);
-            res = waitRes();
-            retries--;
+        for (int i = 0;i < 4 && !res;i++) {
+            CommandReply *reply = fileWriteRequest(path, offsetNow, size, dataNow, 1);
+            if (reply->waitForFinished()) {
+                VByteArray vb(reply->data());
+                vb.vbPopFrontInt32();
+                res = vb.vbPopFrontInt8();
+            }
+            reply->deleteLater();
         }
         return res;
     };
@@ -2592,7 +2814,7 @@ bool Commands::fileBlockWrite(QString path, QByteArray data)
     t.start();
 
     qint32 offset = 0;
-    auto res = waitResRetry(offset, size, data.mid(0, sz));
+    auto res = writeRetry(offset, size, data.mid(0, sz));
     offset += sz;
     data.remove(0, sz);
 
@@ -2602,7 +2824,7 @@ bool Commands::fileBlockWrite(QString path, QByteArray data)
         emit fileProgress(size - data.size(), size, mFilePercentage, mFileSpeed);
 
         sz = data.size() > chunkSize ? chunkSize : data.size();
-        res = waitResRetry(offset, size, data.mid(0, sz));
+        res = writeRetry(offset, size, data.mid(0, sz));
         offset += sz;
         data.remove(0, sz);
 
@@ -2618,78 +2840,28 @@ bool Commands::fileBlockMkdir(QString path)
 {
     mFileShouldCancel = false;
 
-    auto waitRes = [this]() {
-        bool res = false;
-
-        QEventLoop loop;
-        QTimer timeoutTimer;
-        timeoutTimer.setSingleShot(true);
-        timeoutTimer.start(1500);
-        auto conn = connect(this, &Commands::fileMkdirRx,
-                            [&res,&loop](bool ok) {
-            res = ok;
-            loop.quit();
-        });
-
-        connect(&timeoutTimer, SIGNAL(timeout()), &loop, SLOT(quit()));
-        loop.exec();
-        disconnect(conn);
-
-        return res;
-    };
-
-    auto waitResRetry = [waitRes,path,this]() {
-        fileMkdir(path);
-        auto res = waitRes();
-        int retries = 3;
-        while (!res && retries > 0) {
-            fileMkdir(path);
-            res = waitRes();
-            retries--;
-        }
-        return res;
-    };
+    bool res = false;
+    for (int i = 0;i < 4 && !res;i++) {
+        CommandReply *reply = fileMkdirRequest(path, 1);
+        res = reply->waitForFinished() && !reply->data().isEmpty() && reply->data().at(0);
+        reply->deleteLater();
+    }
 
-    return waitResRetry();
+    return res;
 }
 
 bool Commands::fileBlockRemove(QString path)
 {
     mFileShouldCancel = false;
 
-    auto waitRes = [this]() {
-        bool res = false;
-
-        QEventLoop loop;
-        QTimer timeoutTimer;
-        timeoutTimer.setSingleShot(true);
-        timeoutTimer.start(1500);
-        auto conn = connect(this, &Commands::fileRemoveRx,
-                            [&res,&loop](bool ok) {
-            res = ok;
-            loop.quit();
-        });
-
-        connect(&timeoutTimer, SIGNAL(timeout()), &loop, SLOT(quit()));
-        loop.exec();
-        disconnect(conn);
-
-        return res;
-    };
-
-    auto waitResRetry = [waitRes,path,this]() {
-        fileRemove(path);
-        auto res = waitRes();
-        int retries = 3;
-        while (!res && retries > 0) {
-            fileRemove(path);
-            res = waitRes();
-            retries--;
-        }
-        return res;
-    };
+    bool res = false;
+    for (int i = 0;i < 4 && !res;i++) {
+        CommandReply *reply = fileRemoveRequest(path, 1);
+        res = reply->waitForFinished() && !reply->data().isEmpty() && reply->data().at(0);
+        reply->deleteLater();
+    }
 
-    return waitResRetry();
+    return res;
 }
 
 void Commands::fileBlockCancel()
@@ -2767,50 +2939,193 @@ QString Commands::faultToStr(mc_fault_code fault)
     return "Unknown fault";
 }
 
-QByteArray Commands::bmReadMemWait(uint32_t addr, quint16 size, int timeoutMs)
-{
-    bmReadMem(addr, size);
-
-    int res = -10;
-    QByteArray resData;
-
-    QEventLoop loop;
-    QTimer timeoutTimer;
-    timeoutTimer.setSingleShot(true);
-    timeoutTimer.start(timeoutMs);
-    auto conn = connect(this, &Commands::bmReadMemRes, [&res,&resData,&loop]
-                        (int rdRes, QByteArray data) {
-        res = rdRes;
-        resData = data;
-        loop.quit();
-    });
+/**
+ * @brief Commands::commandToStr
+ * Name of a COMM_PACKET_ID, e.g. for the link statistics.
+ */
+QString Commands::commandToStr(int command)
+{
+    switch (COMM_PACKET_ID(command)) {
+    case COMM_FW_VERSION: return "COMM_FW_VERSION";
+    case COMM_JUMP_TO_BOOTLOADER: return "COMM_JUMP_TO_BOOTLOADER";
+    case COMM_ERASE_NEW_APP: return "COMM_ERASE_NEW_APP";
+    case COMM_WRITE_NEW_APP_DATA: return "COMM_WRITE_NEW_APP_DATA";
+    case COMM_GET_VALUES: return "COMM_GET_VALUES";
+    case COMM_SET_DUTY: return "COMM_SET_DUTY";
+    case COMM_SET_CURRENT: return "COMM_SET_CURRENT";
+    case COMM_SET_CURRENT_BRAKE: return "COMM_SET_CURRENT_BRAKE";
+    case COMM_SET_RPM: return "COMM_SET_RPM";
+    case COMM_SET_POS: return "COMM_SET_POS";
+    case COMM_SET_HANDBRAKE: return "COMM_SET_HANDBRAKE";
+    case COMM_SET_DETECT: return "COMM_SET_DETECT";
+    case COMM_SET_SERVO_POS: return "COMM_SET_SERVO_POS";
+    case COMM_SET_MCCONF: return "COMM_SET_MCCONF";
+    case COMM_GET_MCCONF: return "COMM_GET_MCCONF";
+    case COMM_GET_MCCONF_DEFAULT: return "COMM_GET_MCCONF_DEFAULT";
+    case COMM_SET_APPCONF: return "COMM_SET_APPCONF";
+    case COMM_GET_APPCONF: return "COMM_GET_APPCONF";
+    case COMM_GET_APPCONF_DEFAULT: return "COMM_GET_APPCONF_DEFAULT";
+    case COMM_SAMPLE_PRINT: return "COMM_SAMPLE_PRINT";
+    case COMM_TERMINAL_CMD: return "COMM_TERMINAL_CMD";
+    case COMM_PRINT: return "COMM_PRINT";
+    case COMM_ROTOR_POSITION: return "COMM_ROTOR_POSITION";
+    case COMM_EXPERIMENT_SAMPLE: return "COMM_EXPERIMENT_SAMPLE";
+    case COMM_DETECT_MOTOR_PARAM: return "COMM_DETECT_MOTOR_PARAM";
+    case COMM_DETECT_MOTOR_R_L: return "COMM_DETECT_MOTOR_R_L";
+    case COMM_DETECT_MOTOR_FLUX_LINKAGE: return "COMM_DETECT_MOTOR_FLUX_LINKAGE";
+    case COMM_DETECT_ENCODER: return "COMM_DETECT_ENCODER";
+    case COMM_DETECT_HALL_FOC: return "COMM_DETECT_HALL_FOC";
+    case COMM_REBOOT: return "COMM_REBOOT";
+    case COMM_ALIVE: return "COMM_ALIVE";
+    case COMM_GET_DECODED_PPM: return "COMM_GET_DECODED_PPM";
+    case COMM_GET_DECODED_ADC: return "COMM_GET_DECODED_ADC";
+    case COMM_GET_DECODED_CHUK: return "COMM_GET_DECODED_CHUK";
+    case COMM_FORWARD_CAN: return "COMM_FORWARD_CAN";
+    case COMM_SET_CHUCK_DATA: return "COMM_SET_CHUCK_DATA";
+    case COMM_CUSTOM_APP_DATA: return "COMM_CUSTOM_APP_DATA";
+    case COMM_NRF_START_PAIRING: return "COMM_NRF_START_PAIRING";
+    case COMM_GPD_SET_FSW: return "COMM_GPD_SET_FSW";
+    case COMM_GPD_BUFFER_NOTIFY: return "COMM_GPD_BUFFER_NOTIFY";
+    case COMM_GPD_BUFFER_SIZE_LEFT: return "COMM_GPD_BUFFER_SIZE_LEFT";
+    case COMM_GPD_FILL_BUFFER: return "COMM_GPD_FILL_BUFFER";
+    case COMM_GPD_OUTPUT_SAMPLE: return "COMM_GPD_OUTPUT_SAMPLE";
+    case COMM_GPD_SET_MODE: return "COMM_GPD_SET_MODE";
+    case COMM_GPD_FILL_BUFFER_INT8: return "COMM_GPD_FILL_BUFFER_INT8";
+    case COMM_GPD_FILL_BUFFER_INT16: return "COMM_GPD_FILL_BUFFER_INT16";
+    case COMM_GPD_SET_BUFFER_INT_SCALE: return "COMM_GPD_SET_BUFFER_INT_SCALE";
+    case COMM_GET_VALUES_SETUP: return "COMM_GET_VALUES_SETUP";
+    case COMM_SET_MCCONF_TEMP: return "COMM_SET_MCCONF_TEMP";
+    case COMM_SET_MCCONF_TEMP_SETUP: return "COMM_SET_MCCONF_TEMP_SETUP";
+    case COMM_GET_VALUES_SELECTIVE: return "COMM_GET_VALUES_SELECTIVE";
+    case COMM_GET_VALUES_SETUP_SELECTIVE: return "COMM_GET_VALUES_SETUP_SELECTIVE";
+    case COMM_EXT_NRF_PRESENT: return "COMM_EXT_NRF_PRESENT";
+    case COMM_EXT_NRF_ESB_SET_CH_ADDR: return "COMM_EXT_NRF_ESB_SET_CH_ADDR";
+    case COMM_EXT_NRF_ESB_SEND_DATA: return "COMM_EXT_NRF_ESB_SEND_DATA";
+    case COMM_EXT_NRF_ESB_RX_DATA: return "COMM_EXT_NRF_ESB_RX_DATA";
+    case COMM_EXT_NRF_SET_ENABLED: return "COMM_EXT_NRF_SET_ENABLED";
+    case COMM_DETECT_MOTOR_FLUX_LINKAGE_OPENLOOP: return "COMM_DETECT_MOTOR_FLUX_LINKAGE_OPENLOOP";
+    case COMM_DETECT_APPLY_ALL_FOC: return "COMM_DETECT_APPLY_ALL_FOC";
+    case COMM_JUMP_TO_BOOTLOADER_ALL_CAN: return "COMM_JUMP_TO_BOOTLOADER_ALL_CAN";
+    case COMM_ERASE_NEW_APP_ALL_CAN: return "COMM_ERASE_NEW_APP_ALL_CAN";
+    case COMM_WRITE_NEW_APP_DATA_ALL_CAN: return "COMM_WRITE_NEW_APP_DATA_ALL_CAN";
+    case COMM_PING_CAN: return "COMM_PING_CAN";
+    case COMM_APP_DISABLE_OUTPUT: return "COMM_APP_DISABLE_OUTPUT";
+    case COMM_TERMINAL_CMD_SYNC: return "COMM_TERMINAL_CMD_SYNC";
+    case COMM_GET_IMU_DATA: return "COMM_GET_IMU_DATA";
+    case COMM_BM_CONNECT: return "COMM_BM_CONNECT";
+    case COMM_BM_ERASE_FLASH_ALL: return "COMM_BM_ERASE_FLASH_ALL";
+    case COMM_BM_WRITE_FLASH: return "COMM_BM_WRITE_FLASH";
+    case COMM_BM_REBOOT: return "COMM_BM_REBOOT";
+    case COMM_BM_DISCONNECT: return "COMM_BM_DISCONNECT";
+    case COMM_BM_MAP_PINS_DEFAULT: return "COMM_BM_MAP_PINS_DEFAULT";
+    case COMM_BM_MAP_PINS_NRF5X: return "COMM_BM_MAP_PINS_NRF5X";
+    case COMM_ERASE_BOOTLOADER: return "COMM_ERASE_BOOTLOADER";
+    case COMM_ERASE_BOOTLOADER_ALL_CAN: return "COMM_ERASE_BOOTLOADER_ALL_CAN";
+    case COMM_PLOT_INIT: return "COMM_PLOT_INIT";
+    case COMM_PLOT_DATA: return "COMM_PLOT_DATA";
+    case COMM_PLOT_ADD_GRAPH: return "COMM_PLOT_ADD_GRAPH";
+    case COMM_PLOT_SET_GRAPH: return "COMM_PLOT_SET_GRAPH";
+    case COMM_GET_DECODED_BALANCE: return "COMM_GET_DECODED_BALANCE";
+    case COMM_BM_MEM_READ: return "COMM_BM_MEM_READ";
+    case COMM_WRITE_NEW_APP_DATA_LZO: return "COMM_WRITE_NEW_APP_DATA_LZO";
+    case COMM_WRITE_NEW_APP_DATA_ALL_CAN_LZO: return "COMM_WRITE_NEW_APP_DATA_ALL_CAN_LZO";
+    case COMM_BM_WRITE_FLASH_LZO: return "COMM_BM_WRITE_FLASH_LZO";
+    case COMM_SET_CURRENT_REL: return "COMM_SET_CURRENT_REL";
+    case COMM_CAN_FWD_FRAME: return "COMM_CAN_FWD_FRAME";
+    case COMM_SET_BATTERY_CUT: return "COMM_SET_BATTERY_CUT";
+    case COMM_SET_BLE_NAME: return "COMM_SET_BLE_NAME";
+    case COMM_SET_BLE_PIN: return "COMM_SET_BLE_PIN";
+    case COMM_SET_CAN_MODE: return "COMM_SET_CAN_MODE";
+    case COMM_GET_IMU_CALIBRATION: return "COMM_GET_IMU_CALIBRATION";
+    case COMM_GET_MCCONF_TEMP: return "COMM_GET_MCCONF_TEMP";
+    case COMM_GET_CUSTOM_CONFIG_XML: return "COMM_GET_CUSTOM_CONFIG_XML";
+    case COMM_GET_CUSTOM_CONFIG: return "COMM_GET_CUSTOM_CONFIG";
+    case COMM_GET_CUSTOM_CONFIG_DEFAULT: return "COMM_GET_CUSTOM_CONFIG_DEFAULT";
+    case COMM_SET_CUSTOM_CONFIG: return "COMM_SET_CUSTOM_CONFIG";
+    case COMM_BMS_GET_VALUES: return "COMM_BMS_GET_VALUES";
+    case COMM_BMS_SET_CHARGE_ALLOWED: return "COMM_BMS_SET_CHARGE_ALLOWED";
+    case COMM_BMS_SET_BALANCE_OVERRIDE: return "COMM_BMS_SET_BALANCE_OVERRIDE";
+    case COMM_BMS_RESET_COUNTERS: return "COMM_BMS_RESET_COUNTERS";
+    case COMM_BMS_FORCE_BALANCE: return "COMM_BMS_FORCE_BALANCE";
+    case COMM_BMS_ZERO_CURRENT_OFFSET: return "COMM_BMS_ZERO_CURRENT_OFFSET";
+    case COMM_JUMP_TO_BOOTLOADER_HW: return "COMM_JUMP_TO_BOOTLOADER_HW";
+    case COMM_ERASE_NEW_APP_HW: return "COMM_ERASE_NEW_APP_HW";
+    case COMM_WRITE_NEW_APP_DATA_HW: return "COMM_WRITE_NEW_APP_DATA_HW";
+    case COMM_ERASE_BOOTLOADER_HW: return "COMM_ERASE_BOOTLOADER_HW";
+    case COMM_JUMP_TO_BOOTLOADER_ALL_CAN_HW: return "COMM_JUMP_TO_BOOTLOADER_ALL_CAN_HW";
+    case COMM_ERASE_NEW_APP_ALL_CAN_HW: return "COMM_ERASE_NEW_APP_ALL_CAN_HW";
+    case COMM_WRITE_NEW_APP_DATA_ALL_CAN_HW: return "COMM_WRITE_NEW_APP_DATA_ALL_CAN_HW";
+    case COMM_ERASE_BOOTLOADER_ALL_CAN_HW: return "COMM_ERASE_BOOTLOADER_ALL_CAN_HW";
+    case COMM_SET_ODOMETER: return "COMM_SET_ODOMETER";
+    case COMM_PSW_GET_STATUS: return "COMM_PSW_GET_STATUS";
+    case COMM_PSW_SWITCH: return "COMM_PSW_SWITCH";
+    case COMM_BMS_FWD_CAN_RX: return "COMM_BMS_FWD_CAN_RX";
+    case COMM_BMS_HW_DATA: return "COMM_BMS_HW_DATA";
+    case COMM_GET_BATTERY_CUT: return "COMM_GET_BATTERY_CUT";
+    case COMM_BM_HALT_REQ: return "COMM_BM_HALT_REQ";
+    case COMM_GET_QML_UI_HW: return "COMM_GET_QML_UI_HW";
+    case COMM_GET_QML_UI_APP: return "COMM_GET_QML_UI_APP";
+    case COMM_CUSTOM_HW_DATA: return "COMM_CUSTOM_HW_DATA";
+    case COMM_QMLUI_ERASE: return "COMM_QMLUI_ERASE";
+    case COMM_QMLUI_WRITE: return "COMM_QMLUI_WRITE";
+    case COMM_IO_BOARD_GET_ALL: return "COMM_IO_BOARD_GET_ALL";
+    case COMM_IO_BOARD_SET_PWM: return "COMM_IO_BOARD_SET_PWM";
+    case COMM_IO_BOARD_SET_DIGITAL: return "COMM_IO_BOARD_SET_DIGITAL";
+    case COMM_BM_MEM_WRITE: return "COMM_BM_MEM_WRITE";
+    case COMM_BMS_BLNC_SELFTEST: return "COMM_BMS_BLNC_SELFTEST";
+    case COMM_GET_EXT_HUM_TMP: return "COMM_GET_EXT_HUM_TMP";
+    case COMM_GET_STATS: return "COMM_GET_STATS";
+    case COMM_RESET_STATS: return "COMM_RESET_STATS";
+    case COMM_LISP_READ_CODE: return "COMM_LISP_READ_CODE";
+    case COMM_LISP_WRITE_CODE: return "COMM_LISP_WRITE_CODE";
+    case COMM_LISP_ERASE_CODE: return "COMM_LISP_ERASE_CODE";
+    case COMM_LISP_SET_RUNNING: return "COMM_LISP_SET_RUNNING";
+    case COMM_LISP_GET_STATS: return "COMM_LISP_GET_STATS";
+    case COMM_LISP_PRINT: return "COMM_LISP_PRINT";
+    case COMM_BMS_SET_BATT_TYPE: return "COMM_BMS_SET_BATT_TYPE";
+    case COMM_BMS_GET_BATT_TYPE: return "COMM_BMS_GET_BATT_TYPE";
+    case COMM_LISP_REPL_CMD: return "COMM_LISP_REPL_CMD";
+    case COMM_LISP_STREAM_CODE: return "COMM_LISP_STREAM_CODE";
+    case COMM_FILE_LIST: return "COMM_FILE_LIST";
+    case COMM_FILE_READ: return "COMM_FILE_READ";
+    case COMM_FILE_WRITE: return "COMM_FILE_WRITE";
+    case COMM_FILE_MKDIR: return "COMM_FILE_MKDIR";
+    case COMM_FILE_REMOVE: return "COMM_FILE_REMOVE";
+    case COMM_LOG_START: return "COMM_LOG_START";
+    case COMM_LOG_STOP: return "COMM_LOG_STOP";
+    case COMM_LOG_CONFIG_FIELD: return "COMM_LOG_CONFIG_FIELD";
+    case COMM_LOG_DATA_F32: return "COMM_LOG_DATA_F32";
+    case COMM_SET_APPCONF_NO_STORE: return "COMM_SET_APPCONF_NO_STORE";
+    case COMM_GET_GNSS: return "COMM_GET_GNSS";
+    case COMM_LOG_DATA_F64: return "COMM_LOG_DATA_F64";
+    case COMM_DETECT_ANTICOGGING: return "COMM_DETECT_ANTICOGGING";
+    case COMM_WRITE_ANTICOGGING: return "COMM_WRITE_ANTICOGGING";
+    case COMM_READ_ANTICOGGING: return "COMM_READ_ANTICOGGING";
+    }
 
-    connect(&timeoutTimer, SIGNAL(timeout()), &loop, SLOT(quit()));
-    loop.exec();
+    return QString("COMM_%1").arg(command);
+}
 
-    disconnect(conn);
-    return resData;
+QByteArray Commands::bmReadMemWait(uint32_t addr, quint16 size, int timeoutMs)
+{
+    CommandReply *reply = bmReadMemRequest(addr, size, timeoutMs);
+    VByteArray vb;
+    if (reply->waitForFinished()) {
+        vb = VByteArray(reply->data());
+        vb.vbPopFrontInt16();
+    }
+    reply->deleteLater();
+    return vb;
 }
 
 int Commands::bmWriteMemWait(uint32_t addr, QByteArray data, int timeoutMs)
 {
-    bmWriteFlash(addr, data);
-
+    CommandReply *reply = bmWriteFlashRequest(addr, data, timeoutMs);
     int res = -10;
-
-    QEventLoop loop;
-    QTimer timeoutTimer;
-    timeoutTimer.setSingleShot(true);
-    timeoutTimer.start(timeoutMs);
-    auto conn = connect(this, &Commands::bmWriteFlashRes, [&res,&loop](int wrRes) {
-        res = wrRes;
-        loop.quit();
-    });
-
-    connect(&timeoutTimer, SIGNAL(timeout()), &loop, SLOT(quit()));
-    loop.exec();
-
-    disconnect(conn);
+    if (reply->waitForFinished()) {
+        res = VByteArray(reply->data()).vbPopFrontInt16();
+    }
+    reply->deleteLater();
     return res;
 }
 
@@ -2896,3 +3211,40 @@ void Commands::emitEmptyStats()
 
     emit statsRx(stat, 0xFFFFFFFF);
 }
+
+/**
+ * @brief Commands::dispatchReply
+ * Finish the oldest pending request that the packet is a reply to. The
+ * packet is processed as usual afterwards, so the signals for it are still
+ * emitted.
+ */
+void Commands::dispatchReply(int id, const VByteArray &vb)
+{
+    for (int i = 0;i < mRequests.size();i++) {
+        CommandReply *reply = mRequests.at(i);
+
+        if (!reply || reply->isFinished()) {
+            mRequests.removeAt(i--);
+            continue;
+        }
+
+        if (reply->mCommand == id && (!reply->mMatch || reply->mMatch(vb))) {
+            mRequests.removeAt(i);
+            reply->finish(CommandReply::REPLY_OK, vb);
+            return;
+        }
+    }
+}
+
+QList<FILE_LIST_ENTRY> Commands::fileListFromReply(VByteArray &vb)
+{
+    QList<FILE_LIST_ENTRY> files;
+    while (vb.size() > 0) {
+        FILE_LIST_ENTRY f;
+        f.isDir = vb.vbPopFrontInt8();
+        f.size = vb.vbPopFrontInt32();
+        f.name = vb.vbPopFrontString();
+        files.append(f);
+    }
+    return files;
+}
@@ -25,9 +25,13 @@
 #include <QMap>
 #include <QVariant>
 #include <QVariantList>
+#include <QPointer>
+#include <functional>
 
 #include "datatypes.h"
 #include "configparams.h"
+#include "commandreply.h"
+#include "linkstats.h"
 
 class Commands : public QObject
 {
@@ -58,6 +62,7 @@ public:
     void setLimitedCompatibilityCommands(QVector<int> compatibilityCommands);
 
     Q_INVOKABLE static QString faultToStr(mc_fault_code fault);
+    Q_INVOKABLE static QString commandToStr(int command);
 
     Q_INVOKABLE QByteArray bmReadMemWait(uint32_t addr, quint16 size, int timeoutMs = 3000);
     Q_INVOKABLE int bmWriteMemWait(uint32_t addr, QByteArray data, int timeoutMs = 3000);
@@ -86,6 +91,26 @@ public:
     Q_INVOKABLE double getFilePercentage() const;
     Q_INVOKABLE double getFileSpeed() const;
 
+    CommandReply *request(int replyCommand, std::function<void()> send,
+                          std::function<bool(VByteArray)> match = nullptr,
+                          int timeoutMs = 1500, int tries = 4);
+    CommandReply *fileListRequest(QString path, QString from, int tries = 4);
+    CommandReply *fileReadRequest(QString path, qint32 offset, int tries = 4);
+    CommandReply *fileWriteRequest(QString path, qint32 offset, qint32 size, QByteArray data, int tries = 4);
+    CommandReply *fileMkdirRequest(QString path, int tries = 4);
+    CommandReply *fileRemoveRequest(QString path, int tries = 4);
+    CommandReply *bmReadMemRequest(uint32_t addr, quint16 size, int timeoutMs = 3000, int tries = 1);
+    CommandReply *bmWriteFlashRequest(uint32_t addr, QByteArray data, int timeoutMs = 3000, int tries = 1);
+    CommandReply *lispEraseCodeRequest(int size, int timeoutMs = 8000);
+    CommandReply *lispWriteCodeRequest(QByteArray data, quint32 offset, int timeoutMs = 1000, int tries = 5);
+    CommandReply *focAnticoggingDownloadCalDataRequest(ANTICOGGING_BLOCK_TRANSMISSION_STATE state, uint32_t offset,
+                                                       QByteArray payload, int timeoutMs = 3000, int tries = 1);
+    CommandReply *focAnticoggingReadBackCalDataRequest(ANTICOGGING_BLOCK_TRANSMISSION_STATE state, uint32_t offset,
+                                                       uint32_t len, int timeoutMs = 3000, int tries = 1);
+    Q_INVOKABLE void cancelRequests();
+
+    Q_INVOKABLE LinkStats *linkStats() const;
+
 signals:
     void dataToSend(QByteArray &data);
 
@@ -223,11 +248,14 @@ public slots:
     void setMcconfTemp(const MCCONF_TEMP &conf, bool is_setup, bool store,
                        bool forward_can, bool divide_by_controllers, bool ack);
     void getValuesSelective(unsigned int mask);
+    void getValuesSelectiveAll(QVector<int> canIds, unsigned int mask, bool includeLocal = true);
     void getValuesSetupSelective(unsigned int mask);
     void measureLinkageOpenloop(double current, double erpm_per_sec, double low_duty,
                                 double resistance, double inductance);
     void detectAllFoc(bool detect_can, double max_power_loss, double min_current_in,
                       double max_current_in, double openloop_rpm, double sl_erpm);
+    void detectAllFocCan(int canId, double max_power_loss, double min_current_in,
+                         double max_current_in, double openloop_rpm, double sl_erpm);
     void pingCan();
     void disableAppOutput(int time_ms, bool fwdCan);
     void getImuData(unsigned int mask);
@@ -299,6 +327,7 @@ private slots:
 
 private:
     void emitData(QByteArray data);
+    void emitDataTo(QByteArray data, int canId);
 
     QTimer *mTimer;
     bool mSendCan;
@@ -335,6 +364,12 @@ private:
     double mFileSpeed;
     bool mFileShouldCancel;
 
+    QList<QPointer<CommandReply>> mRequests;
+    LinkStats *mLinkStats;
+
+    void dispatchReply(int id, const VByteArray &vb);
+    static QList<FILE_LIST_ENTRY> fileListFromReply(VByteArray &vb);
+
 };
 
 #endif // COMMANDS_H
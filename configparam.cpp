@@ -18,6 +18,7 @@
     */
 
 #include "configparam.h"
+#include <QHash>
 
 ConfigParam::ConfigParam()
 {
@@ -95,3 +96,68 @@ void ConfigParam::setBool(bool val)
     type = CFG_T_BOOL;
     valInt = val;
 }
+
+ConfigParam::Field ConfigParam::fieldFromName(const QString &name)
+{
+    static const QHash<QString, Field> fields = {
+        {"description", FIELD_DESCRIPTION},
+        {"cDefine", FIELD_CDEFINE},
+        {"editorDecimalsDouble", FIELD_EDITOR_DECIMALS_DOUBLE},
+        {"editorScale", FIELD_EDITOR_SCALE},
+        {"editAsPercentage", FIELD_EDIT_AS_PERCENTAGE},
+        {"enumNames", FIELD_ENUM_NAMES},
+        {"longName", FIELD_LONG_NAME},
+        {"maxDouble", FIELD_MAX_DOUBLE},
+        {"maxInt", FIELD_MAX_INT},
+        {"minDouble", FIELD_MIN_DOUBLE},
+        {"minInt", FIELD_MIN_INT},
+        {"showDisplay", FIELD_SHOW_DISPLAY},
+        {"stepDouble", FIELD_STEP_DOUBLE},
+        {"stepInt", FIELD_STEP_INT},
+        {"maxLen", FIELD_MAX_LEN},
+        {"suffix", FIELD_SUFFIX},
+        {"type", FIELD_TYPE},
+        {"transmittable", FIELD_TRANSMITTABLE},
+        {"valDouble", FIELD_VAL_DOUBLE},
+        {"valInt", FIELD_VAL_INT},
+        {"valString", FIELD_VAL_STRING},
+        {"vTx", FIELD_VTX},
+        {"vTxDoubleScale", FIELD_VTX_DOUBLE_SCALE}
+    };
+
+    return fields.value(name, FIELD_UNKNOWN);
+}
+
+/**
+ * @brief ConfigParam::setField
+ * Set a field from its text in the parameter XML. Enum names are appended.
+ */
+void ConfigParam::setField(Field field, const QString &value)
+{
+    switch (field) {
+    case FIELD_DESCRIPTION: description = value; break;
+    case FIELD_CDEFINE: cDefine = value; break;
+    case FIELD_EDITOR_DECIMALS_DOUBLE: editorDecimalsDouble = value.toInt(); break;
+    case FIELD_EDITOR_SCALE: editorScale = value.toDouble(); break;
+    case FIELD_EDIT_AS_PERCENTAGE: editAsPercentage = value.toInt(); break;
+    case FIELD_ENUM_NAMES: enumNames.append(value); break;
+    case FIELD_LONG_NAME: longName = value; break;
+    case FIELD_MAX_DOUBLE: maxDouble = value.toDouble(); break;
+    case FIELD_MAX_INT: maxInt = value.toInt(); break;
+    case FIELD_MIN_DOUBLE: minDouble = value.toDouble(); break;
+    case FIELD_MIN_INT: minInt = value.toInt(); break;
+    case FIELD_SHOW_DISPLAY: showDisplay = value.toInt(); break;
+    case FIELD_STEP_DOUBLE: stepDouble = value.toDouble(); break;
+    case FIELD_STEP_INT: stepInt = value.toInt(); break;
+    case FIELD_MAX_LEN: maxLen = value.toInt(); break;
+    case FIELD_SUFFIX: suffix = value; break;
+    case FIELD_TYPE: type = CFG_T(value.toInt()); break;
+    case FIELD_TRANSMITTABLE: transmittable = value.toInt(); break;
+    case FIELD_VAL_DOUBLE: valDouble = value.toDouble(); break;
+    case FIELD_VAL_INT: valInt = value.toInt(); break;
+    case FIELD_VAL_STRING: valString = value; break;
+    case FIELD_VTX: vTx = VESC_TX_T(value.toInt()); break;
+    case FIELD_VTX_DOUBLE_SCALE: vTxDoubleScale = value.toDouble(); break;
+    default: break;
+    }
+}
@@ -35,6 +35,34 @@ class ConfigParam {
     Q_PROPERTY(QString valString MEMBER valString)
 
 public:
+    // The elements of a parameter in the parameter XML
+    enum Field {
+        FIELD_UNKNOWN = -1,
+        FIELD_DESCRIPTION = 0,
+        FIELD_CDEFINE,
+        FIELD_EDITOR_DECIMALS_DOUBLE,
+        FIELD_EDITOR_SCALE,
+        FIELD_EDIT_AS_PERCENTAGE,
+        FIELD_ENUM_NAMES,
+        FIELD_LONG_NAME,
+        FIELD_MAX_DOUBLE,
+        FIELD_MAX_INT,
+        FIELD_MIN_DOUBLE,
+        FIELD_MIN_INT,
+        FIELD_SHOW_DISPLAY,
+        FIELD_STEP_DOUBLE,
+        FIELD_STEP_INT,
+        FIELD_MAX_LEN,
+        FIELD_SUFFIX,
+        FIELD_TYPE,
+        FIELD_TRANSMITTABLE,
+        FIELD_VAL_DOUBLE,
+        FIELD_VAL_INT,
+        FIELD_VAL_STRING,
+        FIELD_VTX,
+        FIELD_VTX_DOUBLE_SCALE
+    };
+
     ConfigParam();
 
     void reset();
@@ -46,6 +74,9 @@ public:
     void setString(QString val, int maxLen);
     void setBool(bool val);
 
+    static Field fieldFromName(const QString &name);
+    void setField(Field field, const QString &value);
+
     CFG_T type;
     QString longName;
     QString description;
@@ -28,10 +28,22 @@
 #include <QFile>
 #include <QFileInfo>
 #include <QBuffer>
+#include <QDir>
+#include <QDataStream>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QCryptographicHash>
 #include <cmath>
+#include <algorithm>
 #include "utility.h"
+#include "configstore.h"
 #include "lzokay/lzokay.hpp"
 
+namespace {
+const quint32 schemaMagic = 0x56435342; // "VCSB"
+const quint16 schemaVersion = 1;
+}
+
 ConfigParams::ConfigParams(QObject *parent) : QObject(parent)
 {
     mUpdateOnlyName.clear();
@@ -39,6 +51,7 @@ ConfigParams::ConfigParams(QObject *parent) : QObject(parent)
     mUpdatesEnabled = true;
     mConfigVersion = -1;
     mStoreConfigVersion = true;
+    mNextSubscription = 0;
 }
 
 void ConfigParams::addParam(const QString &name, ConfigParam param)
@@ -54,6 +67,7 @@ void ConfigParams::addParam(const QString &name, ConfigParam param)
 void ConfigParams::deleteParam(const QString &name)
 {
     mParams.remove(name);
+    mLazyDescIndex.remove(name);
     for (int i = 0;i < mParamList.size();i++) {
         if (mParamList.at(i) == name) {
             mParamList.removeAt(i);
@@ -89,10 +103,104 @@ void ConfigParams::setUpdatesEnabled(bool updatesEnabled)
     mUpdatesEnabled = updatesEnabled;
 }
 
+/**
+ * @brief ConfigParams::subscribe
+ * Call a function when a parameter changes. Unlike the paramChanged signals,
+ * which every listener receives for every parameter, only the listeners of
+ * the parameter that changed are called.
+ *
+ * @param name
+ * The parameter to listen to.
+ *
+ * @param receiver
+ * The object the listener belongs to. The subscription is removed when it
+ * is destroyed.
+ *
+ * @param listener
+ * Function called with the source of the change and the updated parameter.
+ *
+ * @return
+ * Handle that can be passed to unsubscribe.
+ */
+int ConfigParams::subscribe(const QString &name, QObject *receiver, ParamListener listener)
+{
+    Subscription s;
+    s.handle = mNextSubscription++;
+    s.receiver = receiver;
+    s.listener = listener;
+    mSubscriptions[name].append(s);
+    mSubscriptionNames.insert(s.handle, name);
+
+    auto r = mReceivers.find(receiver);
+    if (r == mReceivers.end()) {
+        r = mReceivers.insert(receiver, Receiver());
+        r->destroyedConn = connect(receiver, &QObject::destroyed, this, [this](QObject *obj) {
+            unsubscribeAll(obj);
+        });
+    }
+    r->handles.append(s.handle);
+
+    return s.handle;
+}
+
+void ConfigParams::unsubscribe(int handle)
+{
+    auto n = mSubscriptionNames.find(handle);
+    if (n == mSubscriptionNames.end()) {
+        return;
+    }
+
+    auto subs = mSubscriptions.find(n.value());
+    mSubscriptionNames.erase(n);
+
+    if (subs == mSubscriptions.end()) {
+        return;
+    }
+
+    for (int i = 0;i < subs->size();i++) {
+        if (subs->at(i).handle != handle) {
+            continue;
+        }
+
+        auto r = mReceivers.find(subs->at(i).receiver);
+        if (r != mReceivers.end()) {
+            r->handles.removeOne(handle);
+            if (r->handles.isEmpty()) {
+                disconnect(r->destroyedConn);
+                mReceivers.erase(r);
+            }
+        }
+
+        subs->remove(i);
+        break;
+    }
+
+    if (subs->isEmpty()) {
+        mSubscriptions.erase(subs);
+    }
+}
+
+void ConfigParams::unsubscribeAll(QObject *receiver)
+{
+    auto r = mReceivers.find(receiver);
+    if (r == mReceivers.end()) {
+        return;
+    }
+
+    // Taken first, as unsubscribe removes the receiver with its last handle
+    QVector<int> handles = r->handles;
+    for (auto h: handles) {
+        unsubscribe(h);
+    }
+}
+
 void ConfigParams::clearParams()
 {
     mParams.clear();
     mParamList.clear();
+    mLazyDescData.clear();
+    mLazyDescIndex.clear();
+    mLazyDescFile.reset();
 }
 
 void ConfigParams::clearAll()
@@ -112,6 +220,10 @@ ConfigParam *ConfigParams::getParam(const QString &name)
 
     if (mParams.contains(name)) {
         retVal = &mParams[name];
+        if (mLazyDescIndex.contains(name)) {
+            retVal->description = lazyDescription(name);
+            mLazyDescIndex.remove(name);
+        }
     } else {
         qWarning() << name << "not found";
     }
@@ -125,6 +237,9 @@ ConfigParam ConfigParams::getParamCopy(const QString &name) const
 
     if (mParams.contains(name)) {
         retVal = mParams.value(name);
+        if (mLazyDescIndex.contains(name)) {
+            retVal.description = lazyDescription(name);
+        }
     } else {
         qWarning() << name << "not found";
     }
@@ -299,7 +414,7 @@ QString ConfigParams::getDescription(const QString &name)
     QString retVal = "";
 
     if (mParams.contains(name)) {
-        retVal = mParams[name].description;
+        retVal = getParam(name)->description;
     } else {
         qWarning() << name << "not found";
     }
@@ -703,7 +818,7 @@ void ConfigParams::setParamSerial(VByteArray &vb, const QString &name, QObject *
             if (mUpdatesEnabled && (mUpdateOnlyName.isEmpty() || mUpdateOnlyName == name)) {
                 if (p.valDouble != val) {
                     p.valDouble = val;
-                    emit paramChangedDouble(src, name, val);
+                    notifyParamChanged(src, name, p);
                 }
             }
         } break;
@@ -731,7 +846,7 @@ void ConfigParams::setParamSerial(VByteArray &vb, const QString &name, QObject *
             if (mUpdatesEnabled && (mUpdateOnlyName.isEmpty() || mUpdateOnlyName == name)) {
                 if (p.valInt != val) {
                     p.valInt = val;
-                    emit paramChangedInt(src, name, val);
+                    notifyParamChanged(src, name, p);
                 }
             }
         } break;
@@ -742,7 +857,7 @@ void ConfigParams::setParamSerial(VByteArray &vb, const QString &name, QObject *
             if (mUpdatesEnabled && (mUpdateOnlyName.isEmpty() || mUpdateOnlyName == name)) {
                 if (p.valString != val) {
                     p.valString = val;
-                    emit paramChangedQString(src, name, val);
+                    notifyParamChanged(src, name, p);
                 }
             }
         } break;
@@ -754,11 +869,7 @@ void ConfigParams::setParamSerial(VByteArray &vb, const QString &name, QObject *
             if (mUpdatesEnabled && (mUpdateOnlyName.isEmpty() || mUpdateOnlyName == name)) {
                 if (p.valInt != val) {
                     p.valInt = val;
-                    if (p.type == CFG_T_BOOL) {
-                        emit paramChangedBool(src, name, val);
-                    } else {
-                        emit paramChangedEnum(src, name, val);
-                    }
+                    notifyParamChanged(src, name, p);
                 }
             }
         } break;
@@ -779,7 +890,7 @@ void ConfigParams::updateParamDouble(QString name, double param, QObject *src)
         if (p.type == CFG_T_DOUBLE) {
             if (p.valDouble != param) {
                 p.valDouble = param;
-                emit paramChangedDouble(src, name, param);
+                notifyParamChanged(src, name, p);
             }
         } else {
             qWarning() << name << "wrong type";
@@ -800,7 +911,7 @@ void ConfigParams::updateParamInt(QString name, int param, QObject *src)
         if (p.type == CFG_T_INT || p.type == CFG_T_BITFIELD) {
             if (p.valInt != param) {
                 p.valInt = param;
-                emit paramChangedInt(src, name, param);
+                notifyParamChanged(src, name, p);
             }
         } else {
             qWarning() << name << "wrong type";
@@ -821,7 +932,7 @@ void ConfigParams::updateParamEnum(QString name, int param, QObject *src)
         if (p.type == CFG_T_ENUM) {
             if (p.valInt != param) {
                 p.valInt = param;
-                emit paramChangedEnum(src, name, param);
+                notifyParamChanged(src, name, p);
             }
         } else {
             qWarning() << name << "wrong type";
@@ -842,7 +953,7 @@ void ConfigParams::updateParamString(QString name, QString param, QObject *src)
         if (p.type == CFG_T_QSTRING) {
             if (p.valString != param) {
                 p.valString = param;
-                emit paramChangedQString(src, name, param);
+                notifyParamChanged(src, name, p);
             }
         } else {
             qWarning() << name << "wrong type";
@@ -863,7 +974,7 @@ void ConfigParams::updateParamBool(QString name, bool param, QObject *src)
         if (p.type == CFG_T_BOOL) {
             if (p.valInt != param) {
                 p.valInt = param;
-                emit paramChangedBool(src, name, param);
+                notifyParamChanged(src, name, p);
             }
         } else {
             qWarning() << name << "wrong type";
@@ -934,6 +1045,105 @@ int ConfigParams::getConfigVersion() const
     return mConfigVersion;
 }
 
+QString ConfigParams::lazyDescription(const QString &name) const
+{
+    auto d = mLazyDescIndex.value(name);
+    return QString::fromUtf8(mLazyDescData.constData() + d.first, d.second);
+}
+
+/**
+ * @brief ConfigParams::loadParamsXmlCached
+ * Load parameter XML through a binary schema cache. The first time an XML
+ * document is seen it is parsed and compiled with getParamsBinary, after
+ * that the compiled schema is memory mapped from the cache directory and
+ * loaded directly. The file stays mapped while the descriptions are in use,
+ * so they are only read from it when they are accessed. The cache is keyed
+ * on the XML content, so stale entries are never used.
+ */
+bool ConfigParams::loadParamsXmlCached(const QByteArray &xml)
+{
+    QCryptographicHash hash(QCryptographicHash::Md5);
+    hash.addData(xml);
+    hash.addData(QByteArray::number(schemaVersion));
+
+    QString cacheDir = QStandardPaths::writableLocation(QStandardPaths::CacheLocation);
+    QString cacheFile;
+    if (!cacheDir.isEmpty()) {
+        cacheDir += "/config_schema";
+        cacheFile = cacheDir + "/" + QString::fromLatin1(hash.result().toHex()) + ".bin";
+    }
+
+    if (!cacheFile.isEmpty()) {
+        QSharedPointer<QFile> file(new QFile(cacheFile));
+        if (file->open(QIODevice::ReadOnly)) {
+            bool ok = false;
+            uchar *map = file->map(0, file->size());
+            if (map) {
+                ok = setParamsBinary(QByteArray::fromRawData((const char*)map, int(file->size())));
+                if (ok) {
+                    mLazyDescFile = file;
+                }
+            } else {
+                ok = setParamsBinary(file->readAll());
+            }
+
+            if (ok) {
+                return true;
+            }
+
+            qWarning() << "Invalid config schema cache, recompiling" << cacheFile;
+        }
+    }
+
+    QXmlStreamReader stream(xml);
+    bool res = setParamsXML(stream);
+
+    if (res && !cacheFile.isEmpty() && QDir().mkpath(cacheDir)) {
+        QSaveFile file(cacheFile);
+        if (file.open(QIODevice::WriteOnly)) {
+            file.write(getParamsBinary());
+            file.commit();
+        }
+    }
+
+    return res;
+}
+
+void ConfigParams::notifyParamChanged(QObject *src, const QString &name, const ConfigParam &p)
+{
+    // Copied, as listeners may subscribe or unsubscribe
+    auto subs = mSubscriptions.value(name);
+    for (const auto &s: subs) {
+        s.listener(src, p);
+    }
+
+    switch (p.type) {
+    case CFG_T_DOUBLE:
+        emit paramChangedDouble(src, name, p.valDouble);
+        break;
+
+    case CFG_T_INT:
+    case CFG_T_BITFIELD:
+        emit paramChangedInt(src, name, p.valInt);
+        break;
+
+    case CFG_T_ENUM:
+        emit paramChangedEnum(src, name, p.valInt);
+        break;
+
+    case CFG_T_BOOL:
+        emit paramChangedBool(src, name, p.valInt);
+        break;
+
+    case CFG_T_QSTRING:
+        emit paramChangedQString(src, name, p.valString);
+        break;
+
+    default:
+        break;
+    }
+}
+
 // http://realtimecollisiondetection.net/blog/?p=89
 bool ConfigParams::almostEqual(float A, float B, float eps)
 {
@@ -1048,14 +1258,14 @@ bool ConfigParams::setXML(QXmlStreamReader &stream, QString configName)
                 case CFG_T_BOOL:
                     if (valInt != p.valInt) {
                         p.valInt = valInt;
-                        emit paramChangedBool(nullptr, name, valInt);
+                        notifyParamChanged(nullptr, name, p);
                     }
                     break;
 
                 case CFG_T_ENUM:
                     if (valInt != p.valInt) {
                         p.valInt = valInt;
-                        emit paramChangedEnum(nullptr, name, valInt);
+                        notifyParamChanged(nullptr, name, p);
                     }
                     break;
 
@@ -1063,21 +1273,21 @@ bool ConfigParams::setXML(QXmlStreamReader &stream, QString configName)
                 case CFG_T_BITFIELD:
                     if (valInt != p.valInt) {
                         p.valInt = valInt;
-                        emit paramChangedInt(nullptr, name, valInt);
+                        notifyParamChanged(nullptr, name, p);
                     }
                     break;
 
                 case CFG_T_DOUBLE:
                     if (valDouble != p.valDouble) {
                         p.valDouble = valDouble;
-                        emit paramChangedDouble(nullptr, name, valDouble);
+                        notifyParamChanged(nullptr, name, p);
                     }
                     break;
 
                 case CFG_T_QSTRING:
                     if (text != p.valString) {
                         p.valString = text;
-                        emit paramChangedQString(nullptr, name, text);
+                        notifyParamChanged(nullptr, name, p);
                     }
                     break;
 
@@ -1328,53 +1538,10 @@ bool ConfigParams::setParamsXML(QXmlStreamReader &stream)
 
                     while (stream.readNextStartElement()) {
                         QString name = stream.name().toString();
+                        ConfigParam::Field field = ConfigParam::fieldFromName(name);
 
-                        if (name == "description") {
-                            p.description = stream.readElementText();
-                        } else if (name == "cDefine") {
-                            p.cDefine = stream.readElementText();
-                        } else if (name == "editorDecimalsDouble") {
-                            p.editorDecimalsDouble = stream.readElementText().toInt();
-                        } else if (name == "editorScale") {
-                            p.editorScale = stream.readElementText().toDouble();
-                        } else if (name == "editAsPercentage") {
-                            p.editAsPercentage = stream.readElementText().toInt();
-                        } else if (name == "enumNames") {
-                            p.enumNames.append(stream.readElementText());
-                        } else if (name == "longName") {
-                            p.longName = stream.readElementText();
-                        } else if (name == "maxDouble") {
-                            p.maxDouble = stream.readElementText().toDouble();
-                        } else if (name == "maxInt") {
-                            p.maxInt = stream.readElementText().toInt();
-                        } else if (name == "minDouble") {
-                            p.minDouble = stream.readElementText().toDouble();
-                        } else if (name == "minInt") {
-                            p.minInt = stream.readElementText().toInt();
-                        } else if (name == "showDisplay") {
-                            p.showDisplay = stream.readElementText().toInt();
-                        } else if (name == "stepDouble") {
-                            p.stepDouble = stream.readElementText().toDouble();
-                        } else if (name == "stepInt") {
-                            p.stepInt = stream.readElementText().toInt();
-                        } else if (name == "maxLen") {
-                            p.maxLen = stream.readElementText().toInt();
-                        } else if (name == "suffix") {
-                            p.suffix = stream.readElementText();
-                        } else if (name == "type") {
-                            p.type = CFG_T(stream.readElementText().toInt());
-                        } else if (name == "transmittable") {
-                            p.transmittable = stream.readElementText().toInt();
-                        } else if (name == "valDouble") {
-                            p.valDouble = stream.readElementText().toDouble();
-                        } else if (name == "valInt") {
-                            p.valInt = stream.readElementText().toInt();
-                        } else if (name == "valString") {
-                            p.valString = stream.readElementText();
-                        } else if (name == "vTx") {
-                            p.vTx = VESC_TX_T(stream.readElementText().toInt());
-                        } else if (name == "vTxDoubleScale") {
-                            p.vTxDoubleScale = stream.readElementText().toDouble();
+                        if (field != ConfigParam::FIELD_UNKNOWN) {
+                            p.setField(field, stream.readElementText());
                         } else {
                             qWarning() << "Parameter not found: " << name;
                             stream.skipCurrentElement();
@@ -1489,12 +1656,10 @@ bool ConfigParams::loadParamsXml(QString fileName)
         return false;
     }
 
-    QXmlStreamReader stream(&file);
-    bool res = setParamsXML(stream);
-
+    QByteArray xml = file.readAll();
     file.close();
 
-    return res;
+    return loadParamsXmlCached(xml);
 }
 
 QByteArray ConfigParams::getCompressedParamsXml()
@@ -1509,12 +1674,157 @@ QByteArray ConfigParams::getCompressedParamsXml()
 
 bool ConfigParams::loadCompressedParamsXml(QByteArray data)
 {
-    QByteArray uncompressed = qUncompress(data);
-    QXmlStreamReader stream(uncompressed);
-    bool res = setParamsXML(stream);
+    return loadParamsXmlCached(qUncompress(data));
+}
+
+/**
+ * @brief ConfigParams::getParamsBinary
+ * Compile the parameter schema into a compact binary form that can be loaded
+ * with setParamsBinary without going through the XML parser. Descriptions
+ * are stored as one UTF-8 blob at the end so that they can be decoded lazily.
+ *
+ * @return
+ * The binary schema.
+ */
+QByteArray ConfigParams::getParamsBinary()
+{
+    QByteArray res;
+    QByteArray descData;
+    QDataStream out(&res, QIODevice::WriteOnly);
+    out.setVersion(QDataStream::Qt_5_12);
+
+    out << schemaMagic << schemaVersion;
+    out << qint32(mParamList.size());
+
+    for (const auto &name: mParamList) {
+        ConfigParam *p = getParam(name);
+        QByteArray desc = p->description.toUtf8();
+
+        out << name << qint32(p->type) << p->longName << p->cDefine
+            << p->valDouble << qint32(p->valInt) << p->valString << p->enumNames
+            << p->maxDouble << p->minDouble << p->stepDouble
+            << qint32(p->editorDecimalsDouble) << qint32(p->maxInt) << qint32(p->minInt)
+            << qint32(p->stepInt) << qint32(p->maxLen) << qint32(p->vTx) << p->vTxDoubleScale
+            << p->suffix << p->editorScale << p->editAsPercentage << p->showDisplay
+            << p->transmittable;
+        out << qint32(descData.size()) << qint32(desc.size());
+
+        descData.append(desc);
+    }
+
+    out << mSerializeOrder;
+    out << mParamGrouping;
+    out << descData;
+
     return res;
 }
 
+/**
+ * @brief ConfigParams::setParamsBinary
+ * Load a parameter schema created by getParamsBinary. Nothing is changed
+ * if the data is not valid. The descriptions are not copied, they are
+ * decoded from data when they are accessed.
+ *
+ * @param data
+ * The binary schema.
+ *
+ * @return
+ * True on success, false otherwise.
+ */
+bool ConfigParams::setParamsBinary(const QByteArray &data)
+{
+    QDataStream in(data);
+    in.setVersion(QDataStream::Qt_5_12);
+
+    quint32 magic = 0;
+    quint16 version = 0;
+    qint32 paramCount = 0;
+    in >> magic >> version >> paramCount;
+
+    if (in.status() != QDataStream::Ok || magic != schemaMagic ||
+            version != schemaVersion || paramCount < 0) {
+        return false;
+    }
+
+    QHash<QString, ConfigParam> params;
+    QStringList paramList;
+    QHash<QString, QPair<int, int>> descIndex;
+    params.reserve(paramCount);
+    paramList.reserve(paramCount);
+    descIndex.reserve(paramCount);
+
+    for (int i = 0;i < paramCount;i++) {
+        QString name;
+        ConfigParam p;
+        qint32 type, valInt, editorDecimalsDouble, maxInt, minInt, stepInt, maxLen, vTx;
+        qint32 descOffset, descLen;
+
+        in >> name >> type >> p.longName >> p.cDefine
+           >> p.valDouble >> valInt >> p.valString >> p.enumNames
+           >> p.maxDouble >> p.minDouble >> p.stepDouble
+           >> editorDecimalsDouble >> maxInt >> minInt
+           >> stepInt >> maxLen >> vTx >> p.vTxDoubleScale
+           >> p.suffix >> p.editorScale >> p.editAsPercentage >> p.showDisplay
+           >> p.transmittable;
+        in >> descOffset >> descLen;
+
+        if (in.status() != QDataStream::Ok) {
+            return false;
+        }
+
+        p.type = CFG_T(type);
+        p.valInt = valInt;
+        p.editorDecimalsDouble = editorDecimalsDouble;
+        p.maxInt = maxInt;
+        p.minInt = minInt;
+        p.stepInt = stepInt;
+        p.maxLen = maxLen;
+        p.vTx = VESC_TX_T(vTx);
+
+        params.insert(name, p);
+        paramList.append(name);
+        descIndex.insert(name, qMakePair(int(descOffset), int(descLen)));
+    }
+
+    QStringList serializeOrder;
+    QList<QPair<QString, QList<QPair<QString, QStringList>>>> grouping;
+    quint32 descSize = 0;
+    in >> serializeOrder >> grouping >> descSize;
+
+    if (in.status() != QDataStream::Ok) {
+        return false;
+    }
+
+    // The description blob is serialized as a QByteArray. Instead of reading
+    // it, the description offsets are moved to point into data.
+    if (descSize == 0xFFFFFFFF) {
+        descSize = 0;
+    }
+
+    qint64 descStart = in.device()->pos();
+    if ((descStart + qint64(descSize)) > data.size()) {
+        return false;
+    }
+
+    for (auto &d: descIndex) {
+        if (d.first < 0 || d.second < 0 || (qint64(d.first) + d.second) > qint64(descSize)) {
+            return false;
+        }
+        d.first += int(descStart);
+    }
+
+    mParams = params;
+    mParamList = paramList;
+    mSerializeOrder = serializeOrder;
+    mParamGrouping = grouping;
+    mLazyDescData = data;
+    mLazyDescIndex = descIndex;
+    mLazyDescFile.reset();
+    mXmlStatus = tr("OK");
+
+    return true;
+}
+
 bool ConfigParams::saveCDefines(const QString &fileName, bool wrapIfdef)
 {
     QFile file(fileName);
@@ -1999,6 +2309,68 @@ ConfigParams &ConfigParams::operator=(const ConfigParams &other)
     this->mUpdatesEnabled = other.mUpdatesEnabled;
     this->mSerializeOrder = other.mSerializeOrder;
     this->mXmlStatus = other.mXmlStatus;
+    this->mLazyDescData = other.mLazyDescData;
+    this->mLazyDescIndex = other.mLazyDescIndex;
+    this->mLazyDescFile = other.mLazyDescFile;
 
     return *this;
 }
+
+ConfigParamWatcher::ConfigParamWatcher(QObject *parent) : QObject(parent)
+{
+    mHandle = -1;
+}
+
+ConfigParams *ConfigParamWatcher::params() const
+{
+    return mParams;
+}
+
+void ConfigParamWatcher::setParams(ConfigParams *params)
+{
+    if (params != mParams) {
+        // The handle is dropped even if the parameters were destroyed, as
+        // handles are only unique within one ConfigParams
+        if (mParams) {
+            mParams->unsubscribe(mHandle);
+        }
+
+        mHandle = -1;
+        mParams = params;
+        resubscribe();
+        emit paramsChanged();
+    }
+}
+
+QString ConfigParamWatcher::paramName() const
+{
+    return mParamName;
+}
+
+void ConfigParamWatcher::setParamName(const QString &paramName)
+{
+    if (paramName != mParamName) {
+        mParamName = paramName;
+        resubscribe();
+        emit paramNameChanged();
+    }
+}
+
+void ConfigParamWatcher::resubscribe()
+{
+    if (!mParams) {
+        return;
+    }
+
+    if (mHandle >= 0) {
+        mParams->unsubscribe(mHandle);
+        mHandle = -1;
+    }
+
+    if (!mParamName.isEmpty()) {
+        mHandle = mParams->subscribe(mParamName, this, [this](QObject *src, const ConfigParam &p) {
+            (void)p;
+            emit changed(src);
+        });
+    }
+}
@@ -24,9 +24,15 @@
 #include <QHash>
 #include <QXmlStreamWriter>
 #include <QXmlStreamReader>
+#include <QVector>
+#include <QSharedPointer>
+#include <QPointer>
+#include <functional>
 #include "configparam.h"
 #include "vbytearray.h"
 
+class QFile;
+
 class ConfigParams : public QObject
 {
     Q_OBJECT
@@ -41,6 +47,12 @@ public:
     Q_INVOKABLE void clearParams();
     Q_INVOKABLE void clearAll();
 
+    // Targeted change notification
+    typedef std::function<void(QObject *src, const ConfigParam &param)> ParamListener;
+    int subscribe(const QString &name, QObject *receiver, ParamListener listener);
+    void unsubscribe(int handle);
+    void unsubscribeAll(QObject *receiver);
+
     Q_INVOKABLE bool hasParam(const QString &name);
     ConfigParam *getParam(const QString &name);
     Q_INVOKABLE ConfigParam getParamCopy(const QString &name) const;
@@ -104,6 +116,8 @@ public:
     bool loadParamsXml(QString fileName);
     QByteArray getCompressedParamsXml();
     bool loadCompressedParamsXml(QByteArray data);
+    QByteArray getParamsBinary();
+    bool setParamsBinary(const QByteArray &data);
 
     bool saveCDefines(const QString &fileName, bool wrapIfdef = false);
 
@@ -167,6 +181,8 @@ public slots:
     void updateDone();
 
 private:
+    friend class ConfigStore;
+
     QHash<QString, ConfigParam> mParams;
     QStringList mParamList;
     QString mUpdateOnlyName;
@@ -177,7 +193,69 @@ private:
     int mConfigVersion;
     bool mStoreConfigVersion;
 
+    // Descriptions from the binary schema are only decoded on first access. When
+    // the schema is memory mapped from the cache, mLazyDescData points into the
+    // map and mLazyDescFile keeps it mapped.
+    QByteArray mLazyDescData;
+    QHash<QString, QPair<int, int>> mLazyDescIndex;
+    QSharedPointer<QFile> mLazyDescFile;
+
+    struct Subscription {
+        int handle;
+        QObject *receiver;
+        ParamListener listener;
+    };
+
+    struct Receiver {
+        QMetaObject::Connection destroyedConn;
+        QVector<int> handles;
+    };
+
+    // Listeners by parameter, with indexes by handle and by receiver so
+    // that subscribing and unsubscribing do not scan all subscriptions.
+    QHash<QString, QVector<Subscription>> mSubscriptions;
+    QHash<int, QString> mSubscriptionNames;
+    QHash<QObject*, Receiver> mReceivers;
+    int mNextSubscription;
+
+    void notifyParamChanged(QObject *src, const QString &name, const ConfigParam &p);
     bool almostEqual(float A, float B, float eps);
+    QString lazyDescription(const QString &name) const;
+    bool loadParamsXmlCached(const QByteArray &xml);
+
+};
+
+/**
+ * @brief The ConfigParamWatcher class
+ * Lets QML follow a single parameter through the subscriptions of
+ * ConfigParams, so that an editor only runs JavaScript when its own
+ * parameter changes instead of for every change of its type.
+ */
+class ConfigParamWatcher : public QObject
+{
+    Q_OBJECT
+    Q_PROPERTY(ConfigParams* params READ params WRITE setParams NOTIFY paramsChanged)
+    Q_PROPERTY(QString paramName READ paramName WRITE setParamName NOTIFY paramNameChanged)
+
+public:
+    explicit ConfigParamWatcher(QObject *parent = nullptr);
+
+    ConfigParams *params() const;
+    void setParams(ConfigParams *params);
+    QString paramName() const;
+    void setParamName(const QString &paramName);
+
+signals:
+    void paramsChanged();
+    void paramNameChanged();
+    void changed(QObject *src);
+
+private:
+    QPointer<ConfigParams> mParams;
+    QString mParamName;
+    int mHandle;
+
+    void resubscribe();
 
 };
 
@@ -0,0 +1,417 @@
+/*
+    Copyright 2016 - 2024 Benjamin Vedder	benjamin@vedder.se
+
+    This file is part of VESC Tool.
+
+    VESC Tool is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    VESC Tool is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+#include "configstore.h"
+#include <QFile>
+#include <QDebug>
+#include <QtEndian>
+
+/*
+ * Layout, all integers big endian:
+ *
+ * Header:
+ * u32 magic, u16 version, u16 files per version,
+ * u32 string count, u32 field count, u32 record count, u32 version count,
+ * u32 string index offset, u32 string data offset, u32 field table offset,
+ * u32 record index offset, u32 version index offset
+ *
+ * String index: (u32 offset in string data, u32 length) per UTF-8 string
+ * Field table: u32 string of the XML element name per field
+ * Record index: u32 offset per record
+ * Record: u32 parameter name string, u16 field count,
+ * (u16 field, u32 value string) per field
+ * Version index: u16 major, u16 minor, u32 block offset per file
+ *
+ * Block: u32 offset of the block this is a delta to, 0 for none. Then the
+ * parameter records, the serialization order and the grouping, each as u32
+ * length in words followed by operations on the same list of the base
+ * block. A copy operation is u32 (OP_COPY | length) and u32 start in the
+ * base list, an insert operation is u32 length followed by the entries.
+ *
+ * The grouping is one list where TOKEN_GROUP and TOKEN_SUBGROUP are
+ * followed by the string of the group or subgroup name, and all other
+ * entries are parameters of the last subgroup.
+ */
+
+namespace {
+const quint32 storeMagic = 0x56434653; // "VCFS"
+const quint16 storeVersion = 1;
+const quint32 headerLen = 44;
+const quint32 OP_COPY = 0x80000000;
+const quint32 TOKEN_GROUP = 0xFFFFFFFF;
+const quint32 TOKEN_SUBGROUP = 0xFFFFFFFE;
+}
+
+ConfigStore::ConfigStore()
+{
+    mStringCount = 0;
+    mRecordCount = 0;
+    mStringIndexOffset = 0;
+    mStringDataOffset = 0;
+    mRecordIndexOffset = 0;
+}
+
+/**
+ * @brief ConfigStore::open
+ * Open a packed config store.
+ *
+ * @param data
+ * The store. It is shared with the ConfigParams loaded from it, as their
+ * descriptions are decoded from it on first use.
+ *
+ * @return
+ * True on success, false if the data is not a valid store.
+ */
+bool ConfigStore::open(const QByteArray &data)
+{
+    mData = data;
+    mFields.clear();
+    mVersions.clear();
+
+    if (!inRange(0, headerLen) || u32(0) != storeMagic || u16(4) != storeVersion ||
+            u16(6) != CONFIG_FILE_NUM) {
+        mData.clear();
+        return false;
+    }
+
+    mStringCount = u32(8);
+    quint32 fieldCount = u32(12);
+    mRecordCount = u32(16);
+    quint32 versionCount = u32(20);
+    mStringIndexOffset = u32(24);
+    mStringDataOffset = u32(28);
+    quint32 fieldTableOffset = u32(32);
+    mRecordIndexOffset = u32(36);
+    quint32 versionIndexOffset = u32(40);
+
+    quint32 versionLen = 4 + 4 * CONFIG_FILE_NUM;
+
+    if (!inRange(mStringIndexOffset, quint64(mStringCount) * 8) ||
+            !inRange(fieldTableOffset, quint64(fieldCount) * 4) ||
+            !inRange(mRecordIndexOffset, quint64(mRecordCount) * 4) ||
+            !inRange(versionIndexOffset, quint64(versionCount) * versionLen)) {
+        mData.clear();
+        return false;
+    }
+
+    for (quint32 i = 0;i < mStringCount;i++) {
+        quint32 pos = mStringIndexOffset + i * 8;
+        if (!inRange(quint64(mStringDataOffset) + u32(pos), u32(pos + 4))) {
+            mData.clear();
+            return false;
+        }
+    }
+
+    for (quint32 i = 0;i < fieldCount;i++) {
+        quint32 s = u32(fieldTableOffset + i * 4);
+        mFields.append(s < mStringCount ? ConfigParam::fieldFromName(string(s)) :
+                                          ConfigParam::FIELD_UNKNOWN);
+    }
+
+    for (quint32 i = 0;i < versionCount;i++) {
+        quint32 pos = versionIndexOffset + i * versionLen;
+        Version v;
+        v.major = u16(pos);
+        v.minor = u16(pos + 2);
+        for (int j = 0;j < CONFIG_FILE_NUM;j++) {
+            v.blocks[j] = u32(pos + 4 + 4 * j);
+        }
+        mVersions.append(v);
+    }
+
+    return true;
+}
+
+bool ConfigStore::openFile(const QString &fileName)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        qWarning() << "Could not open config store" << fileName;
+        return false;
+    }
+
+    bool res = open(file.readAll());
+    file.close();
+
+    if (!res) {
+        qWarning() << "Invalid config store" << fileName;
+    }
+
+    return res;
+}
+
+bool ConfigStore::isOpen() const
+{
+    return !mData.isEmpty();
+}
+
+QVector<QPair<int, int> > ConfigStore::versions() const
+{
+    QVector<QPair<int, int>> res;
+    for (const auto &v: mVersions) {
+        res.append(qMakePair(v.major, v.minor));
+    }
+    return res;
+}
+
+bool ConfigStore::hasVersion(int fwMajor, int fwMinor) const
+{
+    for (const auto &v: mVersions) {
+        if (v.major == fwMajor && v.minor == fwMinor) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief ConfigStore::loadParams
+ * Load the parameters of one file of a firmware version, the same way as
+ * ConfigParams::loadParamsXml would load the XML file.
+ *
+ * @param fwMajor
+ * Major firmware version.
+ *
+ * @param fwMinor
+ * Minor firmware version.
+ *
+ * @param file
+ * Which of the files of the version to load.
+ *
+ * @param params
+ * The parameters to replace.
+ *
+ * @return
+ * True on success. Nothing is changed on failure.
+ */
+bool ConfigStore::loadParams(int fwMajor, int fwMinor, ConfigFile file, ConfigParams *params) const
+{
+    if (file < 0 || file >= CONFIG_FILE_NUM) {
+        return false;
+    }
+
+    quint32 block = 0;
+    for (const auto &v: mVersions) {
+        if (v.major == fwMajor && v.minor == fwMinor) {
+            block = v.blocks[file];
+            break;
+        }
+    }
+
+    QVector<quint32> lists[LIST_NUM];
+    if (block == 0 || !expandLists(block, lists)) {
+        return false;
+    }
+
+    QHash<QString, ConfigParam> paramMap;
+    QStringList paramList;
+    QHash<QString, QPair<int, int>> descIndex;
+    paramMap.reserve(lists[LIST_PARAMS].size());
+    paramList.reserve(lists[LIST_PARAMS].size());
+    descIndex.reserve(lists[LIST_PARAMS].size());
+
+    for (auto r: lists[LIST_PARAMS]) {
+        if (r >= mRecordCount) {
+            return false;
+        }
+
+        quint32 pos = u32(mRecordIndexOffset + 4 * r);
+        if (!inRange(pos, 6) || !inRange(pos + 6, quint64(u16(pos + 4)) * 6) ||
+                u32(pos) >= mStringCount) {
+            return false;
+        }
+
+        QString name = string(u32(pos));
+        int fieldCount = u16(pos + 4);
+        pos += 6;
+
+        ConfigParam p;
+        for (int i = 0;i < fieldCount;i++) {
+            quint16 f = u16(pos);
+            quint32 val = u32(pos + 2);
+            pos += 6;
+
+            if (f >= mFields.size() || val >= mStringCount) {
+                return false;
+            }
+
+            if (mFields.at(f) == ConfigParam::FIELD_DESCRIPTION) {
+                // Decoded on first use, see ConfigParams::getParam
+                descIndex.insert(name, stringRange(val));
+            } else {
+                p.setField(mFields.at(f), string(val));
+            }
+        }
+
+        if (!paramMap.contains(name)) {
+            paramMap.insert(name, p);
+            paramList.append(name);
+        }
+    }
+
+    QStringList serOrder;
+    for (auto s: lists[LIST_SER_ORDER]) {
+        if (s >= mStringCount) {
+            return false;
+        }
+        serOrder.append(string(s));
+    }
+
+    QList<QPair<QString, QList<QPair<QString, QStringList>>>> grouping;
+    const auto &g = lists[LIST_GROUPING];
+    for (int i = 0;i < g.size();i++) {
+        quint32 t = g.at(i);
+        bool hasName = (i + 1) < g.size() && g.at(i + 1) < mStringCount;
+
+        if (t == TOKEN_GROUP && hasName) {
+            grouping.append(qMakePair(string(g.at(++i)), QList<QPair<QString, QStringList>>()));
+        } else if (t == TOKEN_SUBGROUP && hasName && !grouping.isEmpty()) {
+            grouping.last().second.append(qMakePair(string(g.at(++i)), QStringList()));
+        } else if (t < mStringCount && !grouping.isEmpty() && !grouping.last().second.isEmpty()) {
+            grouping.last().second.last().second.append(string(t));
+        } else {
+            return false;
+        }
+    }
+
+    params->clearParams();
+    params->mParams = paramMap;
+    params->mParamList = paramList;
+    params->mSerializeOrder = serOrder;
+    params->mParamGrouping = grouping;
+    params->mLazyDescData = mData;
+    params->mLazyDescIndex = descIndex;
+    params->mXmlStatus = ConfigParams::tr("OK");
+
+    return true;
+}
+
+/**
+ * @brief ConfigStore::bundled
+ * The store with the configurations of all firmware versions this version
+ * of VESC Tool supports.
+ */
+const ConfigStore &ConfigStore::bundled()
+{
+    static const ConfigStore store = []() {
+        ConfigStore s;
+        s.openFile("://res/config/config_store.bin");
+        return s;
+    }();
+
+    return store;
+}
+
+quint32 ConfigStore::u32(quint32 offset) const
+{
+    return qFromBigEndian<quint32>(mData.constData() + offset);
+}
+
+quint16 ConfigStore::u16(quint32 offset) const
+{
+    return qFromBigEndian<quint16>(mData.constData() + offset);
+}
+
+bool ConfigStore::inRange(quint64 offset, quint64 len) const
+{
+    return (offset + len) <= quint64(mData.size());
+}
+
+QPair<int, int> ConfigStore::stringRange(quint32 id) const
+{
+    quint32 pos = mStringIndexOffset + id * 8;
+    return qMakePair(int(mStringDataOffset + u32(pos)), int(u32(pos + 4)));
+}
+
+QString ConfigStore::string(quint32 id) const
+{
+    auto r = stringRange(id);
+    return QString::fromUtf8(mData.constData() + r.first, r.second);
+}
+
+/**
+ * @brief ConfigStore::expandLists
+ * Apply the deltas from the first block in the chain of bases up to block.
+ */
+bool ConfigStore::expandLists(quint32 block, QVector<quint32> *lists) const
+{
+    QVector<quint32> chain;
+    while (block != 0) {
+        if (!inRange(block, 4) || chain.size() > mVersions.size()) {
+            return false;
+        }
+
+        chain.prepend(block);
+        block = u32(block);
+    }
+
+    for (int i = 0;i < LIST_NUM;i++) {
+        lists[i].clear();
+    }
+
+    for (auto b: chain) {
+        quint32 pos = b + 4;
+
+        for (int i = 0;i < LIST_NUM;i++) {
+            if (!inRange(pos, 4)) {
+                return false;
+            }
+
+            quint64 end = quint64(pos) + 4 + quint64(u32(pos)) * 4;
+            if (end > quint64(mData.size())) {
+                return false;
+            }
+
+            pos += 4;
+            QVector<quint32> res;
+
+            while (pos < end) {
+                quint32 op = u32(pos);
+
+                if (op & OP_COPY) {
+                    quint32 len = op & ~OP_COPY;
+                    if ((quint64(pos) + 8) > end) {
+                        return false;
+                    }
+
+                    quint32 start = u32(pos + 4);
+                    if ((quint64(start) + len) > quint64(lists[i].size())) {
+                        return false;
+                    }
+
+                    res.append(lists[i].mid(int(start), int(len)));
+                    pos += 8;
+                } else {
+                    if ((quint64(pos) + 4 + quint64(op) * 4) > end) {
+                        return false;
+                    }
+
+                    for (quint32 j = 0;j < op;j++) {
+                        res.append(u32(pos + 4 + 4 * j));
+                    }
+                    pos += 4 + 4 * op;
+                }
+            }
+
+            lists[i] = res;
+        }
+    }
+
+    return true;
+}
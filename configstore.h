@@ -0,0 +1,91 @@
+/*
+    Copyright 2016 - 2024 Benjamin Vedder	benjamin@vedder.se
+
+    This file is part of VESC Tool.
+
+    VESC Tool is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    VESC Tool is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+#ifndef CONFIGSTORE_H
+#define CONFIGSTORE_H
+
+#include <QByteArray>
+#include <QVector>
+#include <QPair>
+#include "configparams.h"
+
+/**
+ * @brief The ConfigStore class
+ * Reader for the packed parameter XML files of all supported firmware
+ * versions, created by res/config/pack_configs.py. All strings are stored
+ * once, every parameter that is identical between versions is stored once
+ * and the files of a version are stored as a delta to the previous version.
+ * A version is loaded into ConfigParams directly from the store, without
+ * going through the XML parser.
+ */
+class ConfigStore
+{
+public:
+    enum ConfigFile {
+        CONFIG_MCCONF = 0,
+        CONFIG_APPCONF,
+        CONFIG_INFO,
+        CONFIG_FILE_NUM
+    };
+
+    ConfigStore();
+
+    bool open(const QByteArray &data);
+    bool openFile(const QString &fileName);
+    bool isOpen() const;
+
+    QVector<QPair<int, int>> versions() const;
+    bool hasVersion(int fwMajor, int fwMinor) const;
+    bool loadParams(int fwMajor, int fwMinor, ConfigFile file, ConfigParams *params) const;
+
+    static const ConfigStore &bundled();
+
+private:
+    enum {
+        LIST_PARAMS = 0,
+        LIST_SER_ORDER,
+        LIST_GROUPING,
+        LIST_NUM
+    };
+
+    struct Version {
+        int major;
+        int minor;
+        quint32 blocks[CONFIG_FILE_NUM];
+    };
+
+    QByteArray mData;
+    quint32 mStringCount;
+    quint32 mRecordCount;
+    quint32 mStringIndexOffset;
+    quint32 mStringDataOffset;
+    quint32 mRecordIndexOffset;
+    QVector<ConfigParam::Field> mFields;
+    QVector<Version> mVersions;
+
+    quint32 u32(quint32 offset) const;
+    quint16 u16(quint32 offset) const;
+    bool inRange(quint64 offset, quint64 len) const;
+    QPair<int, int> stringRange(quint32 id) const;
+    QString string(quint32 id) const;
+    bool expandLists(quint32 block, QVector<quint32> *lists) const;
+
+};
+
+#endif // CONFIGSTORE_H
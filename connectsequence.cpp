@@ -0,0 +1,669 @@
+/*
+    Copyright 2016 - 2024 Benjamin Vedder	benjamin@vedder.se
+
+    This file is part of VESC Tool.
+
+    VESC Tool is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    VESC Tool is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+#include "connectsequence.h"
+#include <QDebug>
+
+Q_LOGGING_CATEGORY(lcConnect, "vesc.connect", QtInfoMsg)
+
+namespace {
+// The first chunk is small, as it is only needed for the length
+const int HEAD_SIZE = 10;
+// The qCompress stream ends with the Adler-32 of the uncompressed data
+const int TAIL_SIZE = 4;
+const int CHUNK_SIZE = 400;
+const int TIMEOUT_MS = 1500;
+const int TRIES = 5;
+// Chunk requests in flight per blob and in total. The total is kept low
+// so that replies do not queue up for longer than the timeout on slow
+// links such as BLE.
+const int BLOB_WINDOW = 3;
+const int MAX_IN_FLIGHT = 4;
+}
+
+ConnectSequence::ConnectSequence(Commands *commands, ConfigParams *mcConfig,
+                                 ConfigParams *appConfig, DeviceDataCache *cache,
+                                 QObject *parent) : QObject(parent)
+{
+    mCommands = commands;
+    mMcConfig = mcConfig;
+    mAppConfig = appConfig;
+    mCache = cache;
+    mBegun = false;
+    mRunning = false;
+    mInteractive = false;
+
+    for (int i = 0;i < STAGE_NUM;i++) {
+        mStages[i] = {STATE_WAITING, 0, 0, 0, 0, 0};
+    }
+
+    mTimer = new QTimer(this);
+    mTimer->setInterval(50);
+    connect(mTimer, SIGNAL(timeout()), this, SLOT(timerSlot()));
+
+    connect(mCommands, &Commands::customConfigChunkRx,
+            [this](int confInd, int lenConf, int ofsConf, QByteArray data) {
+        chunkRx(DeviceDataCache::DATA_CUSTOM_CONFIG, confInd, lenConf, ofsConf, data);
+    });
+    connect(mCommands, &Commands::qmluiHwRx, [this](int lenQml, int ofsQml, QByteArray data) {
+        chunkRx(DeviceDataCache::DATA_QML_HW, 0, lenQml, ofsQml, data);
+    });
+    connect(mCommands, &Commands::qmluiAppRx, [this](int lenQml, int ofsQml, QByteArray data) {
+        chunkRx(DeviceDataCache::DATA_QML_APP, 0, lenQml, ofsQml, data);
+    });
+    connect(mMcConfig, &ConfigParams::updated, [this]() {
+        configReceived(STAGE_MCCONF);
+    });
+    connect(mAppConfig, &ConfigParams::updated, [this]() {
+        configReceived(STAGE_APPCONF);
+    });
+}
+
+/**
+ * @brief ConnectSequence::begin
+ * Mark the time at which the transport connected, so that the time to
+ * interactive includes reading the firmware version.
+ *
+ * @param transport
+ * Name of the transport, which the times are grouped by.
+ */
+void ConnectSequence::begin(const QString &transport)
+{
+    abort();
+
+    mTransport = transport;
+    mElapsed.start();
+    mBegun = true;
+
+    for (int i = 0;i < STAGE_NUM;i++) {
+        mStages[i] = {STATE_WAITING, 0, 0, 0, 0, 0};
+    }
+    mStages[STAGE_FW_VERSION].state = STATE_RUNNING;
+}
+
+/**
+ * @brief ConnectSequence::start
+ * Start reading from the VESC after its firmware version was received.
+ *
+ * @param params
+ * The firmware version parameters.
+ *
+ * @param readConfigs
+ * Read the motor and app configuration.
+ *
+ * @param loadQmlUi
+ * Read the qmlui if the VESC has any.
+ */
+void ConnectSequence::start(const FW_RX_PARAMS &params, bool readConfigs, bool loadQmlUi)
+{
+    abort();
+
+    // Without begin, e.g. when switching CAN device, the time starts here
+    if (!mBegun) {
+        mElapsed.start();
+    }
+
+    mBegun = false;
+    mRunning = true;
+    mInteractive = false;
+
+    qint64 now = mElapsed.elapsed();
+    qint64 fwStart = mStages[STAGE_FW_VERSION].state == STATE_RUNNING ?
+                mStages[STAGE_FW_VERSION].startMs : now;
+
+    for (int i = 0;i < STAGE_NUM;i++) {
+        mStages[i] = {STATE_WAITING, 1u << STAGE_FW_VERSION, 0, 0, 0, 0};
+    }
+
+    mStages[STAGE_FW_VERSION] = {STATE_DONE, 0, 1, fwStart, fwStart, now};
+
+    for (int i = 0;i < params.customConfigNum;i++) {
+        mBlobs.append({DeviceDataCache::DATA_CUSTOM_CONFIG, i, BLOB_HEAD, -1, 0,
+                       QByteArray(), QByteArray(), QMap<int, Request>(), QMap<int, QByteArray>()});
+    }
+
+    if (loadQmlUi && params.hasQmlHw) {
+        mBlobs.append({DeviceDataCache::DATA_QML_HW, 0, BLOB_HEAD, -1, 0,
+                       QByteArray(), QByteArray(), QMap<int, Request>(), QMap<int, QByteArray>()});
+    }
+
+    if (loadQmlUi && params.hasQmlApp) {
+        mBlobs.append({DeviceDataCache::DATA_QML_APP, 0, BLOB_HEAD, -1, 0,
+                       QByteArray(), QByteArray(), QMap<int, Request>(), QMap<int, QByteArray>()});
+    }
+
+    bool skip[STAGE_NUM] = {false};
+    skip[STAGE_MCCONF] = !readConfigs;
+    skip[STAGE_APPCONF] = !readConfigs;
+    skip[STAGE_CUSTOM_CONFIG] = params.customConfigNum <= 0;
+    skip[STAGE_QML] = !(loadQmlUi && (params.hasQmlHw || params.hasQmlApp));
+
+    mTimer->start();
+    emit stageFinished(STAGE_FW_VERSION, true);
+
+    // One at a time, so that a stage that is skipped is not seen as finished
+    // by the handlers of the stages before it
+    for (int i = 0;i < STAGE_NUM && mRunning;i++) {
+        if (skip[i]) {
+            mStages[i].startMs = now;
+            setState(STAGE(i), STATE_SKIPPED);
+        }
+    }
+
+    update();
+}
+
+void ConnectSequence::abort()
+{
+    mRunning = false;
+    mTimer->stop();
+    mBlobs.clear();
+}
+
+bool ConnectSequence::isRunning() const
+{
+    return mRunning;
+}
+
+ConnectSequence::STATE ConnectSequence::stageState(STAGE stage) const
+{
+    return mStages[stage].state;
+}
+
+qint64 ConnectSequence::stageTimeMs(STAGE stage) const
+{
+    return mStages[stage].endMs - mStages[stage].startMs;
+}
+
+/**
+ * @brief ConnectSequence::data
+ * Get a custom config or qmlui that was read.
+ *
+ * @param type
+ * The type of data.
+ *
+ * @param index
+ * Index of the custom config, 0 for the qmlui.
+ *
+ * @param len
+ * Set to the length the VESC reported, or -1 if it did not respond.
+ *
+ * @return
+ * The data that was read. It is only complete if its size equals len.
+ */
+QByteArray ConnectSequence::data(DeviceDataCache::DATA_TYPE type, int index, int *len) const
+{
+    for (const auto &b: mBlobs) {
+        if (b.type == type && b.index == index) {
+            if (len) {
+                *len = b.len;
+            }
+            return b.data;
+        }
+    }
+
+    if (len) {
+        *len = -1;
+    }
+    return QByteArray();
+}
+
+QString ConnectSequence::transport() const
+{
+    return mTransport;
+}
+
+/**
+ * @brief ConnectSequence::timingReport
+ * When each stage of the last sequence started and finished, in ms from the
+ * transport connecting.
+ */
+QString ConnectSequence::timingReport() const
+{
+    static const char *stateNames[] = {"waiting", "running", "done", "failed", "skipped"};
+
+    QStringList stages;
+    for (int i = 0;i < STAGE_NUM;i++) {
+        const auto &s = mStages[i];
+        if (s.state == STATE_SKIPPED) {
+            continue;
+        }
+
+        stages.append(QString("%1 %2 %3-%4 ms").arg(stageName(STAGE(i))).
+                      arg(stateNames[s.state]).arg(s.startMs).arg(s.endMs));
+    }
+
+    return QString("Connect sequence over %1: %2").arg(mTransport, stages.join(", "));
+}
+
+/**
+ * @brief ConnectSequence::transportReport
+ * Time to interactive of all connections since start, per transport.
+ */
+QString ConnectSequence::transportReport() const
+{
+    QStringList res;
+    for (auto it = mTransportStats.constBegin();it != mTransportStats.constEnd();++it) {
+        const auto &s = it.value();
+        res.append(QString("%1: %2 connections, last %3 ms, mean %4 ms, min %5 ms, max %6 ms").
+                   arg(it.key()).arg(s.connections).arg(s.lastMs).
+                   arg(s.totalMs / s.connections).arg(s.minMs).arg(s.maxMs));
+    }
+    return res.join("\n");
+}
+
+QString ConnectSequence::stageName(STAGE stage)
+{
+    switch (stage) {
+    case STAGE_FW_VERSION: return "FW version";
+    case STAGE_MCCONF: return "MC config";
+    case STAGE_APPCONF: return "App config";
+    case STAGE_CUSTOM_CONFIG: return "Custom config";
+    case STAGE_QML: return "Qmlui";
+    default: return "Unknown";
+    }
+}
+
+void ConnectSequence::timerSlot()
+{
+    if (!mRunning) {
+        return;
+    }
+
+    qint64 now = mElapsed.elapsed();
+
+    for (auto stage: {STAGE_MCCONF, STAGE_APPCONF}) {
+        auto &s = mStages[stage];
+        if (s.state == STATE_RUNNING && (now - s.lastReqMs) > TIMEOUT_MS) {
+            if (s.tries >= TRIES) {
+                setState(stage, STATE_FAILED);
+            } else {
+                requestConfig(stage);
+            }
+        }
+    }
+
+    for (auto &b: mBlobs) {
+        if (b.phase == BLOB_DONE || b.phase == BLOB_FAILED) {
+            continue;
+        }
+
+        QList<int> timedOut;
+        for (auto it = b.requests.constBegin();it != b.requests.constEnd();++it) {
+            if ((now - it.value().sentMs) > TIMEOUT_MS) {
+                timedOut.append(it.key());
+            }
+        }
+
+        for (int offset: timedOut) {
+            Request req = b.requests.value(offset);
+
+            if (req.tries >= TRIES) {
+                b.phase = BLOB_FAILED;
+                b.requests.clear();
+                b.received.clear();
+                break;
+            }
+
+            sendChunkRequest(b, offset, req.size, req.tries + 1);
+        }
+    }
+
+    updateBlobStages();
+    update();
+}
+
+void ConnectSequence::setState(STAGE stage, STATE state)
+{
+    auto &s = mStages[stage];
+    s.state = state;
+
+    if (state == STATE_RUNNING) {
+        s.startMs = mElapsed.elapsed();
+        s.tries = 0;
+    } else if (state != STATE_WAITING) {
+        s.endMs = mElapsed.elapsed();
+        emit stageFinished(stage, state != STATE_FAILED);
+    }
+}
+
+/**
+ * @brief ConnectSequence::update
+ * Start the stages that became ready, send chunk requests and finish when
+ * nothing is left.
+ */
+void ConnectSequence::update()
+{
+    if (!mRunning) {
+        return;
+    }
+
+    checkInteractive();
+    startReadyStages();
+
+    if (!mRunning) {
+        return;
+    }
+
+    for (const auto &s: mStages) {
+        if (s.state == STATE_WAITING || s.state == STATE_RUNNING) {
+            return;
+        }
+    }
+
+    mRunning = false;
+    mTimer->stop();
+    qCDebug(lcConnect).noquote() << timingReport();
+    emit finished();
+}
+
+void ConnectSequence::startReadyStages()
+{
+    for (int i = 0;i < STAGE_NUM && mRunning;i++) {
+        auto &s = mStages[i];
+        if (s.state != STATE_WAITING) {
+            continue;
+        }
+
+        bool ready = true;
+        bool depFailed = false;
+        for (int j = 0;j < STAGE_NUM;j++) {
+            if (s.deps & (1u << j)) {
+                STATE d = mStages[j].state;
+                ready = ready && (d == STATE_DONE || d == STATE_SKIPPED || d == STATE_FAILED);
+                depFailed = depFailed || d == STATE_FAILED;
+            }
+        }
+
+        if (!ready) {
+            continue;
+        }
+
+        if (depFailed) {
+            setState(STAGE(i), STATE_FAILED);
+            continue;
+        }
+
+        setState(STAGE(i), STATE_RUNNING);
+        if (i == STAGE_MCCONF || i == STAGE_APPCONF) {
+            requestConfig(STAGE(i));
+        }
+    }
+
+    sendRequests();
+}
+
+void ConnectSequence::requestConfig(STAGE stage)
+{
+    auto &s = mStages[stage];
+    s.tries++;
+    s.lastReqMs = mElapsed.elapsed();
+
+    // Commands drops the request if one is in flight already
+    if (stage == STAGE_MCCONF) {
+        mCommands->getMcconf();
+    } else {
+        mCommands->getAppConf();
+    }
+}
+
+void ConnectSequence::configReceived(STAGE stage)
+{
+    if (!mRunning || mStages[stage].state != STATE_RUNNING) {
+        return;
+    }
+
+    setState(stage, STATE_DONE);
+    update();
+}
+
+/**
+ * @brief ConnectSequence::sendRequests
+ * Fill the request window. Blobs are served in order, so custom configs
+ * come before the qmlui.
+ */
+void ConnectSequence::sendRequests()
+{
+    int inFlight = requestsInFlight();
+
+    for (auto &b: mBlobs) {
+        if (inFlight >= MAX_IN_FLIGHT) {
+            break;
+        }
+
+        if (mStages[blobStage(b.type)].state != STATE_RUNNING) {
+            continue;
+        }
+
+        switch (b.phase) {
+        case BLOB_HEAD:
+            if (b.requests.isEmpty()) {
+                sendChunkRequest(b, 0, HEAD_SIZE, 1);
+                inFlight++;
+            }
+            break;
+
+        case BLOB_TAIL:
+            if (b.requests.isEmpty()) {
+                sendChunkRequest(b, b.len - TAIL_SIZE, TAIL_SIZE, 1);
+                inFlight++;
+            }
+            break;
+
+        case BLOB_BODY:
+            while (b.requests.size() < BLOB_WINDOW && b.nextOffset < b.len &&
+                   inFlight < MAX_IN_FLIGHT) {
+                int size = qMin(CHUNK_SIZE, b.len - b.nextOffset);
+                sendChunkRequest(b, b.nextOffset, size, 1);
+                b.nextOffset += size;
+                inFlight++;
+            }
+            break;
+
+        default:
+            break;
+        }
+    }
+}
+
+void ConnectSequence::sendChunkRequest(Blob &blob, int offset, int size, int tries)
+{
+    blob.requests.insert(offset, {size, tries, mElapsed.elapsed()});
+
+    switch (blob.type) {
+    case DeviceDataCache::DATA_CUSTOM_CONFIG:
+        mCommands->customConfigGetChunk(blob.index, size, offset);
+        break;
+    case DeviceDataCache::DATA_QML_HW:
+        mCommands->qmlUiHwGet(size, offset);
+        break;
+    case DeviceDataCache::DATA_QML_APP:
+        mCommands->qmlUiAppGet(size, offset);
+        break;
+    }
+}
+
+void ConnectSequence::chunkRx(DeviceDataCache::DATA_TYPE type, int index, int len, int offset, QByteArray chunk)
+{
+    if (!mRunning) {
+        return;
+    }
+
+    for (auto &b: mBlobs) {
+        if (b.type == type && b.index == index) {
+            // Replies to retried requests can arrive twice
+            if (b.requests.contains(offset)) {
+                blobReceived(b, len, offset, chunk);
+                updateBlobStages();
+                update();
+            }
+            return;
+        }
+    }
+}
+
+void ConnectSequence::blobReceived(Blob &blob, int len, int offset, QByteArray chunk)
+{
+    Request req = blob.requests.take(offset);
+
+    switch (blob.phase) {
+    case BLOB_HEAD:
+        blob.len = len;
+        blob.data = chunk;
+
+        if (len < 0) {
+            blob.phase = BLOB_FAILED;
+        } else if (blob.data.size() >= len) {
+            blob.data.truncate(len);
+            blob.phase = BLOB_DONE;
+        } else {
+            blob.cached = mCache->find(blob.type, blob.index, len, blob.data);
+            if (blob.cached.isEmpty()) {
+                mCache->addMiss();
+                blob.phase = BLOB_BODY;
+                blob.nextOffset = blob.data.size();
+            } else {
+                blob.phase = BLOB_TAIL;
+            }
+        }
+        break;
+
+    case BLOB_TAIL:
+        if (chunk == blob.cached.right(TAIL_SIZE)) {
+            blob.data = blob.cached;
+            blob.phase = BLOB_DONE;
+            mCache->addHit(blob.len);
+        } else {
+            mCache->addMiss();
+            blob.phase = BLOB_BODY;
+            blob.nextOffset = blob.data.size();
+        }
+        blob.cached.clear();
+        break;
+
+    case BLOB_BODY:
+        if (chunk.isEmpty()) {
+            blob.phase = BLOB_FAILED;
+            blob.requests.clear();
+            break;
+        }
+
+        chunk.truncate(req.size);
+        if (chunk.size() < req.size) {
+            sendChunkRequest(blob, offset + chunk.size(), req.size - chunk.size(), 1);
+        }
+
+        blob.received.insert(offset, chunk);
+        while (blob.received.contains(blob.data.size())) {
+            blob.data.append(blob.received.take(blob.data.size()));
+        }
+
+        if (blob.data.size() >= blob.len) {
+            blob.data.truncate(blob.len);
+            blob.phase = BLOB_DONE;
+            blob.requests.clear();
+            blob.received.clear();
+            mCache->store(blob.type, blob.index, blob.data);
+        }
+        break;
+
+    default:
+        break;
+    }
+}
+
+/**
+ * @brief ConnectSequence::updateBlobStages
+ * Report the progress of the stages that read blobs, and finish them when
+ * all their blobs are done or failed.
+ */
+void ConnectSequence::updateBlobStages()
+{
+    for (auto stage: {STAGE_CUSTOM_CONFIG, STAGE_QML}) {
+        if (mStages[stage].state != STATE_RUNNING) {
+            continue;
+        }
+
+        qint64 received = 0;
+        qint64 total = 0;
+        bool finished = true;
+        bool failed = false;
+
+        for (const auto &b: mBlobs) {
+            if (blobStage(b.type) != stage) {
+                continue;
+            }
+
+            received += b.data.size();
+            total += qMax(b.len, 0);
+            finished = finished && (b.phase == BLOB_DONE || b.phase == BLOB_FAILED);
+            failed = failed || b.phase == BLOB_FAILED;
+        }
+
+        emit stageProgress(stage, total > 0 ? double(received) / double(total) : 0.0);
+
+        if (!mRunning) {
+            return;
+        }
+
+        if (finished) {
+            setState(stage, failed ? STATE_FAILED : STATE_DONE);
+        }
+    }
+}
+
+void ConnectSequence::checkInteractive()
+{
+    auto mcState = mStages[STAGE_MCCONF].state;
+    if (mInteractive || mStages[STAGE_FW_VERSION].state != STATE_DONE ||
+            mcState == STATE_WAITING || mcState == STATE_RUNNING) {
+        return;
+    }
+
+    mInteractive = true;
+    qint64 ms = mElapsed.elapsed();
+
+    if (mTransportStats.contains(mTransport)) {
+        auto &s = mTransportStats[mTransport];
+        s.connections++;
+        s.lastMs = ms;
+        s.totalMs += ms;
+        s.minMs = qMin(s.minMs, ms);
+        s.maxMs = qMax(s.maxMs, ms);
+    } else {
+        mTransportStats.insert(mTransport, {1, ms, ms, ms, ms});
+    }
+
+    qCDebug(lcConnect).noquote() << QString("Time to interactive over %1: %2 ms").arg(mTransport).arg(ms);
+    emit interactive(mTransport, ms);
+}
+
+int ConnectSequence::requestsInFlight() const
+{
+    int res = 0;
+    for (const auto &b: mBlobs) {
+        res += b.requests.size();
+    }
+    return res;
+}
+
+ConnectSequence::STAGE ConnectSequence::blobStage(DeviceDataCache::DATA_TYPE type)
+{
+    return type == DeviceDataCache::DATA_CUSTOM_CONFIG ? STAGE_CUSTOM_CONFIG : STAGE_QML;
+}
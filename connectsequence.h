@@ -0,0 +1,174 @@
+/*
+    Copyright 2016 - 2024 Benjamin Vedder	benjamin@vedder.se
+
+    This file is part of VESC Tool.
+
+    VESC Tool is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    VESC Tool is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+#ifndef CONNECTSEQUENCE_H
+#define CONNECTSEQUENCE_H
+
+#include <QObject>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QVector>
+#include <QMap>
+#include <QHash>
+#include <QLoggingCategory>
+#include "datatypes.h"
+#include "commands.h"
+#include "configparams.h"
+#include "devicedatacache.h"
+
+// Stage timings, time to interactive and device data cache statistics. Off
+// by default, enable with QT_LOGGING_RULES="vesc.connect.debug=true".
+Q_DECLARE_LOGGING_CATEGORY(lcConnect)
+
+/**
+ * @brief The ConnectSequence class
+ * Reads everything VESC Tool needs from a VESC after the firmware version
+ * has been received. The stages form a dependency graph, and all stages
+ * whose dependencies are done run at the same time. Custom configs and
+ * qmlui are read with several chunk requests in flight, which the protocol
+ * allows as every chunk reply carries its offset.
+ *
+ * The connection counts as interactive once the firmware version and the
+ * motor configuration are there. The time from the transport connecting to
+ * that point is logged per transport.
+ */
+class ConnectSequence : public QObject
+{
+    Q_OBJECT
+
+public:
+    typedef enum {
+        STAGE_FW_VERSION = 0,
+        STAGE_MCCONF,
+        STAGE_APPCONF,
+        STAGE_CUSTOM_CONFIG,
+        STAGE_QML,
+        STAGE_NUM
+    } STAGE;
+
+    typedef enum {
+        STATE_WAITING = 0,
+        STATE_RUNNING,
+        STATE_DONE,
+        STATE_FAILED,
+        STATE_SKIPPED
+    } STATE;
+
+    explicit ConnectSequence(Commands *commands, ConfigParams *mcConfig,
+                             ConfigParams *appConfig, DeviceDataCache *cache,
+                             QObject *parent = nullptr);
+
+    void begin(const QString &transport);
+    void start(const FW_RX_PARAMS &params, bool readConfigs, bool loadQmlUi);
+    void abort();
+    bool isRunning() const;
+
+    STATE stageState(STAGE stage) const;
+    qint64 stageTimeMs(STAGE stage) const;
+    QByteArray data(DeviceDataCache::DATA_TYPE type, int index, int *len = nullptr) const;
+    QString transport() const;
+    QString timingReport() const;
+    QString transportReport() const;
+
+    static QString stageName(STAGE stage);
+
+signals:
+    void stageProgress(int stage, double progress);
+    void stageFinished(int stage, bool ok);
+    void interactive(QString transport, qint64 ms);
+    void finished();
+
+private slots:
+    void timerSlot();
+
+private:
+    typedef enum {
+        BLOB_HEAD = 0,
+        BLOB_TAIL,
+        BLOB_BODY,
+        BLOB_DONE,
+        BLOB_FAILED
+    } BLOB_PHASE;
+
+    struct Request {
+        int size;
+        int tries;
+        qint64 sentMs;
+    };
+
+    struct Blob {
+        DeviceDataCache::DATA_TYPE type;
+        int index;
+        BLOB_PHASE phase;
+        int len;
+        int nextOffset;
+        QByteArray data;
+        QByteArray cached;
+        QMap<int, Request> requests;
+        QMap<int, QByteArray> received;
+    };
+
+    struct Stage {
+        STATE state;
+        quint32 deps;
+        int tries;
+        qint64 startMs;
+        qint64 lastReqMs;
+        qint64 endMs;
+    };
+
+    struct TransportStats {
+        int connections;
+        qint64 lastMs;
+        qint64 totalMs;
+        qint64 minMs;
+        qint64 maxMs;
+    };
+
+    Commands *mCommands;
+    ConfigParams *mMcConfig;
+    ConfigParams *mAppConfig;
+    DeviceDataCache *mCache;
+    QTimer *mTimer;
+    QElapsedTimer mElapsed;
+    QString mTransport;
+    bool mBegun;
+    bool mRunning;
+    bool mInteractive;
+    Stage mStages[STAGE_NUM];
+    QVector<Blob> mBlobs;
+    QHash<QString, TransportStats> mTransportStats;
+
+    void setState(STAGE stage, STATE state);
+    void update();
+    void startReadyStages();
+    void requestConfig(STAGE stage);
+    void configReceived(STAGE stage);
+    void sendRequests();
+    void sendChunkRequest(Blob &blob, int offset, int size, int tries);
+    void chunkRx(DeviceDataCache::DATA_TYPE type, int index, int len, int offset, QByteArray chunk);
+    void blobReceived(Blob &blob, int len, int offset, QByteArray chunk);
+    void updateBlobStages();
+    void checkInteractive();
+    int requestsInFlight() const;
+    static STAGE blobStage(DeviceDataCache::DATA_TYPE type);
+
+};
+
+#endif // CONNECTSEQUENCE_H
@@ -0,0 +1,242 @@
+/*
+    Copyright 2016 - 2024 Benjamin Vedder	benjamin@vedder.se
+
+    This file is part of VESC Tool.
+
+    VESC Tool is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    VESC Tool is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+#include "devicedatacache.h"
+#include <QCryptographicHash>
+#include <QStandardPaths>
+#include <QSaveFile>
+#include <QFile>
+#include <QDir>
+#include <QDateTime>
+#include <QSet>
+
+DeviceDataCache::DeviceDataCache()
+{
+    mDir = QStandardPaths::writableLocation(QStandardPaths::CacheLocation);
+    if (!mDir.isEmpty()) {
+        mDir += "/device_data";
+    }
+
+    mEnabled = true;
+    mHits = 0;
+    mMisses = 0;
+    mBytesFromCache = 0;
+}
+
+/**
+ * @brief DeviceDataCache::setDevice
+ * Set the device that the following lookups are for.
+ */
+void DeviceDataCache::setDevice(const QByteArray &uuid, int fwMajor, int fwMinor)
+{
+    mDevice = QString("%1_%2.%3").arg(QString::fromLatin1(uuid.toHex())).arg(fwMajor).arg(fwMinor);
+}
+
+/**
+ * @brief DeviceDataCache::find
+ * Look up cached data.
+ *
+ * @param type
+ * The type of data.
+ *
+ * @param index
+ * Index of the custom config, 0 for the QML UIs.
+ *
+ * @param len
+ * Length of the data, as reported by the VESC.
+ *
+ * @param head
+ * The first chunk of the data, as read from the VESC.
+ *
+ * @return
+ * The cached data, or an empty array if there is none that matches. The
+ * caller has to compare its end with the VESC before using it. A match
+ * counts as a use for the least recently used eviction.
+ */
+QByteArray DeviceDataCache::find(DATA_TYPE type, int index, int len, const QByteArray &head) const
+{
+    if (!mEnabled || mDir.isEmpty() || mDevice.isEmpty()) {
+        return QByteArray();
+    }
+
+    QFile keyFile(keyPath(type, index, len));
+    if (!keyFile.open(QIODevice::ReadOnly)) {
+        return QByteArray();
+    }
+
+    QByteArray hash = QByteArray::fromHex(keyFile.readAll().trimmed());
+    keyFile.close();
+
+    QFile blobFile(blobPath(hash));
+    if (!blobFile.open(QIODevice::ReadOnly)) {
+        return QByteArray();
+    }
+
+    QByteArray data = blobFile.readAll();
+    blobFile.close();
+
+    if (data.size() != len || !data.startsWith(head) ||
+            QCryptographicHash::hash(data, QCryptographicHash::Sha1) != hash) {
+        return QByteArray();
+    }
+
+    touch(keyFile.fileName());
+    touch(blobFile.fileName());
+
+    return data;
+}
+
+void DeviceDataCache::store(DATA_TYPE type, int index, const QByteArray &data)
+{
+    if (!mEnabled || mDir.isEmpty() || mDevice.isEmpty() ||
+            !QDir().mkpath(mDir + "/keys") || !QDir().mkpath(mDir + "/blobs")) {
+        return;
+    }
+
+    QByteArray hash = QCryptographicHash::hash(data, QCryptographicHash::Sha1);
+
+    if (!QFile::exists(blobPath(hash))) {
+        QSaveFile blobFile(blobPath(hash));
+        if (!blobFile.open(QIODevice::WriteOnly)) {
+            return;
+        }
+        blobFile.write(data);
+        if (!blobFile.commit()) {
+            return;
+        }
+    }
+
+    QSaveFile keyFile(keyPath(type, index, data.size()));
+    if (keyFile.open(QIODevice::WriteOnly)) {
+        keyFile.write(hash.toHex());
+        keyFile.commit();
+    }
+
+    touch(blobPath(hash));
+    prune();
+}
+
+void DeviceDataCache::clear()
+{
+    if (!mDir.isEmpty()) {
+        QDir(mDir).removeRecursively();
+    }
+}
+
+void DeviceDataCache::addHit(int bytes)
+{
+    mHits++;
+    mBytesFromCache += bytes;
+}
+
+void DeviceDataCache::addMiss()
+{
+    mMisses++;
+}
+
+int DeviceDataCache::hits() const
+{
+    return mHits;
+}
+
+int DeviceDataCache::misses() const
+{
+    return mMisses;
+}
+
+qint64 DeviceDataCache::bytesFromCache() const
+{
+    return mBytesFromCache;
+}
+
+QString DeviceDataCache::statsString() const
+{
+    return QString("%1 hits, %2 misses, %3 bytes read from cache").
+            arg(mHits).arg(mMisses).arg(mBytesFromCache);
+}
+
+bool DeviceDataCache::isEnabled() const
+{
+    return mEnabled;
+}
+
+void DeviceDataCache::setEnabled(bool enabled)
+{
+    mEnabled = enabled;
+}
+
+QString DeviceDataCache::keyPath(DATA_TYPE type, int index, int len) const
+{
+    QString key = QString("%1_%2_%3_%4").arg(mDevice).arg(int(type)).arg(index).arg(len);
+    return mDir + "/keys/" + QString::fromLatin1(
+                QCryptographicHash::hash(key.toUtf8(), QCryptographicHash::Md5).toHex());
+}
+
+QString DeviceDataCache::blobPath(const QByteArray &hash) const
+{
+    return mDir + "/blobs/" + QString::fromLatin1(hash.toHex()) + ".bin";
+}
+
+/**
+ * @brief DeviceDataCache::touch
+ * Mark a file as used now. The modification time is the last use of keys
+ * and data, and decides what is evicted first.
+ */
+void DeviceDataCache::touch(const QString &path) const
+{
+    QFile file(path);
+    if (file.open(QIODevice::Append)) {
+        file.setFileTime(QDateTime::currentDateTime(), QFileDevice::FileModificationTime);
+        file.close();
+    }
+}
+
+/**
+ * @brief DeviceDataCache::prune
+ * Remove the least recently used entries above maxEntries, data that no
+ * entry points to any more and the least recently used data above maxBytes.
+ * Entries whose data was removed are not found any more and age out.
+ */
+void DeviceDataCache::prune()
+{
+    auto keys = QDir(mDir + "/keys").entryInfoList(QDir::Files, QDir::Time);
+    QSet<QString> used;
+
+    for (int i = 0;i < keys.size();i++) {
+        if (i >= maxEntries) {
+            QFile::remove(keys.at(i).absoluteFilePath());
+            continue;
+        }
+
+        QFile keyFile(keys.at(i).absoluteFilePath());
+        if (keyFile.open(QIODevice::ReadOnly)) {
+            used.insert(QString::fromLatin1(keyFile.readAll().trimmed()) + ".bin");
+            keyFile.close();
+        }
+    }
+
+    qint64 bytes = 0;
+    for (const auto &blob: QDir(mDir + "/blobs").entryInfoList(QDir::Files, QDir::Time)) {
+        if (!used.contains(blob.fileName()) || (bytes + blob.size()) > maxBytes) {
+            QFile::remove(blob.absoluteFilePath());
+        } else {
+            bytes += blob.size();
+        }
+    }
+}
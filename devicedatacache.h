@@ -0,0 +1,86 @@
+/*
+    Copyright 2016 - 2024 Benjamin Vedder	benjamin@vedder.se
+
+    This file is part of VESC Tool.
+
+    VESC Tool is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    VESC Tool is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+#ifndef DEVICEDATACACHE_H
+#define DEVICEDATACACHE_H
+
+#include <QByteArray>
+#include <QString>
+
+/**
+ * @brief The DeviceDataCache class
+ * On-disk cache for the custom configurations and QML UIs that are read from
+ * the VESC in chunks when connecting. Entries are found by device UUID,
+ * firmware version, data type, index and length, and point to the data
+ * stored under its SHA-1, so that boards with the same data share it.
+ *
+ * The data is compressed with qCompress, which ends with the Adler-32 of the
+ * uncompressed content. A cached entry is therefore only used if its first
+ * chunk and its last four bytes match what the VESC sends for the same
+ * offsets.
+ *
+ * Every device and firmware version adds entries, so the cache is limited
+ * to maxEntries entries and maxBytes of data. The least recently used
+ * entries and data are removed when something new is stored.
+ */
+class DeviceDataCache
+{
+public:
+    typedef enum {
+        DATA_CUSTOM_CONFIG = 0,
+        DATA_QML_HW,
+        DATA_QML_APP
+    } DATA_TYPE;
+
+    DeviceDataCache();
+
+    void setDevice(const QByteArray &uuid, int fwMajor, int fwMinor);
+    QByteArray find(DATA_TYPE type, int index, int len, const QByteArray &head) const;
+    void store(DATA_TYPE type, int index, const QByteArray &data);
+    void clear();
+
+    void addHit(int bytes);
+    void addMiss();
+    int hits() const;
+    int misses() const;
+    qint64 bytesFromCache() const;
+    QString statsString() const;
+
+    bool isEnabled() const;
+    void setEnabled(bool enabled);
+
+    static const int maxEntries = 256;
+    static const qint64 maxBytes = 16 * 1024 * 1024;
+
+private:
+    QString mDir;
+    QString mDevice;
+    bool mEnabled;
+    int mHits;
+    int mMisses;
+    qint64 mBytesFromCache;
+
+    QString keyPath(DATA_TYPE type, int index, int len) const;
+    QString blobPath(const QByteArray &hash) const;
+    void touch(const QString &path) const;
+    void prune();
+
+};
+
+#endif // DEVICEDATACACHE_H
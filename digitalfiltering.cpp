@@ -18,9 +18,17 @@
     */
 
 #include "digitalfiltering.h"
+#include "fftw3wrapper.h"
 #include <cmath>
+#include <algorithm>
 #include <QDebug>
 
+namespace {
+// From this filter length on the overlap-save FFT convolution is faster
+// than the direct one for the signal lengths the sampled data page uses.
+const int FFT_FILTER_MIN_TAPS = 64;
+}
+
 DigitalFiltering::DigitalFiltering()
 {
 }
@@ -194,32 +202,56 @@ int DigitalFiltering::whichPowerOfTwo(unsigned int number)
     return exponent;
 }
 
+/**
+ * @brief DigitalFiltering::filterSignal
+ * Filter a signal with a FIR filter. For long filters the convolution is
+ * done with FFTs, otherwise directly. Both give the same result.
+ *
+ * @param signal
+ * The signal to filter.
+ *
+ * @param filter
+ * The filter taps, e.g. from generateFirFilter.
+ *
+ * @param padAfter
+ * Put half of the taps as zeros after the result instead of before it,
+ * which compensates for the delay of the filter.
+ *
+ * @return
+ * The filtered signal.
+ */
 QVector<double> DigitalFiltering::filterSignal(const QVector<double> &signal, const QVector<double> &filter, bool padAfter)
 {
-    QVector<double> result;
-    int taps = filter.size();
+    return applyFilter(signal, filter, padAfter, filter.size() >= FFT_FILTER_MIN_TAPS);
+}
 
-    for (int i = 0;i < taps / 2;i++) {
-        result.append(0.0);
-    }
+QVector<double> DigitalFiltering::filterSignalDirect(const QVector<double> &signal, const QVector<double> &filter, bool padAfter)
+{
+    return applyFilter(signal, filter, padAfter, false);
+}
 
-    if (!padAfter) {
-        for (int i = 0;i < taps / 2;i++) {
-            result.append(0.0);
-        }
-    }
+QVector<double> DigitalFiltering::filterSignalFft(const QVector<double> &signal, const QVector<double> &filter, bool padAfter)
+{
+    return applyFilter(signal, filter, padAfter, true);
+}
 
-    for (int i = 0;i < signal.size() - taps;i++) {
-        double coeff = 0;
-        for (int j = 0;j < taps;j++) {
-            coeff += signal[i + j] * filter[j];
-        }
-        result.append(coeff);
-    }
+QVector<double> DigitalFiltering::applyFilter(const QVector<double> &signal, const QVector<double> &filter,
+                                              bool padAfter, bool useFft)
+{
+    int taps = filter.size();
+    int filteredLen = qMax(signal.size() - taps, 0);
+    int zerosBefore = padAfter ? taps / 2 : 2 * (taps / 2);
+    int zerosAfter = padAfter ? taps / 2 : 0;
 
-    if (padAfter) {
-        for (int i = 0;i < taps / 2;i++) {
-            result.append(0.0);
+    QVector<double> result(zerosBefore + filteredLen + zerosAfter, 0.0);
+
+    if (filteredLen > 0) {
+        if (useFft) {
+            correlateFft(signal.constData(), signal.size(), filter.constData(),
+                         taps, result.data() + zerosBefore, filteredLen);
+        } else {
+            correlateDirect(signal.constData(), filter.constData(),
+                            taps, result.data() + zerosBefore, filteredLen);
         }
     }
 
@@ -265,12 +297,13 @@ QVector<double> DigitalFiltering::generateFirFilter(double f_break, int bits, bo
 
 QVector<double> DigitalFiltering::fftWithShift(QVector<double> &signal, int resultBits, bool scaleByLen)
 {
-    QVector<double> result;
     int taps = signal.size();
     int resultLen = 1 << resultBits;
 
-    double *signal_vector = new double[resultLen];
-    double *imag = new double[resultLen];
+    // The signal is real, so a real-input transform of the cached plan
+    // gives the same spectrum with half of the work.
+    FFT fft(resultLen);
+    double *signal_vector = fft.input();
 
     if (resultLen < taps) {
         int sizeDiffHalf = (taps - resultLen) / 2;
@@ -279,7 +312,6 @@ QVector<double> DigitalFiltering::fftWithShift(QVector<double> &signal, int resu
 
         for(int i = 0;i < resultLen;i++) {
             signal_vector[i] = signal[i];
-            imag[i] = 0;
         }
     } else {
         int sizeDiffHalf = (resultLen - taps) / 2;
@@ -291,20 +323,86 @@ QVector<double> DigitalFiltering::fftWithShift(QVector<double> &signal, int resu
             } else {
                 signal_vector[i] = 0;
             }
-            imag[i] = 0;
         }
     }
 
     fftshift(signal_vector, resultLen);
-    fft(0, resultBits, signal_vector, imag);
+    fft.execute();
 
+    // Only half of the bins are computed. The real part of the upper half
+    // mirrors the lower half.
+    const fftw_complex *bins = fft.output();
     double div_factor = scaleByLen ? (double)taps : 1.0;
+    QVector<double> result(resultLen);
     for(int i = 0;i < resultLen;i++) {
-        result.append(fabs(signal_vector[i]) / div_factor);
+        int bin = i <= resultLen / 2 ? i : resultLen - i;
+        result[i] = fabs(bins[bin][0]) / div_factor;
     }
 
-    delete[] signal_vector;
-    delete[] imag;
-
     return result;
 }
+
+void DigitalFiltering::correlateDirect(const double *signal, const double *filter, int taps, double *result, int resultLen)
+{
+    for (int i = 0;i < resultLen;i++) {
+        double coeff = 0;
+        for (int j = 0;j < taps;j++) {
+            coeff += signal[i + j] * filter[j];
+        }
+        result[i] = coeff;
+    }
+}
+
+/**
+ * @brief DigitalFiltering::correlateFft
+ * Same as correlateDirect, using overlap-save convolution with the reversed
+ * filter. Each block of blockLen samples gives blockLen - taps + 1 results,
+ * the other results are corrupted by the circular wrap-around and dropped.
+ */
+void DigitalFiltering::correlateFft(const double *signal, int signalLen, const double *filter, int taps, double *result, int resultLen)
+{
+    // About four times the filter length keeps the discarded part of each
+    // block small, but a short signal is done in a single block.
+    int blockBits = qMin(whichPowerOfTwo(4 * taps), whichPowerOfTwo(signalLen));
+    int blockLen = 1 << blockBits;
+    int step = blockLen - taps + 1;
+    int bins = blockLen / 2 + 1;
+
+    FFT fft(blockLen);
+    IFFT ifft(blockLen);
+    double *in = fft.input();
+    const fftw_complex *spectrum = fft.output();
+
+    // Spectrum of the reversed filter, with the 1 / N of the inverse
+    // transform included.
+    for (int i = 0;i < blockLen;i++) {
+        in[i] = i < taps ? filter[taps - 1 - i] / double(blockLen) : 0.0;
+    }
+    fft.execute();
+
+    QVector<double> filterRe(bins), filterIm(bins);
+    for (int i = 0;i < bins;i++) {
+        filterRe[i] = spectrum[i][0];
+        filterIm[i] = spectrum[i][1];
+    }
+
+    for (int start = 0;start < resultLen;start += step) {
+        int available = qMin(blockLen, signalLen - start);
+        std::copy(signal + start, signal + start + available, in);
+        std::fill(in + available, in + blockLen, 0.0);
+        fft.execute();
+
+        fftw_complex *product = ifft.input();
+        for (int i = 0;i < bins;i++) {
+            double re = spectrum[i][0];
+            double im = spectrum[i][1];
+            product[i][0] = re * filterRe[i] - im * filterIm[i];
+            product[i][1] = re * filterIm[i] + im * filterRe[i];
+        }
+        ifft.execute();
+
+        const double *block = ifft.output();
+        int num = qMin(step, resultLen - start);
+        std::copy(block + taps - 1, block + taps - 1 + num, result + start);
+    }
+}
@@ -35,8 +35,16 @@ public:
     static int whichPowerOfTwo(unsigned int number);
 
     static QVector<double> filterSignal(const QVector<double> &signal, const QVector<double> &filter, bool padAfter = false);
+    static QVector<double> filterSignalDirect(const QVector<double> &signal, const QVector<double> &filter, bool padAfter = false);
+    static QVector<double> filterSignalFft(const QVector<double> &signal, const QVector<double> &filter, bool padAfter = false);
     static QVector<double> generateFirFilter(double f_break, int bits, bool useHamming);
     static QVector<double> fftWithShift(QVector<double> &signal, int resultBits, bool scaleByLen = false);
+
+private:
+    static void correlateDirect(const double *signal, const double *filter, int taps, double *result, int resultLen);
+    static void correlateFft(const double *signal, int signalLen, const double *filter, int taps, double *result, int resultLen);
+    static QVector<double> applyFilter(const QVector<double> &signal, const QVector<double> &filter, bool padAfter, bool useFft);
+
 };
 
 #endif // DIGITALFILTERING_H
@@ -19,11 +19,23 @@
 
 #include <QDebug>
 #include <QTime>
+#include <QElapsedTimer>
 #include "esp32flash.h"
+#include "serial_comm.h"
 #include "utility.h"
 
 #ifdef HAS_SERIALPORT
 static QSerialPort *sPort = nullptr;
+
+// Writes are collected and flushed before the next read, so that a SLIP packet
+// with many escaped bytes goes out in one write. Reads are served from a buffer
+// that is refilled with everything the port has whenever it runs dry.
+static QByteArray sTxBuf;
+static QByteArray sRxBuf;
+static int sRxPos = 0;
+
+static bool flushTx(uint32_t timeout);
+static void clearBuffers();
 #endif
 static int64_t sTimeEnd;
 
@@ -52,7 +64,7 @@ Esp32Flash::~Esp32Flash()
 #endif
 }
 
-bool Esp32Flash::connectEsp(QString port)
+bool Esp32Flash::connectEsp(QString port, int baudrate)
 {
 #ifdef HAS_SERIALPORT
     sPort->setPortName(port);
@@ -63,14 +75,55 @@ bool Esp32Flash::connectEsp(QString port)
         return false;
     }
 
-    sPort->setBaudRate(115200);
     sPort->setDataBits(QSerialPort::Data8);
     sPort->setParity(QSerialPort::NoParity);
     sPort->setStopBits(QSerialPort::OneStop);
     sPort->setFlowControl(QSerialPort::NoFlowControl);
 
-    esp_loader_connect_args_t connect_config = ESP_LOADER_CONNECT_DEFAULT();
-    esp_loader_error_t err = esp_loader_connect(&connect_config);
+    // Try the requested baudrate first and fall back to the old default if
+    // the adapter cannot keep up. The built in USB ignores the baudrate.
+    QList<int> baudrates = {baudrate};
+    if (baudrate > 460800 && !isBuiltinUsb()) {
+        baudrates.append(460800);
+    }
+
+    esp_loader_error_t err = ESP_LOADER_ERROR_FAIL;
+    for (int baud: baudrates) {
+        sPort->setBaudRate(115200);
+        clearBuffers();
+
+        esp_loader_connect_args_t connect_config = ESP_LOADER_CONNECT_DEFAULT();
+        err = esp_loader_connect(&connect_config);
+        if (err != ESP_LOADER_SUCCESS) {
+            break;
+        }
+
+        if (isBuiltinUsb() || baud <= 115200) {
+            break;
+        }
+
+        qDebug() << "Changing baudrate to" << baud;
+        err = esp_loader_change_baudrate(baud);
+        if (err == ESP_LOADER_ERROR_UNSUPPORTED_FUNC) {
+            err = ESP_LOADER_SUCCESS;
+            break;
+        } else if (err != ESP_LOADER_SUCCESS) {
+            continue;
+        }
+
+        loader_port_change_baudrate(baud);
+
+        // Make sure that the link works at the new rate
+        loader_port_start_timer(100);
+        err = loader_sync_cmd();
+        if (err == ESP_LOADER_SUCCESS) {
+            qDebug() << "Baudrate changed!";
+            break;
+        }
+
+        qWarning() << "No response at" << baud << "baud";
+    }
+
     if (err != ESP_LOADER_SUCCESS) {
         emit stateUpdate(QString("Cannot connect to target. Error: %1").arg(err));
         sPort->close();
@@ -91,15 +144,9 @@ bool Esp32Flash::connectEsp(QString port)
 
     emit stateUpdate(QString("Connected to %1").arg(targetName));
 
-    qDebug() << "Changing baudrate to 460800";
-    if (esp_loader_change_baudrate(460800) == ESP_LOADER_SUCCESS) {
-        loader_port_change_baudrate(460800);
-        qDebug() << "Baudrate changed!";
-    }
-
     return true;
 #else
-    (void)port;
+    (void)port; (void)baudrate;
     return false;
 #endif
 }
@@ -109,6 +156,7 @@ bool Esp32Flash::disconnectEsp()
 #ifdef HAS_SERIALPORT
     esp_loader_reset_target();
     sPort->close();
+    clearBuffers();
     emit stateUpdate("Disconnected");
 #endif
     return true;
@@ -126,12 +174,24 @@ bool Esp32Flash::flashFirmware(QByteArray data, size_t address)
 
     esp_loader_error_t err;
     static uint8_t payload[1024];
-    const uint8_t *bin_addr = (uint8_t*)data.data();
+
+    // The ROM loader on everything but the ESP8266 can inflate zlib streams,
+    // which cuts the amount of data sent over the wire to a fraction.
+    bool useDeflate = esp_loader_get_target() != ESP8266_CHIP;
+    QByteArray comp;
 
     emit stateUpdate("Erasing flash (this may take a while)...");
-    Utility::sleepWithEventLoop(500);
+    Utility::sleepWithEventLoop(10);
+
+    if (useDeflate) {
+        // qCompress prepends the uncompressed size to a regular zlib stream
+        comp = qCompress(data, 9).mid(4);
+        qDebug() << "Compressed" << size << "to" << comp.size() << "bytes";
+        err = esp_loader_flash_defl_start(address, data.constData(), size, comp.size(), sizeof(payload));
+    } else {
+        err = esp_loader_flash_start(address, size, sizeof(payload));
+    }
 
-    err = esp_loader_flash_start(address, size, sizeof(payload));
     if (err != ESP_LOADER_SUCCESS) {
         QString errStr = QString("Erasing flash failed with error: %1").arg(err);
         emit stateUpdate(errStr);
@@ -140,16 +200,26 @@ bool Esp32Flash::flashFirmware(QByteArray data, size_t address)
     }
 
     emit stateUpdate("Programming...");
-    Utility::sleepWithEventLoop(500);
+    Utility::sleepWithEventLoop(10);
+
+    QElapsedTimer timer;
+    timer.start();
 
-    size_t binary_size = size;
+    const uint8_t *bin_addr = (uint8_t*)(useDeflate ? comp.constData() : data.constData());
+    size_t binary_size = useDeflate ? comp.size() : size;
+    size_t left = binary_size;
     size_t written = 0;
 
-    while (size > 0) {
-        size_t to_read = std::min(size, sizeof(payload));
+    while (left > 0) {
+        size_t to_read = std::min(left, sizeof(payload));
         memcpy(payload, bin_addr, to_read);
 
-        err = esp_loader_flash_write(payload, to_read);
+        if (useDeflate) {
+            err = esp_loader_flash_defl_write(payload, to_read);
+        } else {
+            err = esp_loader_flash_write(payload, to_read);
+        }
+
         if (err != ESP_LOADER_SUCCESS) {
             QString errStr = QString("Packet could not be written! Code: %1").arg(err);
             emit stateUpdate(errStr);
@@ -157,15 +227,28 @@ bool Esp32Flash::flashFirmware(QByteArray data, size_t address)
             return false;
         }
 
-        size -= to_read;
+        left -= to_read;
         bin_addr += to_read;
         written += to_read;
 
         emit flashProgress(double(written) / double(binary_size));
     };
 
+    if (useDeflate) {
+        // Leave compressed flash mode, but stay in the loader for the verification
+        err = esp_loader_flash_defl_finish(false);
+        if (err != ESP_LOADER_SUCCESS) {
+            QString errStr = QString("Finishing compressed flash failed with error: %1").arg(err);
+            emit stateUpdate(errStr);
+            qWarning() << errStr;
+            return false;
+        }
+    }
+
+    qDebug() << "Wrote" << size << "bytes in" << timer.elapsed() << "ms";
+
     emit stateUpdate("Done, verifying flash...");
-    Utility::sleepWithEventLoop(500);
+    Utility::sleepWithEventLoop(10);
 
     err = esp_loader_flash_verify();
     if (err != ESP_LOADER_SUCCESS) {
@@ -183,6 +266,7 @@ bool Esp32Flash::flashFirmware(QByteArray data, size_t address)
 
     return true;
 #else
+    (void)data; (void)address;
     return false;
 #endif
 }
@@ -267,14 +351,16 @@ void Esp32Flash::serialPortError(QSerialPort::SerialPortError error)
 }
 #endif
 
-esp_loader_error_t loader_port_serial_write(const uint8_t *data, uint16_t size, uint32_t timeout)
-{
 #ifdef HAS_SERIALPORT
-    if (!sPort->isOpen()) {
-        return ESP_LOADER_ERROR_FAIL;
+static bool flushTx(uint32_t timeout)
+{
+    if (sTxBuf.isEmpty()) {
+        return true;
     }
 
-    sPort->write((char*)data, size);
+    qint64 size = sTxBuf.size();
+    sPort->write(sTxBuf);
+    sTxBuf.clear();
 
     qint64 written = 0;
     auto conn = QObject::connect(sPort, &QSerialPort::bytesWritten, [&written](qint64 bytes) {
@@ -288,7 +374,31 @@ esp_loader_error_t loader_port_serial_write(const uint8_t *data, uint16_t size,
 
     QObject::disconnect(conn);
 
-    return ok ? ESP_LOADER_SUCCESS : ESP_LOADER_ERROR_TIMEOUT;
+    return ok;
+}
+
+static void clearBuffers()
+{
+    sTxBuf.clear();
+    sRxBuf.clear();
+    sRxPos = 0;
+}
+#endif
+
+esp_loader_error_t loader_port_serial_write(const uint8_t *data, uint16_t size, uint32_t timeout)
+{
+#ifdef HAS_SERIALPORT
+    if (!sPort->isOpen()) {
+        return ESP_LOADER_ERROR_FAIL;
+    }
+
+    sTxBuf.append((const char*)data, size);
+
+    if (sTxBuf.size() >= 4096) {
+        return flushTx(timeout) ? ESP_LOADER_SUCCESS : ESP_LOADER_ERROR_TIMEOUT;
+    }
+
+    return ESP_LOADER_SUCCESS;
 #else
     (void)data;(void)size;(void)timeout;
     return ESP_LOADER_ERROR_FAIL;
@@ -303,22 +413,37 @@ esp_loader_error_t loader_port_serial_read(uint8_t *data, uint16_t size, uint32_
         return ESP_LOADER_ERROR_FAIL;
     }
 
-    QByteArray res;
-    while (size > 0 && timeout > 0) {
-        auto chunk = sPort->read(size);
-        size -= chunk.size();
-        res.append(chunk);
-        if (size > 0) {
-            Utility::sleepWithEventLoop(1);
-            timeout--;
-        }
+    QElapsedTimer timer;
+    timer.start();
+
+    if (!flushTx(timeout)) {
+        return ESP_LOADER_ERROR_TIMEOUT;
     }
 
-    for (int i = 0; i < res.size();i++) {
-        data[i] = uint8_t(res.at(i));
+    while ((sRxBuf.size() - sRxPos) < size) {
+        if (sRxPos > 0) {
+            sRxBuf.remove(0, sRxPos);
+            sRxPos = 0;
+        }
+
+        sRxBuf.append(sPort->readAll());
+
+        if (sRxBuf.size() >= size) {
+            break;
+        }
+
+        qint64 remaining = qint64(timeout) - timer.elapsed();
+        if (remaining <= 0 || !sPort->isOpen()) {
+            return ESP_LOADER_ERROR_TIMEOUT;
+        }
+
+        Utility::waitSignal(sPort, SIGNAL(readyRead()), int(remaining));
     }
 
-    return timeout > 0 ? ESP_LOADER_SUCCESS : ESP_LOADER_ERROR_TIMEOUT;
+    memcpy(data, sRxBuf.constData() + sRxPos, size);
+    sRxPos += size;
+
+    return ESP_LOADER_SUCCESS;
 #else
     (void)data;(void)size;(void)timeout;
     return ESP_LOADER_ERROR_FAIL;
@@ -426,7 +551,11 @@ esp_loader_error_t loader_port_change_baudrate(uint32_t baudrate)
     if (!sPort->isOpen()) {
         return ESP_LOADER_ERROR_FAIL;
     }
+    flushTx(100);
     sPort->setBaudRate(baudrate);
+    sPort->clear(QSerialPort::Input);
+    sRxBuf.clear();
+    sRxPos = 0;
     return ESP_LOADER_SUCCESS;
 #else
     (void)baudrate;
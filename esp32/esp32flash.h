@@ -35,7 +35,7 @@ public:
     explicit Esp32Flash(QObject *parent = nullptr);
     ~Esp32Flash();
 
-    bool connectEsp(QString port);
+    bool connectEsp(QString port, int baudrate = 921600);
     bool disconnectEsp();
     bool flashFirmware(QByteArray data, size_t address);
     bool eraseFlash(size_t size, size_t address);
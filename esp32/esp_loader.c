@@ -33,6 +33,7 @@
 static const uint32_t DEFAULT_TIMEOUT = 3000;
 static const uint32_t DEFAULT_FLASH_TIMEOUT = 4000;       // timeout for most flash operations
 static const uint32_t ERASE_REGION_TIMEOUT_PER_MB = 12000; // timeout (per megabyte) for erasing a region
+static const uint32_t ERASE_WRITE_TIMEOUT_PER_MB = 40000;  // timeout (per megabyte) for erasing and writing data
 static const uint8_t  PADDING_PATTERN = 0xFF;
 
 typedef enum {
@@ -40,6 +41,7 @@ typedef enum {
 } spi_flash_cmd_t;
 
 static uint32_t s_flash_write_size = 0;
+static uint32_t s_defl_compressed_size = 0;
 static const target_registers_t *s_reg = NULL;
 static target_chip_t s_target = ESP_UNKNOWN_CHIP;
 
@@ -219,12 +221,8 @@ static esp_loader_error_t detect_flash_size(size_t *flash_size)
     return ESP_LOADER_SUCCESS;
 }
 
-esp_loader_error_t esp_loader_flash_start(uint32_t offset, uint32_t image_size, uint32_t block_size)
+static esp_loader_error_t set_flash_parameters(uint32_t image_size)
 {
-    uint32_t blocks_to_write = (image_size + block_size - 1) / block_size;
-    uint32_t erase_size = block_size * blocks_to_write;
-    s_flash_write_size = block_size;
-
     size_t flash_size = 0;
     if (detect_flash_size(&flash_size) == ESP_LOADER_SUCCESS) {
         if (image_size > flash_size) {
@@ -236,6 +234,17 @@ esp_loader_error_t esp_loader_flash_start(uint32_t offset, uint32_t image_size,
         loader_port_debug_print("Flash size detection failed, falling back to default");
     }
 
+    return ESP_LOADER_SUCCESS;
+}
+
+esp_loader_error_t esp_loader_flash_start(uint32_t offset, uint32_t image_size, uint32_t block_size)
+{
+    uint32_t blocks_to_write = (image_size + block_size - 1) / block_size;
+    uint32_t erase_size = block_size * blocks_to_write;
+    s_flash_write_size = block_size;
+
+    RETURN_ON_ERROR( set_flash_parameters(image_size) );
+
     init_md5(offset, image_size);
 
     bool encryption_in_cmd = encryption_in_begin_flash_cmd(s_target);
@@ -263,6 +272,55 @@ esp_loader_error_t esp_loader_flash_write(void *payload, uint32_t size)
 }
 
 
+esp_loader_error_t esp_loader_flash_defl_start(uint32_t offset, const void *image, uint32_t image_size,
+                                               uint32_t compressed_size, uint32_t block_size)
+{
+    if (s_target == ESP8266_CHIP) {
+        return ESP_LOADER_ERROR_UNSUPPORTED_FUNC;
+    }
+
+    uint32_t blocks_to_write = (compressed_size + block_size - 1) / block_size;
+    // The ROM loader wants the uncompressed size rounded up to whole blocks
+    uint32_t write_size = block_size * ((image_size + block_size - 1) / block_size);
+    s_flash_write_size = block_size;
+    s_defl_compressed_size = compressed_size;
+
+    RETURN_ON_ERROR( set_flash_parameters(image_size) );
+
+    // The target computes the MD5 over the uncompressed data in flash
+    init_md5(offset, image_size);
+    md5_update(image, image_size);
+
+    bool encryption_in_cmd = encryption_in_begin_flash_cmd(s_target);
+
+    loader_port_start_timer(timeout_per_mb(write_size, ERASE_REGION_TIMEOUT_PER_MB));
+    return loader_flash_defl_begin_cmd(offset, write_size, block_size, blocks_to_write, encryption_in_cmd);
+}
+
+
+esp_loader_error_t esp_loader_flash_defl_write(const void *payload, uint32_t size)
+{
+    if (size > s_flash_write_size || s_defl_compressed_size == 0) {
+        return ESP_LOADER_ERROR_INVALID_PARAM;
+    }
+
+    // The target decompresses and writes each block before responding, so scale
+    // the timeout with the estimated uncompressed size of this block.
+    uint32_t uncompressed = (uint32_t)(((uint64_t)size * s_image_size) / s_defl_compressed_size);
+    loader_port_start_timer(timeout_per_mb(uncompressed, ERASE_WRITE_TIMEOUT_PER_MB));
+
+    return loader_flash_defl_data_cmd(payload, size);
+}
+
+
+esp_loader_error_t esp_loader_flash_defl_finish(bool reboot)
+{
+    loader_port_start_timer(DEFAULT_TIMEOUT);
+
+    return loader_flash_defl_end_cmd(!reboot);
+}
+
+
 esp_loader_error_t esp_loader_flash_finish(bool reboot)
 {
     loader_port_start_timer(DEFAULT_TIMEOUT);
@@ -150,6 +150,51 @@ esp_loader_error_t esp_loader_flash_start(uint32_t offset, uint32_t image_size,
   */
 esp_loader_error_t esp_loader_flash_write(void *payload, uint32_t size);
 
+/**
+  * @brief Initiates compressed flash operation. The data is sent with
+  *        esp_loader_flash_defl_write as a zlib stream, which the target
+  *        inflates while writing.
+  *
+  * @param offset[in]           Address from which flash operation will be performed.
+  * @param image[in]            Uncompressed image, used for the MD5 checked by esp_loader_flash_verify.
+  * @param image_size[in]       Size of the uncompressed image.
+  * @param compressed_size[in]  Size of the compressed stream.
+  * @param block_size[in]       Maximum size of each compressed chunk passed to esp_loader_flash_defl_write.
+  *
+  * @return
+  *     - ESP_LOADER_SUCCESS Success
+  *     - ESP_LOADER_ERROR_TIMEOUT Timeout
+  *     - ESP_LOADER_ERROR_INVALID_RESPONSE Internal error
+  *     - ESP_LOADER_ERROR_UNSUPPORTED_FUNC Unsupported on the target
+  */
+esp_loader_error_t esp_loader_flash_defl_start(uint32_t offset, const void *image, uint32_t image_size,
+                                               uint32_t compressed_size, uint32_t block_size);
+
+/**
+  * @brief Writes a chunk of the compressed stream to target's flash memory.
+  *
+  * @param payload[in]      Compressed data.
+  * @param size[in]         Size of payload in bytes, at most block_size. No padding is added.
+  *
+  * @return
+  *     - ESP_LOADER_SUCCESS Success
+  *     - ESP_LOADER_ERROR_TIMEOUT Timeout
+  *     - ESP_LOADER_ERROR_INVALID_RESPONSE Internal error
+  */
+esp_loader_error_t esp_loader_flash_defl_write(const void *payload, uint32_t size);
+
+/**
+  * @brief Ends compressed flash operation.
+  *
+  * @param reboot[in]       reboot the target if true.
+  *
+  * @return
+  *     - ESP_LOADER_SUCCESS Success
+  *     - ESP_LOADER_ERROR_TIMEOUT Timeout
+  *     - ESP_LOADER_ERROR_INVALID_RESPONSE Internal error
+  */
+esp_loader_error_t esp_loader_flash_defl_finish(bool reboot);
+
 /**
   * @brief Ends flash operation.
   *
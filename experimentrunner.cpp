@@ -0,0 +1,567 @@
+/*
+    Copyright 2016 - 2024 Benjamin Vedder	benjamin@vedder.se
+
+    This file is part of VESC Tool.
+
+    VESC Tool is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    VESC Tool is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+#include "experimentrunner.h"
+#include "vescinterface.h"
+#include "iothread.h"
+#include "packet.h"
+#include "vbytearray.h"
+#include <QMutexLocker>
+#include <QDebug>
+#include <cmath>
+
+namespace {
+// Requests whose reply has not arrived by then are considered lost
+const qint64 replyTimeoutNs = 500000000LL;
+// How much meter history to keep for interpolation
+const qint64 meterHistoryNs = 5000000000LL;
+// COMM_GET_VALUES_SELECTIVE fields requested during sweeps: the temperatures,
+// currents, duty cycle, rpm, input voltage, fault, vesc_id and the individual
+// MOSFET temperatures. The mask comes back with the reply, which tells the
+// replies to the sweep apart from those requested by other pages.
+const unsigned int sampleMask = (1 << 0) | (1 << 1) | (1 << 2) | (1 << 3) |
+        (1 << 6) | (1 << 7) | (1 << 8) | (1 << 15) | (1 << 17) | (1 << 18);
+}
+
+ExperimentWorker::ExperimentWorker(ExperimentRunner *runner) : QObject()
+{
+    mRunner = runner;
+    mTimer = nullptr;
+    mMeterTimer = nullptr;
+    mStartNs = 0;
+    mTick = 0;
+    mHolding = false;
+    mMeterPollCurrent = false;
+#ifdef HAS_SERIALPORT
+    mMeterPort = nullptr;
+#endif
+}
+
+void ExperimentWorker::init()
+{
+    mTimer = new QTimer(this);
+    mTimer->setSingleShot(true);
+    mTimer->setTimerType(Qt::PreciseTimer);
+    connect(mTimer, &QTimer::timeout, this, &ExperimentWorker::tick);
+
+    mMeterTimer = new QTimer(this);
+    mMeterTimer->setInterval(5);
+    connect(mMeterTimer, &QTimer::timeout, this, &ExperimentWorker::pollMeter);
+
+#ifdef HAS_SERIALPORT
+    mMeterPort = new QSerialPort(this);
+    connect(mMeterPort, &QSerialPort::readyRead, this, &ExperimentWorker::meterDataAvailable);
+#endif
+}
+
+void ExperimentWorker::start()
+{
+    mTimer->stop();
+    mTick = 0;
+    mHolding = false;
+    mStartNs = IoThread::timestampNs();
+    tick();
+}
+
+void ExperimentWorker::stop()
+{
+    bool wasActive = mRunner->mRunning || mHolding;
+
+    mTimer->stop();
+    mRunner->mRunning = false;
+    mHolding = false;
+
+    {
+        QMutexLocker locker(&mRunner->mMutex);
+        mRunner->mPending.clear();
+    }
+
+    if (wasActive) {
+        VByteArray vb;
+        vb.vbAppendInt8(COMM_SET_CURRENT);
+        vb.vbAppendDouble32(0.0, 1e3);
+        send(vb);
+    }
+}
+
+bool ExperimentWorker::openMeter(QString port)
+{
+#ifdef HAS_SERIALPORT
+    closeMeter();
+
+    mMeterPort->setPortName(port);
+    mMeterPort->open(QIODevice::ReadWrite);
+
+    if (!mMeterPort->isOpen()) {
+        return false;
+    }
+
+    mMeterPort->setBaudRate(19200);
+    mMeterPort->setDataBits(QSerialPort::Data8);
+    mMeterPort->setParity(QSerialPort::NoParity);
+    mMeterPort->setStopBits(QSerialPort::OneStop);
+    mMeterPort->setFlowControl(QSerialPort::NoFlowControl);
+
+    {
+        QMutexLocker locker(&mRunner->mMutex);
+        mRunner->mMeterVoltage.clear();
+        mRunner->mMeterCurrent.clear();
+    }
+
+    mMeterData.clear();
+    mRunner->mMeterOpen = true;
+    mMeterTimer->start();
+    return true;
+#else
+    (void)port;
+    return false;
+#endif
+}
+
+void ExperimentWorker::closeMeter()
+{
+    mMeterTimer->stop();
+#ifdef HAS_SERIALPORT
+    if (mMeterPort->isOpen()) {
+        mMeterPort->close();
+    }
+#endif
+    mRunner->mMeterOpen = false;
+}
+
+void ExperimentWorker::tick()
+{
+    if (!mRunner->mRunning) {
+        return;
+    }
+
+    ExperimentRunner::Sweep sweep;
+    {
+        QMutexLocker locker(&mRunner->mMutex);
+        sweep = mRunner->mSweep;
+    }
+
+    if (mHolding) {
+        VByteArray vb;
+        vb.vbAppendInt8(COMM_SET_RPM);
+        vb.vbAppendInt32(sweep.holdRpmValue);
+        send(vb);
+        mTick++;
+        scheduleNext();
+        return;
+    }
+
+    double step = sweep.step;
+    if (sweep.from > sweep.to) {
+        step = -step;
+    }
+
+    if (step == 0.0 || sweep.stepTime <= 0.0 || sweep.intervalMs <= 0) {
+        finish();
+        return;
+    }
+
+    // Everything is derived from the sample index, so that a GUI or
+    // scheduling delay cannot change which set point a sample belongs to.
+    double totalTime = ((sweep.to - sweep.from) / step) * sweep.stepTime;
+    double time = double(mTick) * double(sweep.intervalMs) / 1000.0;
+
+    if (time >= totalTime) {
+        if (sweep.mode == ExperimentRunner::SWEEP_RPM && sweep.holdRpm) {
+            mHolding = true;
+            emit progress(1.0);
+            tick();
+        } else {
+            finish();
+        }
+        return;
+    }
+
+    double setpoint = sweep.from + floor(time / sweep.stepTime) * step;
+
+    VByteArray vb;
+    switch (sweep.mode) {
+    case ExperimentRunner::SWEEP_DUTY:
+        vb.vbAppendInt8(COMM_SET_DUTY);
+        vb.vbAppendDouble32(setpoint, 1e5);
+        break;
+
+    case ExperimentRunner::SWEEP_CURRENT:
+        vb.vbAppendInt8(COMM_SET_CURRENT);
+        vb.vbAppendDouble32(setpoint, 1e3);
+        break;
+
+    case ExperimentRunner::SWEEP_RPM:
+        vb.vbAppendInt8(COMM_SET_RPM);
+        vb.vbAppendInt32(int(setpoint));
+        break;
+    }
+    send(vb);
+
+    {
+        QMutexLocker locker(&mRunner->mMutex);
+        ExperimentRunner::Pending p;
+        p.tick = mTick;
+        p.setpoint = setpoint;
+        p.cmdNs = IoThread::timestampNs();
+        mRunner->mPending.append(p);
+    }
+
+    VByteArray vbGet;
+    vbGet.vbAppendInt8(COMM_GET_VALUES_SELECTIVE);
+    vbGet.vbAppendUint32(sampleMask);
+    send(vbGet);
+
+    emit progress(time / totalTime);
+
+    mTick++;
+    scheduleNext();
+}
+
+void ExperimentWorker::pollMeter()
+{
+#ifdef HAS_SERIALPORT
+    if (mMeterPort->isOpen()) {
+        mMeterPort->write(mMeterPollCurrent ? ":78FED00D2\n" : ":78DED00D4\n");
+        mMeterPollCurrent = !mMeterPollCurrent;
+    }
+#endif
+}
+
+void ExperimentWorker::meterDataAvailable()
+{
+#ifdef HAS_SERIALPORT
+    bool updated = false;
+
+    for (char c: mMeterPort->readAll()) {
+        mMeterData.append(c);
+
+        if (c != '\n') {
+            continue;
+        }
+
+        if (mMeterData.startsWith(':')) {
+            QString data(mMeterData);
+
+            // Example
+            // :7001000C80076
+
+            // Check checksum
+            quint8 sum = 7;
+            for (int i = 2;i < data.size();i += 2) {
+                sum += data.mid(i, 2).toInt(0, 16);
+            }
+
+            if (sum == 0x55) {
+                int cmd = data.mid(2, 2).toInt(0, 16) + data.mid(4, 2).toInt(0, 16) * 256;
+                double val = (double)((qint16)((data.mid(8, 2).toInt(0, 16)) | ((quint16)(data.mid(10, 2).toInt(0, 16)) << 8)));
+
+                ExperimentRunner::MeterPoint p;
+                p.ns = IoThread::timestampNs();
+
+                QMutexLocker locker(&mRunner->mMutex);
+                QList<ExperimentRunner::MeterPoint> *points = nullptr;
+
+                switch (cmd) {
+                case 60813:
+                    p.value = val / 100.0;
+                    points = &mRunner->mMeterVoltage;
+                    break;
+
+                case 60815:
+                    p.value = -val / 10.0;
+                    points = &mRunner->mMeterCurrent;
+                    break;
+
+                default:
+                    break;
+                }
+
+                if (points) {
+                    points->append(p);
+                    while ((p.ns - points->first().ns) > meterHistoryNs) {
+                        points->removeFirst();
+                    }
+                    updated = true;
+                }
+            }
+        }
+
+        mMeterData.clear();
+    }
+
+    if (updated) {
+        double voltage = 0.0;
+        double current = 0.0;
+
+        {
+            QMutexLocker locker(&mRunner->mMutex);
+            if (!mRunner->mMeterVoltage.isEmpty()) {
+                voltage = mRunner->mMeterVoltage.last().value;
+            }
+            if (!mRunner->mMeterCurrent.isEmpty()) {
+                current = mRunner->mMeterCurrent.last().value;
+            }
+        }
+
+        emit meterUpdated(voltage, current);
+    }
+#endif
+}
+
+void ExperimentWorker::send(const QByteArray &payload)
+{
+    QByteArray data = payload;
+
+    {
+        QMutexLocker locker(&mRunner->mMutex);
+        if (mRunner->mSendCan) {
+            data.prepend(char(mRunner->mCanId));
+            data.prepend(char(COMM_FORWARD_CAN));
+        }
+    }
+
+    // With a serial port the frame is written from this thread, so that a
+    // busy GUI thread does not delay it.
+    IoThread *io = mRunner->mIo;
+    if (io && io->isSerialOpen()) {
+        io->write(Packet::framePacket(data));
+    } else {
+        emit payloadToSend(data);
+    }
+}
+
+void ExperimentWorker::scheduleNext()
+{
+    qint64 intervalNs;
+    {
+        QMutexLocker locker(&mRunner->mMutex);
+        intervalNs = qint64(mRunner->mSweep.intervalMs) * 1000000LL;
+    }
+
+    // Schedule against the start time instead of the previous tick, so
+    // that timer jitter does not accumulate.
+    qint64 due = mStartNs + qint64(mTick) * intervalNs;
+    qint64 remaining = due - IoThread::timestampNs();
+    mTimer->start(remaining > 0 ? int((remaining + 999999) / 1000000) : 0);
+}
+
+void ExperimentWorker::finish()
+{
+    VByteArray vb;
+    vb.vbAppendInt8(COMM_SET_CURRENT);
+    vb.vbAppendDouble32(0.0, 1e3);
+    send(vb);
+
+    mTimer->stop();
+    mRunner->mRunning = false;
+    emit progress(1.0);
+    emit finished();
+}
+
+ExperimentRunner::ExperimentRunner(QObject *parent) : QObject(parent)
+{
+    mVesc = nullptr;
+    mIo = nullptr;
+    mRunning = false;
+    mMeterOpen = false;
+    mSendCan = false;
+    mCanId = -1;
+    mTargetId = -1;
+
+    mSweep.mode = SWEEP_CURRENT;
+    mSweep.from = 0.0;
+    mSweep.to = 0.0;
+    mSweep.step = 0.0;
+    mSweep.stepTime = 0.0;
+    mSweep.intervalMs = 10;
+    mSweep.holdRpm = false;
+    mSweep.holdRpmValue = 0;
+
+    mThread.setObjectName("VESC Experiment");
+    mWorker = new ExperimentWorker(this);
+    mWorker->moveToThread(&mThread);
+    connect(&mThread, &QThread::finished, mWorker, &QObject::deleteLater);
+    connect(mWorker, &ExperimentWorker::progress, this, &ExperimentRunner::progress);
+    connect(mWorker, &ExperimentWorker::finished, this, &ExperimentRunner::finished);
+    connect(mWorker, &ExperimentWorker::meterUpdated, this, &ExperimentRunner::meterUpdated);
+    connect(mWorker, &ExperimentWorker::payloadToSend, this, [this](QByteArray payload) {
+        if (mVesc) {
+            mVesc->sendPacket(payload);
+        }
+    });
+    mThread.start();
+
+    QMetaObject::invokeMethod(mWorker, "init", Qt::BlockingQueuedConnection);
+}
+
+ExperimentRunner::~ExperimentRunner()
+{
+    QMetaObject::invokeMethod(mWorker, "closeMeter", Qt::BlockingQueuedConnection);
+    mThread.quit();
+    mThread.wait();
+}
+
+void ExperimentRunner::setVesc(VescInterface *vesc)
+{
+    mVesc = vesc;
+    mIo = vesc ? vesc->ioThread() : nullptr;
+}
+
+bool ExperimentRunner::start(const Sweep &sweep)
+{
+    if (!mVesc) {
+        return false;
+    }
+
+    {
+        QMutexLocker locker(&mMutex);
+        mSweep = sweep;
+        mSendCan = mVesc->commands()->getSendCan();
+        mCanId = mVesc->commands()->getCanSendId();
+        // The controller ID of the local VESC is taken from its first reply,
+        // as the app configuration might not have been read yet.
+        mTargetId = mSendCan ? mCanId : -1;
+        mPending.clear();
+    }
+
+    mRunning = true;
+    QMetaObject::invokeMethod(mWorker, "start", Qt::QueuedConnection);
+    return true;
+}
+
+void ExperimentRunner::stop()
+{
+    QMetaObject::invokeMethod(mWorker, "stop", Qt::BlockingQueuedConnection);
+}
+
+bool ExperimentRunner::isRunning() const
+{
+    return mRunning;
+}
+
+bool ExperimentRunner::openMeter(const QString &port)
+{
+    bool res = false;
+    QMetaObject::invokeMethod(mWorker, "openMeter", Qt::BlockingQueuedConnection,
+                              Q_RETURN_ARG(bool, res), Q_ARG(QString, port));
+    return res;
+}
+
+void ExperimentRunner::closeMeter()
+{
+    QMetaObject::invokeMethod(mWorker, "closeMeter", Qt::BlockingQueuedConnection);
+}
+
+bool ExperimentRunner::isMeterOpen() const
+{
+    return mMeterOpen;
+}
+
+/**
+ * @brief ExperimentRunner::takeSample
+ * Pair a COMM_GET_VALUES_SELECTIVE reply with the oldest outstanding request
+ * of the sweep. Replies with another mask or from another VESC were requested
+ * by someone else and are left alone. Requests that have not been answered
+ * within replyTimeoutNs are dropped, so that a lost reply does not shift the
+ * pairing of the following ones. If the meter is open, the input voltage and
+ * current are replaced by meter readings interpolated to rxNs.
+ *
+ * @param values
+ * The decoded reply.
+ *
+ * @param mask
+ * The mask of the reply, as given by Commands::valuesReceived.
+ *
+ * @param rxNs
+ * When the reply was decoded, from IoThread::timestampNs.
+ *
+ * @param sample
+ * Filled in if the reply belongs to the sweep.
+ *
+ * @return
+ * False if there is no request that the reply can belong to.
+ */
+bool ExperimentRunner::takeSample(const MC_VALUES &values, unsigned int mask,
+                                  qint64 rxNs, Sample &sample)
+{
+    QMutexLocker locker(&mMutex);
+
+    if (mask != sampleMask || (mTargetId >= 0 && values.vesc_id != mTargetId)) {
+        return false;
+    }
+
+    while (!mPending.isEmpty() && (rxNs - mPending.first().cmdNs) > replyTimeoutNs) {
+        mPending.removeFirst();
+    }
+
+    if (mPending.isEmpty() || mPending.first().cmdNs > rxNs) {
+        return false;
+    }
+
+    if (mTargetId < 0) {
+        mTargetId = values.vesc_id;
+    }
+
+    Pending p = mPending.takeFirst();
+    sample.tick = p.tick;
+    sample.time = double(p.tick) * double(mSweep.intervalMs) / 1000.0;
+    sample.setpoint = p.setpoint;
+    sample.cmdNs = p.cmdNs;
+    sample.rxNs = rxNs;
+    sample.values = values;
+
+    if (mMeterOpen) {
+        bool ok = false;
+        double voltage = interpolate(mMeterVoltage, rxNs, &ok);
+        if (ok) {
+            sample.values.v_in = voltage;
+        }
+
+        double current = interpolate(mMeterCurrent, rxNs, &ok);
+        if (ok) {
+            sample.values.current_in = current;
+        }
+    }
+
+    return true;
+}
+
+double ExperimentRunner::interpolate(const QList<MeterPoint> &points, qint64 ns, bool *ok)
+{
+    *ok = !points.isEmpty();
+    if (points.isEmpty()) {
+        return 0.0;
+    }
+
+    if (ns <= points.first().ns) {
+        return points.first().value;
+    }
+
+    for (int i = 1;i < points.size();i++) {
+        const MeterPoint &b = points.at(i);
+        if (b.ns >= ns) {
+            const MeterPoint &a = points.at(i - 1);
+            double f = double(ns - a.ns) / double(b.ns - a.ns);
+            return a.value + f * (b.value - a.value);
+        }
+    }
+
+    return points.last().value;
+}
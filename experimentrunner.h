@@ -0,0 +1,182 @@
+/*
+    Copyright 2016 - 2024 Benjamin Vedder	benjamin@vedder.se
+
+    This file is part of VESC Tool.
+
+    VESC Tool is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    VESC Tool is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+#ifndef EXPERIMENTRUNNER_H
+#define EXPERIMENTRUNNER_H
+
+#include <QObject>
+#include <QThread>
+#include <QMutex>
+#include <QTimer>
+#include <QList>
+#include <QVector>
+#include <atomic>
+#include "datatypes.h"
+
+#ifdef HAS_SERIALPORT
+#include <QSerialPort>
+#endif
+
+class VescInterface;
+class IoThread;
+class ExperimentRunner;
+
+class ExperimentWorker : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit ExperimentWorker(ExperimentRunner *runner);
+
+signals:
+    void payloadToSend(QByteArray payload);
+    void progress(double progress);
+    void finished();
+    void meterUpdated(double voltage, double current);
+
+public slots:
+    void init();
+    void start();
+    void stop();
+    bool openMeter(QString port);
+    void closeMeter();
+
+private slots:
+    void tick();
+    void pollMeter();
+    void meterDataAvailable();
+
+private:
+    ExperimentRunner *mRunner;
+    QTimer *mTimer;
+    QTimer *mMeterTimer;
+    qint64 mStartNs;
+    int mTick;
+    bool mHolding;
+    bool mMeterPollCurrent;
+
+#ifdef HAS_SERIALPORT
+    QSerialPort *mMeterPort;
+#endif
+    QByteArray mMeterData;
+
+    void send(const QByteArray &payload);
+    void scheduleNext();
+    void finish();
+
+};
+
+/**
+ * @brief The ExperimentRunner class
+ * Runs duty cycle, current and RPM sweeps on a separate thread. The set
+ * point of every sample is derived from the sample index instead of from
+ * wall clock time, so the same sweep sends the same commands and produces
+ * the same number of samples on every run, even if the GUI stalls. Every
+ * request and reply is timestamped with IoThread::timestampNs, and readings
+ * from an external Victron BMV meter are interpolated to the time at which
+ * each reply was decoded.
+ */
+class ExperimentRunner : public QObject
+{
+    Q_OBJECT
+
+public:
+    typedef enum {
+        SWEEP_DUTY = 0,
+        SWEEP_CURRENT,
+        SWEEP_RPM
+    } sweep_mode;
+
+    struct Sweep {
+        sweep_mode mode;
+        double from;
+        double to;
+        double step;
+        double stepTime;
+        int intervalMs;
+        bool holdRpm;
+        int holdRpmValue;
+    };
+
+    struct Sample {
+        int tick;
+        // Scheduled time of the sample, in seconds from the start
+        double time;
+        double setpoint;
+        qint64 cmdNs;
+        qint64 rxNs;
+        MC_VALUES values;
+    };
+
+    explicit ExperimentRunner(QObject *parent = nullptr);
+    ~ExperimentRunner();
+
+    void setVesc(VescInterface *vesc);
+    bool start(const Sweep &sweep);
+    void stop();
+    bool isRunning() const;
+
+    bool openMeter(const QString &port);
+    void closeMeter();
+    bool isMeterOpen() const;
+
+    bool takeSample(const MC_VALUES &values, unsigned int mask,
+                    qint64 rxNs, Sample &sample);
+
+signals:
+    void progress(double progress);
+    void finished();
+    void meterUpdated(double voltage, double current);
+
+private:
+    friend class ExperimentWorker;
+
+    struct Pending {
+        int tick;
+        double setpoint;
+        qint64 cmdNs;
+    };
+
+    struct MeterPoint {
+        qint64 ns;
+        double value;
+    };
+
+    QThread mThread;
+    ExperimentWorker *mWorker;
+    VescInterface *mVesc;
+    IoThread *mIo;
+    std::atomic<bool> mRunning;
+    std::atomic<bool> mMeterOpen;
+
+    // Shared with the worker
+    mutable QMutex mMutex;
+    Sweep mSweep;
+    bool mSendCan;
+    int mCanId;
+    int mTargetId;
+    QList<Pending> mPending;
+    QList<MeterPoint> mMeterVoltage;
+    QList<MeterPoint> mMeterCurrent;
+
+    static double interpolate(const QList<MeterPoint> &points, qint64 ns, bool *ok);
+
+};
+
+#endif // EXPERIMENTRUNNER_H
@@ -1 +1,54 @@
 #include "fftw3wrapper.h"
+#include <QMutex>
+#include <QMutexLocker>
+#include <unordered_map>
+
+namespace {
+// Creating and destroying FFTW plans is not thread safe, executing them is.
+QMutex plannerMutex;
+
+struct PlanCache {
+	std::unordered_map<int, fftw_plan> r2c;
+	std::unordered_map<int, fftw_plan> c2r;
+
+	~PlanCache() {
+		for (auto& i : r2c) {
+			fftw_destroy_plan(i.second);
+		}
+		for (auto& i : c2r) {
+			fftw_destroy_plan(i.second);
+		}
+	}
+};
+
+PlanCache planCache;
+}
+
+// The plans are made on scratch buffers, as FFTW_MEASURE overwrites them.
+// fftw_malloc gives every buffer the same alignment, so the plans can be
+// executed on the buffers of any FFT and IFFT instance.
+fftw_plan fftwPlanR2c(int n) {
+	QMutexLocker locker(&plannerMutex);
+	auto& p = planCache.r2c[n];
+	if (!p) {
+		double* in = fftw_alloc_real(n);
+		fftw_complex* out = fftw_alloc_complex(n / 2 + 1);
+		p = fftw_plan_dft_r2c_1d(n, in, out, FFTW_MEASURE);
+		fftw_free(in);
+		fftw_free(out);
+	}
+	return p;
+}
+
+fftw_plan fftwPlanC2r(int n) {
+	QMutexLocker locker(&plannerMutex);
+	auto& p = planCache.c2r[n];
+	if (!p) {
+		fftw_complex* in = fftw_alloc_complex(n / 2 + 1);
+		double* out = fftw_alloc_real(n);
+		p = fftw_plan_dft_c2r_1d(n, in, out, FFTW_MEASURE);
+		fftw_free(in);
+		fftw_free(out);
+	}
+	return p;
+}
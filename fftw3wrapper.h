@@ -5,20 +5,28 @@
 #include <ranges>
 #include <span>
 
+// Plans shared by all instances of the same size, in all threads. They are
+// created once per process with FFTW_MEASURE and executed with the new-array
+// functions on the buffers of each instance, which is thread safe.
+fftw_plan fftwPlanR2c(int n);
+fftw_plan fftwPlanC2r(int n);
+
 class FFT {
 public:
 	FFT(int n) : N(n) {
 		in = (double*)fftw_malloc(sizeof(double) * N);
 		out = (fftw_complex*)fftw_malloc(sizeof(fftw_complex) * (N / 2 + 1));
-		p = fftw_plan_dft_r2c_1d(N, in, out, FFTW_MEASURE); // or FFTW_ESTIMATE?
+		p = fftwPlanR2c(N);
 	}
 
 	~FFT() {
-		fftw_destroy_plan(p);
 		fftw_free(in);
 		fftw_free(out);
 	}
 
+	FFT(const FFT&) = delete;
+	FFT& operator=(const FFT&) = delete;
+
 	QVector<std::complex<double>> transform(const QVector<double>& input) {
 		// copy data
 		std::ranges::copy(input, in);
@@ -27,7 +35,7 @@ public:
 		//}
 
 		// perform FFT
-		fftw_execute(p);
+		execute();
 
 		// copy FFT output to QVector
 		QVector<std::complex<double>> output(N / 2 + 1);
@@ -49,6 +57,15 @@ public:
 		using namespace std::complex_literals;
 		std::ranges::fill(input | std::views::drop(cutoff_freq), 0i);
 	}
+
+	// Transform on the aligned buffers of this instance, without copying
+	// from and to QVectors. Fill input() with N samples, call execute() and
+	// read N / 2 + 1 bins from output().
+	int size() const { return N; }
+	double* input() { return in; }
+	const fftw_complex* output() const { return out; }
+	void execute() { fftw_execute_dft_r2c(p, in, out); }
+
 private:
 	int N;
 	double* in;
@@ -61,15 +78,17 @@ public:
 	IFFT(int n) : N(n) {
 		in = (fftw_complex*)fftw_malloc(sizeof(fftw_complex) * (N / 2 + 1));
 		out = (double*)fftw_malloc(sizeof(double) * N);
-		p = fftw_plan_dft_c2r_1d(N, in, out, FFTW_MEASURE);
+		p = fftwPlanC2r(N);
 	}
 
 	~IFFT() {
-		fftw_destroy_plan(p);
 		fftw_free(in);
 		fftw_free(out);
 	}
 
+	IFFT(const IFFT&) = delete;
+	IFFT& operator=(const IFFT&) = delete;
+
 	QVector<double> transform(const QVector<std::complex<double>>& input) {
 		// copy data to IFFT input
 		for (int i = 0; i < (N / 2 + 1); ++i) {
@@ -78,7 +97,7 @@ public:
 		}
 
 		// perform IFFT
-		fftw_execute(p);
+		execute();
 
 		// copy IFFT output to QVector
 		QVector<double> output(N);
@@ -89,6 +108,12 @@ public:
 		return output;
 	}
 
+	// Same as for FFT. Note that execute() does not divide by N.
+	int size() const { return N; }
+	fftw_complex* input() { return in; }
+	const double* output() const { return out; }
+	void execute() { fftw_execute_dft_c2r(p, in, out); }
+
 private:
 	int N;
 	fftw_complex* in;
@@ -0,0 +1,421 @@
+/*
+    Copyright 2016 - 2024 Benjamin Vedder	benjamin@vedder.se
+
+    This file is part of VESC Tool.
+
+    VESC Tool is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    VESC Tool is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+#include "focdetector.h"
+#include "commands.h"
+#include "vescinterface.h"
+#include "utility.h"
+
+#include <algorithm>
+
+namespace {
+// current_motor, rpm, fault_code. vesc_id is always added.
+const unsigned int POLL_MASK = (uint32_t(1) << 2) | (uint32_t(1) << 7) | (uint32_t(1) << 15);
+const int POLL_INTERVAL_MS = 250;
+}
+
+FocDetector::FocDetector(Commands *commands, QObject *parent) : QObject(parent)
+{
+    mCommands = commands;
+    mRunning = false;
+    mWaveNum = 0;
+
+    mPollTimer = new QTimer(this);
+    mPollTimer->setInterval(POLL_INTERVAL_MS);
+
+    mWaveTimer = new QTimer(this);
+    mWaveTimer->setSingleShot(true);
+
+    connect(mPollTimer, SIGNAL(timeout()), this, SLOT(pollTimerSlot()));
+    connect(mWaveTimer, SIGNAL(timeout()), this, SLOT(waveTimeout()));
+    connect(mCommands, SIGNAL(valuesReceived(MC_VALUES, unsigned int)),
+            this, SLOT(valuesReceived(MC_VALUES, unsigned int)));
+    connect(mCommands, SIGNAL(detectAllFocReceived(int)),
+            this, SLOT(detectAllFocReceived(int)));
+}
+
+/**
+ * @brief FocDetector::discoverNodes
+ * Find the VESCs that are connected directly and over CAN. VESCs that
+ * report the same UUID share the same hardware and are put in the same
+ * group, so that they are not detected at the same time.
+ *
+ * @param vesc
+ * Pointer to a connected VescInterface instance.
+ *
+ * @return
+ * The nodes, with the VESC that is connected directly first.
+ */
+QVector<FocDetector::Node> FocDetector::discoverNodes(VescInterface *vesc)
+{
+    QVector<Node> res;
+    QVector<QByteArray> uuids;
+
+    auto addNode = [&res, &uuids](int canId, const FW_RX_PARAMS &params) {
+        Node n;
+        n.canId = canId;
+        n.group = uuids.indexOf(params.uuid);
+        if (n.group < 0 || params.uuid.isEmpty()) {
+            uuids.append(params.uuid);
+            n.group = uuids.size() - 1;
+        }
+        res.append(n);
+    };
+
+    FW_RX_PARAMS params;
+    vesc->canTmpOverride(false, 0);
+    bool localOk = Utility::getFwVersionBlocking(vesc, &params);
+    vesc->canTmpOverrideEnd();
+
+    if (localOk && params.hwType == HW_TYPE_VESC) {
+        addNode(-1, params);
+    }
+
+    for (auto d: vesc->scanCan()) {
+        FW_RX_PARAMS paramsCan;
+        if (Utility::getFwVersionBlockingCan(vesc, &paramsCan, d) &&
+                paramsCan.hwType == HW_TYPE_VESC) {
+            addNode(d, paramsCan);
+        }
+    }
+
+    return res;
+}
+
+bool FocDetector::start(const QVector<Node> &nodes, const Params &params)
+{
+    if (mRunning || nodes.isEmpty()) {
+        return false;
+    }
+
+    mNodes = nodes;
+    for (auto &n: mNodes) {
+        n.state = NODE_WAITING;
+        n.result = 0;
+        n.msg.clear();
+        n.startMs = 0;
+        n.endMs = 0;
+        n.fault = FAULT_CODE_NONE;
+    }
+
+    mParams = params;
+    mWaveNum = 0;
+    mRunning = true;
+    mElapsed.start();
+    mPollTimer->start();
+
+    startNextWave();
+    return true;
+}
+
+/**
+ * @brief FocDetector::cancel
+ * Stop waiting for the running detections. The firmware has no command to
+ * abort a detection, so nodes that are running will finish on their own.
+ */
+void FocDetector::cancel()
+{
+    if (!mRunning) {
+        return;
+    }
+
+    mWaveTimer->stop();
+
+    for (int i = 0;i < mNodes.size();i++) {
+        if (mNodes.at(i).state == NODE_RUNNING || mNodes.at(i).state == NODE_WAITING) {
+            mNodes[i].state = NODE_FAILED;
+            mNodes[i].msg = tr("Canceled");
+            mNodes[i].endMs = mElapsed.elapsed();
+            emit nodeUpdated(i);
+        }
+    }
+
+    mWave.clear();
+    finish();
+}
+
+bool FocDetector::isRunning() const
+{
+    return mRunning;
+}
+
+QVector<FocDetector::Node> FocDetector::nodes() const
+{
+    return mNodes;
+}
+
+QString FocDetector::report() const
+{
+    qint64 totalMs = 0;
+    qint64 sumMs = 0;
+    int okNum = 0;
+
+    for (const auto &n: mNodes) {
+        totalMs = qMax(totalMs, n.endMs);
+        sumMs += n.endMs - n.startMs;
+        if (n.state == NODE_OK) {
+            okNum++;
+        }
+    }
+
+    QString res = QString("FOC detection of %1 VESCs in %2 waves\n"
+                          "Succeeded          : %3 of %1\n"
+                          "Total time         : %4 s\n"
+                          "Sum of node times  : %5 s\n").
+            arg(mNodes.size()).arg(mWaveNum).arg(okNum).
+            arg(double(totalMs) / 1000.0, 0, 'f', 1).
+            arg(double(sumMs) / 1000.0, 0, 'f', 1);
+
+    for (const auto &n: mNodes) {
+        QString state;
+        switch (n.state) {
+        case NODE_WAITING: state = "Not started"; break;
+        case NODE_RUNNING: state = "Running"; break;
+        case NODE_OK: state = "OK"; break;
+        case NODE_FAILED: state = "Failed: " + n.msg; break;
+        }
+
+        res += QString("\n%1 (group %2, %3 s - %4 s): %5").
+                arg(n.canId < 0 ? QString("Local VESC") : QString("CAN ID %1").arg(n.canId), -10).
+                arg(n.group).
+                arg(double(n.startMs) / 1000.0, 0, 'f', 1).
+                arg(double(n.endMs) / 1000.0, 0, 'f', 1).
+                arg(state);
+    }
+
+    return res;
+}
+
+void FocDetector::valuesReceived(MC_VALUES values, unsigned int mask)
+{
+    if (!mRunning || !(mask & (uint32_t(1) << 17)) || values.vesc_id == 255) {
+        return;
+    }
+
+    // The VESC that is connected directly is the only one that is not
+    // known by its CAN ID
+    int ind = nodeIndex(values.vesc_id);
+    if (ind < 0) {
+        ind = nodeIndex(-1);
+    }
+
+    if (ind < 0 || mNodes.at(ind).state != NODE_RUNNING) {
+        return;
+    }
+
+    Node &n = mNodes[ind];
+    n.current = values.current_motor;
+    n.rpm = values.rpm;
+    if (n.fault == FAULT_CODE_NONE) {
+        n.fault = values.fault_code;
+    }
+
+    emit nodeUpdated(ind);
+}
+
+void FocDetector::detectAllFocReceived(int result)
+{
+    if (!mRunning || mWave.isEmpty()) {
+        return;
+    }
+
+    mWaveResults.append(result);
+    if (mWaveResults.size() >= mWave.size()) {
+        finishWave(false);
+    }
+}
+
+void FocDetector::pollTimerSlot()
+{
+    if (!mRunning || mWave.isEmpty()) {
+        return;
+    }
+
+    QVector<int> canIds;
+    bool includeLocal = false;
+    for (auto i: mWave) {
+        if (mNodes.at(i).canId < 0) {
+            includeLocal = true;
+        } else {
+            canIds.append(mNodes.at(i).canId);
+        }
+    }
+
+    mCommands->getValuesSelectiveAll(canIds, POLL_MASK, includeLocal);
+}
+
+void FocDetector::waveTimeout()
+{
+    if (mRunning && !mWave.isEmpty()) {
+        finishWave(true);
+    }
+}
+
+int FocDetector::nodeIndex(int canId) const
+{
+    for (int i = 0;i < mNodes.size();i++) {
+        if (mNodes.at(i).canId == canId) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+void FocDetector::startNextWave()
+{
+    mWave.clear();
+    mWaveResults.clear();
+
+    QVector<int> groups;
+    for (int i = 0;i < mNodes.size();i++) {
+        if (mParams.maxConcurrent > 0 && mWave.size() >= mParams.maxConcurrent) {
+            break;
+        }
+
+        const Node &n = mNodes.at(i);
+        if (n.state == NODE_WAITING && !groups.contains(n.group)) {
+            mWave.append(i);
+            groups.append(n.group);
+        }
+    }
+
+    if (mWave.isEmpty()) {
+        finish();
+        return;
+    }
+
+    // The VESC that is connected directly is started last, so that it has
+    // forwarded the requests to the other nodes before it gets busy.
+    std::stable_sort(mWave.begin(), mWave.end(), [this](int a, int b) {
+        return mNodes.at(a).canId >= 0 && mNodes.at(b).canId < 0;
+    });
+
+    mWaveNum++;
+    mCommands->disableAppOutput(mParams.timeoutMs, true);
+
+    for (auto i: mWave) {
+        Node &n = mNodes[i];
+        n.state = NODE_RUNNING;
+        n.startMs = mElapsed.elapsed();
+        mCommands->detectAllFocCan(n.canId, mParams.maxPowerLoss,
+                                   mParams.minCurrentIn, mParams.maxCurrentIn,
+                                   mParams.openloopRpm, mParams.slErpm);
+        emit nodeUpdated(i);
+    }
+
+    mWaveTimer->start(mParams.timeoutMs);
+}
+
+void FocDetector::finishWave(bool timeout)
+{
+    mWaveTimer->stop();
+
+    QVector<int> pending = mWave;
+    QVector<int> unresolved;
+    int okNum = 0;
+    qint64 now = mElapsed.elapsed();
+
+    // Match fault results to the nodes that reported that fault while running
+    for (auto r: mWaveResults) {
+        if (r >= 0) {
+            okNum++;
+            continue;
+        }
+
+        int match = -1;
+        if (r >= -100 && r < -100 + 256) {
+            for (auto i: pending) {
+                if (mNodes.at(i).fault == mc_fault_code(r + 100) &&
+                        mNodes.at(i).fault != FAULT_CODE_NONE) {
+                    match = i;
+                    break;
+                }
+            }
+        }
+
+        if (match >= 0) {
+            mNodes[match].state = NODE_FAILED;
+            mNodes[match].result = r;
+            mNodes[match].msg = Utility::detectAllFocResultToStr(r);
+            mNodes[match].endMs = now;
+            pending.removeOne(match);
+            emit nodeUpdated(match);
+        } else {
+            unresolved.append(r);
+        }
+    }
+
+    if (!timeout && unresolved.isEmpty()) {
+        for (auto i: pending) {
+            mNodes[i].state = NODE_OK;
+            mNodes[i].endMs = now;
+            emit nodeUpdated(i);
+        }
+    } else if (!pending.isEmpty()) {
+        QStringList reasons;
+        for (auto r: unresolved) {
+            reasons.append(Utility::detectAllFocResultToStr(r));
+        }
+
+        if (timeout) {
+            reasons.append(tr("%1 of %2 nodes did not reply in time").
+                           arg(pending.size() - okNum - unresolved.size()).
+                           arg(pending.size()));
+        }
+
+        QStringList ids;
+        for (auto i: pending) {
+            ids.append(mNodes.at(i).canId < 0 ? "local" : QString::number(mNodes.at(i).canId));
+        }
+
+        // The result cannot be matched to a node, so all candidates are
+        // marked as failed.
+        QString msg = reasons.join("; ");
+        if (pending.size() > 1) {
+            msg = tr("One or more of %1 failed: %2").arg(ids.join(", "), msg);
+        }
+
+        for (auto i: pending) {
+            mNodes[i].state = NODE_FAILED;
+            mNodes[i].result = unresolved.isEmpty() ? 0 : unresolved.first();
+            mNodes[i].msg = msg;
+            mNodes[i].endMs = now;
+            emit nodeUpdated(i);
+        }
+    }
+
+    startNextWave();
+}
+
+void FocDetector::finish()
+{
+    mRunning = false;
+    mWave.clear();
+    mPollTimer->stop();
+    mWaveTimer->stop();
+    mCommands->disableAppOutput(0, true);
+
+    bool ok = true;
+    for (const auto &n: mNodes) {
+        ok = ok && n.state == NODE_OK;
+    }
+
+    emit finished(ok);
+}
@@ -0,0 +1,147 @@
+/*
+    Copyright 2016 - 2024 Benjamin Vedder	benjamin@vedder.se
+
+    This file is part of VESC Tool.
+
+    VESC Tool is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    VESC Tool is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+#ifndef FOCDETECTOR_H
+#define FOCDETECTOR_H
+
+#include <QObject>
+#include <QTimer>
+#include <QVector>
+#include <QElapsedTimer>
+#include "datatypes.h"
+
+class Commands;
+class VescInterface;
+
+/**
+ * @brief The FocDetector class
+ * Runs FOC detection on several VESCs at the same time and follows the
+ * progress of every node by its CAN ID.
+ *
+ * Nodes are started in waves. Nodes that share a group, e.g. the two
+ * motors of a dual controller, are never in the same wave, and a wave has
+ * at most maxConcurrent nodes. While a wave runs, the current, speed and
+ * fault code of all its nodes are polled with a single request.
+ *
+ * The firmware replies to a detection without saying which VESC the reply
+ * came from, so failures are matched to nodes by the fault code that was
+ * polled during the detection when possible.
+ */
+class FocDetector : public QObject
+{
+    Q_OBJECT
+
+public:
+    typedef enum {
+        NODE_WAITING = 0,
+        NODE_RUNNING,
+        NODE_OK,
+        NODE_FAILED
+    } node_state;
+
+    struct Node {
+        Node() {
+            canId = -1;
+            group = 0;
+            state = NODE_WAITING;
+            result = 0;
+            startMs = 0;
+            endMs = 0;
+            current = 0.0;
+            rpm = 0.0;
+            fault = FAULT_CODE_NONE;
+        }
+
+        // -1 for the VESC that is connected directly
+        int canId;
+        // Nodes with the same group are detected one at a time
+        int group;
+        node_state state;
+        int result;
+        QString msg;
+        qint64 startMs;
+        qint64 endMs;
+        double current;
+        double rpm;
+        mc_fault_code fault;
+    };
+
+    struct Params {
+        Params() {
+            maxPowerLoss = 60.0;
+            minCurrentIn = -20.0;
+            maxCurrentIn = 20.0;
+            openloopRpm = 700.0;
+            slErpm = 4000.0;
+            maxConcurrent = 2;
+            timeoutMs = 180000;
+        }
+
+        double maxPowerLoss;
+        double minCurrentIn;
+        double maxCurrentIn;
+        double openloopRpm;
+        double slErpm;
+        // Nodes detected at the same time in total, 0 means no limit. Every
+        // detection draws current from the same supply, so the default is
+        // kept low.
+        int maxConcurrent;
+        int timeoutMs;
+    };
+
+    explicit FocDetector(Commands *commands, QObject *parent = nullptr);
+
+    static QVector<Node> discoverNodes(VescInterface *vesc);
+
+    bool start(const QVector<Node> &nodes, const Params &params);
+    void cancel();
+    bool isRunning() const;
+    QVector<Node> nodes() const;
+    QString report() const;
+
+signals:
+    void nodeUpdated(int index);
+    void finished(bool ok);
+
+private slots:
+    void valuesReceived(MC_VALUES values, unsigned int mask);
+    void detectAllFocReceived(int result);
+    void pollTimerSlot();
+    void waveTimeout();
+
+private:
+    Commands *mCommands;
+    QTimer *mPollTimer;
+    QTimer *mWaveTimer;
+    QElapsedTimer mElapsed;
+    Params mParams;
+    QVector<Node> mNodes;
+    QVector<int> mWave;
+    QVector<int> mWaveResults;
+    bool mRunning;
+    int mWaveNum;
+
+    int nodeIndex(int canId) const;
+    void startNextWave();
+    void finishWave(bool timeout);
+    void finish();
+
+};
+
+#endif // FOCDETECTOR_H
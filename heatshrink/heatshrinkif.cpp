@@ -1,8 +1,20 @@
 #include "heatshrinkif.h"
+#include "vbytearray.h"
 
 #include <QFile>
 #include <QDebug>
+#include <QVector>
+#include <QThread>
+#include <QElapsedTimer>
+#include <QtConcurrent/QtConcurrent>
 #include <cstring>
+#include <climits>
+#include <atomic>
+
+namespace {
+const quint32 blockMagic = 0x48534231; // "HSB1"
+const int blockHeaderSize = 16;
+}
 
 HeatshrinkIf::HeatshrinkIf()
 {
@@ -18,73 +30,258 @@ HeatshrinkIf::~HeatshrinkIf()
 
 QByteArray HeatshrinkIf::encode(QByteArray in)
 {
-    heatshrink_encoder_reset(hse);
+    QByteArray res(int(encodeBound(size_t(in.size()))), Qt::Uninitialized);
+    int len = encode((const uint8_t*)in.constData(), size_t(in.size()),
+                     (uint8_t*)res.data(), size_t(res.size()));
+    res.resize(len < 0 ? 0 : len);
+    return res;
+}
+
+QByteArray HeatshrinkIf::decode(QByteArray in)
+{
+    heatshrink_decoder_reset(hsd);
 
-    size_t input_size = in.size();
-    size_t comp_sz = input_size + (input_size/2) + 4;
-    uint8_t *comp = new uint8_t[comp_sz];
+    size_t compressed_size = in.size();
+    size_t count = 0;
+    size_t sunk = 0;
+    size_t polled = 0;
     uint8_t *input = (uint8_t*)in.data();
 
-    memset(comp, 0, comp_sz);
+    // Poll straight into the result and grow it geometrically, instead of
+    // going through a small bounce buffer.
+    QByteArray res(qMax(in.size() * 2, 1024), Qt::Uninitialized);
 
-    size_t count = 0;
-    uint32_t sunk = 0;
-    uint32_t polled = 0;
+    auto pollAll = [&]() {
+        HSD_poll_res pres;
+        do {
+            if (polled == size_t(res.size())) {
+                res.resize(res.size() * 2);
+            }
+            pres = heatshrink_decoder_poll(hsd, (uint8_t*)res.data() + polled,
+                                           res.size() - polled, &count);
+            polled += count;
+        } while (pres == HSDR_POLL_MORE);
+        return pres == HSDR_POLL_EMPTY;
+    };
 
-    while (sunk < input_size) {
-        heatshrink_encoder_sink(hse, &input[sunk], input_size - sunk, &count);
+    while (sunk < compressed_size) {
+        heatshrink_decoder_sink(hsd, &input[sunk], compressed_size - sunk, &count);
         sunk += count;
-        if (sunk == input_size) {
-            heatshrink_encoder_finish(hse);
+        if (!pollAll()) {
+            return QByteArray();
         }
+    }
+
+    while (heatshrink_decoder_finish(hsd) == HSDR_FINISH_MORE) {
+        if (!pollAll()) {
+            return QByteArray();
+        }
+    }
+
+    res.resize(int(polled));
+    return res;
+}
+
+int HeatshrinkIf::encode(const uint8_t *in, size_t inLen, uint8_t *out, size_t outCap)
+{
+    heatshrink_encoder_reset(hse);
+
+    size_t count = 0;
+    size_t sunk = 0;
+    size_t polled = 0;
 
+    auto pollAll = [&]() {
         HSE_poll_res pres;
         do {
-            pres = heatshrink_encoder_poll(hse, &comp[polled], comp_sz - polled, &count);
+            if (polled == outCap) {
+                // Full, but the encoder can only tell if it is done by polling again
+                uint8_t spare;
+                pres = heatshrink_encoder_poll(hse, &spare, 1, &count);
+                if (count > 0) {
+                    return false;
+                }
+                break;
+            }
+            pres = heatshrink_encoder_poll(hse, &out[polled], outCap - polled, &count);
             polled += count;
         } while (pres == HSER_POLL_MORE);
+        return pres == HSER_POLL_EMPTY;
+    };
 
-        if (sunk == input_size) {
-            heatshrink_encoder_finish(hse);
+    while (sunk < inLen) {
+        heatshrink_encoder_sink(hse, (uint8_t*)&in[sunk], inLen - sunk, &count);
+        sunk += count;
+        if (!pollAll()) {
+            return -1;
         }
     }
 
-    QByteArray res = QByteArray((char*)comp, polled);
-    delete[] comp;
+    while (heatshrink_encoder_finish(hse) == HSER_FINISH_MORE) {
+        if (!pollAll()) {
+            return -1;
+        }
+    }
 
-    return res;
+    return int(polled);
 }
 
-QByteArray HeatshrinkIf::decode(QByteArray in)
+int HeatshrinkIf::decode(const uint8_t *in, size_t inLen, uint8_t *out, size_t outCap)
 {
     heatshrink_decoder_reset(hsd);
 
-    uint32_t compressed_size = in.size();
     size_t count = 0;
-    uint32_t sunk = 0;
-    uint32_t polled = 0;
-    uint8_t *input = (uint8_t*)in.data();
-    QByteArray res;
-
-    while (sunk < compressed_size) {
-        heatshrink_decoder_sink(hsd, &input[sunk], compressed_size - sunk, &count);
-        sunk += count;
-        if (sunk == compressed_size) {
-            heatshrink_decoder_finish(hsd);
-        }
+    size_t sunk = 0;
+    size_t polled = 0;
 
+    auto pollAll = [&]() {
         HSD_poll_res pres;
         do {
-            uint8_t chunk[16];
-            pres = heatshrink_decoder_poll(hsd, chunk, 16, &count);
-            res.append((char*)chunk, count);
+            if (polled == outCap) {
+                // Full, but the decoder can only tell if it is done by polling again
+                uint8_t spare;
+                pres = heatshrink_decoder_poll(hsd, &spare, 1, &count);
+                if (count > 0) {
+                    return false;
+                }
+                break;
+            }
+            pres = heatshrink_decoder_poll(hsd, &out[polled], outCap - polled, &count);
             polled += count;
         } while (pres == HSDR_POLL_MORE);
-        if (sunk == compressed_size) {
-            heatshrink_decoder_finish(hsd);
+        return pres == HSDR_POLL_EMPTY;
+    };
+
+    while (sunk < inLen) {
+        heatshrink_decoder_sink(hsd, (uint8_t*)&in[sunk], inLen - sunk, &count);
+        sunk += count;
+        if (!pollAll()) {
+            return -1;
         }
     }
 
+    while (heatshrink_decoder_finish(hsd) == HSDR_FINISH_MORE) {
+        if (!pollAll()) {
+            return -1;
+        }
+    }
+
+    return int(polled);
+}
+
+size_t HeatshrinkIf::encodeBound(size_t inLen)
+{
+    // Worst case is one tag bit per literal byte
+    return inLen + inLen / 8 + 16;
+}
+
+QByteArray HeatshrinkIf::encodeBlocks(const QByteArray &in, int blockSize)
+{
+    if (blockSize <= 0) {
+        return QByteArray();
+    }
+
+    int blocks = (in.size() + blockSize - 1) / blockSize;
+
+    QVector<int> indexes;
+    for (int i = 0;i < blocks;i++) {
+        indexes.append(i);
+    }
+
+    QVector<QByteArray> comp(blocks);
+    QByteArray *compData = comp.data();
+
+    QtConcurrent::blockingMap(indexes, [&in, blockSize, compData](int i) {
+        HeatshrinkIf hs;
+        int start = i * blockSize;
+        size_t len = size_t(qMin(blockSize, in.size() - start));
+        QByteArray out(int(encodeBound(len)), Qt::Uninitialized);
+        int outLen = hs.encode((const uint8_t*)in.constData() + start, len,
+                               (uint8_t*)out.data(), size_t(out.size()));
+        out.resize(outLen < 0 ? 0 : outLen);
+        compData[i] = out;
+    });
+
+    VByteArray res;
+    res.vbAppendUint32(blockMagic);
+    res.vbAppendUint32(quint32(in.size()));
+    res.vbAppendUint32(quint32(blockSize));
+    res.vbAppendUint32(quint32(blocks));
+    for (const auto &c: comp) {
+        res.vbAppendUint32(quint32(c.size()));
+    }
+    for (const auto &c: comp) {
+        res.append(c);
+    }
+
+    return res;
+}
+
+QByteArray HeatshrinkIf::decodeBlocks(const QByteArray &in)
+{
+    if (in.size() < blockHeaderSize) {
+        return QByteArray();
+    }
+
+    VByteArray header(in.left(blockHeaderSize));
+    if (header.vbPopFrontUint32() != blockMagic) {
+        return QByteArray();
+    }
+
+    qint64 sizeTot = qint64(header.vbPopFrontUint32());
+    qint64 blockSize = qint64(header.vbPopFrontUint32());
+    qint64 blocks = qint64(header.vbPopFrontUint32());
+
+    // Everything in the header is checked against the input size before it
+    // is used, so that a corrupt or hostile stream cannot make the blocks
+    // be written outside the result.
+    if (sizeTot > INT_MAX || blockSize <= 0 || blockSize > INT_MAX ||
+            blocks != (sizeTot + blockSize - 1) / blockSize ||
+            qint64(in.size()) < qint64(blockHeaderSize) + 4 * blocks) {
+        return QByteArray();
+    }
+
+    VByteArray lenTable(in.mid(blockHeaderSize, int(4 * blocks)));
+    QVector<int> offsets;
+    QVector<int> lengths;
+    qint64 offset = blockHeaderSize + 4 * blocks;
+    for (int i = 0;i < blocks;i++) {
+        qint64 len = qint64(lenTable.vbPopFrontUint32());
+        if (offset + len > in.size()) {
+            return QByteArray();
+        }
+
+        offsets.append(int(offset));
+        lengths.append(int(len));
+        offset += len;
+    }
+
+    if (offset != in.size()) {
+        return QByteArray();
+    }
+
+    QByteArray res(int(sizeTot), Qt::Uninitialized);
+    char *resData = res.data();
+    QVector<int> indexes;
+    for (int i = 0;i < blocks;i++) {
+        indexes.append(i);
+    }
+
+    std::atomic<bool> failed(false);
+    QtConcurrent::blockingMap(indexes, [&](int i) {
+        HeatshrinkIf hs;
+        int start = i * int(blockSize);
+        int len = int(qMin(blockSize, sizeTot - start));
+        int outLen = hs.decode((const uint8_t*)in.constData() + offsets.at(i), size_t(lengths.at(i)),
+                               (uint8_t*)resData + start, size_t(len));
+        if (outLen != len) {
+            failed = true;
+        }
+    });
+
+    if (failed) {
+        return QByteArray();
+    }
+
     return res;
 }
 
@@ -100,12 +297,63 @@ void HeatshrinkIf::test(QString fileName)
     auto dataIn = file.readAll();
     file.close();
 
+    auto mbps = [&dataIn](qint64 ns) {
+        return ns > 0 ? (double(dataIn.size()) / 1e6) / (double(ns) / 1e9) : 0.0;
+    };
+
+    QElapsedTimer t;
+    t.start();
     auto comp = encode(dataIn);
+    qint64 encNs = t.nsecsElapsed();
 
     qDebug() << "In:" << dataIn.size() << "Out:" << comp.size() << "Final size:"
              << (100.0 * double(comp.size()) / double(dataIn.size())) << "%";
 
+    t.restart();
     auto decomp = decode(comp);
+    qint64 decNs = t.nsecsElapsed();
     qDebug() << "DecompSz:" <<  decomp.size();
     qDebug() << "Compare:" << decomp.compare(dataIn);
+    qDebug() << "Stream encode:" << mbps(encNs) << "MB/s" << "decode:" << mbps(decNs) << "MB/s";
+
+    // Buffer reuse: same buffers for several rounds
+    const int rounds = 5;
+    QByteArray compBuf(int(encodeBound(size_t(dataIn.size()))), Qt::Uninitialized);
+    QByteArray decompBuf(dataIn.size(), Qt::Uninitialized);
+    int compLen = 0;
+    int decompLen = 0;
+    encNs = 0;
+    decNs = 0;
+    for (int i = 0;i < rounds;i++) {
+        t.restart();
+        compLen = encode((const uint8_t*)dataIn.constData(), size_t(dataIn.size()),
+                         (uint8_t*)compBuf.data(), size_t(compBuf.size()));
+        encNs += t.nsecsElapsed();
+        t.restart();
+        decompLen = decode((const uint8_t*)compBuf.constData(), size_t(compLen),
+                           (uint8_t*)decompBuf.data(), size_t(decompBuf.size()));
+        decNs += t.nsecsElapsed();
+    }
+    qDebug() << "Buffer round trip:" << (compLen == comp.size() && decompLen == dataIn.size() &&
+                                         memcmp(decompBuf.constData(), dataIn.constData(), size_t(decompLen)) == 0);
+    qDebug() << "Buffer encode:" << mbps(encNs / rounds) << "MB/s" << "decode:" << mbps(decNs / rounds) << "MB/s";
+
+    // Output buffer that is too small must be reported
+    qDebug() << "Overflow detected:" << (decode((const uint8_t*)compBuf.constData(), size_t(compLen),
+                                                (uint8_t*)decompBuf.data(), size_t(decompBuf.size() / 2)) == -1);
+
+    for (int blockSize: {16384, 65536, 131072}) {
+        t.restart();
+        auto compBlocks = encodeBlocks(dataIn, blockSize);
+        encNs = t.nsecsElapsed();
+        t.restart();
+        auto decompBlocks = decodeBlocks(compBlocks);
+        decNs = t.nsecsElapsed();
+
+        qDebug() << "Blocks" << blockSize << "threads" << QThread::idealThreadCount()
+                 << "Out:" << compBlocks.size()
+                 << "(" << 100.0 * double(compBlocks.size()) / double(dataIn.size()) << "% )"
+                 << "Compare:" << decompBlocks.compare(dataIn)
+                 << "encode:" << mbps(encNs) << "MB/s" << "decode:" << mbps(decNs) << "MB/s";
+    }
 }
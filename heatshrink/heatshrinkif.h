@@ -13,6 +13,20 @@ public:
 
     QByteArray encode(QByteArray in);
     QByteArray decode(QByteArray in);
+
+    // Streaming over caller-provided buffers. Return the number of bytes
+    // written to out, or -1 if outCap is too small.
+    int encode(const uint8_t *in, size_t inLen, uint8_t *out, size_t outCap);
+    int decode(const uint8_t *in, size_t inLen, uint8_t *out, size_t outCap);
+    static size_t encodeBound(size_t inLen);
+
+    // Block mode: the input is split into independently compressed blocks
+    // that are encoded and decoded on the global thread pool. Note that this
+    // is a container format of its own, the bootloader only understands the
+    // plain stream from encode.
+    static QByteArray encodeBlocks(const QByteArray &in, int blockSize = 65536);
+    static QByteArray decodeBlocks(const QByteArray &in);
+
     void test(QString fileName);
 
 private:
@@ -0,0 +1,479 @@
+/*
+    Copyright 2016 - 2024 Benjamin Vedder	benjamin@vedder.se
+
+    This file is part of VESC Tool.
+
+    VESC Tool is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    VESC Tool is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+#include "iothread.h"
+#include "packet.h"
+#include "packetcapture.h"
+#include "datatypes.h"
+#include <QElapsedTimer>
+#include <QMutexLocker>
+#include <QDebug>
+
+namespace {
+QElapsedTimer ioClock()
+{
+    QElapsedTimer t;
+    t.start();
+    return t;
+}
+
+const QElapsedTimer ioClockStart = ioClock();
+}
+
+IoWorker::IoWorker(IoThread *io) : QObject()
+{
+    mIo = io;
+    mPacket = nullptr;
+#ifdef HAS_SERIALPORT
+    mSerialPort = nullptr;
+#endif
+}
+
+/**
+ * @brief IoWorker::init
+ * Create the port and the packet decoder. This runs on the I/O thread, so
+ * that their timers and notifiers belong to it.
+ */
+void IoWorker::init()
+{
+    mPacket = new Packet(this);
+
+    connect(mPacket, &Packet::packetReceived, [this](QByteArray &packet) {
+        mIo->enqueue(packet, IoThread::timestampNs());
+    });
+
+#ifdef HAS_SERIALPORT
+    mSerialPort = new QSerialPort(this);
+
+    connect(mSerialPort, &QSerialPort::readyRead, this, &IoWorker::readAvailable);
+    connect(mSerialPort, &QSerialPort::errorOccurred, [this](QSerialPort::SerialPortError error) {
+        if (error == QSerialPort::NoError) {
+            return;
+        }
+
+        QString errorString = mSerialPort->errorString();
+        if (mSerialPort->isOpen()) {
+            mSerialPort->close();
+        }
+        mIo->mSerialOpen = false;
+        emit serialError(errorString);
+    });
+#endif
+}
+
+bool IoWorker::openSerial(QString port, int baudrate)
+{
+#ifdef HAS_SERIALPORT
+    if (mSerialPort->isOpen()) {
+        return true;
+    }
+
+    mSerialPort->setPortName(port);
+    mSerialPort->open(QIODevice::ReadWrite);
+
+    if (!mSerialPort->isOpen()) {
+        return false;
+    }
+
+    mSerialPort->setBaudRate(baudrate);
+    mSerialPort->setDataBits(QSerialPort::Data8);
+    mSerialPort->setParity(QSerialPort::NoParity);
+    mSerialPort->setStopBits(QSerialPort::OneStop);
+    mSerialPort->setFlowControl(QSerialPort::NoFlowControl);
+    mPacket->resetState();
+    mIo->mSerialOpen = true;
+    return true;
+#else
+    (void)port;
+    (void)baudrate;
+    return false;
+#endif
+}
+
+void IoWorker::closeSerial()
+{
+#ifdef HAS_SERIALPORT
+    if (mSerialPort->isOpen()) {
+        mSerialPort->flush();
+        mSerialPort->close();
+    }
+    mIo->mSerialOpen = false;
+#endif
+}
+
+void IoWorker::flush()
+{
+#ifdef HAS_SERIALPORT
+    if (mSerialPort->isOpen()) {
+        mSerialPort->flush();
+    }
+#endif
+}
+
+void IoWorker::write(QByteArray data)
+{
+#ifdef HAS_SERIALPORT
+    if (mSerialPort->isOpen()) {
+        mSerialPort->write(data);
+    }
+#else
+    (void)data;
+#endif
+}
+
+void IoWorker::resetState()
+{
+    mPacket->resetState();
+}
+
+void IoWorker::readAvailable()
+{
+#ifdef HAS_SERIALPORT
+    // Leave the data in the port buffer while the GUI has a full queue
+    // to work through. Reading resumes when the queue has been drained.
+    while (!mIo->mReadPaused && mSerialPort->isOpen() && mSerialPort->bytesAvailable() > 0) {
+        QByteArray data = mSerialPort->read(4096);
+        if (PacketCapture *capture = mIo->mCapture) {
+            capture->record(mIo->mCaptureTransport, false, data);
+        }
+        mPacket->processData(data);
+    }
+#endif
+}
+
+void IoWorker::setFrameForwarding(bool on)
+{
+    if (mFrameConn) {
+        disconnect(mFrameConn);
+    }
+
+    if (on) {
+        mFrameConn = connect(mPacket, &Packet::frameReceived, [this](QByteArray &frame) {
+            emit mIo->frameReceived(frame);
+        });
+    }
+}
+
+IoThread::IoThread(QObject *parent) : QObject(parent)
+{
+    mSerialOpen = false;
+    mReadPaused = false;
+    mCapture = nullptr;
+    mCaptureTransport = 0;
+    mDrainPending = false;
+    mMaxQueueLength = 500;
+    mCoalesced = 0;
+    mCurrentRxNs = 0;
+
+    mThread.setObjectName("VESC I/O");
+    mWorker = new IoWorker(this);
+    mWorker->moveToThread(&mThread);
+    connect(&mThread, &QThread::finished, mWorker, &QObject::deleteLater);
+    connect(mWorker, &IoWorker::serialError, this, &IoThread::serialError);
+    mThread.start();
+
+    QMetaObject::invokeMethod(mWorker, "init", Qt::BlockingQueuedConnection);
+}
+
+IoThread::~IoThread()
+{
+    QMetaObject::invokeMethod(mWorker, "closeSerial", Qt::BlockingQueuedConnection);
+    mThread.quit();
+    mThread.wait();
+}
+
+bool IoThread::openSerial(const QString &port, int baudrate)
+{
+    bool res = false;
+    QMetaObject::invokeMethod(mWorker, "openSerial", Qt::BlockingQueuedConnection,
+                              Q_RETURN_ARG(bool, res), Q_ARG(QString, port), Q_ARG(int, baudrate));
+
+    if (res) {
+        mPortName = port;
+    }
+
+    return res;
+}
+
+void IoThread::closeSerial()
+{
+    QMetaObject::invokeMethod(mWorker, "closeSerial", Qt::BlockingQueuedConnection);
+
+    QMutexLocker locker(&mQueueMutex);
+    mQueue.clear();
+}
+
+bool IoThread::isSerialOpen() const
+{
+    return mSerialOpen;
+}
+
+QString IoThread::serialPortName() const
+{
+    return mPortName;
+}
+
+void IoThread::flush()
+{
+    QMetaObject::invokeMethod(mWorker, "flush", Qt::BlockingQueuedConnection);
+}
+
+void IoThread::write(const QByteArray &data)
+{
+    QMetaObject::invokeMethod(mWorker, "write", Qt::QueuedConnection, Q_ARG(QByteArray, data));
+}
+
+void IoThread::resetState()
+{
+    QMetaObject::invokeMethod(mWorker, "resetState", Qt::BlockingQueuedConnection);
+
+    QMutexLocker locker(&mQueueMutex);
+    mQueue.clear();
+}
+
+/**
+ * @brief IoThread::setFrameForwarding
+ * Emit frameReceived with the raw frame of every packet from the port. The
+ * signal is emitted on the I/O thread, so that it can be forwarded without
+ * waiting for the GUI thread.
+ */
+void IoThread::setFrameForwarding(bool on)
+{
+    QMetaObject::invokeMethod(mWorker, "setFrameForwarding", Qt::BlockingQueuedConnection, Q_ARG(bool, on));
+}
+
+/**
+ * @brief IoThread::setCapture
+ * Record the data read from the serial port to a capture, tagged with the
+ * transport. Set before opening the port, as the transport is read without
+ * a lock on the I/O thread.
+ */
+void IoThread::setCapture(PacketCapture *capture, int transport)
+{
+    mCaptureTransport = transport;
+    mCapture = capture;
+}
+
+/**
+ * @brief IoThread::setMaxQueueLength
+ * Set how many decoded packets can wait for the GUI thread before the I/O
+ * thread stops reading from the port.
+ */
+void IoThread::setMaxQueueLength(int len)
+{
+    QMutexLocker locker(&mQueueMutex);
+    mMaxQueueLength = len;
+}
+
+int IoThread::coalescedPackets() const
+{
+    QMutexLocker locker(&mQueueMutex);
+    return mCoalesced;
+}
+
+/**
+ * @brief IoThread::currentPacketRxTime
+ * The time, from timestampNs, at which the packet that currently is being
+ * delivered with packetReceived was decoded on the I/O thread.
+ */
+qint64 IoThread::currentPacketRxTime() const
+{
+    return mCurrentRxNs;
+}
+
+qint64 IoThread::timestampNs()
+{
+    return ioClockStart.nsecsElapsed();
+}
+
+void IoThread::drainQueue()
+{
+    bool resume = false;
+
+    {
+        QMutexLocker locker(&mQueueMutex);
+        mDrainPending = false;
+        mDelivering.append(mQueue);
+        mQueue.clear();
+        resume = mReadPaused;
+        mReadPaused = false;
+    }
+
+    if (resume) {
+        QMetaObject::invokeMethod(mWorker, "readAvailable", Qt::QueuedConnection);
+    }
+
+    // Packet handlers can run nested event loops that end up here again, so
+    // deliver from a member list to keep the order.
+    while (!mDelivering.isEmpty()) {
+        RxPacket p = mDelivering.takeFirst();
+        mCurrentRxNs = p.rxNs;
+        emit packetReceived(p.data);
+    }
+}
+
+/**
+ * @brief IoThread::enqueue
+ * Called on the I/O thread for every decoded packet.
+ *
+ * @return
+ * False if the queue is full and reading has been paused.
+ */
+bool IoThread::enqueue(const QByteArray &packet, qint64 rxNs)
+{
+    QMutexLocker locker(&mQueueMutex);
+
+    RxPacket p;
+    p.data = packet;
+    p.key = coalesceKey(packet);
+    p.rxNs = rxNs;
+
+    if (!p.key.isEmpty()) {
+        for (int i = mQueue.size() - 1;i >= 0;i--) {
+            if (mQueue.at(i).key == p.key) {
+                mQueue.removeAt(i);
+                mCoalesced++;
+                break;
+            }
+        }
+    }
+
+    mQueue.append(p);
+
+    if (!mDrainPending) {
+        mDrainPending = true;
+        QMetaObject::invokeMethod(this, "drainQueue", Qt::QueuedConnection);
+    }
+
+    // Set under the lock, so that a drain on the GUI thread cannot clear
+    // the flag before it is set here and leave reading paused.
+    if (mQueue.size() >= mMaxQueueLength) {
+        mReadPaused = true;
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief IoThread::coalesceKey
+ * Telemetry where a newer packet makes an older one that has not been
+ * delivered yet useless. Packets are only coalesced when the command and
+ * the field mask match, so selective replies with different masks are kept.
+ * Values replies also carry the controller ID, so that the replies from
+ * different VESCs on the CAN-bus are all delivered.
+ *
+ * @return
+ * The bytes that identify the packet, or an empty array if it must always
+ * be delivered.
+ */
+QByteArray IoThread::coalesceKey(const QByteArray &packet)
+{
+    if (packet.isEmpty()) {
+        return QByteArray();
+    }
+
+    int len = 0;
+    int idPos = -1;
+    COMM_PACKET_ID id = COMM_PACKET_ID(quint8(packet.at(0)));
+
+    switch (id) {
+    case COMM_ROTOR_POSITION:
+    case COMM_GET_DECODED_PPM:
+    case COMM_GET_DECODED_ADC:
+    case COMM_GET_DECODED_CHUK:
+    case COMM_GET_DECODED_BALANCE:
+        len = 1;
+        break;
+
+    case COMM_GET_IMU_DATA:
+        len = 3;
+        break;
+
+    case COMM_GET_VALUES:
+    case COMM_GET_VALUES_SETUP:
+        len = 1;
+        idPos = vescIdPos(packet, id, 0xFFFFFFFF, 1);
+        break;
+
+    case COMM_GET_VALUES_SELECTIVE:
+    case COMM_GET_VALUES_SETUP_SELECTIVE:
+        len = 5;
+        if (packet.size() >= len) {
+            quint32 mask = quint32(quint8(packet.at(1))) << 24 |
+                    quint32(quint8(packet.at(2))) << 16 |
+                    quint32(quint8(packet.at(3))) << 8 |
+                    quint32(quint8(packet.at(4)));
+            idPos = vescIdPos(packet, id, mask, 5);
+        }
+        break;
+
+    default:
+        break;
+    }
+
+    if (len == 0 || packet.size() < len) {
+        return QByteArray();
+    }
+
+    QByteArray key = packet.left(len);
+    if (idPos >= 0) {
+        key.append(packet.at(idPos));
+    }
+
+    return key;
+}
+
+/**
+ * @brief IoThread::vescIdPos
+ * Find the controller ID in a values reply by walking the fields that come
+ * before it, the same way Commands::processPacket reads them.
+ *
+ * @return
+ * The index of the ID byte, or -1 if the reply does not carry it.
+ */
+int IoThread::vescIdPos(const QByteArray &packet, int id, quint32 mask, int start)
+{
+    // Field sizes in bytes, up to and including the ID at bit 17
+    static const int valuesSizes[] = {2, 2, 4, 4, 4, 4, 2, 4, 2, 4, 4, 4, 4, 4, 4, 1, 4};
+    static const int setupSizes[] = {2, 2, 4, 4, 2, 4, 4, 2, 2, 4, 4, 4, 4, 4, 4, 4, 1};
+
+    bool setup = id == COMM_GET_VALUES_SETUP || id == COMM_GET_VALUES_SETUP_SELECTIVE;
+    const int *sizes = setup ? setupSizes : valuesSizes;
+    int pos = start;
+
+    for (int i = 0;i < 17;i++) {
+        if (!(mask & (quint32(1) << i))) {
+            continue;
+        }
+
+        // Older firmware ends the values before the position
+        if (!setup && i == 16 && packet.size() - pos < 4) {
+            return -1;
+        }
+
+        pos += sizes[i];
+    }
+
+    if (!(mask & (quint32(1) << 17)) || pos >= packet.size()) {
+        return -1;
+    }
+
+    return pos;
+}
@@ -0,0 +1,143 @@
+/*
+    Copyright 2016 - 2024 Benjamin Vedder	benjamin@vedder.se
+
+    This file is part of VESC Tool.
+
+    VESC Tool is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    VESC Tool is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+#ifndef IOTHREAD_H
+#define IOTHREAD_H
+
+#include <QObject>
+#include <QThread>
+#include <QMutex>
+#include <QList>
+#include <QByteArray>
+#include <atomic>
+
+#ifdef HAS_SERIALPORT
+#include <QSerialPort>
+#endif
+
+class Packet;
+class PacketCapture;
+class IoThread;
+
+class IoWorker : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit IoWorker(IoThread *io);
+
+signals:
+    void serialError(QString errorString);
+
+public slots:
+    void init();
+    bool openSerial(QString port, int baudrate);
+    void closeSerial();
+    void flush();
+    void write(QByteArray data);
+    void resetState();
+    void readAvailable();
+    void setFrameForwarding(bool on);
+
+private:
+    IoThread *mIo;
+    Packet *mPacket;
+    QMetaObject::Connection mFrameConn;
+
+#ifdef HAS_SERIALPORT
+    QSerialPort *mSerialPort;
+#endif
+
+};
+
+/**
+ * @brief The IoThread class
+ * Owns the serial port on a separate thread and does the packet framing
+ * there, so that reading and decoding does not stall when the GUI thread
+ * is busy. Decoded packets are handed to the GUI thread through a bounded
+ * queue where superseded telemetry is coalesced, so that only the newest
+ * sample of e.g. COMM_GET_VALUES is delivered when the GUI falls behind.
+ */
+class IoThread : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit IoThread(QObject *parent = nullptr);
+    ~IoThread();
+
+    bool openSerial(const QString &port, int baudrate);
+    void closeSerial();
+    bool isSerialOpen() const;
+    QString serialPortName() const;
+    void flush();
+    void write(const QByteArray &data);
+    void resetState();
+    void setFrameForwarding(bool on);
+
+    void setCapture(PacketCapture *capture, int transport);
+    void setMaxQueueLength(int len);
+    int coalescedPackets() const;
+    qint64 currentPacketRxTime() const;
+
+    static qint64 timestampNs();
+
+signals:
+    void packetReceived(QByteArray &packet);
+    void serialError(QString errorString);
+    void frameReceived(QByteArray frame);
+
+private slots:
+    void drainQueue();
+
+private:
+    friend class IoWorker;
+
+    struct RxPacket {
+        QByteArray data;
+        QByteArray key;
+        qint64 rxNs;
+    };
+
+    QThread mThread;
+    IoWorker *mWorker;
+    QString mPortName;
+    std::atomic<bool> mSerialOpen;
+    std::atomic<PacketCapture*> mCapture;
+    int mCaptureTransport;
+
+    // Shared with the worker
+    mutable QMutex mQueueMutex;
+    QList<RxPacket> mQueue;
+    bool mDrainPending;
+    int mMaxQueueLength;
+    int mCoalesced;
+    std::atomic<bool> mReadPaused; // Written under the lock
+
+    // Only used on the GUI thread
+    QList<RxPacket> mDelivering;
+    qint64 mCurrentRxNs;
+
+    bool enqueue(const QByteArray &packet, qint64 rxNs);
+    static QByteArray coalesceKey(const QByteArray &packet);
+    static int vescIdPos(const QByteArray &packet, int id, quint32 mask, int start);
+
+};
+
+#endif // IOTHREAD_H
@@ -0,0 +1,301 @@
+/*
+    Copyright 2016 - 2024 Benjamin Vedder	benjamin@vedder.se
+
+    This file is part of VESC Tool.
+
+    VESC Tool is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    VESC Tool is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+#include "linkstats.h"
+#include "commands.h"
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonArray>
+#include <QDateTime>
+#include <QSaveFile>
+
+namespace {
+// Upper limits of the round trip time buckets, the last bucket is open
+const qint64 rttLimitsMs[] = {5, 10, 20, 50, 100, 200, 500, 1000, 2000};
+
+// Sent packets that have not been replied to within this time are forgotten
+const qint64 pendingMaxMs = 5000;
+const int pendingMax = 32;
+
+// Packets the VESC sends on its own, or as a stream of several packets per
+// request. They are never paired with a request.
+bool isUnsolicited(int command)
+{
+    switch (command) {
+    case COMM_PRINT:
+    case COMM_SAMPLE_PRINT:
+    case COMM_ROTOR_POSITION:
+    case COMM_EXPERIMENT_SAMPLE:
+    case COMM_CUSTOM_APP_DATA:
+    case COMM_GPD_BUFFER_NOTIFY:
+    case COMM_EXT_NRF_ESB_RX_DATA:
+    case COMM_PLOT_INIT:
+    case COMM_PLOT_DATA:
+    case COMM_PLOT_ADD_GRAPH:
+    case COMM_PLOT_SET_GRAPH:
+    case COMM_LISP_PRINT:
+    case COMM_LOG_START:
+    case COMM_LOG_STOP:
+    case COMM_LOG_CONFIG_FIELD:
+    case COMM_LOG_DATA_F32:
+    case COMM_LOG_DATA_F64:
+        return true;
+
+    default:
+        return false;
+    }
+}
+}
+
+LinkStats::LinkStats(QObject *parent) : QObject(parent)
+{
+    mTransport = "None";
+    mElapsed.start();
+}
+
+void LinkStats::setTransport(const QString &transport)
+{
+    mTransport = transport;
+    mPending.clear();
+}
+
+QString LinkStats::transport() const
+{
+    return mTransport;
+}
+
+/**
+ * @brief LinkStats::recordTx
+ * Count a sent packet and remember when it was sent, to measure the round
+ * trip time when the reply arrives.
+ *
+ * @param forwarded
+ * The packet is forwarded to another VESC over CAN. The reply to it is
+ * still paired in order, but not included in the round trip times, as it
+ * includes the CAN-bus and cannot be told apart from a local reply.
+ */
+void LinkStats::recordTx(int command, int bytes, bool forwarded)
+{
+    auto &s = mStats[mTransport][command];
+    s.tx++;
+    s.bytesOut += bytes;
+
+    if (isUnsolicited(command)) {
+        return;
+    }
+
+    qint64 now = mElapsed.elapsed();
+    auto &pending = mPending[command];
+    while (!pending.isEmpty() &&
+           (pending.size() >= pendingMax || (now - pending.head().ms) > pendingMaxMs)) {
+        pending.dequeue();
+    }
+
+    Pending p;
+    p.ms = now;
+    p.forwarded = forwarded;
+    pending.enqueue(p);
+}
+
+void LinkStats::recordRx(int command, int bytes, qint64 decodeNs)
+{
+    auto &s = mStats[mTransport][command];
+    s.rx++;
+    s.bytesIn += bytes;
+    s.decodeTotalNs += decodeNs;
+    s.decodeMaxNs = qMax(s.decodeMaxNs, decodeNs);
+
+    if (isUnsolicited(command)) {
+        return;
+    }
+
+    auto it = mPending.find(command);
+    if (it != mPending.end() && !it->isEmpty()) {
+        Pending p = it->dequeue();
+        qint64 rtt = mElapsed.elapsed() - p.ms;
+        if (!p.forwarded && rtt <= pendingMaxMs) {
+            s.rttCount++;
+            s.rttTotalMs += rtt;
+            s.rttMinMs = s.rttMinMs < 0 ? rtt : qMin(s.rttMinMs, rtt);
+            s.rttMaxMs = qMax(s.rttMaxMs, rtt);
+            s.rttHist[rttBucket(rtt)]++;
+        }
+    }
+}
+
+/**
+ * @brief LinkStats::recordTimeout
+ * Count a request that was not replied to in time. The requests of the
+ * command that are waiting for a reply are dropped, so that a late reply is
+ * not paired with a later request and counted with a too short time.
+ */
+void LinkStats::recordTimeout(int command)
+{
+    mStats[mTransport][command].timeouts++;
+    mPending.remove(command);
+}
+
+void LinkStats::recordRetry(int command)
+{
+    mStats[mTransport][command].retries++;
+    mPending.remove(command);
+}
+
+QStringList LinkStats::transports() const
+{
+    return mStats.keys();
+}
+
+/**
+ * @brief LinkStats::transportStats
+ * The totals of all commands on a transport.
+ */
+QVariantMap LinkStats::transportStats(QString transport) const
+{
+    CommandStats tot;
+    for (const auto &s: mStats.value(transport)) {
+        tot.tx += s.tx;
+        tot.rx += s.rx;
+        tot.bytesOut += s.bytesOut;
+        tot.bytesIn += s.bytesIn;
+        tot.timeouts += s.timeouts;
+        tot.retries += s.retries;
+        tot.rttCount += s.rttCount;
+        tot.rttTotalMs += s.rttTotalMs;
+        if (s.rttMinMs >= 0) {
+            tot.rttMinMs = tot.rttMinMs < 0 ? s.rttMinMs : qMin(tot.rttMinMs, s.rttMinMs);
+        }
+        tot.rttMaxMs = qMax(tot.rttMaxMs, s.rttMaxMs);
+        for (int i = 0;i < RTT_BUCKETS;i++) {
+            tot.rttHist[i] += s.rttHist[i];
+        }
+        tot.decodeTotalNs += s.decodeTotalNs;
+        tot.decodeMaxNs = qMax(tot.decodeMaxNs, s.decodeMaxNs);
+    }
+
+    auto res = commandToMap(-1, tot);
+    res.remove("command");
+    res.remove("name");
+    res.insert("transport", transport);
+    return res;
+}
+
+/**
+ * @brief LinkStats::commandStats
+ * The statistics of every command seen on a transport, ordered by command
+ * ID. Each entry is a map with the same keys as in the JSON export.
+ */
+QVariantList LinkStats::commandStats(QString transport) const
+{
+    QVariantList res;
+    const auto stats = mStats.value(transport);
+    for (auto it = stats.constBegin();it != stats.constEnd();++it) {
+        res.append(commandToMap(it.key(), it.value()));
+    }
+    return res;
+}
+
+QString LinkStats::toJson() const
+{
+    QJsonObject root;
+    root.insert("created", QDateTime::currentDateTime().toString(Qt::ISODate));
+    root.insert("rttBuckets", QJsonArray::fromStringList(rttBucketNames()));
+
+    QJsonArray transports;
+    for (const auto &t: mStats.keys()) {
+        QJsonObject obj = QJsonObject::fromVariantMap(transportStats(t));
+        obj.insert("commands", QJsonArray::fromVariantList(commandStats(t)));
+        transports.append(obj);
+    }
+    root.insert("transports", transports);
+
+    return QString::fromUtf8(QJsonDocument(root).toJson());
+}
+
+bool LinkStats::saveJson(QString path) const
+{
+    if (path.startsWith("file:/")) {
+        path.remove(0, 6);
+    }
+
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+
+    file.write(toJson().toUtf8());
+    return file.commit();
+}
+
+void LinkStats::reset()
+{
+    mStats.clear();
+    mPending.clear();
+}
+
+QStringList LinkStats::rttBucketNames()
+{
+    QStringList res;
+    qint64 last = 0;
+    for (auto limit: rttLimitsMs) {
+        res.append(QString("%1-%2 ms").arg(last).arg(limit));
+        last = limit;
+    }
+    res.append(QString(">%1 ms").arg(last));
+    return res;
+}
+
+int LinkStats::rttBucket(qint64 ms)
+{
+    int i = 0;
+    for (auto limit: rttLimitsMs) {
+        if (ms <= limit) {
+            return i;
+        }
+        i++;
+    }
+    return RTT_BUCKETS - 1;
+}
+
+QVariantMap LinkStats::commandToMap(int command, const CommandStats &s)
+{
+    QVariantMap res;
+    res.insert("command", command);
+    res.insert("name", Commands::commandToStr(command));
+    res.insert("tx", s.tx);
+    res.insert("rx", s.rx);
+    res.insert("bytesOut", s.bytesOut);
+    res.insert("bytesIn", s.bytesIn);
+    res.insert("timeouts", s.timeouts);
+    res.insert("retries", s.retries);
+    res.insert("rttCount", s.rttCount);
+    res.insert("rttMeanMs", s.rttCount > 0 ? double(s.rttTotalMs) / double(s.rttCount) : 0.0);
+    res.insert("rttMinMs", qMax(s.rttMinMs, qint64(0)));
+    res.insert("rttMaxMs", s.rttMaxMs);
+
+    QVariantList hist;
+    for (int i = 0;i < RTT_BUCKETS;i++) {
+        hist.append(s.rttHist[i]);
+    }
+    res.insert("rttHistogram", hist);
+
+    res.insert("decodeMeanUs", s.rx > 0 ? double(s.decodeTotalNs) / double(s.rx) / 1000.0 : 0.0);
+    res.insert("decodeMaxUs", double(s.decodeMaxNs) / 1000.0);
+    return res;
+}
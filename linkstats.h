@@ -0,0 +1,104 @@
+/*
+    Copyright 2016 - 2024 Benjamin Vedder	benjamin@vedder.se
+
+    This file is part of VESC Tool.
+
+    VESC Tool is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    VESC Tool is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+#ifndef LINKSTATS_H
+#define LINKSTATS_H
+
+#include <QObject>
+#include <QMap>
+#include <QHash>
+#include <QQueue>
+#include <QElapsedTimer>
+#include <QVariantMap>
+#include <QVariantList>
+#include <QStringList>
+
+/**
+ * @brief The LinkStats class
+ * Statistics about the packets sent and received by Commands, per transport
+ * and per command: packet counts, bytes, round trip times, timeouts,
+ * retries and the time spent decoding the replies.
+ *
+ * The round trip time is measured from sending a command to receiving a
+ * packet with the same command ID, so it is only recorded for commands
+ * that the VESC replies to with the same ID. Packets the VESC sends on its
+ * own and replies to requests forwarded over CAN are left out of it. Bytes
+ * are counted on the packet payload, without the framing of the transport.
+ */
+class LinkStats : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit LinkStats(QObject *parent = nullptr);
+
+    void setTransport(const QString &transport);
+    Q_INVOKABLE QString transport() const;
+
+    void recordTx(int command, int bytes, bool forwarded = false);
+    void recordRx(int command, int bytes, qint64 decodeNs);
+    void recordTimeout(int command);
+    void recordRetry(int command);
+
+    Q_INVOKABLE QStringList transports() const;
+    Q_INVOKABLE QVariantMap transportStats(QString transport) const;
+    Q_INVOKABLE QVariantList commandStats(QString transport) const;
+    Q_INVOKABLE QString toJson() const;
+    Q_INVOKABLE bool saveJson(QString path) const;
+    Q_INVOKABLE void reset();
+
+    Q_INVOKABLE static QStringList rttBucketNames();
+
+private:
+    static const int RTT_BUCKETS = 10;
+
+    struct CommandStats {
+        quint64 tx = 0;
+        quint64 rx = 0;
+        quint64 bytesOut = 0;
+        quint64 bytesIn = 0;
+        quint64 timeouts = 0;
+        quint64 retries = 0;
+        quint64 rttCount = 0;
+        qint64 rttTotalMs = 0;
+        qint64 rttMinMs = -1;
+        qint64 rttMaxMs = 0;
+        quint64 rttHist[RTT_BUCKETS] = {};
+        qint64 decodeTotalNs = 0;
+        qint64 decodeMaxNs = 0;
+    };
+
+    typedef QMap<int, CommandStats> TransportStats;
+
+    QString mTransport;
+    QMap<QString, TransportStats> mStats;
+    struct Pending {
+        qint64 ms;
+        bool forwarded;
+    };
+
+    QHash<int, QQueue<Pending>> mPending;
+    QElapsedTimer mElapsed;
+
+    static int rttBucket(qint64 ms);
+    static QVariantMap commandToMap(int command, const CommandStats &s);
+
+};
+
+#endif // LINKSTATS_H
@@ -25,10 +25,13 @@
 #include "mobile/logwriter.h"
 #include "mobile/logreader.h"
 #include "tcpserversimple.h"
+#include "udpserversimple.h"
 #include "pages/pagemotorcomparison.h"
 #include "codeloader.h"
 #include "configparam.h"
 #include "utility.h"
+#include "productionline.h"
+#include "virtualvesc.h"
 
 #include <QApplication>
 #include <QStyleFactory>
@@ -87,6 +90,9 @@ static void showHelp()
     qDebug() << "--buildPkg [pkgPath:lispPath:qmlPath:isFullscreen:optMd:optName] : Build VESC Package";
     qDebug() << "--useBoardSetupWindow : Start board setup window instead of the main UI";
     qDebug() << "--xmlConfToCode [xml-file] : Generate C code from XML configuration file (the files are saved in the same directory as the XML)";
+    qDebug() << "--productionLine [ports:mcXml:appXml:bootloader] : Run the board setup on all comma-separated serial ports in parallel without GUI";
+    qDebug() << "--virtualVesc [port:latencyMs:bytesPerSecond:lossPercent] : Run a simulated VESC that VESC Tool can connect to over TCP";
+    qDebug() << "--captureFile [file] : Record the raw data on the link to a capture file, together with --tcpServer or --loadQml";
 }
 
 #ifdef Q_OS_LINUX
@@ -202,6 +208,7 @@ int main(int argc, char *argv[])
 #endif
     qmlRegisterType<Commands>("Vedder.vesc.commands", 1, 0, "Commands");
     qmlRegisterType<ConfigParams>("Vedder.vesc.configparams", 1, 0, "ConfigParams");
+    qmlRegisterType<ConfigParamWatcher>("Vedder.vesc.configparams", 1, 0, "ConfigParamWatcher");
     qmlRegisterType<FwHelper>("Vedder.vesc.fwhelper", 1, 0, "FwHelper");
     qmlRegisterType<TcpServerSimple>("Vedder.vesc.tcpserversimple", 1, 0, "TcpServerSimple");
     qmlRegisterType<UdpServerSimple>("Vedder.vesc.udpserversimple", 1, 0, "UdpServerSimple");
@@ -210,6 +217,7 @@ int main(int argc, char *argv[])
     qmlRegisterType<LogReader>("Vedder.vesc.logreader", 1, 0, "LogReader");
     qmlRegisterType<TcpHub>("Vedder.vesc.tcphub", 1, 0, "TcpHub");
     qmlRegisterType<CodeLoader>("Vedder.vesc.codeloader", 1, 0, "CodeLoader");
+    qmlRegisterType<LinkStats>("Vedder.vesc.linkstats", 1, 0, "LinkStats");
 
     qRegisterMetaType<VSerialInfo_t>();
     qRegisterMetaType<MCCONF_TEMP>();
@@ -258,6 +266,9 @@ int main(int argc, char *argv[])
     bool isTcpHub = false;
     QStringList pkgArgs;
     QString xmlCodePath = "";
+    QStringList lineArgs;
+    QStringList virtualVescArgs;
+    QString captureFile;
 
     for (int i = 0;i < args.size();i++) {
         // Skip the program argument
@@ -381,6 +392,39 @@ int main(int argc, char *argv[])
             }
         }
 
+        if (str == "--productionLine") {
+            if ((i + 1) < args.size()) {
+                i++;
+                lineArgs = args.at(i).split(":");
+                found = true;
+            } else {
+                i++;
+                qCritical() << "No production line arguments";
+                return 1;
+            }
+        }
+
+        if (str == "--virtualVesc") {
+            virtualVescArgs = QStringList() << "65102";
+            if ((i + 1) < args.size() && !args.at(i + 1).startsWith("-")) {
+                i++;
+                virtualVescArgs = args.at(i).split(":");
+            }
+            found = true;
+        }
+
+        if (str == "--captureFile") {
+            if ((i + 1) < args.size()) {
+                i++;
+                captureFile = args.at(i);
+                found = true;
+            } else {
+                i++;
+                qCritical() << "No capture file specified";
+                return 1;
+            }
+        }
+
         if (!found) {
             if (dash) {
                 qCritical() << "At least one of the flags is invalid:" << str;
@@ -419,6 +463,62 @@ int main(int argc, char *argv[])
         return 0;
     }
 
+    if (!virtualVescArgs.isEmpty()) {
+        QCoreApplication a(argc, argv);
+        VirtualVesc sim;
+        sim.setLatencyMs(virtualVescArgs.size() > 1 ? virtualVescArgs.at(1).toInt() : 0);
+        sim.setBandwidth(virtualVescArgs.size() > 2 ? virtualVescArgs.at(2).toInt() : 0);
+        sim.setLossRate(virtualVescArgs.size() > 3 ? virtualVescArgs.at(3).toDouble() / 100.0 : 0.0);
+
+        if (!sim.listen(virtualVescArgs.at(0).toInt(), QHostAddress::Any)) {
+            qCritical() << "Could not start the TCP server";
+            return 1;
+        }
+
+        qDebug() << "Virtual VESC listening on port" << sim.port();
+        return a.exec();
+    }
+
+    if (!lineArgs.isEmpty()) {
+        QStringList ports = lineArgs.at(0).split(",", Qt::SkipEmptyParts);
+        if (ports.isEmpty()) {
+            qCritical() << "No serial ports given";
+            return 1;
+        }
+
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+        QCoreApplication a(argc, argv);
+
+        ProductionStation::Options options;
+        options.mcXmlPath = lineArgs.size() > 1 ? lineArgs.at(1) : QString();
+        options.appXmlPath = lineArgs.size() > 2 ? lineArgs.at(2) : QString();
+        options.uploadBootloader = lineArgs.size() > 3 ? lineArgs.at(3).toInt() : false;
+        options.motorTolerance = 0.1;
+        options.directionTimeoutMs = 60000;
+
+        ProductionLine line;
+        QObject::connect(&line, &ProductionLine::stationStep, [&](int station, int step, int state, QString text) {
+            QString stepStr = step >= 0 ? ProductionStation::stepName(step) : "Status";
+            QString stateStr = state == ProductionLine::STATE_OK ? "OK" :
+                               state == ProductionLine::STATE_FAILED ? "FAILED" : "";
+            qDebug().noquote() << QString("[%1] %2 %3 %4").
+                                  arg(ports.at(station), stepStr, stateStr, text).simplified();
+        });
+        QObject::connect(&line, &ProductionLine::allFinished, &a, &QCoreApplication::quit);
+
+        line.start(ports, options);
+        a.exec();
+
+        qDebug().noquote() << line.timingReport();
+
+        bool allOk = true;
+        for (const auto &r: line.results()) {
+            allOk = allOk && r.ok;
+        }
+
+        return allOk ? 0 : 1;
+    }
+
     if (!pkgArgs.isEmpty()) {
         if (pkgArgs.size() < 4) {
             qWarning() << "Invalid arguments";
@@ -744,6 +844,10 @@ int main(int argc, char *argv[])
             w->show();
         }
     }
+
+    if (vesc && !captureFile.isEmpty() && !vesc->openCaptureFile(captureFile)) {
+        qCritical() << "Could not open capture file" << captureFile;
+    }
 #endif
 #ifdef Q_OS_IOS
     SetIosParams();
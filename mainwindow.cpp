@@ -1520,6 +1520,8 @@ void MainWindow::reloadPages()
 
     mPageRtData = new PageRtData(this);
     mPageRtData->setVesc(mVesc);
+    connect(mPreferences, &Preferences::rtDataHistoryChanged,
+            mPageRtData, &PageRtData::setHistory);
     ui->pageWidget->addWidget(mPageRtData);
     addPageItem(tr("Realtime Data"),  theme + "icons/rt_off.png", "", false, true);
     mPageNameIdList.insert("data_rt", ui->pageList->count() - 1);
@@ -1570,6 +1572,11 @@ void MainWindow::reloadPages()
     ui->pageWidget->addWidget(mPageCanAnalyzer);
     mPageVESCDev->addTab(mPageCanAnalyzer, Utility::getIcon("icons/can_off.png"), tr("CAN Analyzer"));
 
+    mPageLinkStats = new PageLinkStats(this);
+    mPageLinkStats->setVesc(mVesc);
+    ui->pageWidget->addWidget(mPageLinkStats);
+    mPageVESCDev->addTab(mPageLinkStats, Utility::getIcon("icons/Line Chart-96.png"), tr("Link Stats"));
+
     mPageDisplayTool = new PageDisplayTool(this);
     ui->pageWidget->addWidget(mPageDisplayTool);
     mPageVESCDev->addTab(mPageDisplayTool, Utility::getIcon("icons/Calculator-96.png"), tr("Display Tool"));
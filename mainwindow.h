@@ -71,6 +71,7 @@
 #include "pages/pageespprog.h"
 #include "pages/pagevescpackage.h"
 #include "pages/pagedisplaytool.h"
+#include "pages/pagelinkstats.h"
 
 namespace Ui {
 class MainWindow;
@@ -212,6 +213,7 @@ private:
     PageAppNrf *mPageAppNrf;
     PageAppBalance *mPageAppBalance;
     PageCanAnalyzer *mPageCanAnalyzer;
+    PageLinkStats *mPageLinkStats;
     PageTerminal *mPageTerminal;
     PageAppPas *mPageAppPas;
     PageSwdProg *mPageSwdProg;
@@ -391,13 +391,12 @@ Item {
         }
     }
 
-    Connections {
-        target: mMcConf
+    ConfigParamWatcher {
+        params: mMcConf
+        paramName: "l_current_max"
 
-        function onParamChangedDouble(src, name, newParam) {
-            if (name === "l_current_max") {
-                currentBox.realValue = newParam / 3.0
-            }
+        onChanged: {
+            currentBox.realValue = mMcConf.getParamDouble("l_current_max") / 3.0
         }
     }
 }
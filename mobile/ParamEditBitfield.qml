@@ -206,12 +206,13 @@ Item {
         }
     }
 
-    Connections {
-        target: params
+    ConfigParamWatcher {
+        params: editor.params
+        paramName: editor.paramName
 
-        function onParamChangedInt(src, name, newParam) {
-            if (src !== editor && name === paramName) {
-                setBits(newParam)
+        onChanged: {
+            if (src !== editor) {
+                setBits(params.getParamInt(paramName))
             }
         }
     }
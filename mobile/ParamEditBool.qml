@@ -128,12 +128,13 @@ Item {
         }
     }
 
-    Connections {
-        target: params
+    ConfigParamWatcher {
+        params: editor.params
+        paramName: editor.paramName
 
-        function onParamChangedBool(src, name, newParam) {
-            if (src !== editor && name === paramName) {
-                boolSwitch.checked = newParam
+        onChanged: {
+            if (src !== editor) {
+                boolSwitch.checked = params.getParamBool(paramName)
             }
         }
     }
@@ -188,11 +188,13 @@ Item {
         }
     }
 
-    Connections {
-        target: params
+    ConfigParamWatcher {
+        params: editor.params
+        paramName: editor.paramName
 
-        function onParamChangedDouble(src, name, newParam) {
-            if (src !== editor && name === paramName) {
+        onChanged: {
+            if (src !== editor) {
+                var newParam = params.getParamDouble(paramName)
                 valueBox.realValue = newParam * params.getParamEditorScale(paramName)
                 percentageBox.value = Math.round((100.0 * newParam) / maxVal)
             }
@@ -140,12 +140,13 @@ Item {
         }
     }
 
-    Connections {
-        target: params
+    ConfigParamWatcher {
+        params: editor.params
+        paramName: editor.paramName
 
-        function onParamChangedEnum(src, name, newParam) {
-            if (src !== editor && name === paramName) {
-                enumBox.currentIndex = newParam
+        onChanged: {
+            if (src !== editor) {
+                enumBox.currentIndex = params.getParamEnum(paramName)
             }
         }
     }
@@ -200,11 +200,13 @@ Item {
         }
     }
 
-    Connections {
-        target: params
+    ConfigParamWatcher {
+        params: editor.params
+        paramName: editor.paramName
 
-        function onParamChangedInt(src, name, newParam) {
-            if (src !== editor && name === paramName) {
+        onChanged: {
+            if (src !== editor) {
+                var newParam = params.getParamInt(paramName)
                 valueBox.value = newParam * params.getParamEditorScale(paramName)
                 percentageBox.value = Math.round((100.0 * newParam) / maxVal)
             }
@@ -144,12 +144,13 @@ Item {
         }
     }
 
-    Connections {
-        target: params
+    ConfigParamWatcher {
+        params: editor.params
+        paramName: editor.paramName
 
-        function onParamChangedQString(src, name, newParam) {
-            if (src !== editor && name === paramName) {
-                stringInput.text = newParam
+        onChanged: {
+            if (src !== editor) {
+                stringInput.text = params.getParamQString(paramName)
             }
         }
     }
@@ -220,7 +220,7 @@ Item {
     Connections {
         target: mMcConf
 
-        function onParamChangedDouble(src, name, newParam) {
+        function onParamsChanged(src, names) {
             checkActive()
         }
     }
@@ -20,6 +20,7 @@
 #include "packet.h"
 #include <cstring>
 #include <QDebug>
+#include <QMetaMethod>
 
 namespace {
 // CRC Table
@@ -83,6 +84,17 @@ void Packet::sendPacket(const QByteArray &data)
         return;
     }
 
+    QByteArray to_send = framePacket(data);
+    emit dataToSend(to_send);
+}
+
+/**
+ * @brief Packet::framePacket
+ * Add the start byte, length, CRC and stop byte to data. This does not
+ * check the length against the maximum packet length.
+ */
+QByteArray Packet::framePacket(const QByteArray &data)
+{
     QByteArray to_send;
     unsigned int len_tot = data.size();
 
@@ -107,7 +119,7 @@ void Packet::sendPacket(const QByteArray &data)
     to_send.append((char)(crc & 0xFF));
     to_send.append((char)3);
 
-    emit dataToSend(to_send);
+    return to_send;
 }
 
 void Packet::resetState()
@@ -129,6 +141,10 @@ unsigned short Packet::crc16(const unsigned char *buf, unsigned int len)
 void Packet::processData(QByteArray data)
 {
     QVector<QByteArray> decodedPackets;
+    QVector<QByteArray> decodedFrames;
+
+    // Keep the raw frames only when someone forwards them
+    bool keepFrames = isSignalConnected(QMetaMethod::fromSignal(&Packet::frameReceived));
 
     for(unsigned char rx_data: data) {
         mRxTimer = mByteTimeout;
@@ -164,7 +180,8 @@ void Packet::processData(QByteArray data)
         // until we run out of data.
         for (;;) {
             int res = try_decode_packet(mRxBuffer + mRxReadPtr, data_len,
-                                        &mBytesLeft, decodedPackets);
+                                        &mBytesLeft, decodedPackets,
+                                        keepFrames ? &decodedFrames : nullptr);
 
             // More data is needed
             if (res == -2) {
@@ -188,7 +205,12 @@ void Packet::processData(QByteArray data)
         }
     }
 
-    for (QByteArray b: decodedPackets) {
+    for (int i = 0;i < decodedPackets.size();i++) {
+        if (keepFrames) {
+            emit frameReceived(decodedFrames[i]);
+        }
+
+        QByteArray b = decodedPackets.at(i);
         emit packetReceived(b);
     }
 }
@@ -205,7 +227,8 @@ void Packet::timerSlot()
 }
 
 int Packet::try_decode_packet(unsigned char *buffer, unsigned int in_len,
-                              int *bytes_left, QVector<QByteArray> &decodedPackets)
+                              int *bytes_left, QVector<QByteArray> &decodedPackets,
+                              QVector<QByteArray> *decodedFrames)
 {
     *bytes_left = 0;
 
@@ -280,6 +303,9 @@ int Packet::try_decode_packet(unsigned char *buffer, unsigned int in_len,
     if (crc_calc == crc_rx) {
         QByteArray res((const char*)(buffer + data_start), (int)len);
         decodedPackets.append(res);
+        if (decodedFrames) {
+            decodedFrames->append(QByteArray((const char*)buffer, int(len + data_start + 3)));
+        }
         return len + data_start + 3;
     } else {
         return -1;
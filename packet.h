@@ -32,10 +32,12 @@ public:
     void sendPacket(const QByteArray &data);
     void resetState();
     static unsigned short crc16(const unsigned char *buf, unsigned int len);
+    static QByteArray framePacket(const QByteArray &data);
 
 signals:
     void dataToSend(QByteArray &data);
     void packetReceived(QByteArray &packet);
+    void frameReceived(QByteArray &frame);
 
 public slots:
     void processData(QByteArray data);
@@ -55,7 +57,8 @@ private:
     unsigned char *mRxBuffer;
 
     int try_decode_packet(unsigned char *buffer, unsigned int in_len,
-                          int *bytes_left, QVector<QByteArray> &decodedPackets);
+                          int *bytes_left, QVector<QByteArray> &decodedPackets,
+                          QVector<QByteArray> *decodedFrames);
 
 };
 
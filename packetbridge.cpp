@@ -0,0 +1,428 @@
+/*
+    Copyright 2016 - 2024 Benjamin Vedder	benjamin@vedder.se
+
+    This file is part of VESC Tool.
+
+    VESC Tool is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    VESC Tool is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+#include "packetbridge.h"
+#include "packet.h"
+#include "iothread.h"
+#include "datatypes.h"
+#include <QNetworkDatagram>
+#include <QDebug>
+
+namespace {
+// Replies that have not arrived by then are not waited for anymore
+const qint64 requestTimeoutMs = 3000;
+// UDP has no connection, so clients that are silent for this long are dropped
+const qint64 udpClientTimeoutMs = 30000;
+}
+
+PacketBridgeWorker::PacketBridgeWorker(PacketBridge *bridge) : QObject()
+{
+    mBridge = bridge;
+    mTcpServer = nullptr;
+    mUdpSocket = nullptr;
+    mTimer = nullptr;
+    mNextClientId = 0;
+}
+
+void PacketBridgeWorker::init()
+{
+    mClock.start();
+    mTcpServer = new QTcpServer(this);
+    mUdpSocket = new QUdpSocket(this);
+    mTimer = new QTimer(this);
+    mTimer->start(1000);
+
+    connect(mTcpServer, &QTcpServer::newConnection, [this]() {
+        while (mTcpServer->hasPendingConnections()) {
+            QTcpSocket *socket = mTcpServer->nextPendingConnection();
+            socket->setSocketOption(QAbstractSocket::LowDelayOption, true);
+
+            Client *c = addClient(QString("%1:%2").arg(socket->peerAddress().toString()).
+                                  arg(socket->peerPort()), socket);
+            int id = c->id;
+
+            connect(socket, &QTcpSocket::readyRead, [this, id, socket]() {
+                Client *c = mClients.value(id);
+                if (c) {
+                    c->lastRx = mClock.elapsed();
+                    c->packet->processData(socket->readAll());
+                }
+            });
+
+            connect(socket, &QTcpSocket::disconnected, [this, id]() {
+                removeClient(id);
+            });
+        }
+    });
+
+    connect(mUdpSocket, &QUdpSocket::readyRead, [this]() {
+        while (mUdpSocket->hasPendingDatagrams()) {
+            QNetworkDatagram datagram = mUdpSocket->receiveDatagram();
+
+            Client *c = nullptr;
+            for (auto cl: mClients) {
+                if (!cl->socket && cl->udpPort == datagram.senderPort() &&
+                        cl->udpAddr == datagram.senderAddress()) {
+                    c = cl;
+                    break;
+                }
+            }
+
+            if (!c) {
+                c = addClient(QString("%1:%2").arg(datagram.senderAddress().toString()).
+                              arg(datagram.senderPort()), nullptr,
+                              datagram.senderAddress(), quint16(datagram.senderPort()));
+            }
+
+            c->lastRx = mClock.elapsed();
+            c->packet->processData(datagram.data());
+        }
+    });
+
+    connect(mTimer, &QTimer::timeout, [this]() {
+        qint64 now = mClock.elapsed();
+
+        for (auto c: mClients.values()) {
+            if (!c->socket && (now - c->lastRx) > udpClientTimeoutMs) {
+                removeClient(c->id);
+            }
+        }
+
+        while (!mRequests.isEmpty() && (now - mRequests.first().time) > requestTimeoutMs) {
+            mRequests.removeFirst();
+        }
+    });
+}
+
+bool PacketBridgeWorker::startTcp(int port, QString addr)
+{
+    stopTcp();
+
+    bool res = mTcpServer->listen(addr.isEmpty() ? QHostAddress(QHostAddress::Any) : QHostAddress(addr), quint16(port));
+
+    QMutexLocker locker(&mBridge->mStateMutex);
+    mBridge->mErrorString = res ? QString() : mTcpServer->errorString();
+    mBridge->mTcpRunning = res;
+    return res;
+}
+
+void PacketBridgeWorker::stopTcp()
+{
+    mTcpServer->close();
+    mBridge->mTcpRunning = false;
+
+    for (auto c: mClients.values()) {
+        if (c->socket) {
+            removeClient(c->id);
+        }
+    }
+}
+
+bool PacketBridgeWorker::startUdp(int port, QString addr)
+{
+    stopUdp();
+
+    bool res = mUdpSocket->bind(addr.isEmpty() ? QHostAddress(QHostAddress::Any) : QHostAddress(addr), quint16(port));
+
+    QMutexLocker locker(&mBridge->mStateMutex);
+    mBridge->mErrorString = res ? QString() : mUdpSocket->errorString();
+    mBridge->mUdpRunning = res;
+    return res;
+}
+
+void PacketBridgeWorker::stopUdp()
+{
+    mUdpSocket->close();
+    mBridge->mUdpRunning = false;
+
+    for (auto c: mClients.values()) {
+        if (!c->socket) {
+            removeClient(c->id);
+        }
+    }
+}
+
+/**
+ * @brief PacketBridgeWorker::vescFrame
+ * A complete frame from the VESC. It goes to the oldest client that has an
+ * outstanding request with the same command, or to all clients if nobody
+ * asked for it.
+ */
+void PacketBridgeWorker::vescFrame(QByteArray frame)
+{
+    int cmd = frameCommand(frame, false);
+    qint64 now = mClock.elapsed();
+
+    for (int i = 0;i < mRequests.size();i++) {
+        const Request &r = mRequests.at(i);
+        if ((now - r.time) > requestTimeoutMs) {
+            mRequests.removeAt(i);
+            i--;
+            continue;
+        }
+
+        if (r.cmd == cmd) {
+            Client *c = mClients.value(r.clientId);
+            mRequests.removeAt(i);
+            if (c) {
+                sendToClient(c, frame);
+                return;
+            }
+            break;
+        }
+    }
+
+    for (auto c: mClients) {
+        sendToClient(c, frame);
+    }
+}
+
+PacketBridgeWorker::Client *PacketBridgeWorker::addClient(const QString &name, QTcpSocket *socket,
+                                                          const QHostAddress &udpAddr, quint16 udpPort)
+{
+    Client *c = new Client;
+    c->id = mNextClientId++;
+    c->name = name;
+    c->socket = socket;
+    c->udpAddr = udpAddr;
+    c->udpPort = udpPort;
+    c->packet = new Packet(this);
+    c->lastRx = mClock.elapsed();
+
+    int id = c->id;
+    connect(c->packet, &Packet::frameReceived, [this, id](QByteArray &frame) {
+        clientFrame(id, frame);
+    });
+
+    mClients.insert(id, c);
+    updateClientList();
+    return c;
+}
+
+void PacketBridgeWorker::removeClient(int id)
+{
+    Client *c = mClients.take(id);
+    if (!c) {
+        return;
+    }
+
+    if (c->socket) {
+        c->socket->disconnect(this);
+        c->socket->abort();
+        c->socket->deleteLater();
+    }
+
+    c->packet->deleteLater();
+    delete c;
+
+    for (int i = 0;i < mRequests.size();i++) {
+        if (mRequests.at(i).clientId == id) {
+            mRequests.removeAt(i);
+            i--;
+        }
+    }
+
+    updateClientList();
+}
+
+void PacketBridgeWorker::sendToClient(Client *c, const QByteArray &frame)
+{
+    if (c->socket) {
+        c->socket->write(frame);
+    } else {
+        mUdpSocket->writeDatagram(frame, c->udpAddr, c->udpPort);
+    }
+}
+
+void PacketBridgeWorker::clientFrame(int id, const QByteArray &frame)
+{
+    int cmd = frameCommand(frame, true);
+    if (cmd >= 0) {
+        Request r;
+        r.cmd = quint8(cmd);
+        r.clientId = id;
+        r.time = mClock.elapsed();
+        mRequests.append(r);
+    }
+
+    IoThread *io = mBridge->mIo;
+    if (io && io->isSerialOpen()) {
+        io->write(frame);
+    } else {
+        emit frameToVesc(frame);
+    }
+}
+
+void PacketBridgeWorker::updateClientList()
+{
+    QStringList tcp;
+    QStringList udp;
+
+    for (auto c: mClients) {
+        if (c->socket) {
+            tcp.append(c->name);
+        } else {
+            udp.append(c->name);
+        }
+    }
+
+    {
+        QMutexLocker locker(&mBridge->mStateMutex);
+        mBridge->mTcpClients = tcp;
+        mBridge->mUdpClients = udp;
+    }
+
+    mBridge->mClientCount = mClients.size();
+    emit mBridge->clientsChanged();
+}
+
+/**
+ * @brief PacketBridgeWorker::frameCommand
+ * Get the command of a complete frame. Replies to forwarded requests come
+ * back without the forward header, so for requests the forwarded command
+ * is used if skipForward is set.
+ */
+int PacketBridgeWorker::frameCommand(const QByteArray &frame, bool skipForward)
+{
+    if (frame.isEmpty()) {
+        return -1;
+    }
+
+    int start = quint8(frame.at(0));
+    if (frame.size() <= start) {
+        return -1;
+    }
+
+    int cmd = quint8(frame.at(start));
+    if (skipForward && cmd == COMM_FORWARD_CAN) {
+        cmd = frame.size() > (start + 2) ? quint8(frame.at(start + 2)) : -1;
+    }
+
+    return cmd;
+}
+
+PacketBridge::PacketBridge(QObject *parent) : QObject(parent)
+{
+    mIo = nullptr;
+    mLastTcpPort = -1;
+    mTcpRunning = false;
+    mUdpRunning = false;
+    mClientCount = 0;
+
+    mThread.setObjectName("VESC Bridge");
+    mWorker = new PacketBridgeWorker(this);
+    mWorker->moveToThread(&mThread);
+    connect(&mThread, &QThread::finished, mWorker, &QObject::deleteLater);
+    connect(mWorker, &PacketBridgeWorker::frameToVesc, this, &PacketBridge::frameToVesc);
+    mThread.start();
+
+    QMetaObject::invokeMethod(mWorker, "init", Qt::BlockingQueuedConnection);
+}
+
+PacketBridge::~PacketBridge()
+{
+    stopTcp();
+    stopUdp();
+    mThread.quit();
+    mThread.wait();
+}
+
+/**
+ * @brief PacketBridge::setIoThread
+ * Frames from the clients are written directly to the serial port of io
+ * when it is open, instead of going through frameToVesc.
+ */
+void PacketBridge::setIoThread(IoThread *io)
+{
+    mIo = io;
+}
+
+bool PacketBridge::startTcp(int port, const QString &addr)
+{
+    bool res = false;
+    QMetaObject::invokeMethod(mWorker, "startTcp", Qt::BlockingQueuedConnection,
+                              Q_RETURN_ARG(bool, res), Q_ARG(int, port), Q_ARG(QString, addr));
+    mLastTcpPort = port;
+    return res;
+}
+
+void PacketBridge::stopTcp()
+{
+    QMetaObject::invokeMethod(mWorker, "stopTcp", Qt::BlockingQueuedConnection);
+}
+
+bool PacketBridge::isTcpRunning() const
+{
+    return mTcpRunning;
+}
+
+int PacketBridge::lastTcpPort() const
+{
+    return mLastTcpPort;
+}
+
+bool PacketBridge::startUdp(int port, const QString &addr)
+{
+    bool res = false;
+    QMetaObject::invokeMethod(mWorker, "startUdp", Qt::BlockingQueuedConnection,
+                              Q_RETURN_ARG(bool, res), Q_ARG(int, port), Q_ARG(QString, addr));
+    return res;
+}
+
+void PacketBridge::stopUdp()
+{
+    QMetaObject::invokeMethod(mWorker, "stopUdp", Qt::BlockingQueuedConnection);
+}
+
+bool PacketBridge::isUdpRunning() const
+{
+    return mUdpRunning;
+}
+
+QString PacketBridge::errorString() const
+{
+    QMutexLocker locker(&mStateMutex);
+    return mErrorString;
+}
+
+QStringList PacketBridge::tcpClients() const
+{
+    QMutexLocker locker(&mStateMutex);
+    return mTcpClients;
+}
+
+QStringList PacketBridge::udpClients() const
+{
+    QMutexLocker locker(&mStateMutex);
+    return mUdpClients;
+}
+
+/**
+ * @brief PacketBridge::vescFrame
+ * Forward a complete frame from the VESC to the clients. This can be called
+ * from any thread.
+ */
+void PacketBridge::vescFrame(QByteArray frame)
+{
+    if (mClientCount == 0) {
+        return;
+    }
+
+    QMetaObject::invokeMethod(mWorker, "vescFrame", Qt::QueuedConnection, Q_ARG(QByteArray, frame));
+}
@@ -0,0 +1,149 @@
+/*
+    Copyright 2016 - 2024 Benjamin Vedder	benjamin@vedder.se
+
+    This file is part of VESC Tool.
+
+    VESC Tool is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    VESC Tool is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+#ifndef PACKETBRIDGE_H
+#define PACKETBRIDGE_H
+
+#include <QObject>
+#include <QThread>
+#include <QMutex>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QUdpSocket>
+#include <QElapsedTimer>
+#include <QTimer>
+#include <QHash>
+#include <QList>
+#include <atomic>
+
+class Packet;
+class IoThread;
+class PacketBridge;
+
+class PacketBridgeWorker : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit PacketBridgeWorker(PacketBridge *bridge);
+
+signals:
+    void frameToVesc(QByteArray frame);
+
+public slots:
+    void init();
+    bool startTcp(int port, QString addr);
+    void stopTcp();
+    bool startUdp(int port, QString addr);
+    void stopUdp();
+    void vescFrame(QByteArray frame);
+
+private:
+    struct Client {
+        int id;
+        QString name;
+        QTcpSocket *socket;
+        QHostAddress udpAddr;
+        quint16 udpPort;
+        Packet *packet;
+        qint64 lastRx;
+    };
+
+    struct Request {
+        quint8 cmd;
+        int clientId;
+        qint64 time;
+    };
+
+    PacketBridge *mBridge;
+    QTcpServer *mTcpServer;
+    QUdpSocket *mUdpSocket;
+    QTimer *mTimer;
+    QElapsedTimer mClock;
+    QHash<int, Client*> mClients;
+    QList<Request> mRequests;
+    int mNextClientId;
+
+    Client *addClient(const QString &name, QTcpSocket *socket,
+                      const QHostAddress &udpAddr = QHostAddress(), quint16 udpPort = 0);
+    void removeClient(int id);
+    void sendToClient(Client *c, const QByteArray &frame);
+    void clientFrame(int id, const QByteArray &frame);
+    void updateClientList();
+    static int frameCommand(const QByteArray &frame, bool skipForward);
+
+};
+
+/**
+ * @brief The PacketBridge class
+ * Makes the connected VESC available to several TCP and UDP clients at
+ * the same time. Frames are validated once and then forwarded as they are,
+ * without decoding and encoding them again. Requests from the clients are
+ * tracked so that each reply is routed to the client that asked for it,
+ * everything else is sent to all clients. The sockets live on a separate
+ * thread, and frames to and from the serial port bypass the GUI thread.
+ */
+class PacketBridge : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit PacketBridge(QObject *parent = nullptr);
+    ~PacketBridge();
+
+    void setIoThread(IoThread *io);
+
+    bool startTcp(int port, const QString &addr = QString());
+    void stopTcp();
+    bool isTcpRunning() const;
+    int lastTcpPort() const;
+    bool startUdp(int port, const QString &addr = QString());
+    void stopUdp();
+    bool isUdpRunning() const;
+    QString errorString() const;
+
+    QStringList tcpClients() const;
+    QStringList udpClients() const;
+
+signals:
+    void frameToVesc(QByteArray frame);
+    void clientsChanged();
+
+public slots:
+    void vescFrame(QByteArray frame);
+
+private:
+    friend class PacketBridgeWorker;
+
+    QThread mThread;
+    PacketBridgeWorker *mWorker;
+    IoThread *mIo;
+    int mLastTcpPort;
+    std::atomic<bool> mTcpRunning;
+    std::atomic<bool> mUdpRunning;
+    std::atomic<int> mClientCount;
+
+    mutable QMutex mStateMutex;
+    QString mErrorString;
+    QStringList mTcpClients;
+    QStringList mUdpClients;
+
+};
+
+#endif // PACKETBRIDGE_H
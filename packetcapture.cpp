@@ -0,0 +1,438 @@
+/*
+    Copyright 2016 - 2024 Benjamin Vedder	benjamin@vedder.se
+
+    This file is part of VESC Tool.
+
+    VESC Tool is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    VESC Tool is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+#include "packetcapture.h"
+#include "vbytearray.h"
+#include "iothread.h"
+
+#include <QMutexLocker>
+
+namespace {
+const char captureMagic[] = "VCAP";
+const quint8 captureVersion = 1;
+const quint8 tagOutbound = 0x80;
+
+void appendVarint(QByteArray &dest, quint64 value)
+{
+    while (value >= 0x80) {
+        dest.append(char((value & 0x7F) | 0x80));
+        value >>= 7;
+    }
+    dest.append(char(value));
+}
+
+bool readVarint(const QByteArray &src, int &pos, quint64 &value)
+{
+    value = 0;
+    for (int shift = 0;shift < 64;shift += 7) {
+        if (pos >= src.size()) {
+            return false;
+        }
+
+        quint8 b = quint8(src.at(pos++));
+        value |= quint64(b & 0x7F) << shift;
+        if (!(b & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Longest time the replay spends feeding data before returning to the
+// event loop when running as fast as possible
+const qint64 replaySliceMs = 5;
+}
+
+PacketCapture::PacketCapture(QObject *parent) : QObject(parent)
+{
+    mOpen = false;
+    mStartNs = 0;
+    mLastUs = 0;
+    mRecords = 0;
+    mBytes = 0;
+}
+
+PacketCapture::~PacketCapture()
+{
+    close();
+}
+
+/**
+ * @brief PacketCapture::open
+ * Start a new capture.
+ *
+ * @param path
+ * The file to write. It is replaced if it exists.
+ *
+ * @param transports
+ * Names of the transports, indexed by the transport argument of record.
+ *
+ * @return
+ * True if the file could be opened.
+ */
+bool PacketCapture::open(const QString &path, const QStringList &transports)
+{
+    close();
+
+    QMutexLocker locker(&mMutex);
+
+    mFile.setFileName(path);
+    if (!mFile.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        return false;
+    }
+
+    VByteArray header;
+    header.append(captureMagic, 4);
+    header.vbAppendUint8(captureVersion);
+    header.vbAppendInt64(QDateTime::currentMSecsSinceEpoch());
+    header.vbAppendUint8(quint8(transports.size()));
+    for (const auto &t: transports) {
+        // Not vbAppendString, as that uses the local 8-bit encoding
+        header.append(t.toUtf8());
+        header.append(char(0));
+    }
+    mFile.write(header);
+
+    mStartNs = IoThread::timestampNs();
+    mLastUs = 0;
+    mRecords = 0;
+    mBytes = 0;
+    mOpen = true;
+    return true;
+}
+
+void PacketCapture::close()
+{
+    QMutexLocker locker(&mMutex);
+    mOpen = false;
+    if (mFile.isOpen()) {
+        mFile.close();
+    }
+}
+
+bool PacketCapture::isOpen() const
+{
+    return mOpen;
+}
+
+QString PacketCapture::path() const
+{
+    QMutexLocker locker(&mMutex);
+    return mFile.fileName();
+}
+
+/**
+ * @brief PacketCapture::record
+ * Append data to the capture. Does nothing when no capture is open, so it
+ * is cheap to call on every read and write.
+ *
+ * @param transport
+ * Index in the transport names given to open.
+ *
+ * @param outbound
+ * True for data sent to the VESC.
+ *
+ * @param data
+ * The raw bytes, as they are read from or written to the transport.
+ *
+ * @param timeNs
+ * When the data was read or written, from IoThread::timestampNs. -1 for now.
+ */
+void PacketCapture::record(int transport, bool outbound, const QByteArray &data, qint64 timeNs)
+{
+    if (!mOpen || data.isEmpty()) {
+        return;
+    }
+
+    if (timeNs < 0) {
+        timeNs = IoThread::timestampNs();
+    }
+
+    QMutexLocker locker(&mMutex);
+
+    if (!mFile.isOpen()) {
+        return;
+    }
+
+    // Data read on the I/O thread can be stamped before data that got the
+    // lock first, so keep the times monotonic in the file.
+    qint64 us = qMax((timeNs - mStartNs) / 1000, mLastUs);
+
+    QByteArray rec;
+    rec.reserve(data.size() + 12);
+    rec.append(char((transport & 0x7F) | (outbound ? tagOutbound : 0)));
+    appendVarint(rec, quint64(us - mLastUs));
+    appendVarint(rec, quint64(data.size()));
+    rec.append(data);
+    mFile.write(rec);
+
+    mLastUs = us;
+    mRecords++;
+    mBytes += data.size();
+}
+
+qint64 PacketCapture::recordCount() const
+{
+    QMutexLocker locker(&mMutex);
+    return mRecords;
+}
+
+qint64 PacketCapture::byteCount() const
+{
+    QMutexLocker locker(&mMutex);
+    return mBytes;
+}
+
+/**
+ * @brief PacketCapture::load
+ * Read a capture file.
+ *
+ * @param path
+ * The file to read.
+ *
+ * @param records
+ * The records in the file are appended here. A truncated last record, such
+ * as when the program was closed while capturing, is left out.
+ *
+ * @param transports
+ * Optional, the transport names from the header.
+ *
+ * @param start
+ * Optional, when the capture was started.
+ *
+ * @return
+ * False if the file could not be read or is not a capture.
+ */
+bool PacketCapture::load(const QString &path, QVector<Record> &records,
+                         QStringList *transports, QDateTime *start)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    const QByteArray data = file.readAll();
+    file.close();
+
+    if (data.size() < 14 || !data.startsWith(captureMagic) || quint8(data.at(4)) != captureVersion) {
+        return false;
+    }
+
+    VByteArray header(data.mid(5, 9));
+    qint64 startMs = header.vbPopFrontInt64();
+    int transportNum = quint8(header.vbPopFrontUint8());
+
+    int pos = 14;
+    QStringList names;
+    for (int i = 0;i < transportNum;i++) {
+        int end = data.indexOf(char(0), pos);
+        if (end < 0) {
+            return false;
+        }
+        names.append(QString::fromUtf8(data.constData() + pos, end - pos));
+        pos = end + 1;
+    }
+
+    if (transports) {
+        *transports = names;
+    }
+
+    if (start) {
+        *start = QDateTime::fromMSecsSinceEpoch(startMs, Qt::UTC);
+    }
+
+    qint64 timeUs = 0;
+    while (pos < data.size()) {
+        quint8 tag = quint8(data.at(pos++));
+        quint64 deltaUs = 0;
+        quint64 len = 0;
+
+        if (!readVarint(data, pos, deltaUs) || !readVarint(data, pos, len) ||
+                len > quint64(data.size() - pos)) {
+            break;
+        }
+
+        timeUs += qint64(deltaUs);
+
+        Record r;
+        r.timeUs = timeUs;
+        r.transport = tag & 0x7F;
+        r.outbound = tag & tagOutbound;
+        r.data = data.mid(pos, int(len));
+        records.append(r);
+
+        pos += int(len);
+    }
+
+    return true;
+}
+
+CaptureReplay::CaptureReplay(QObject *parent) : QObject(parent)
+{
+    mPacket = nullptr;
+    mTransport = -1;
+    mNext = 0;
+    mRunning = false;
+    mRealTime = true;
+
+    mTimer = new QTimer(this);
+    mTimer->setSingleShot(true);
+    mTimer->setTimerType(Qt::PreciseTimer);
+    connect(mTimer, SIGNAL(timeout()), this, SLOT(timerSlot()));
+}
+
+bool CaptureReplay::load(const QString &path)
+{
+    stop();
+    mRecords.clear();
+    mTransports.clear();
+    return PacketCapture::load(path, mRecords, &mTransports);
+}
+
+int CaptureReplay::recordCount() const
+{
+    return mRecords.size();
+}
+
+qint64 CaptureReplay::durationUs() const
+{
+    return mRecords.isEmpty() ? 0 : mRecords.last().timeUs;
+}
+
+QStringList CaptureReplay::transports() const
+{
+    return mTransports;
+}
+
+/**
+ * @brief CaptureReplay::setPacket
+ * The decoder to feed with the inbound data. It is reset when the replay
+ * starts.
+ */
+void CaptureReplay::setPacket(Packet *packet)
+{
+    mPacket = packet;
+}
+
+/**
+ * @brief CaptureReplay::setTransport
+ * Only replay the data of one transport, as indexed by transports(), or
+ * -1 for all of them.
+ */
+void CaptureReplay::setTransport(int transport)
+{
+    mTransport = transport;
+}
+
+/**
+ * @brief CaptureReplay::start
+ * Start feeding the inbound data to the packet decoder from the event loop.
+ * finished is emitted when everything has been fed.
+ *
+ * @param realTime
+ * Keep the timing of the capture. Otherwise the data is fed as fast as
+ * possible, returning to the event loop every few milliseconds.
+ *
+ * @return
+ * False if there is no packet decoder or nothing to replay.
+ */
+bool CaptureReplay::start(bool realTime)
+{
+    stop();
+
+    if (!mPacket || mRecords.isEmpty()) {
+        return false;
+    }
+
+    mPacket->resetState();
+    mRealTime = realTime;
+    mNext = 0;
+    mRunning = true;
+    mElapsed.start();
+    mTimer->start(0);
+    return true;
+}
+
+void CaptureReplay::stop()
+{
+    mTimer->stop();
+    mRunning = false;
+}
+
+bool CaptureReplay::isRunning() const
+{
+    return mRunning;
+}
+
+double CaptureReplay::progress() const
+{
+    return mRecords.isEmpty() ? 0.0 : double(mNext) / double(mRecords.size());
+}
+
+void CaptureReplay::timerSlot()
+{
+    if (!mRunning || !mPacket) {
+        return;
+    }
+
+    if (mRealTime) {
+        qint64 nowUs = mElapsed.nsecsElapsed() / 1000;
+        while (mNext < mRecords.size() && mRecords.at(mNext).timeUs <= nowUs) {
+            const auto &r = mRecords.at(mNext++);
+            if (isReplayed(r)) {
+                mPacket->processData(r.data);
+            }
+        }
+
+        if (!mRunning) {
+            return;
+        }
+
+        if (mNext < mRecords.size()) {
+            mTimer->start(int(qMax(qint64(0), (mRecords.at(mNext).timeUs - nowUs) / 1000)));
+            return;
+        }
+    } else {
+        QElapsedTimer slice;
+        slice.start();
+        while (mNext < mRecords.size() && slice.elapsed() < replaySliceMs) {
+            const auto &r = mRecords.at(mNext++);
+            if (isReplayed(r)) {
+                mPacket->processData(r.data);
+            }
+        }
+
+        if (!mRunning) {
+            return;
+        }
+
+        if (mNext < mRecords.size()) {
+            mTimer->start(0);
+            return;
+        }
+    }
+
+    mRunning = false;
+    emit finished();
+}
+
+bool CaptureReplay::isReplayed(const PacketCapture::Record &r) const
+{
+    return !r.outbound && (mTransport < 0 || r.transport == mTransport);
+}
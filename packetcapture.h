@@ -0,0 +1,133 @@
+/*
+    Copyright 2016 - 2024 Benjamin Vedder	benjamin@vedder.se
+
+    This file is part of VESC Tool.
+
+    VESC Tool is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    VESC Tool is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+#ifndef PACKETCAPTURE_H
+#define PACKETCAPTURE_H
+
+#include <QObject>
+#include <QFile>
+#include <QMutex>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QDateTime>
+#include <QVector>
+#include <QStringList>
+#include <atomic>
+#include "packet.h"
+
+/**
+ * @brief The PacketCapture class
+ * Records the raw bytes sent and received on the link, with monotonic
+ * timestamps, to a compact binary file that CaptureReplay can feed to the
+ * packet decoder again later. Recording is thread safe, as the serial port
+ * is read on the I/O thread.
+ *
+ * File format, with integers in big endian:
+ *   Header: "VCAP", uint8 version, int64 UTC start time in ms since epoch,
+ *           uint8 transport count and a null-terminated name per transport.
+ *   Record: uint8 tag where bit 7 is set for outbound data and bits 0 - 6
+ *           index the transport names, varint time since the previous
+ *           record in µs, varint length and the raw bytes.
+ * Varints are unsigned LEB128, so most records have three bytes of overhead.
+ */
+class PacketCapture : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Record {
+        qint64 timeUs; // Since the capture was opened
+        int transport;
+        bool outbound;
+        QByteArray data;
+    };
+
+    explicit PacketCapture(QObject *parent = nullptr);
+    ~PacketCapture();
+
+    bool open(const QString &path, const QStringList &transports);
+    void close();
+    bool isOpen() const;
+    QString path() const;
+    void record(int transport, bool outbound, const QByteArray &data, qint64 timeNs = -1);
+    qint64 recordCount() const;
+    qint64 byteCount() const;
+
+    static bool load(const QString &path, QVector<Record> &records,
+                     QStringList *transports = nullptr, QDateTime *start = nullptr);
+
+private:
+    mutable QMutex mMutex;
+    QFile mFile;
+    std::atomic<bool> mOpen;
+    qint64 mStartNs;
+    qint64 mLastUs;
+    qint64 mRecords;
+    qint64 mBytes;
+
+};
+
+/**
+ * @brief The CaptureReplay class
+ * Feeds the inbound data of a capture to a packet decoder, with the original
+ * timing or as fast as possible. When the decoder is connected to Commands,
+ * as in VescInterface, the pages, plots and log writer see the same data as
+ * during the captured session.
+ */
+class CaptureReplay : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit CaptureReplay(QObject *parent = nullptr);
+
+    bool load(const QString &path);
+    int recordCount() const;
+    qint64 durationUs() const;
+    QStringList transports() const;
+    void setPacket(Packet *packet);
+    void setTransport(int transport);
+
+    bool start(bool realTime);
+    void stop();
+    bool isRunning() const;
+    double progress() const;
+
+signals:
+    void finished();
+
+private slots:
+    void timerSlot();
+
+private:
+    QVector<PacketCapture::Record> mRecords;
+    QStringList mTransports;
+    Packet *mPacket;
+    QTimer *mTimer;
+    QElapsedTimer mElapsed;
+    int mTransport;
+    int mNext;
+    bool mRunning;
+    bool mRealTime;
+
+    bool isReplayed(const PacketCapture::Record &r) const;
+
+};
+
+#endif // PACKETCAPTURE_H
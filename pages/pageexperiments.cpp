@@ -69,12 +69,15 @@ PageExperiments::PageExperiments(QWidget *parent) :
     ui->autoscaleButton->setIcon(mycon);
 
 
-    mTimer = new QTimer(this);
-    mTimer->start(ui->sampleIntervalBox->value());
-    mState = EXPERIMENT_OFF;
+    mRunner = new ExperimentRunner(this);
 
-    connect(mTimer, SIGNAL(timeout()),
-            this, SLOT(timerSlot()));
+    connect(mRunner, &ExperimentRunner::progress, [this](double progress) {
+        ui->progressBar->setValue(int(progress * 100.0));
+    });
+    connect(mRunner, &ExperimentRunner::meterUpdated, [this](double voltage, double current) {
+        ui->extVoltageLabel->setText(QString("Voltage: %1 V").arg(voltage));
+        ui->extCurrentLabel->setText(QString("Current: %1 A").arg(current));
+    });
 
     ui->plot->setInteractions(QCP::iRangeDrag | QCP::iRangeZoom);
 
@@ -89,13 +92,6 @@ PageExperiments::PageExperiments(QWidget *parent) :
     ui->plot->yAxis2->setLabel("RPM");
     ui->plot->yAxis2->setVisible(true);
 
-#ifdef HAS_SERIALPORT
-    mVictronPort = new QSerialPort(this);
-#endif
-    mVictronVoltage = 0.0;
-    mVictronCurrent = 0.0;
-    mVictronTimer.start();
-
     connect(ui->showCurrentButton, &QPushButton::toggled,
             [=]() {plotSamples(false);});
     connect(ui->showPowerButton, &QPushButton::toggled,
@@ -135,11 +131,6 @@ PageExperiments::PageExperiments(QWidget *parent) :
     connect(ui->compBEdit, &QLineEdit::textChanged,
             [=]() {plotSamples(false);});
 
-#ifdef HAS_SERIALPORT
-    connect(mVictronPort, SIGNAL(readyRead()),
-            this, SLOT(victronDataAvailable()));
-#endif
-
     plotSamples(false);
     on_victronRefreshButton_clicked();
 }
@@ -157,6 +148,7 @@ VescInterface *PageExperiments::vesc() const
 void PageExperiments::setVesc(VescInterface *vesc)
 {
     mVesc = vesc;
+    mRunner->setVesc(vesc);
 
     connect(mVesc->commands(), SIGNAL(valuesReceived(MC_VALUES,uint)),
             this, SLOT(valuesReceived(MC_VALUES,uint)));
@@ -164,160 +156,53 @@ void PageExperiments::setVesc(VescInterface *vesc)
 
 void PageExperiments::stop()
 {
+    mRunner->stop();
     mVesc->commands()->setCurrent(0);
-    mState = EXPERIMENT_OFF;
     ui->progressBar->setValue(100);
 }
 
 void PageExperiments::valuesReceived(MC_VALUES values, unsigned int mask)
 {
-    (void)mask;
+    // Use the time at which the reply was decoded, not when it was handled here
+    IoThread *io = mVesc->ioThread();
+    qint64 rxNs = io->isSerialOpen() ? io->currentPacketRxTime() : IoThread::timestampNs();
 
-    if (mState != EXPERIMENT_OFF) {
-#ifdef HAS_SERIALPORT
-        if (mVictronPort->isOpen()) {
-            values.current_in = mVictronCurrent;
-            values.v_in = mVictronVoltage;
-        }
-#endif
-
-        mTimeVec.append((double)mExperimentTimer.elapsed() / 1000.0);
-        mCurrentInVec.append(values.current_in);
-        mCurrentMotorVec.append(values.current_motor);
-        mPowerVec.append(values.current_in * values.v_in);
-        mVoltageVec.append(values.v_in);
-        mRpmVec.append(values.rpm);
-        mTempFetVec.append(values.temp_mos);
-        mTempFet1Vec.append(values.temp_mos_1);
-        mTempFet2Vec.append(values.temp_mos_2);
-        mTempFet3Vec.append(values.temp_mos_3);
-        mTempMotorVec.append(values.temp_motor);
-        mDutyVec.append(values.duty_now * 100.0);
-
-        plotSamples(false);
-    }
-}
-
-void PageExperiments::timerSlot()
-{
-#ifdef HAS_SERIALPORT
-    if (mVictronPort->isOpen() && mVictronTimer.elapsed() >= 5) {
-        mVictronTimer.restart();
-        static bool current  = false;
-        if (current) {
-            victronGetCurrent();
-        } else {
-            victronGetVoltage();
-        }
-        current = !current;
+    ExperimentRunner::Sample sample;
+    if (!mRunner->takeSample(values, mask, rxNs, sample)) {
+        return;
     }
-#endif
-
-    if(mState == EXPERIMENT_HOLD){
-        mVesc->commands()->setRpm( ui->rpmEndBox->value() );
-    }else{
-        if (mState != EXPERIMENT_OFF) {
-
-            mVesc->commands()->getValues();
-
-            double from = 0.0;
-            double to = 0.0;
-            double step = 0.0;
-            double stepTime = 0.0;
-
-            switch (mState) {
-            case EXPERIMENT_DUTY:
-                from = ui->dutyFromBox->value();
-                to = ui->dutyToBox->value();
-                step = ui->dutyStepBox->value();
-                stepTime = ui->dutyStepTimeBox->value();
-                break;
-
-            case EXPERIMENT_CURRENT:
-                from = ui->currentFromBox->value();
-                to = ui->currentToBox->value();
-                step = ui->currentStepBox->value();
-                stepTime = ui->currentStepTimeBox->value();
-                break;
-
-            case EXPERIMENT_RPM:
-                from = ui->rpmFromBox->value();
-                to = ui->rpmToBox->value();
-                step = ui->rpmStepBox->value();
-                stepTime = ui->rpmStepTimeBox->value();
-                break;
-
-            default:
-                break;
-            }
-
-            if (from > to) {
-                step = -step;
-            }
-
-            double elapsedSecs = (double)mExperimentTimer.elapsed() / 1000.0;
-            double totalSteps = (to - from) / step;
-            double totalTime = totalSteps * stepTime;
-            double progress = elapsedSecs / totalTime;
-            double stepNow = floor(progress * totalSteps);
-            double valueNow = from + stepNow * step;
-
-            if (progress >= 1.0) {
-                if (mState == EXPERIMENT_RPM && ui->keepRPMcheckBox->isChecked()) {
-                    mVesc->commands()->setRpm(ui->rpmEndBox->value());
-                    mState = EXPERIMENT_HOLD;
-                } else {
-                    mVesc->commands()->setCurrent(0);
-                    mState = EXPERIMENT_OFF;
-                }
-            } else {
-                ui->progressBar->setValue(progress * 100);
 
-                switch (mState) {
-                case EXPERIMENT_DUTY:
-                    mVesc->commands()->setDutyCycle(valueNow);
-                    break;
+    values = sample.values;
+
+    mTimeVec.append(sample.time);
+    mCurrentInVec.append(values.current_in);
+    mCurrentMotorVec.append(values.current_motor);
+    mPowerVec.append(values.current_in * values.v_in);
+    mVoltageVec.append(values.v_in);
+    mRpmVec.append(values.rpm);
+    mTempFetVec.append(values.temp_mos);
+    mTempFet1Vec.append(values.temp_mos_1);
+    mTempFet2Vec.append(values.temp_mos_2);
+    mTempFet3Vec.append(values.temp_mos_3);
+    mTempMotorVec.append(values.temp_motor);
+    mDutyVec.append(values.duty_now * 100.0);
 
-                case EXPERIMENT_CURRENT:
-                    mVesc->commands()->setCurrent(valueNow);
-                    break;
-
-                case EXPERIMENT_RPM:
-                    mVesc->commands()->setRpm(valueNow);
-                    break;
-
-                default:
-                    break;
-                }
-            }
-        }
-    }
+    plotSamples(false);
 }
 
 void PageExperiments::on_dutyRunButton_clicked()
 {
-    mState = EXPERIMENT_DUTY;
-    mExperimentTimer.start();
-    resetSamples();
+    startSweep(ExperimentRunner::SWEEP_DUTY);
 }
 
 void PageExperiments::on_currentRunButton_clicked()
 {
-    mState = EXPERIMENT_CURRENT;
-    mExperimentTimer.start();
-    resetSamples();
+    startSweep(ExperimentRunner::SWEEP_CURRENT);
 }
 
 void PageExperiments::on_rpmRunButton_clicked()
 {
-    mState = EXPERIMENT_RPM;
-    mExperimentTimer.start();
-    resetSamples();
-}
-
-void PageExperiments::on_sampleIntervalBox_valueChanged(int arg1)
-{
-    mTimer->setInterval(arg1);
+    startSweep(ExperimentRunner::SWEEP_RPM);
 }
 
 void PageExperiments::on_stopButton_clicked()
@@ -599,26 +484,41 @@ void PageExperiments::plotSamples(bool exportFormat)
     ui->plot->replotWhenVisible();
 }
 
-void PageExperiments::victronGetCurrent()
-{
-#ifdef HAS_SERIALPORT
-    if (mVictronPort->isOpen()) {
-        QString cmd;
-        cmd += ":78FED00D2\n";
-        mVictronPort->write(cmd.toLocal8Bit().data());
+void PageExperiments::startSweep(ExperimentRunner::sweep_mode mode)
+{
+    ExperimentRunner::Sweep sweep;
+    sweep.mode = mode;
+
+    switch (mode) {
+    case ExperimentRunner::SWEEP_DUTY:
+        sweep.from = ui->dutyFromBox->value();
+        sweep.to = ui->dutyToBox->value();
+        sweep.step = ui->dutyStepBox->value();
+        sweep.stepTime = ui->dutyStepTimeBox->value();
+        break;
+
+    case ExperimentRunner::SWEEP_CURRENT:
+        sweep.from = ui->currentFromBox->value();
+        sweep.to = ui->currentToBox->value();
+        sweep.step = ui->currentStepBox->value();
+        sweep.stepTime = ui->currentStepTimeBox->value();
+        break;
+
+    case ExperimentRunner::SWEEP_RPM:
+        sweep.from = ui->rpmFromBox->value();
+        sweep.to = ui->rpmToBox->value();
+        sweep.step = ui->rpmStepBox->value();
+        sweep.stepTime = ui->rpmStepTimeBox->value();
+        break;
     }
-#endif
-}
 
-void PageExperiments::victronGetVoltage()
-{
-#ifdef HAS_SERIALPORT
-    if (mVictronPort->isOpen()) {
-        QString cmd;
-        cmd += ":78DED00D4\n";
-        mVictronPort->write(cmd.toLocal8Bit().data());
-    }
-#endif
+    sweep.intervalMs = ui->sampleIntervalBox->value();
+    sweep.holdRpm = ui->keepRPMcheckBox->isChecked();
+    sweep.holdRpmValue = int(ui->rpmEndBox->value());
+
+    resetSamples();
+    ui->progressBar->setValue(0);
+    mRunner->start(sweep);
 }
 
 void PageExperiments::on_rescaleButton_clicked()
@@ -825,77 +725,12 @@ void PageExperiments::on_victronRefreshButton_clicked()
 
 void PageExperiments::on_victronConnectButton_clicked()
 {
-#ifdef HAS_SERIALPORT
-    if(mVictronPort->isOpen()) {
-        mVictronPort->close();
-    }
-
-    mVictronPort->setPortName(ui->victronPortBox->currentData().toString());
-    mVictronPort->open(QIODevice::ReadWrite);
-
-    if(mVictronPort->isOpen()) {
-        mVictronPort->setBaudRate(19200);
-        mVictronPort->setDataBits(QSerialPort::Data8);
-        mVictronPort->setParity(QSerialPort::NoParity);
-        mVictronPort->setStopBits(QSerialPort::OneStop);
-        mVictronPort->setFlowControl(QSerialPort::NoFlowControl);
-    }
-#endif
+    mRunner->openMeter(ui->victronPortBox->currentData().toString());
 }
 
 void PageExperiments::on_victronDisconnectButton_clicked()
 {
-#ifdef HAS_SERIALPORT
-    mVictronPort->close();
-#endif
-}
-
-void PageExperiments::victronDataAvailable()
-{
-#ifdef HAS_SERIALPORT
-    while (mVictronPort->bytesAvailable() > 0) {
-        for (char c: mVictronPort->readAll()) {
-            mVictronData.append(c);
-
-            if (mVictronData.at(mVictronData.size() - 1) == '\n') {
-                if (mVictronData.startsWith(':')) {
-                    QString data(mVictronData);
-
-                    // Example
-                    // :7001000C80076
-
-                    // Check checksum
-                    quint8 sum = 7;
-                    for (int i = 2;i < data.size();i += 2) {
-                        sum += data.mid(i, 2).toInt(0, 16);
-                    }
-
-                    if (sum == 0x55) {
-                        int cmd = data.mid(2, 2).toInt(0, 16) + data.mid(4, 2).toInt(0, 16) * 256;
-                        double val = (double)((qint16)((data.mid(8, 2).toInt(0, 16)) | ((quint16)(data.mid(10, 2).toInt(0, 16)) << 8)));
-
-                        switch (cmd) {
-                        case 60813: {
-                            mVictronVoltage = val / 100.0;
-                            ui->extVoltageLabel->setText(QString("Voltage: %1 V").arg(mVictronVoltage));
-                        } break;
-
-                        case 60815: {
-                            mVictronCurrent = -val / 10.0;
-                            ui->extCurrentLabel->setText(QString("Current: %1 A").arg(mVictronCurrent));
-                        } break;
-
-                        default:
-                            break;
-                        }
-                    }
-                }
-
-                mVictronData.clear();
-            }
-        }
-    }
-#endif
+    mRunner->closeMeter();
 }
 
 void PageExperiments::on_openCompButton_clicked()
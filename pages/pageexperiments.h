@@ -21,9 +21,8 @@
 #define PAGEEXPERIMENTS_H
 
 #include <QWidget>
-#include <QTimer>
-#include <QElapsedTimer>
 #include "vescinterface.h"
+#include "experimentrunner.h"
 
 #ifdef HAS_SERIALPORT
 #include <QSerialPortInfo>
@@ -47,13 +46,10 @@ public:
 
 private slots:
     void valuesReceived(MC_VALUES values, unsigned int mask);
-    void timerSlot();
-    void victronDataAvailable();
 
     void on_dutyRunButton_clicked();
     void on_currentRunButton_clicked();
     void on_rpmRunButton_clicked();
-    void on_sampleIntervalBox_valueChanged(int arg1);
     void on_stopButton_clicked();
     void on_rescaleButton_clicked();
     void on_zoomHButton_toggled(bool checked);
@@ -69,17 +65,9 @@ private slots:
     void on_compCloseButton_clicked();
 
 private:
-    typedef enum {
-        EXPERIMENT_OFF = 0,
-        EXPERIMENT_DUTY,
-        EXPERIMENT_CURRENT,
-        EXPERIMENT_RPM,
-        EXPERIMENT_HOLD
-    } experiment_state;
-
     Ui::PageExperiments *ui;
     VescInterface *mVesc;
-    experiment_state mState;
+    ExperimentRunner *mRunner;
     QVector<double> mTimeVec;
     QVector<double> mCurrentInVec;
     QVector<double> mCurrentMotorVec;
@@ -106,26 +94,12 @@ private:
     QVector<double> mCTempMotorVec;
     QVector<double> mCDutyVec;
 
-    QTimer *mTimer;
-    QElapsedTimer mExperimentTimer;
-
-    // Victron Energy BMV700
-    QElapsedTimer mVictronTimer;
-#ifdef HAS_SERIALPORT
-    QSerialPort *mVictronPort;
-#endif
-    QByteArray mVictronData;
-    double mVictronVoltage;
-    double mVictronCurrent;
-
     void resetSamples();
     void resetCompareSamples();
     void updateZoom();
     QVector<double> createScaledVector(QVector<double> &inVec, double maxValue, QString &scaleStr);
     void plotSamples(bool exportFormat);
-
-    void victronGetCurrent();
-    void victronGetVoltage();
+    void startSweep(ExperimentRunner::sweep_mode mode);
 
 };
 
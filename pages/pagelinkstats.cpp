@@ -0,0 +1,169 @@
+/*
+    Copyright 2016 - 2024 Benjamin Vedder	benjamin@vedder.se
+
+    This file is part of VESC Tool.
+
+    VESC Tool is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    VESC Tool is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+#include "pagelinkstats.h"
+#include "ui_pagelinkstats.h"
+#include "utility.h"
+#include <QFileDialog>
+
+PageLinkStats::PageLinkStats(QWidget *parent) :
+    QWidget(parent),
+    ui(new Ui::PageLinkStats)
+{
+    ui->setupUi(this);
+
+    ui->resetButton->setIcon(Utility::getIcon("icons/Delete-96.png"));
+    ui->exportButton->setIcon(Utility::getIcon("icons/Save-96.png"));
+
+    layout()->setContentsMargins(0, 0, 0, 0);
+    ui->statsTable->setColumnWidth(0, 260);
+    mVesc = nullptr;
+
+    mTimer = new QTimer(this);
+    mTimer->start(1000);
+    connect(mTimer, SIGNAL(timeout()), this, SLOT(timerSlot()));
+}
+
+PageLinkStats::~PageLinkStats()
+{
+    delete ui;
+}
+
+VescInterface *PageLinkStats::vesc() const
+{
+    return mVesc;
+}
+
+void PageLinkStats::setVesc(VescInterface *vesc)
+{
+    mVesc = vesc;
+}
+
+void PageLinkStats::timerSlot()
+{
+    if (!mVesc || !isVisible()) {
+        return;
+    }
+
+    auto stats = mVesc->commands()->linkStats();
+
+    auto transports = stats->transports();
+    QStringList items;
+    for (int i = 0;i < ui->transportBox->count();i++) {
+        items.append(ui->transportBox->itemText(i));
+    }
+
+    if (items != transports) {
+        QString selected = ui->transportBox->currentText();
+        if (selected.isEmpty()) {
+            selected = stats->transport();
+        }
+        ui->transportBox->clear();
+        ui->transportBox->addItems(transports);
+        ui->transportBox->setCurrentText(selected);
+    }
+
+    QString transport = ui->transportBox->currentText();
+    auto tot = stats->transportStats(transport);
+    ui->summaryLabel->setText(
+                tr("TX: %1 packets, %2 bytes. RX: %3 packets, %4 bytes. "
+                   "Timeouts: %5, retries: %6. RTT mean: %7 ms, max: %8 ms.").
+                arg(tot.value("tx").toULongLong()).
+                arg(tot.value("bytesOut").toULongLong()).
+                arg(tot.value("rx").toULongLong()).
+                arg(tot.value("bytesIn").toULongLong()).
+                arg(tot.value("timeouts").toULongLong()).
+                arg(tot.value("retries").toULongLong()).
+                arg(tot.value("rttMeanMs").toDouble(), 0, 'f', 1).
+                arg(tot.value("rttMaxMs").toLongLong()));
+
+    auto buckets = LinkStats::rttBucketNames();
+    auto commands = stats->commandStats(transport);
+    ui->statsTable->setRowCount(commands.size());
+
+    for (int row = 0;row < commands.size();row++) {
+        auto c = commands.at(row).toMap();
+        bool hasRtt = c.value("rttCount").toULongLong() > 0;
+
+        QStringList cells;
+        cells << c.value("name").toString()
+              << c.value("tx").toString()
+              << c.value("rx").toString()
+              << c.value("bytesOut").toString()
+              << c.value("bytesIn").toString()
+              << c.value("timeouts").toString()
+              << c.value("retries").toString()
+              << (hasRtt ? QString::number(c.value("rttMeanMs").toDouble(), 'f', 1) : "")
+              << (hasRtt ? c.value("rttMinMs").toString() : "")
+              << (hasRtt ? c.value("rttMaxMs").toString() : "")
+              << QString::number(c.value("decodeMeanUs").toDouble(), 'f', 1);
+
+        QString hist;
+        auto histVals = c.value("rttHistogram").toList();
+        for (int i = 0;i < histVals.size() && i < buckets.size();i++) {
+            hist += QString("%1: %2\n").arg(buckets.at(i)).arg(histVals.at(i).toULongLong());
+        }
+
+        for (int col = 0;col < cells.size();col++) {
+            auto item = ui->statsTable->item(row, col);
+            if (!item) {
+                item = new QTableWidgetItem();
+                ui->statsTable->setItem(row, col, item);
+            }
+            item->setText(cells.at(col));
+            item->setToolTip(hasRtt && col >= 7 && col <= 9 ? hist.trimmed() : "");
+        }
+    }
+}
+
+void PageLinkStats::on_resetButton_clicked()
+{
+    if (mVesc) {
+        mVesc->commands()->linkStats()->reset();
+        ui->transportBox->clear();
+        ui->statsTable->setRowCount(0);
+        ui->summaryLabel->clear();
+    }
+}
+
+void PageLinkStats::on_exportButton_clicked()
+{
+    if (!mVesc) {
+        return;
+    }
+
+    QString path;
+    path = QFileDialog::getSaveFileName(this,
+                                        tr("Choose where to save the link statistics"),
+                                        ".",
+                                        tr("JSON files (*.json)"));
+
+    if (path.isNull()) {
+        return;
+    }
+
+    if (!path.toLower().endsWith(".json")) {
+        path += ".json";
+    }
+
+    if (!mVesc->commands()->linkStats()->saveJson(path)) {
+        mVesc->emitMessageDialog(tr("Export Link Statistics"),
+                                 tr("Could not write %1").arg(path), false);
+    }
+}
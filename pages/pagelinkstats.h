@@ -0,0 +1,54 @@
+/*
+    Copyright 2016 - 2024 Benjamin Vedder	benjamin@vedder.se
+
+    This file is part of VESC Tool.
+
+    VESC Tool is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    VESC Tool is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+#ifndef PAGELINKSTATS_H
+#define PAGELINKSTATS_H
+
+#include <QWidget>
+#include <QTimer>
+#include "vescinterface.h"
+
+namespace Ui {
+class PageLinkStats;
+}
+
+class PageLinkStats : public QWidget
+{
+    Q_OBJECT
+
+public:
+    explicit PageLinkStats(QWidget *parent = nullptr);
+    ~PageLinkStats();
+
+    VescInterface *vesc() const;
+    void setVesc(VescInterface *vesc);
+
+private slots:
+    void timerSlot();
+    void on_resetButton_clicked();
+    void on_exportButton_clicked();
+
+private:
+    Ui::PageLinkStats *ui;
+    VescInterface *mVesc;
+    QTimer *mTimer;
+
+};
+
+#endif // PAGELINKSTATS_H
@@ -28,7 +28,9 @@
 
 PageRtData::PageRtData(QWidget *parent) :
     QWidget(parent),
-    ui(new Ui::PageRtData)
+    ui(new Ui::PageRtData),
+    mStore(RtDataStore::CH_COUNT, 500),
+    mPosStore(1, 1500)
 {
     ui->setupUi(this);
     layout()->setContentsMargins(0, 0, 0, 0);
@@ -64,6 +66,8 @@ PageRtData::PageRtData(QWidget *parent) :
 
     mUpdateValPlot = false;
     mUpdatePosPlot = false;
+    mShowMultiMos = false;
+    mPosSamples = 0;
 
     QCustomPlot* allPlots[] =
                 {ui->currentPlot, ui->tempPlot, ui->focPlot,
@@ -91,6 +95,33 @@ PageRtData::PageRtData(QWidget *parent) :
     ui->currentPlot->graph(graphIndex)->setName("Duty cycle");
     graphIndex++;
 
+    // Temperature
+    graphIndex = 0;
+    ui->tempPlot->addGraph();
+    ui->tempPlot->graph(graphIndex)->setPen(QPen(Utility::getAppQColor("plot_graph1")));
+    ui->tempPlot->graph(graphIndex)->setName("Temperature MOSFET");
+    graphIndex++;
+
+    ui->tempPlot->addGraph();
+    ui->tempPlot->graph(graphIndex)->setPen(QPen(Utility::getAppQColor("plot_graph2")));
+    ui->tempPlot->graph(graphIndex)->setName("Temperature MOSFET 1");
+    graphIndex++;
+
+    ui->tempPlot->addGraph();
+    ui->tempPlot->graph(graphIndex)->setPen(QPen(Utility::getAppQColor("plot_graph3")));
+    ui->tempPlot->graph(graphIndex)->setName("Temperature MOSFET 2");
+    graphIndex++;
+
+    ui->tempPlot->addGraph();
+    ui->tempPlot->graph(graphIndex)->setPen(QPen(Utility::getAppQColor("plot_graph4")));
+    ui->tempPlot->graph(graphIndex)->setName("Temperature MOSFET 3");
+    graphIndex++;
+
+    ui->tempPlot->addGraph(ui->tempPlot->xAxis, ui->tempPlot->yAxis2);
+    ui->tempPlot->graph(graphIndex)->setPen(QPen(Utility::getAppQColor("plot_graph5")));
+    ui->tempPlot->graph(graphIndex)->setName("Temperature Motor");
+    graphIndex++;
+
     // RPM
     graphIndex = 0;
     ui->rpmPlot->addGraph();
@@ -165,6 +196,27 @@ PageRtData::PageRtData(QWidget *parent) :
     ui->posPlot->graph(0)->setPen(QPen(Utility::getAppQColor("plot_graph1")));
     ui->posPlot->graph(0)->setName("Position");
 
+    // The graphs share their data with the sample store, so they only
+    // have to be replotted when new samples arrive.
+    setHistory(mSettings.value("rt_data_history", 500).toInt());
+
+    ui->currentPlot->graph(0)->setData(mStore.column(RtDataStore::CH_CURRENT_IN));
+    ui->currentPlot->graph(1)->setData(mStore.column(RtDataStore::CH_CURRENT_MOTOR));
+    ui->currentPlot->graph(2)->setData(mStore.column(RtDataStore::CH_DUTY));
+    ui->tempPlot->graph(0)->setData(mStore.column(RtDataStore::CH_TEMP_MOS));
+    ui->tempPlot->graph(1)->setData(mStore.column(RtDataStore::CH_TEMP_MOS_1));
+    ui->tempPlot->graph(2)->setData(mStore.column(RtDataStore::CH_TEMP_MOS_2));
+    ui->tempPlot->graph(3)->setData(mStore.column(RtDataStore::CH_TEMP_MOS_3));
+    ui->tempPlot->graph(4)->setData(mStore.column(RtDataStore::CH_TEMP_MOTOR));
+    ui->rpmPlot->graph(0)->setData(mStore.column(RtDataStore::CH_RPM));
+    ui->focPlot->graph(0)->setData(mStore.column(RtDataStore::CH_ID));
+    ui->focPlot->graph(1)->setData(mStore.column(RtDataStore::CH_IQ));
+    ui->focPlot->graph(2)->setData(mStore.column(RtDataStore::CH_VD));
+    ui->focPlot->graph(3)->setData(mStore.column(RtDataStore::CH_VQ));
+    ui->posPlot->graph(0)->setData(mPosStore.column(0));
+
+    updateTempGraphs();
+
     ui->posPlot->legend->setVisible(true);
     ui->posPlot->legend->setFont(legendFont);
     ui->posPlot->axisRect()->insetLayout()->setInsetAlignment(0, Qt::AlignRight|Qt::AlignBottom);
@@ -199,6 +251,14 @@ void PageRtData::setVesc(VescInterface *vesc)
     }
 }
 
+void PageRtData::setHistory(int samples)
+{
+    if (samples != mStore.capacity()) {
+        mStore.setCapacity(samples);
+        mPosStore.setCapacity(3 * samples);
+    }
+}
+
 void PageRtData::timerSlot()
 {
     if (mVesc) {
@@ -208,98 +268,29 @@ void PageRtData::timerSlot()
     }
 
     if (mUpdateValPlot) {
-        int dataSize = mTempMosVec.size();
-
-        QVector<double> xAxis(dataSize);
-        for (int i = 0;i < mSeconds.size();i++) {
-            xAxis[i] = mSeconds[i];
+        bool multiMos = mStore.last(RtDataStore::CH_TEMP_MOS_1) != 0.0;
+        if (multiMos != mShowMultiMos) {
+            mShowMultiMos = multiMos;
+            updateTempGraphs();
         }
 
-        // Current and duty-plot
-        int graphIndex = 0;
-        ui->currentPlot->graph(graphIndex++)->setData(xAxis, mCurrInVec);
-        ui->currentPlot->graph(graphIndex++)->setData(xAxis, mCurrMotorVec);
-        ui->currentPlot->graph(graphIndex++)->setData(xAxis, mDutyVec);
-
-        // Temperature plot
-        ui->tempPlot->clearGraphs();
-
-        graphIndex = 0;
-
-        ui->tempPlot->addGraph();
-        ui->tempPlot->graph(graphIndex)->setPen(QPen(Utility::getAppQColor("plot_graph1")));
-        ui->tempPlot->graph(graphIndex)->setName("Temperature MOSFET");
-        ui->tempPlot->graph(graphIndex)->setData(xAxis, mTempMosVec);
-        ui->tempPlot->graph(graphIndex)->setVisible(ui->tempShowMosfetBox->isChecked());
-
-        graphIndex++;
-
-        if (!mTempMos1Vec.isEmpty() && mTempMos1Vec.last() != 0.0) {
-            ui->tempPlot->addGraph();
-            ui->tempPlot->graph(graphIndex)->setPen(QPen(Utility::getAppQColor("plot_graph2")));
-            ui->tempPlot->graph(graphIndex)->setName("Temperature MOSFET 1");
-            ui->tempPlot->graph(graphIndex)->setData(xAxis, mTempMos1Vec);
-            ui->tempPlot->graph(graphIndex)->setVisible(ui->tempShowMosfetBox->isChecked());
-            graphIndex++;
-
-            ui->tempPlot->addGraph();
-            ui->tempPlot->graph(graphIndex)->setPen(QPen(Utility::getAppQColor("plot_graph3")));
-            ui->tempPlot->graph(graphIndex)->setName("Temperature MOSFET 2");
-            ui->tempPlot->graph(graphIndex)->setData(xAxis, mTempMos2Vec);
-            ui->tempPlot->graph(graphIndex)->setVisible(ui->tempShowMosfetBox->isChecked());
-            graphIndex++;
-
-            ui->tempPlot->addGraph();
-            ui->tempPlot->graph(graphIndex)->setPen(QPen(Utility::getAppQColor("plot_graph4")));
-            ui->tempPlot->graph(graphIndex)->setName("Temperature MOSFET 3");
-            ui->tempPlot->graph(graphIndex)->setData(xAxis, mTempMos3Vec);
-            ui->tempPlot->graph(graphIndex)->setVisible(ui->tempShowMosfetBox->isChecked());
-            graphIndex++;
+        // Rescaling has to look at every sample, so it is only done for
+        // the plots that are shown.
+        QCustomPlot *valPlots[] = {ui->currentPlot, ui->tempPlot, ui->rpmPlot, ui->focPlot};
+        for (auto p: valPlots) {
+            if (p->isVisible() && ui->autoscaleButton->isChecked()) {
+                p->rescaleAxes(true);
+            }
+            p->replotWhenVisible();
         }
 
-        ui->tempPlot->addGraph(ui->tempPlot->xAxis, ui->tempPlot->yAxis2);
-        ui->tempPlot->graph(graphIndex)->setPen(QPen(Utility::getAppQColor("plot_graph5")));
-        ui->tempPlot->graph(graphIndex)->setName("Temperature Motor");
-        ui->tempPlot->graph(graphIndex)->setData(xAxis, mTempMotorVec);
-        ui->tempPlot->graph(graphIndex)->setVisible(ui->tempShowMotorBox->isChecked());
-        graphIndex++;
-
-        // RPM plot
-        graphIndex = 0;
-        ui->rpmPlot->graph(graphIndex++)->setData(xAxis, mRpmVec);
-
-        // FOC plot
-        graphIndex = 0;
-        ui->focPlot->graph(graphIndex++)->setData(xAxis, mIdVec);
-        ui->focPlot->graph(graphIndex++)->setData(xAxis, mIqVec);
-        ui->focPlot->graph(graphIndex++)->setData(xAxis, mVdVec);
-        ui->focPlot->graph(graphIndex++)->setData(xAxis, mVqVec);
-
-        if (ui->autoscaleButton->isChecked()) {
-            ui->currentPlot->rescaleAxes();
-            ui->tempPlot->rescaleAxes();
-            ui->rpmPlot->rescaleAxes();
-            ui->focPlot->rescaleAxes();
-        }
-
-        ui->currentPlot->replotWhenVisible();
-        ui->tempPlot->replotWhenVisible();
-        ui->rpmPlot->replotWhenVisible();
-        ui->focPlot->replotWhenVisible();
-
         mUpdateValPlot = false;
     }
 
     if (mUpdatePosPlot) {
-        QVector<double> xAxis(mPositionVec.size());
-        for (int i = 0;i < mPositionVec.size();i++) {
-            xAxis[i] = double(i);
-        }
-
-        ui->posBar->setValue(int(fabs(mPositionVec.last())));
-        ui->posPlot->graph(0)->setData(xAxis, mPositionVec);
+        ui->posBar->setValue(int(fabs(mPosStore.last(0))));
 
-        if (ui->autoscaleButton->isChecked()) {
+        if (ui->posPlot->isVisible() && ui->autoscaleButton->isChecked()) {
             ui->posPlot->rescaleAxes();
         }
 
@@ -314,22 +305,6 @@ void PageRtData::valuesReceived(MC_VALUES values, unsigned int mask)
     (void)mask;
     ui->rtText->setValues(values);
 
-    const int maxS = 500;
-
-    appendDoubleAndTrunc(&mTempMosVec, values.temp_mos, maxS);
-    appendDoubleAndTrunc(&mTempMos1Vec, values.temp_mos_1, maxS);
-    appendDoubleAndTrunc(&mTempMos2Vec, values.temp_mos_2, maxS);
-    appendDoubleAndTrunc(&mTempMos3Vec, values.temp_mos_3, maxS);
-    appendDoubleAndTrunc(&mTempMotorVec, values.temp_motor, maxS);
-    appendDoubleAndTrunc(&mCurrInVec, values.current_in, maxS);
-    appendDoubleAndTrunc(&mCurrMotorVec, values.current_motor, maxS);
-    appendDoubleAndTrunc(&mIdVec, values.id, maxS);
-    appendDoubleAndTrunc(&mIqVec, values.iq, maxS);
-    appendDoubleAndTrunc(&mDutyVec, values.duty_now, maxS);
-    appendDoubleAndTrunc(&mRpmVec, values.rpm, maxS);
-    appendDoubleAndTrunc(&mVdVec, values.vd, maxS);
-    appendDoubleAndTrunc(&mVqVec, values.vq, maxS);
-
     qint64 tNow = QDateTime::currentMSecsSinceEpoch();
 
     double elapsed = double((tNow - mLastUpdateTime)) / 1000.0;
@@ -338,8 +313,7 @@ void PageRtData::valuesReceived(MC_VALUES values, unsigned int mask)
     }
 
     mSecondCounter += elapsed;
-
-    appendDoubleAndTrunc(&mSeconds, mSecondCounter, maxS);
+    mStore.appendValues(mSecondCounter, values);
 
     mLastUpdateTime = tNow;
 
@@ -348,19 +322,10 @@ void PageRtData::valuesReceived(MC_VALUES values, unsigned int mask)
 
 void PageRtData::rotorPosReceived(double pos)
 {
-    appendDoubleAndTrunc(&mPositionVec, pos, 1500);
+    mPosStore.append(0, double(mPosSamples++), pos);
     mUpdatePosPlot = true;
 }
 
-void PageRtData::appendDoubleAndTrunc(QVector<double> *vec, double num, int maxSize)
-{
-    vec->append(num);
-
-    if(vec->size() > maxSize) {
-        vec->remove(0, vec->size() - maxSize);
-    }
-}
-
 void PageRtData::updateZoom()
 {
     Qt::Orientations plotOrientations = Qt::Orientations(
@@ -450,18 +415,34 @@ void PageRtData::on_posStopButton_clicked()
     }
 }
 
-void PageRtData::on_tempShowMosfetBox_toggled(bool checked)
+void PageRtData::updateTempGraphs()
 {
-    if (ui->tempPlot->graphCount() > 0) {
-        ui->tempPlot->graph(0)->setVisible(checked);
+    // MOSFET 1 - 3 are only shown when the hardware reports them
+    bool showMos = ui->tempShowMosfetBox->isChecked();
+    ui->tempPlot->graph(0)->setVisible(showMos);
+    for (int i = 1;i < 4;i++) {
+        ui->tempPlot->graph(i)->setVisible(showMos && mShowMultiMos);
+        if (mShowMultiMos) {
+            ui->tempPlot->graph(i)->addToLegend();
+        } else {
+            ui->tempPlot->graph(i)->removeFromLegend();
+        }
     }
+    ui->tempPlot->graph(4)->setVisible(ui->tempShowMotorBox->isChecked());
+}
+
+void PageRtData::on_tempShowMosfetBox_toggled(bool checked)
+{
+    (void)checked;
+    updateTempGraphs();
+    ui->tempPlot->replotWhenVisible();
 }
 
 void PageRtData::on_tempShowMotorBox_toggled(bool checked)
 {
-    if (ui->tempPlot->graphCount() > 1) {
-        ui->tempPlot->graph(1)->setVisible(checked);
-    }
+    (void)checked;
+    updateTempGraphs();
+    ui->tempPlot->replotWhenVisible();
 }
 
 void PageRtData::on_logRtButton_toggled(bool checked)
@@ -23,7 +23,9 @@
 #include <QWidget>
 #include <QVector>
 #include <QTimer>
+#include <QSettings>
 #include "vescinterface.h"
+#include "rtdatastore.h"
 
 namespace Ui {
 class PageRtData;
@@ -40,6 +42,9 @@ public:
     VescInterface *vesc() const;
     void setVesc(VescInterface *vesc);
 
+public slots:
+    void setHistory(int samples);
+
 private slots:
     void timerSlot();
     void valuesReceived(MC_VALUES values, unsigned int mask);
@@ -63,31 +68,21 @@ private:
     Ui::PageRtData *ui;
     VescInterface *mVesc;
     QTimer *mTimer;
+    QSettings mSettings;
 
-    QVector<double> mTempMosVec;
-    QVector<double> mTempMos1Vec;
-    QVector<double> mTempMos2Vec;
-    QVector<double> mTempMos3Vec;
-    QVector<double> mTempMotorVec;
-    QVector<double> mCurrInVec;
-    QVector<double> mCurrMotorVec;
-    QVector<double> mIdVec;
-    QVector<double> mIqVec;
-    QVector<double> mDutyVec;
-    QVector<double> mRpmVec;
-    QVector<double> mPositionVec;
-    QVector<double> mSeconds;
-    QVector<double> mVdVec;
-    QVector<double> mVqVec;
+    RtDataStore mStore;
+    RtDataStore mPosStore;
+    qint64 mPosSamples;
 
     double mSecondCounter;
     qint64 mLastUpdateTime;
 
     bool mUpdateValPlot;
     bool mUpdatePosPlot;
+    bool mShowMultiMos;
 
-    void appendDoubleAndTrunc(QVector<double> *vec, double num, int maxSize);
     void updateZoom();
+    void updateTempGraphs();
 
 };
 
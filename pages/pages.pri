@@ -38,7 +38,8 @@ FORMS += \
     $$PWD/pageimu.ui \
     $$PWD/pageswdprog.ui \
     $$PWD/pageappimu.ui \
-    $$PWD/pageloganalysis.ui
+    $$PWD/pageloganalysis.ui \
+    $$PWD/pagelinkstats.ui
 
 HEADERS += \
     $$PWD/pageappbalance.h \
@@ -80,7 +81,8 @@ HEADERS += \
     $$PWD/pageimu.h \
     $$PWD/pageswdprog.h \
     $$PWD/pageappimu.h \
-    $$PWD/pageloganalysis.h
+    $$PWD/pageloganalysis.h \
+    $$PWD/pagelinkstats.h
 
 SOURCES += \
     $$PWD/pageappbalance.cpp \
@@ -122,4 +124,5 @@ SOURCES += \
     $$PWD/pageimu.cpp \
     $$PWD/pageswdprog.cpp \
     $$PWD/pageappimu.cpp \
-    $$PWD/pageloganalysis.cpp
+    $$PWD/pageloganalysis.cpp \
+    $$PWD/pagelinkstats.cpp
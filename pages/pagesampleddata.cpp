@@ -23,6 +23,7 @@
 #include "utility.h"
 #include <QFileDialog>
 #include <QMessageBox>
+#include <QtConcurrent/QtConcurrent>
 
 PageSampledData::PageSampledData(QWidget *parent) :
     QWidget(parent),
@@ -63,6 +64,8 @@ PageSampledData::PageSampledData(QWidget *parent) :
     mDoFilterReplot = false;
     mDoRescale = false;
     mSamplesToWait = 0; // TODO: Use timeout instead?
+    mLastSpectrum = false;
+    mReplotGeneration.reset(new QAtomicInt(0));
 
     mTimer = new QTimer(this);
     mTimer->start(20);
@@ -76,6 +79,8 @@ PageSampledData::PageSampledData(QWidget *parent) :
 
     connect(mTimer, SIGNAL(timeout()),
             this, SLOT(timerSlot()));
+    connect(&mReplotWatcher, SIGNAL(finished()),
+            this, SLOT(replotJobFinished()));
 
     connect(ui->compDelayBox, SIGNAL(toggled(bool)), this, SLOT(replotAll()));
     connect(ui->currentFilterFreqBox, SIGNAL(valueChanged(double)), this, SLOT(replotAll()));
@@ -103,6 +108,10 @@ PageSampledData::PageSampledData(QWidget *parent) :
 
 PageSampledData::~PageSampledData()
 {
+    // Cancel the replot jobs. They share the generation counter, so jobs
+    // that still run finish on their own after the page is gone.
+    mReplotGeneration->fetchAndAddOrdered(1);
+
     delete ui;
 }
 
@@ -123,21 +132,20 @@ void PageSampledData::setVesc(VescInterface *vesc)
 
 void PageSampledData::timerSlot()
 {
-    static QVector<double> filter;
     QFont legendFont = font();
     legendFont.setPointSize(9);
 
     // Plot filters
     if (mDoFilterReplot) {
         if (ui->filterBox->currentIndex() == 2) {
-            filter.clear();
+            mFilter.clear();
             int fLen = (1 << ui->currentFilterTapBox->value());
             for (int i = 0;i < fLen;i++) {
-                filter.append(1.0 / (double)fLen);
+                mFilter.append(1.0 / (double)fLen);
             }
         } else {
-            filter = DigitalFiltering::generateFirFilter(ui->currentFilterFreqBox->value(),
-                                                         ui->currentFilterTapBox->value(), ui->hammingBox->isChecked());
+            mFilter = DigitalFiltering::generateFirFilter(ui->currentFilterFreqBox->value(),
+                                                          ui->currentFilterTapBox->value(), ui->hammingBox->isChecked());
         }
 
         static int last_len = 0;
@@ -146,7 +154,7 @@ void PageSampledData::timerSlot()
 
         // Plot filter
         QVector<double> filterIndex;
-        for(int i = 0;i < filter.size();i++) {
+        for(int i = 0;i < mFilter.size();i++) {
             filterIndex.append((double)i);
         }
 
@@ -154,7 +162,7 @@ void PageSampledData::timerSlot()
         ui->filterResponsePlot->clearGraphs();
 
         ui->filterPlot->addGraph();
-        ui->filterPlot->graph(0)->setData(filterIndex, filter);
+        ui->filterPlot->graph(0)->setData(filterIndex, mFilter);
         ui->filterPlot->graph(0)->setName("Filter");
 
         if (ui->filterScatterBox->isChecked()) {
@@ -163,7 +171,7 @@ void PageSampledData::timerSlot()
         }
 
         // Plot response
-        QVector<double> response = DigitalFiltering::fftWithShift(filter, ui->currentFilterTapBox->value() + 4);
+        QVector<double> response = DigitalFiltering::fftWithShift(mFilter, ui->currentFilterTapBox->value() + 4);
 
         // Remove positive half
         response.resize(response.size() / 2);
@@ -202,290 +210,389 @@ void PageSampledData::timerSlot()
     }
 
     if (mDoReplot) {
-        const double f_samp = (ui->fftFreqBox->value() / ui->decimationBox->value());
-        int size = curr1Vector.size();
+        startReplotJob();
+        mDoReplot = false;
+    }
+}
 
-        if(size > 0) {
-            QVector<double> position(size);
-            for (int i=0;i < size;i++) {
-                position[i] = (double)((quint8)statusArray.at(i) & 7);
-            }
+/**
+ * @brief PageSampledData::startReplotJob
+ * Start computing the plots in the background from the current samples and
+ * settings. A job that is still running is canceled, as its result would be
+ * outdated.
+ */
+void PageSampledData::startReplotJob()
+{
+    int generation = mReplotGeneration->fetchAndAddOrdered(1) + 1;
 
-            QVector<double> position_hall(size);
-            for (int i=0;i < size;i++) {
-                position_hall[i] = (double)((quint8)(statusArray.at(i) >> 3) & 7) / 1.0;
-            }
+    if (curr1Vector.isEmpty()) {
+        mDoRescale = false;
+        return;
+    }
 
-            QVector<double> phase(size);
-            for (int i=0;i < size;i++) {
-                phase[i] = (double)((quint8)phaseArray.at(i)) / 250.0 * 360.0;
-            }
+    ReplotInput in;
+    in.generation = generation;
+    in.curr1 = curr1Vector;
+    in.curr2 = curr2Vector;
+    in.ph1 = ph1Vector;
+    in.ph2 = ph2Vector;
+    in.ph3 = ph3Vector;
+    in.vZero = vZeroVector;
+    in.currTot = currTotVector;
+    in.fSw = fSwVector;
+    in.status = statusArray;
+    in.phase = phaseArray;
+    in.filter = mFilter;
+    in.filterCurrents = ui->filterBox->currentIndex() > 0;
+    in.compDelay = ui->compDelayBox->isChecked();
+    in.truncate = ui->truncateBox->isChecked();
+    in.showFft = ui->plotModeBox->currentIndex() == 1;
+    in.fSamp = ui->fftFreqBox->value() / ui->decimationBox->value();
+
+    // A job that is replaced here keeps running until it sees that it is
+    // outdated, so it holds a reference to the counter.
+    QSharedPointer<QAtomicInt> latest = mReplotGeneration;
+    mReplotWatcher.setFuture(QtConcurrent::run([in, latest]() {
+        return computeReplot(in, latest.data());
+    }));
+}
 
-            // Calculate current and voltages
-            QVector<double> curr1 = curr1Vector;
-            QVector<double> curr2 = curr2Vector;
-            QVector<double> curr3(size);
+void PageSampledData::replotJobFinished()
+{
+    ReplotResult res = mReplotWatcher.result();
 
-            QVector<double> ph1 = ph1Vector;
-            QVector<double> ph2 = ph2Vector;
-            QVector<double> ph3 = ph3Vector;
-            QVector<double> vZero = vZeroVector;
+    // Only the result of the latest job is shown
+    if (!res.canceled && res.generation == mReplotGeneration->loadAcquire()) {
+        showReplot(res);
+    }
+}
 
-            QVector<double> totCurrentMc = currTotVector;
-            QVector<double> fSw = fSwVector;
+/**
+ * @brief PageSampledData::computeReplot
+ * Calculate the phase currents and voltages and apply the filter and the
+ * spectrum transform. The current channels are processed in parallel. Runs
+ * outside of the GUI thread.
+ *
+ * @param in
+ * Samples and settings.
+ *
+ * @param latestGeneration
+ * Generation of the latest job. When it no longer matches the job the
+ * calculation stops early and the result is marked as canceled.
+ *
+ * @return
+ * Everything needed to update the plots.
+ */
+PageSampledData::ReplotResult PageSampledData::computeReplot(const ReplotInput &in, const QAtomicInt *latestGeneration)
+{
+    auto canceled = [&in, latestGeneration]() {
+        return latestGeneration->loadAcquire() != in.generation;
+    };
+
+    ReplotResult res;
+    res.generation = in.generation;
+    res.canceled = true;
+    res.showFft = in.showFft;
+
+    int size = in.curr1.size();
+
+    res.position.resize(size);
+    res.positionHall.resize(size);
+    res.phase.resize(size);
+    for (int i=0;i < size;i++) {
+        res.position[i] = (double)((quint8)in.status.at(i) & 7);
+        res.positionHall[i] = (double)((quint8)(in.status.at(i) >> 3) & 7) / 1.0;
+        res.phase[i] = (double)((quint8)in.phase.at(i)) / 250.0 * 360.0;
+    }
 
-            for (int i=0;i < curr2.size(); i++) {
-                curr3[i] = -(curr1[i] + curr2[i]);
+    // Calculate current and voltages
+    res.curr1 = in.curr1;
+    res.curr2 = in.curr2;
+    res.curr3.resize(size);
+    res.ph1 = in.ph1;
+    res.ph2 = in.ph2;
+    res.ph3 = in.ph3;
+    res.vZero = in.vZero;
+    res.totCurrentMc = in.currTot;
 
-                if (ui->truncateBox->isChecked()) {
-                    if (!(position[i] == 1 || position[i] == 4)) {
-                        ph1[i] = 0;
-                    }
+    for (int i=0;i < in.curr2.size(); i++) {
+        res.curr3[i] = -(in.curr1[i] + in.curr2[i]);
 
-                    if (!(position[i] == 2 || position[i] == 5)) {
-                        ph2[i] = 0;
-                    }
+        if (in.truncate) {
+            const double &position = res.position.at(i);
 
-                    if (!(position[i] == 3 || position[i] == 6)) {
-                        ph3[i] = 0;
-                    }
-                }
+            if (!(position == 1 || position == 4)) {
+                res.ph1[i] = 0;
             }
 
-            // Filter currents
-            if (ui->filterBox->currentIndex() > 0) {
-                curr1 = DigitalFiltering::filterSignal(curr1, filter, ui->compDelayBox->isChecked());
-                curr2 = DigitalFiltering::filterSignal(curr2, filter, ui->compDelayBox->isChecked());
-                curr3 = DigitalFiltering::filterSignal(curr3, filter, ui->compDelayBox->isChecked());
+            if (!(position == 2 || position == 5)) {
+                res.ph2[i] = 0;
             }
 
-            bool showFft = ui->plotModeBox->currentIndex() == 1;
-            static bool lastSpectrum = false;
-            bool spectrumChanged = showFft != lastSpectrum;
-            lastSpectrum = showFft;
-
-            // Filtered x-axis vector for currents
-            QVector<double> xAxisCurrDec;
-            QVector<double> xAxisCurr;
-
-            // Use DFT
-            // TODO: The transform only makes sense with a constant sampling frequency right now. Some
-            // weird scaling should be implemented.
-            if (showFft) {
-                int fftBits = 16;
-
-                curr1 = DigitalFiltering::fftWithShift(curr1, fftBits, true);
-                curr2 = DigitalFiltering::fftWithShift(curr2, fftBits, true);
-                curr3 = DigitalFiltering::fftWithShift(curr3, fftBits, true);
-                totCurrentMc = DigitalFiltering::fftWithShift(totCurrentMc, fftBits, true);
-
-                curr1.resize(curr1.size() / 2);
-                curr2.resize(curr2.size() / 2);
-                curr3.resize(curr3.size() / 2);
-                totCurrentMc.resize(totCurrentMc.size() / 2);
-
-                // Resize x-axis
-                xAxisCurrDec.resize(curr1.size());
-                xAxisCurr.resize(totCurrentMc.size());
-
-                // Generate Filtered X-axis
-                for (int i = 0;i < xAxisCurrDec.size();i++) {
-                    xAxisCurrDec[i] = ((double)i / (double)xAxisCurrDec.size()) * (f_samp / 2.0);
-                }
-
-                for (int i = 0;i < xAxisCurr.size();i++) {
-                    xAxisCurr[i] = ((double)i / (double)xAxisCurr.size()) * (f_samp / 2);
-                }
-            } else {
-                // Resize x-axis
-                xAxisCurrDec.resize(curr1.size());
-                xAxisCurr.resize(totCurrentMc.size());
-
-                // Generate X axis
-                double prev_x = 0.0;
-                double rat = (double)fSw.size() / (double)xAxisCurrDec.size();
-                for (int i = 0;i < xAxisCurrDec.size();i++) {
-                    xAxisCurrDec[i] = prev_x;
-                    prev_x += 1.0 / fSw[(int)((double)i * rat)];
-                }
-
-                prev_x = 0.0;
-                rat = (double)fSw.size() / (double)xAxisCurr.size();
-                for (int i = 0;i < xAxisCurr.size();i++) {
-                    xAxisCurr[i] = prev_x;
-                    prev_x += 1.0 / fSw[(int)((double)i * rat)];
-                }
+            if (!(position == 3 || position == 6)) {
+                res.ph3[i] = 0;
             }
+        }
+    }
 
-            QVector<double> xAxisVolt(ph1.size());
-            double prev_x = 0.0;
-            for (int i = 0;i < xAxisVolt.size();i++) {
-                xAxisVolt[i] = prev_x;
-                prev_x += 1.0 / fSw[i];
-            }
+    if (canceled()) {
+        return res;
+    }
 
-            ui->currentPlot->clearGraphs();
-            ui->voltagePlot->clearGraphs();
+    // Filter the currents and take the spectra, one channel per thread
+    struct Channel {
+        QVector<double> *data;
+        bool filter;
+    };
+
+    QVector<Channel> channels;
+    channels.append({&res.curr1, in.filterCurrents});
+    channels.append({&res.curr2, in.filterCurrents});
+    channels.append({&res.curr3, in.filterCurrents});
+    channels.append({&res.totCurrentMc, false});
+
+    QtConcurrent::blockingMap(channels, [&in, &canceled](Channel &c) {
+        if (c.filter && !canceled()) {
+            *c.data = DigitalFiltering::filterSignal(*c.data, in.filter, in.compDelay);
+        }
 
-            QPen phasePen;
-            phasePen.setStyle(Qt::DotLine);
-            phasePen.setColor(Utility::getAppQColor("plot_graph1"));
+        // Use DFT
+        // TODO: The transform only makes sense with a constant sampling frequency right now. Some
+        // weird scaling should be implemented.
+        if (in.showFft && !canceled()) {
+            int fftBits = 16;
+            *c.data = DigitalFiltering::fftWithShift(*c.data, fftBits, true);
+            c.data->resize(c.data->size() / 2);
+        }
+    });
 
-            QPen phasePen2;
-            phasePen2.setStyle(Qt::DotLine);
-            phasePen2.setColor(Utility::getAppQColor("plot_graph2"));
+    if (canceled()) {
+        return res;
+    }
 
-            int graphIndex = 0;
+    // Filtered x-axis vector for currents
+    res.xAxisCurrDec.resize(res.curr1.size());
+    res.xAxisCurr.resize(res.totCurrentMc.size());
 
-            if (ui->showCurrent1Box->isChecked()) {
-                ui->currentPlot->addGraph();
-                ui->currentPlot->graph(graphIndex)->setPen(QPen(Utility::getAppQColor("plot_graph3")));
-                ui->currentPlot->graph(graphIndex)->setData(xAxisCurrDec, curr1);
-                ui->currentPlot->graph(graphIndex)->setName("Phase 1 Current");
-                graphIndex++;
-            }
+    if (in.showFft) {
+        // Generate Filtered X-axis
+        for (int i = 0;i < res.xAxisCurrDec.size();i++) {
+            res.xAxisCurrDec[i] = ((double)i / (double)res.xAxisCurrDec.size()) * (in.fSamp / 2.0);
+        }
 
-            if (ui->showCurrent2Box->isChecked()) {
-                ui->currentPlot->addGraph();
-                ui->currentPlot->graph(graphIndex)->setData(xAxisCurrDec, curr2);
-                ui->currentPlot->graph(graphIndex)->setPen(QPen(Utility::getAppQColor("plot_graph4")));
-                ui->currentPlot->graph(graphIndex)->setName("Phase 2 Current");
-                graphIndex++;
-            }
+        for (int i = 0;i < res.xAxisCurr.size();i++) {
+            res.xAxisCurr[i] = ((double)i / (double)res.xAxisCurr.size()) * (in.fSamp / 2);
+        }
+    } else {
+        // Generate X axis
+        double prev_x = 0.0;
+        double rat = (double)in.fSw.size() / (double)res.xAxisCurrDec.size();
+        for (int i = 0;i < res.xAxisCurrDec.size();i++) {
+            res.xAxisCurrDec[i] = prev_x;
+            prev_x += 1.0 / in.fSw[(int)((double)i * rat)];
+        }
 
-            if (ui->showCurrent3Box->isChecked()) {
-                ui->currentPlot->addGraph();
-                ui->currentPlot->graph(graphIndex)->setData(xAxisCurrDec, curr3);
-                ui->currentPlot->graph(graphIndex)->setPen(QPen(Utility::getAppQColor("plot_graph5")));
-                ui->currentPlot->graph(graphIndex)->setName("Phase 3 Current");
-                graphIndex++;
-            }
+        prev_x = 0.0;
+        rat = (double)in.fSw.size() / (double)res.xAxisCurr.size();
+        for (int i = 0;i < res.xAxisCurr.size();i++) {
+            res.xAxisCurr[i] = prev_x;
+            prev_x += 1.0 / in.fSw[(int)((double)i * rat)];
+        }
+    }
 
-            if (ui->showMcTotalCurrentBox->isChecked()) {
-                ui->currentPlot->addGraph();
-                ui->currentPlot->graph(graphIndex)->setData(xAxisCurr, totCurrentMc);
-                ui->currentPlot->graph(graphIndex)->setPen(QPen(Utility::getAppQColor("plot_graph6")));
-                ui->currentPlot->graph(graphIndex)->setName("Total current filtered by MC");
-                graphIndex++;
-            }
+    res.xAxisVolt.resize(res.ph1.size());
+    double prev_x = 0.0;
+    for (int i = 0;i < res.xAxisVolt.size();i++) {
+        res.xAxisVolt[i] = prev_x;
+        prev_x += 1.0 / in.fSw[i];
+    }
 
-            if (ui->showPosCurrentBox->isChecked() && !showFft) {
-                ui->currentPlot->addGraph();
-                ui->currentPlot->graph(graphIndex)->setData(xAxisCurr, position);
-                ui->currentPlot->graph(graphIndex)->setPen(phasePen);
-                ui->currentPlot->graph(graphIndex)->setName("Current position");
-                graphIndex++;
-            }
+    res.canceled = false;
+    return res;
+}
 
-            if (ui->showPhaseBox->isChecked()) {
-                ui->currentPlot->addGraph(ui->currentPlot->xAxis, ui->currentPlot->yAxis2);
-                ui->currentPlot->graph(graphIndex)->setData(xAxisVolt, phase);
-                ui->currentPlot->graph(graphIndex)->setPen(QPen(Utility::getAppQColor("plot_graph7")));
-                ui->currentPlot->graph(graphIndex)->setName("FOC motor phase");
-                graphIndex++;
-            }
+void PageSampledData::showReplot(const ReplotResult &res)
+{
+    QFont legendFont = font();
+    legendFont.setPointSize(9);
 
-            graphIndex = 0;
+    const QVector<double> &position = res.position;
+    const QVector<double> &position_hall = res.positionHall;
+    const QVector<double> &phase = res.phase;
+    const QVector<double> &curr1 = res.curr1;
+    const QVector<double> &curr2 = res.curr2;
+    const QVector<double> &curr3 = res.curr3;
+    const QVector<double> &totCurrentMc = res.totCurrentMc;
+    const QVector<double> &ph1 = res.ph1;
+    const QVector<double> &ph2 = res.ph2;
+    const QVector<double> &ph3 = res.ph3;
+    const QVector<double> &vZero = res.vZero;
+    const QVector<double> &xAxisCurrDec = res.xAxisCurrDec;
+    const QVector<double> &xAxisCurr = res.xAxisCurr;
+    const QVector<double> &xAxisVolt = res.xAxisVolt;
+
+    bool showFft = res.showFft;
+    bool spectrumChanged = showFft != mLastSpectrum;
+    mLastSpectrum = showFft;
+
+    ui->currentPlot->clearGraphs();
+    ui->voltagePlot->clearGraphs();
+
+    QPen phasePen;
+    phasePen.setStyle(Qt::DotLine);
+    phasePen.setColor(Utility::getAppQColor("plot_graph1"));
+
+    QPen phasePen2;
+    phasePen2.setStyle(Qt::DotLine);
+    phasePen2.setColor(Utility::getAppQColor("plot_graph2"));
+
+    int graphIndex = 0;
+
+    if (ui->showCurrent1Box->isChecked()) {
+        ui->currentPlot->addGraph();
+        ui->currentPlot->graph(graphIndex)->setPen(QPen(Utility::getAppQColor("plot_graph3")));
+        ui->currentPlot->graph(graphIndex)->setData(xAxisCurrDec, curr1);
+        ui->currentPlot->graph(graphIndex)->setName("Phase 1 Current");
+        graphIndex++;
+    }
 
-            if (ui->showPh1Box->isChecked()) {
-                ui->voltagePlot->addGraph();
-                ui->voltagePlot->graph(graphIndex)->setData(xAxisVolt, ph1);
-                ui->voltagePlot->graph(graphIndex)->setPen(QPen(Utility::getAppQColor("plot_graph3")));
-                ui->voltagePlot->graph(graphIndex)->setName("Phase 1 voltage");
-                graphIndex++;
-            }
+    if (ui->showCurrent2Box->isChecked()) {
+        ui->currentPlot->addGraph();
+        ui->currentPlot->graph(graphIndex)->setData(xAxisCurrDec, curr2);
+        ui->currentPlot->graph(graphIndex)->setPen(QPen(Utility::getAppQColor("plot_graph4")));
+        ui->currentPlot->graph(graphIndex)->setName("Phase 2 Current");
+        graphIndex++;
+    }
 
-            if (ui->showPh2Box->isChecked()) {
-                ui->voltagePlot->addGraph();
-                ui->voltagePlot->graph(graphIndex)->setData(xAxisVolt, ph2);
-                ui->voltagePlot->graph(graphIndex)->setPen(QPen(Utility::getAppQColor("plot_graph4")));
-                ui->voltagePlot->graph(graphIndex)->setName("Phase 2 voltage");
-                graphIndex++;
-            }
+    if (ui->showCurrent3Box->isChecked()) {
+        ui->currentPlot->addGraph();
+        ui->currentPlot->graph(graphIndex)->setData(xAxisCurrDec, curr3);
+        ui->currentPlot->graph(graphIndex)->setPen(QPen(Utility::getAppQColor("plot_graph5")));
+        ui->currentPlot->graph(graphIndex)->setName("Phase 3 Current");
+        graphIndex++;
+    }
 
-            if (ui->showPh3Box->isChecked()) {
-                ui->voltagePlot->addGraph();
-                ui->voltagePlot->graph(graphIndex)->setData(xAxisVolt, ph3);
-                ui->voltagePlot->graph(graphIndex)->setPen(QPen(Utility::getAppQColor("plot_graph5")));
-                ui->voltagePlot->graph(graphIndex)->setName("Phase 3 voltage");
-                graphIndex++;
-            }
+    if (ui->showMcTotalCurrentBox->isChecked()) {
+        ui->currentPlot->addGraph();
+        ui->currentPlot->graph(graphIndex)->setData(xAxisCurr, totCurrentMc);
+        ui->currentPlot->graph(graphIndex)->setPen(QPen(Utility::getAppQColor("plot_graph6")));
+        ui->currentPlot->graph(graphIndex)->setName("Total current filtered by MC");
+        graphIndex++;
+    }
 
-            if (ui->showVirtualGndBox->isChecked()) {
-                ui->voltagePlot->addGraph();
-                ui->voltagePlot->graph(graphIndex)->setData(xAxisVolt, vZero);
-                ui->voltagePlot->graph(graphIndex)->setPen(Utility::getAppQColor("plot_graph6"));
-                ui->voltagePlot->graph(graphIndex)->setName("Virtual ground");
-                graphIndex++;
-            }
+    if (ui->showPosCurrentBox->isChecked() && !showFft) {
+        ui->currentPlot->addGraph();
+        ui->currentPlot->graph(graphIndex)->setData(xAxisCurr, position);
+        ui->currentPlot->graph(graphIndex)->setPen(phasePen);
+        ui->currentPlot->graph(graphIndex)->setName("Current position");
+        graphIndex++;
+    }
 
-            if (ui->showPosVoltageBox->isChecked()) {
-                ui->voltagePlot->addGraph();
-                ui->voltagePlot->graph(graphIndex)->setData(xAxisVolt, position);
-                ui->voltagePlot->graph(graphIndex)->setPen(phasePen);
-                ui->voltagePlot->graph(graphIndex)->setName("Current position");
-                graphIndex++;
-
-                ui->voltagePlot->addGraph();
-                ui->voltagePlot->graph(graphIndex)->setData(xAxisVolt, position_hall);
-                ui->voltagePlot->graph(graphIndex)->setPen(phasePen2);
-                ui->voltagePlot->graph(graphIndex)->setName("Hall position");
-                graphIndex++;
-            }
+    if (ui->showPhaseBox->isChecked()) {
+        ui->currentPlot->addGraph(ui->currentPlot->xAxis, ui->currentPlot->yAxis2);
+        ui->currentPlot->graph(graphIndex)->setData(xAxisVolt, phase);
+        ui->currentPlot->graph(graphIndex)->setPen(QPen(Utility::getAppQColor("plot_graph7")));
+        ui->currentPlot->graph(graphIndex)->setName("FOC motor phase");
+        graphIndex++;
+    }
 
-            if (ui->showPhaseVoltageBox->isChecked()) {
-                ui->voltagePlot->addGraph(ui->voltagePlot->xAxis, ui->voltagePlot->yAxis2);
-                ui->voltagePlot->graph(graphIndex)->setData(xAxisVolt, phase);
-                ui->voltagePlot->graph(graphIndex)->setPen(QPen(Utility::getAppQColor("plot_graph7")));
-                ui->voltagePlot->graph(graphIndex)->setName("FOC motor phase");
-                graphIndex++;
-            }
+    graphIndex = 0;
 
-            // Plot settings
-            ui->currentPlot->legend->setVisible(true);
-            ui->currentPlot->legend->setFont(legendFont);
-            ui->currentPlot->axisRect()->insetLayout()->setInsetAlignment(0, Qt::AlignRight|Qt::AlignBottom);
-            if (showFft) {
-                ui->currentPlot->xAxis->setLabel("Frequency (Hz)");
-                ui->currentPlot->yAxis->setLabel("Amplitude");
-            } else {
-                ui->currentPlot->xAxis->setLabel("Seconds (s)");
-                ui->currentPlot->yAxis->setLabel("Amperes (A)");
-
-                if (ui->showPhaseBox->isChecked()) {
-                    ui->currentPlot->yAxis2->setLabel("Motor Phase (Degrees)");
-                    ui->currentPlot->yAxis2->setVisible(true);
-                } else {
-                    ui->currentPlot->yAxis2->setVisible(false);
-                }
-            }
+    if (ui->showPh1Box->isChecked()) {
+        ui->voltagePlot->addGraph();
+        ui->voltagePlot->graph(graphIndex)->setData(xAxisVolt, ph1);
+        ui->voltagePlot->graph(graphIndex)->setPen(QPen(Utility::getAppQColor("plot_graph3")));
+        ui->voltagePlot->graph(graphIndex)->setName("Phase 1 voltage");
+        graphIndex++;
+    }
 
-            ui->voltagePlot->legend->setVisible(true);
-            ui->voltagePlot->legend->setFont(legendFont);
-            ui->voltagePlot->axisRect()->insetLayout()->setInsetAlignment(0, Qt::AlignRight|Qt::AlignBottom);
-            ui->voltagePlot->xAxis->setLabel("Seconds (s)");
-            ui->voltagePlot->yAxis->setLabel("Volts (V)");
-
-            if (ui->showPhaseVoltageBox->isChecked()) {
-                ui->voltagePlot->yAxis2->setLabel("Motor Phase (Degrees)");
-                ui->voltagePlot->yAxis2->setVisible(true);
-            } else {
-                ui->voltagePlot->yAxis2->setVisible(false);
-            }
+    if (ui->showPh2Box->isChecked()) {
+        ui->voltagePlot->addGraph();
+        ui->voltagePlot->graph(graphIndex)->setData(xAxisVolt, ph2);
+        ui->voltagePlot->graph(graphIndex)->setPen(QPen(Utility::getAppQColor("plot_graph4")));
+        ui->voltagePlot->graph(graphIndex)->setName("Phase 2 voltage");
+        graphIndex++;
+    }
 
-            if (mDoRescale || spectrumChanged) {
-                ui->currentPlot->rescaleAxes();
-                ui->voltagePlot->rescaleAxes();
-            }
+    if (ui->showPh3Box->isChecked()) {
+        ui->voltagePlot->addGraph();
+        ui->voltagePlot->graph(graphIndex)->setData(xAxisVolt, ph3);
+        ui->voltagePlot->graph(graphIndex)->setPen(QPen(Utility::getAppQColor("plot_graph5")));
+        ui->voltagePlot->graph(graphIndex)->setName("Phase 3 voltage");
+        graphIndex++;
+    }
 
-            ui->currentPlot->replotWhenVisible();
-            ui->voltagePlot->replotWhenVisible();
+    if (ui->showVirtualGndBox->isChecked()) {
+        ui->voltagePlot->addGraph();
+        ui->voltagePlot->graph(graphIndex)->setData(xAxisVolt, vZero);
+        ui->voltagePlot->graph(graphIndex)->setPen(Utility::getAppQColor("plot_graph6"));
+        ui->voltagePlot->graph(graphIndex)->setName("Virtual ground");
+        graphIndex++;
+    }
 
+    if (ui->showPosVoltageBox->isChecked()) {
+        ui->voltagePlot->addGraph();
+        ui->voltagePlot->graph(graphIndex)->setData(xAxisVolt, position);
+        ui->voltagePlot->graph(graphIndex)->setPen(phasePen);
+        ui->voltagePlot->graph(graphIndex)->setName("Current position");
+        graphIndex++;
+
+        ui->voltagePlot->addGraph();
+        ui->voltagePlot->graph(graphIndex)->setData(xAxisVolt, position_hall);
+        ui->voltagePlot->graph(graphIndex)->setPen(phasePen2);
+        ui->voltagePlot->graph(graphIndex)->setName("Hall position");
+        graphIndex++;
+    }
+
+    if (ui->showPhaseVoltageBox->isChecked()) {
+        ui->voltagePlot->addGraph(ui->voltagePlot->xAxis, ui->voltagePlot->yAxis2);
+        ui->voltagePlot->graph(graphIndex)->setData(xAxisVolt, phase);
+        ui->voltagePlot->graph(graphIndex)->setPen(QPen(Utility::getAppQColor("plot_graph7")));
+        ui->voltagePlot->graph(graphIndex)->setName("FOC motor phase");
+        graphIndex++;
+    }
+
+    // Plot settings
+    ui->currentPlot->legend->setVisible(true);
+    ui->currentPlot->legend->setFont(legendFont);
+    ui->currentPlot->axisRect()->insetLayout()->setInsetAlignment(0, Qt::AlignRight|Qt::AlignBottom);
+    if (showFft) {
+        ui->currentPlot->xAxis->setLabel("Frequency (Hz)");
+        ui->currentPlot->yAxis->setLabel("Amplitude");
+    } else {
+        ui->currentPlot->xAxis->setLabel("Seconds (s)");
+        ui->currentPlot->yAxis->setLabel("Amperes (A)");
+
+        if (ui->showPhaseBox->isChecked()) {
+            ui->currentPlot->yAxis2->setLabel("Motor Phase (Degrees)");
+            ui->currentPlot->yAxis2->setVisible(true);
+        } else {
+            ui->currentPlot->yAxis2->setVisible(false);
         }
+    }
 
-        mDoReplot = false;
-        mDoRescale = false;
+    ui->voltagePlot->legend->setVisible(true);
+    ui->voltagePlot->legend->setFont(legendFont);
+    ui->voltagePlot->axisRect()->insetLayout()->setInsetAlignment(0, Qt::AlignRight|Qt::AlignBottom);
+    ui->voltagePlot->xAxis->setLabel("Seconds (s)");
+    ui->voltagePlot->yAxis->setLabel("Volts (V)");
+
+    if (ui->showPhaseVoltageBox->isChecked()) {
+        ui->voltagePlot->yAxis2->setLabel("Motor Phase (Degrees)");
+        ui->voltagePlot->yAxis2->setVisible(true);
+    } else {
+        ui->voltagePlot->yAxis2->setVisible(false);
     }
+
+    if (mDoRescale || spectrumChanged) {
+        ui->currentPlot->rescaleAxes();
+        ui->voltagePlot->rescaleAxes();
+    }
+
+    ui->currentPlot->replotWhenVisible();
+    ui->voltagePlot->replotWhenVisible();
+
+    mDoRescale = false;
 }
 
 void PageSampledData::samplesReceived(QByteArray bytes)
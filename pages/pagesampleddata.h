@@ -23,6 +23,9 @@
 #include <QWidget>
 #include <QVector>
 #include <QTimer>
+#include <QFutureWatcher>
+#include <QAtomicInt>
+#include <QSharedPointer>
 #include "vescinterface.h"
 
 namespace Ui {
@@ -44,6 +47,7 @@ private slots:
     void timerSlot();
     void samplesReceived(QByteArray bytes);
     void replotAll();
+    void replotJobFinished();
 
     void on_sampleNowButton_clicked();
     void on_sampleStartButton_clicked();
@@ -61,6 +65,48 @@ private slots:
     void on_saveDataButton_clicked();
 
 private:
+    // Everything a replot job needs, taken when it starts. The sample
+    // buffers are implicitly shared with the page and only read by the job.
+    struct ReplotInput {
+        int generation;
+        QVector<double> curr1;
+        QVector<double> curr2;
+        QVector<double> ph1;
+        QVector<double> ph2;
+        QVector<double> ph3;
+        QVector<double> vZero;
+        QVector<double> currTot;
+        QVector<double> fSw;
+        QByteArray status;
+        QByteArray phase;
+        QVector<double> filter;
+        bool filterCurrents;
+        bool compDelay;
+        bool truncate;
+        bool showFft;
+        double fSamp;
+    };
+
+    struct ReplotResult {
+        int generation;
+        bool canceled;
+        bool showFft;
+        QVector<double> position;
+        QVector<double> positionHall;
+        QVector<double> phase;
+        QVector<double> curr1;
+        QVector<double> curr2;
+        QVector<double> curr3;
+        QVector<double> totCurrentMc;
+        QVector<double> ph1;
+        QVector<double> ph2;
+        QVector<double> ph3;
+        QVector<double> vZero;
+        QVector<double> xAxisCurrDec;
+        QVector<double> xAxisCurr;
+        QVector<double> xAxisVolt;
+    };
+
     Ui::PageSampledData *ui;
     VescInterface *mVesc;
     QTimer *mTimer;
@@ -94,8 +140,16 @@ private:
     bool mDoFilterReplot;
     int mSamplesToWait;
 
+    QVector<double> mFilter;
+    QFutureWatcher<ReplotResult> mReplotWatcher;
+    QSharedPointer<QAtomicInt> mReplotGeneration;
+    bool mLastSpectrum;
+
     void clearBuffers();
     void updateZoom();
+    void startReplotJob();
+    void showReplot(const ReplotResult &res);
+    static ReplotResult computeReplot(const ReplotInput &in, const QAtomicInt *latestGeneration);
 
 };
 
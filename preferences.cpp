@@ -63,6 +63,7 @@ Preferences::Preferences(QWidget *parent) :
     ui->pollAppDataBox->setValue(mSettings.value("poll_rate_app_data", 20.0).toDouble());
     ui->pollImuDataBox->setValue(mSettings.value("poll_rate_imu_data", 50.0).toDouble());
     ui->pollBmsDataBox->setValue(mSettings.value("poll_rate_bms_data", 10.0).toDouble());
+    ui->rtDataHistoryBox->setValue(mSettings.value("rt_data_history", 500).toInt());
     ui->darkModeBox->setChecked(Utility::isDarkMode());
 
 #ifdef HAS_GAMEPAD
@@ -431,12 +432,20 @@ void Preferences::on_pollBmsDataBox_valueChanged(double arg1)
     mSettings.sync();
 }
 
+void Preferences::on_rtDataHistoryBox_valueChanged(int arg1)
+{
+    mSettings.setValue("rt_data_history", arg1);
+    mSettings.sync();
+    emit rtDataHistoryChanged(arg1);
+}
+
 void Preferences::on_pollRestoreButton_clicked()
 {
     ui->pollRtDataBox->setValue(50.0);
     ui->pollAppDataBox->setValue(20.0);
     ui->pollImuDataBox->setValue(50.0);
     ui->pollBmsDataBox->setValue(10.0);
+    ui->rtDataHistoryBox->setValue(500);
 }
 
 void Preferences::on_darkModeBox_toggled(bool checked)
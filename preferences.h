@@ -61,6 +61,9 @@ public:
     void setUseGamepadControl(bool useControl);
     bool isUsingGamepadControl();
 
+signals:
+    void rtDataHistoryChanged(int samples);
+
 protected:
     void closeEvent(QCloseEvent *event);
     void showEvent(QShowEvent *event);
@@ -84,6 +87,7 @@ private slots:
     void on_pollAppDataBox_valueChanged(double arg1);
     void on_pollImuDataBox_valueChanged(double arg1);
     void on_pollBmsDataBox_valueChanged(double arg1);
+    void on_rtDataHistoryBox_valueChanged(int arg1);
     void on_pollRestoreButton_clicked();
     void on_darkModeBox_toggled(bool checked);
     void on_okButton_clicked();
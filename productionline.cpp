@@ -0,0 +1,361 @@
+/*
+    Copyright 2016 - 2024 Benjamin Vedder	benjamin@vedder.se
+
+    This file is part of VESC Tool.
+
+    VESC Tool is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    VESC Tool is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+#include "productionline.h"
+#include "boardsetup.h"
+#include "vescinterface.h"
+#include "utility.h"
+#include "configstore.h"
+#include <QElapsedTimer>
+#include <QDebug>
+
+ProductionStation::ProductionStation(const QString &port, const Options &options) : QObject()
+{
+    mPort = port;
+    mOptions = options;
+    mVesc = nullptr;
+    mMcConfigTarget = nullptr;
+    mAppConfigTarget = nullptr;
+    mSetup = nullptr;
+    mCancel = false;
+}
+
+QString ProductionStation::port() const
+{
+    return mPort;
+}
+
+QString ProductionStation::stepName(int step)
+{
+    switch (step) {
+    case STEP_CONNECT: return "Connect USB Port";
+    case STEP_CAN_SCAN: return "CAN Bus Scan";
+    case STEP_BOOTLOADER: return "Bootloader Upload";
+    case STEP_FIRMWARE: return "Firmware Upload";
+    case STEP_FOC_DETECTION: return "Motor FOC Detection";
+    case STEP_MOTOR_DIRECTION: return "Motor Direction Calibration";
+    case STEP_MOTOR_TEST: return "Motor Test";
+    case STEP_APP_SETUP: return "App Setup";
+    case STEP_FINAL: return "Final Diagnostics";
+    default: return "Unknown";
+    }
+}
+
+/**
+ * @brief ProductionStation::run
+ * Run the whole routine. This must be called on the thread of the station,
+ * as the VescInterface is created here.
+ */
+void ProductionStation::run()
+{
+    mVesc = new VescInterface(this);
+    mVesc->fwConfig()->loadParamsXml("://res/config/fw.xml");
+    Utility::configLoadLatest(mVesc);
+
+    connect(mVesc, &VescInterface::fwUploadStatus, [this](const QString &status, double progress, bool isOngoing) {
+        if (isOngoing) {
+            emit statusText(tr("%1 (%2 %)").arg(status).arg(progress * 100, 0, 'f', 1));
+        }
+    });
+
+    mMcConfigTarget = new ConfigParams(this);
+    mAppConfigTarget = new ConfigParams(this);
+    QPair<int, int> latestSupported = Utility::configLatestSupported();
+    ConfigStore::bundled().loadParams(latestSupported.first, latestSupported.second,
+                                      ConfigStore::CONFIG_MCCONF, mMcConfigTarget);
+    ConfigStore::bundled().loadParams(latestSupported.first, latestSupported.second,
+                                      ConfigStore::CONFIG_APPCONF, mAppConfigTarget);
+
+    mSetup = new BoardSetup(mVesc, mMcConfigTarget, mAppConfigTarget, this);
+    connect(mSetup, &BoardSetup::statusText, this, &ProductionStation::statusText);
+
+    bool motorSetup = !mOptions.mcXmlPath.isEmpty();
+    bool appSetup = !mOptions.appXmlPath.isEmpty();
+
+    bool res = true;
+
+    if (motorSetup && !mMcConfigTarget->loadXml(mOptions.mcXmlPath, "MCConfiguration")) {
+        mResultMsg = "Could not load motor configuration " + mOptions.mcXmlPath;
+        res = false;
+    }
+
+    if (appSetup && !mAppConfigTarget->loadXml(mOptions.appXmlPath, "APPConfiguration")) {
+        mResultMsg = "Could not load app configuration " + mOptions.appXmlPath;
+        res = false;
+    }
+
+    res = res && runStep(STEP_CONNECT, [this]() { return mSetup->serialConnect(mPort); }) &&
+            runStep(STEP_CAN_SCAN, [this]() { return mSetup->canScan(); });
+
+    if (res && mOptions.uploadBootloader) {
+        res = runStep(STEP_BOOTLOADER, [this]() { return mSetup->bootloaderUpload(); }) &&
+                runStep(STEP_FIRMWARE, [this]() { return mSetup->firmwareUpload(mPort); }) &&
+                runStep(STEP_CAN_SCAN, [this]() { return mSetup->canScan(); });
+    }
+
+    if (res && motorSetup) {
+        // Instead of waiting for the user to cancel a dialog, the direction
+        // step fails if not all motors have been turned forward in time.
+        QElapsedTimer directionTimer;
+        auto keepWaiting = [this, &directionTimer](const QString &status, QString &abortMsg) {
+            emit statusText(status);
+
+            if (mCancel) {
+                abortMsg = "Direction routine canceled.";
+                return false;
+            }
+
+            if (directionTimer.elapsed() > mOptions.directionTimeoutMs) {
+                abortMsg = "Not all motors were turned before the timeout.";
+                return false;
+            }
+
+            return true;
+        };
+
+        res = runStep(STEP_FOC_DETECTION, [this]() {
+            return mSetup->focDetection(mOptions.mcXmlPath, mOptions.motorTolerance);
+        }) && runStep(STEP_MOTOR_DIRECTION, [this, &directionTimer, keepWaiting]() {
+            directionTimer.start();
+            return mSetup->motorDirection(keepWaiting);
+        }) && runStep(STEP_MOTOR_TEST, [this, appSetup]() {
+            return appSetup || mSetup->restoreApp();
+        });
+    }
+
+    if (res && appSetup) {
+        res = runStep(STEP_APP_SETUP, [this]() {
+            return (mSetup->numVescs() <= 1 || mSetup->applySlaveAppSettings(mOptions.appXmlPath)) &&
+                    mSetup->applyMasterAppSettings(mOptions.appXmlPath);
+        });
+    }
+
+    if (res) {
+        res = runStep(STEP_FINAL, []() { return true; });
+        mResultMsg = "Setup completed succesfully. Your board should now be ready to ride.";
+    }
+
+    // Delete the interface on this thread, as its timers belong to it
+    mVesc->disconnectPort();
+    delete mSetup;
+    mSetup = nullptr;
+    delete mVesc;
+    mVesc = nullptr;
+
+    emit finished(res, mResultMsg);
+}
+
+void ProductionStation::cancel()
+{
+    mCancel = true;
+}
+
+bool ProductionStation::runStep(step_t step, std::function<bool()> func)
+{
+    if (mCancel) {
+        mResultMsg = "Canceled";
+        return false;
+    }
+
+    emit stepStarted(step);
+    mResultMsg.clear();
+
+    QElapsedTimer t;
+    t.start();
+    bool res = func();
+
+    if (!res) {
+        mResultMsg = mSetup->resultMsg();
+    }
+
+    if (mCancel && res) {
+        res = false;
+        mResultMsg = "Canceled";
+    }
+
+    emit stepFinished(step, res, mResultMsg, t.elapsed());
+    return res;
+}
+
+ProductionLine::ProductionLine(QObject *parent) : QObject(parent)
+{
+    mRunning = 0;
+}
+
+ProductionLine::~ProductionLine()
+{
+    cancel();
+    cleanup();
+}
+
+void ProductionLine::start(const QStringList &ports, const ProductionStation::Options &options)
+{
+    if (isRunning()) {
+        return;
+    }
+
+    cleanup();
+
+    for (int i = 0;i < ports.size();i++) {
+        StationResult r;
+        r.port = ports.at(i);
+        r.done = false;
+        r.ok = false;
+        r.stepMs.fill(-1, ProductionStation::STEP_COUNT);
+        mResults.append(r);
+
+        QThread *thread = new QThread;
+        thread->setObjectName("Station " + ports.at(i));
+        ProductionStation *station = new ProductionStation(ports.at(i), options);
+        station->moveToThread(thread);
+
+        connect(thread, &QThread::started, station, &ProductionStation::run);
+
+        connect(station, &ProductionStation::stepStarted, this, [this, i](int step) {
+            emit stationStep(i, step, STATE_RUNNING, ProductionStation::stepName(step));
+        });
+
+        connect(station, &ProductionStation::statusText, this, [this, i](QString text) {
+            emit stationStep(i, -1, STATE_RUNNING, text);
+        });
+
+        connect(station, &ProductionStation::stepFinished, this, [this, i](int step, bool ok, QString msg, qint64 ms) {
+            // A step that runs twice, such as the CAN scan after a firmware upload, adds up
+            qint64 &stepMs = mResults[i].stepMs[step];
+            stepMs = (stepMs < 0 ? 0 : stepMs) + ms;
+            emit stationStep(i, step, ok ? STATE_OK : STATE_FAILED,
+                             msg.isEmpty() ? QString("%1 ms").arg(ms) : msg);
+        });
+
+        connect(station, &ProductionStation::finished, this, [this, i, thread](bool ok, QString msg) {
+            mResults[i].done = true;
+            mResults[i].ok = ok;
+            mResults[i].msg = msg;
+            thread->quit();
+            mRunning--;
+
+            emit stationFinished(i, ok, msg);
+            if (mRunning == 0) {
+                emit allFinished();
+            }
+        });
+
+        mStations.append(station);
+        mThreads.append(thread);
+    }
+
+    mRunning = mThreads.size();
+    for (auto t: mThreads) {
+        t->start();
+    }
+}
+
+void ProductionLine::cancel()
+{
+    for (auto s: mStations) {
+        s->cancel();
+    }
+}
+
+bool ProductionLine::isRunning() const
+{
+    return mRunning > 0;
+}
+
+QVector<ProductionLine::StationResult> ProductionLine::results() const
+{
+    return mResults;
+}
+
+/**
+ * @brief ProductionLine::timingReport
+ * Per step min, average and max time over all stations that ran it, with
+ * the step that took the longest on average marked.
+ */
+QString ProductionLine::timingReport() const
+{
+    QString res;
+    int slowestStep = -1;
+    double slowestAvg = 0.0;
+
+    for (int step = 0;step < ProductionStation::STEP_COUNT;step++) {
+        qint64 min = -1;
+        qint64 max = 0;
+        qint64 sum = 0;
+        int num = 0;
+
+        for (const auto &r: mResults) {
+            qint64 ms = r.stepMs.at(step);
+            if (ms < 0) {
+                continue;
+            }
+
+            min = (min < 0 || ms < min) ? ms : min;
+            max = qMax(max, ms);
+            sum += ms;
+            num++;
+        }
+
+        if (num == 0) {
+            continue;
+        }
+
+        double avg = double(sum) / double(num);
+        if (avg > slowestAvg) {
+            slowestAvg = avg;
+            slowestStep = step;
+        }
+
+        res += QString("%1: min %2 ms, avg %3 ms, max %4 ms (%5 stations)\n").
+                arg(ProductionStation::stepName(step)).arg(min).
+                arg(avg, 0, 'f', 0).arg(max).arg(num);
+    }
+
+    for (const auto &r: mResults) {
+        qint64 total = 0;
+        for (qint64 ms: r.stepMs) {
+            total += ms > 0 ? ms : 0;
+        }
+        res += QString("%1: %2 in %3 s%4\n").arg(r.port).
+                arg(r.done ? (r.ok ? "OK" : "FAILED") : "RUNNING").
+                arg(double(total) / 1000.0, 0, 'f', 1).
+                arg(r.ok || r.msg.isEmpty() ? "" : " - " + r.msg);
+    }
+
+    if (slowestStep >= 0) {
+        res += QString("Slowest step: %1").arg(ProductionStation::stepName(slowestStep));
+    }
+
+    return res;
+}
+
+void ProductionLine::cleanup()
+{
+    for (int i = 0;i < mThreads.size();i++) {
+        mThreads.at(i)->quit();
+        mThreads.at(i)->wait();
+        delete mStations.at(i);
+        delete mThreads.at(i);
+    }
+
+    mStations.clear();
+    mThreads.clear();
+    mResults.clear();
+    mRunning = 0;
+}
@@ -0,0 +1,147 @@
+/*
+    Copyright 2016 - 2024 Benjamin Vedder	benjamin@vedder.se
+
+    This file is part of VESC Tool.
+
+    VESC Tool is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    VESC Tool is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+#ifndef PRODUCTIONLINE_H
+#define PRODUCTIONLINE_H
+
+#include <QObject>
+#include <QThread>
+#include <QVector>
+#include <QStringList>
+#include <functional>
+#include <atomic>
+#include "datatypes.h"
+
+class VescInterface;
+class ConfigParams;
+class BoardSetup;
+
+/**
+ * @brief The ProductionStation class
+ * The end-of-line routine of BoardSetupWindow for one board, without user
+ * interaction. Both run the steps of BoardSetup. Every station has its own
+ * VescInterface and runs on its own thread, so that several boards on
+ * different serial ports can be set up at the same time.
+ */
+class ProductionStation : public QObject
+{
+    Q_OBJECT
+
+public:
+    typedef enum {
+        STEP_CONNECT = 0,
+        STEP_CAN_SCAN,
+        STEP_BOOTLOADER,
+        STEP_FIRMWARE,
+        STEP_FOC_DETECTION,
+        STEP_MOTOR_DIRECTION,
+        STEP_MOTOR_TEST,
+        STEP_APP_SETUP,
+        STEP_FINAL,
+        STEP_COUNT
+    } step_t;
+
+    struct Options {
+        QString mcXmlPath;
+        QString appXmlPath;
+        bool uploadBootloader;
+        // Allowed relative deviation of the detected motor parameters
+        double motorTolerance;
+        int directionTimeoutMs;
+    };
+
+    explicit ProductionStation(const QString &port, const Options &options);
+
+    QString port() const;
+    static QString stepName(int step);
+
+signals:
+    void stepStarted(int step);
+    void stepFinished(int step, bool ok, QString msg, qint64 ms);
+    void statusText(QString text);
+    void finished(bool ok, QString msg);
+
+public slots:
+    void run();
+    void cancel();
+
+private:
+    QString mPort;
+    Options mOptions;
+    VescInterface *mVesc;
+    ConfigParams *mMcConfigTarget;
+    ConfigParams *mAppConfigTarget;
+    BoardSetup *mSetup;
+    std::atomic<bool> mCancel;
+
+    QString mResultMsg;
+
+    bool runStep(step_t step, std::function<bool()> func);
+
+};
+
+/**
+ * @brief The ProductionLine class
+ * Runs one ProductionStation per serial port in parallel and collects the
+ * results and the time each step took on each station.
+ */
+class ProductionLine : public QObject
+{
+    Q_OBJECT
+
+public:
+    typedef enum {
+        STATE_RUNNING = 0,
+        STATE_OK,
+        STATE_FAILED
+    } step_state;
+
+    struct StationResult {
+        QString port;
+        bool done;
+        bool ok;
+        QString msg;
+        QVector<qint64> stepMs;
+    };
+
+    explicit ProductionLine(QObject *parent = nullptr);
+    ~ProductionLine();
+
+    void start(const QStringList &ports, const ProductionStation::Options &options);
+    void cancel();
+    bool isRunning() const;
+    QVector<StationResult> results() const;
+    QString timingReport() const;
+
+signals:
+    void stationStep(int station, int step, int state, QString text);
+    void stationFinished(int station, bool ok, QString msg);
+    void allFinished();
+
+private:
+    QVector<ProductionStation*> mStations;
+    QVector<QThread*> mThreads;
+    QVector<StationResult> mResults;
+    int mRunning;
+
+    void cleanup();
+
+};
+
+#endif // PRODUCTIONLINE_H
@@ -0,0 +1,186 @@
+# Packs the parameter XML files of all firmware versions in this directory
+# into config_store.bin, which is what res_config.qrc bundles. Run it after
+# adding or changing a version. The format is read by ConfigStore in
+# configstore.cpp, see there for the layout.
+#
+# With --check STAMP nothing is written except for the stamp file, and the
+# exit code is 1 if config_store.bin is not what the XML files pack to.
+# vesc_tool.pro runs this on every build where the XML files changed.
+
+import difflib
+import glob
+import os
+import struct
+import sys
+import xml.etree.ElementTree as ET
+
+MAGIC = 0x56434653 # "VCFS"
+FORMAT_VERSION = 1
+FILES = ["parameters_mcconf.xml", "parameters_appconf.xml", "info.xml"]
+OP_COPY = 0x80000000
+TOKEN_GROUP = 0xFFFFFFFF
+TOKEN_SUBGROUP = 0xFFFFFFFE
+
+strings = []
+string_ids = {}
+fields = []
+field_ids = {}
+records = []
+record_ids = {}
+
+def intern(s):
+    s = s or ""
+    if s not in string_ids:
+        string_ids[s] = len(strings)
+        strings.append(s)
+    return string_ids[s]
+
+def field(name):
+    if name not in field_ids:
+        field_ids[name] = len(fields)
+        fields.append(intern(name))
+    return field_ids[name]
+
+def record(param):
+    rec = (intern(param.tag), tuple((field(c.tag), intern(c.text)) for c in param))
+    if rec not in record_ids:
+        record_ids[rec] = len(records)
+        records.append(rec)
+    return record_ids[rec]
+
+def parse(path):
+    root = ET.parse(path).getroot()
+    params, ser_order, grouping = [], [], []
+
+    for section in root:
+        if section.tag == "Params":
+            params = [record(p) for p in section]
+        elif section.tag == "SerOrder":
+            ser_order = [intern(s.text) for s in section if s.tag == "ser"]
+        elif section.tag == "Grouping":
+            for group in section:
+                grouping += [TOKEN_GROUP, intern(group.findtext("groupName", "unknownGroup"))]
+                for sub in group.findall("subgroup"):
+                    grouping += [TOKEN_SUBGROUP, intern(sub.findtext("subgroupName", "unknownSubgroup"))]
+                    for plist in sub.findall("subgroupParams"):
+                        grouping += [intern(p.text) for p in plist if p.tag == "param"]
+
+    return [params, ser_order, grouping]
+
+def delta(base, ids):
+    res = []
+    matcher = difflib.SequenceMatcher(None, base, ids, autojunk=False)
+    for tag, i1, i2, j1, j2 in matcher.get_opcodes():
+        if tag == "equal":
+            res += [OP_COPY | (i2 - i1), i1]
+        elif tag in ("replace", "insert"):
+            res += [j2 - j1] + ids[j1:j2]
+    return res
+
+def versions():
+    res = []
+    for d in sorted(glob.glob("*/")):
+        d = d.rstrip("/\\")
+        vers = []
+        for name in d.split("_o_"):
+            parts = name.split(".")
+            if len(parts) == 2:
+                vers.append((int(parts[0]), int(parts[1])))
+        if vers and all(os.path.exists(os.path.join(d, f)) for f in FILES):
+            res.append((min(vers), d, vers))
+    return [(d, vers) for _, d, vers in sorted(res)]
+
+def pack():
+    dirs = versions()
+    lists = {}
+    for d, _ in dirs:
+        for i, f in enumerate(FILES):
+            lists[(d, i)] = parse(os.path.join(d, f))
+
+    # Header, then the strings, fields, records, versions and file blocks
+    header_len = 4 + 2 + 2 + 4 * 9
+    out = bytearray(header_len)
+
+    string_index_offset = len(out)
+    string_data = bytearray()
+    for s in strings:
+        b = s.encode("utf-8")
+        out += struct.pack(">II", len(string_data), len(b))
+        string_data += b
+    string_data_offset = len(out)
+    out += string_data
+
+    field_table_offset = len(out)
+    for f in fields:
+        out += struct.pack(">I", f)
+
+    record_data = bytearray()
+    record_offsets = []
+    for name, flds in records:
+        record_offsets.append(len(record_data))
+        record_data += struct.pack(">IH", name, len(flds))
+        for f, v in flds:
+            record_data += struct.pack(">HI", f, v)
+    record_index_offset = len(out)
+    record_data_offset = record_index_offset + 4 * len(records)
+    for o in record_offsets:
+        out += struct.pack(">I", record_data_offset + o)
+    out += record_data
+
+    version_count = sum(len(v) for _, v in dirs)
+    version_index_offset = len(out)
+    out += bytearray(version_count * (4 + 4 * len(FILES)))
+
+    # Every file is stored as a delta to the same file of the previous version
+    block_offsets = {}
+    for n, (d, _) in enumerate(dirs):
+        for i in range(len(FILES)):
+            base = lists[(dirs[n - 1][0], i)] if n > 0 else [[], [], []]
+            block_offsets[(d, i)] = len(out)
+            out += struct.pack(">I", block_offsets[(dirs[n - 1][0], i)] if n > 0 else 0)
+            for b, ids in zip(base, lists[(d, i)]):
+                ops = delta(b, ids)
+                out += struct.pack(">I", len(ops))
+                out += struct.pack(">%dI" % len(ops), *ops)
+
+    pos = version_index_offset
+    for d, vers in dirs:
+        for major, minor in vers:
+            struct.pack_into(">HH", out, pos, major, minor)
+            pos += 4
+            for i in range(len(FILES)):
+                struct.pack_into(">I", out, pos, block_offsets[(d, i)])
+                pos += 4
+
+    struct.pack_into(">IHHIIIIIIIII", out, 0, MAGIC, FORMAT_VERSION, len(FILES),
+                     len(strings), len(fields), len(records), version_count,
+                     string_index_offset, string_data_offset, field_table_offset,
+                     record_index_offset, version_index_offset)
+
+    xml_size = sum(os.path.getsize(os.path.join(d, f)) for d, _ in dirs for f in FILES)
+    summary = "%d versions: %d strings, %d records, %d bytes (XML: %d bytes)" % \
+        (version_count, len(strings), len(records), len(out), xml_size)
+    return out, summary
+
+def main():
+    os.chdir(os.path.dirname(os.path.abspath(__file__)))
+    out, summary = pack()
+
+    if len(sys.argv) == 3 and sys.argv[1] == "--check":
+        with open("config_store.bin", "rb") as f:
+            if f.read() != out:
+                print("error: res/config/config_store.bin does not match the XML files, "
+                      "run res/config/pack_configs.py and commit the result", file=sys.stderr)
+                return 1
+        with open(sys.argv[2], "w") as f:
+            f.write(summary + "\n")
+        return 0
+
+    with open("config_store.bin", "wb") as f:
+        f.write(out)
+
+    print("Packed " + summary)
+    return 0
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,115 @@
+/*
+    Copyright 2016 - 2024 Benjamin Vedder	benjamin@vedder.se
+
+    This file is part of VESC Tool.
+
+    VESC Tool is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    VESC Tool is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+#include "rtdatastore.h"
+
+RtDataStore::RtDataStore(int channels, int capacity)
+{
+    mCapacity = qMax(capacity, 1);
+
+    for (int i = 0;i < channels;i++) {
+        mColumns.append(QSharedPointer<QCPGraphDataContainer>(new QCPGraphDataContainer));
+    }
+}
+
+int RtDataStore::channels() const
+{
+    return mColumns.size();
+}
+
+int RtDataStore::capacity() const
+{
+    return mCapacity;
+}
+
+/**
+ * @brief RtDataStore::setCapacity
+ * Set the number of samples kept per channel. When the capacity is
+ * reduced the oldest samples are dropped right away.
+ */
+void RtDataStore::setCapacity(int capacity)
+{
+    mCapacity = qMax(capacity, 1);
+
+    for (auto &c: mColumns) {
+        trim(c.data());
+        c->squeeze();
+    }
+}
+
+void RtDataStore::clear()
+{
+    for (auto &c: mColumns) {
+        c->clear();
+    }
+}
+
+void RtDataStore::append(int channel, double key, double value)
+{
+    QCPGraphDataContainer *col = mColumns.at(channel).data();
+    col->add(QCPGraphData(key, value));
+    trim(col);
+}
+
+void RtDataStore::appendValues(double key, const MC_VALUES &values)
+{
+    append(CH_TEMP_MOS, key, values.temp_mos);
+    append(CH_TEMP_MOS_1, key, values.temp_mos_1);
+    append(CH_TEMP_MOS_2, key, values.temp_mos_2);
+    append(CH_TEMP_MOS_3, key, values.temp_mos_3);
+    append(CH_TEMP_MOTOR, key, values.temp_motor);
+    append(CH_CURRENT_IN, key, values.current_in);
+    append(CH_CURRENT_MOTOR, key, values.current_motor);
+    append(CH_ID, key, values.id);
+    append(CH_IQ, key, values.iq);
+    append(CH_DUTY, key, values.duty_now);
+    append(CH_RPM, key, values.rpm);
+    append(CH_VD, key, values.vd);
+    append(CH_VQ, key, values.vq);
+}
+
+/**
+ * @brief RtDataStore::column
+ * The samples of a channel, to be passed to QCPGraph::setData. The graph
+ * then shares the samples with the store.
+ */
+QSharedPointer<QCPGraphDataContainer> RtDataStore::column(int channel) const
+{
+    return mColumns.at(channel);
+}
+
+int RtDataStore::size(int channel) const
+{
+    return mColumns.at(channel)->size();
+}
+
+double RtDataStore::last(int channel) const
+{
+    auto col = mColumns.at(channel);
+    return col->isEmpty() ? 0.0 : (col->constEnd() - 1)->value;
+}
+
+void RtDataStore::trim(QCPGraphDataContainer *col)
+{
+    int over = col->size() - mCapacity;
+    if (over > 0) {
+        // Drops everything with a smaller key than the first sample to keep
+        col->removeBefore((col->constBegin() + over)->key);
+    }
+}
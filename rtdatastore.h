@@ -0,0 +1,82 @@
+/*
+    Copyright 2016 - 2024 Benjamin Vedder	benjamin@vedder.se
+
+    This file is part of VESC Tool.
+
+    VESC Tool is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    VESC Tool is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+#ifndef RTDATASTORE_H
+#define RTDATASTORE_H
+
+#include <QVector>
+#include <QSharedPointer>
+#include "widgets/qcustomplot.h"
+#include "datatypes.h"
+
+/**
+ * @brief The RtDataStore class
+ * Fixed capacity sample history with one column per channel. Every column
+ * is the data container of the graphs that show it, so plots read the
+ * samples in place and nothing is copied when they are redrawn.
+ *
+ * Old samples are dropped from the front of a column by moving its start
+ * into the preallocated space of the container, which costs the same as
+ * advancing the tail of a ring buffer. The memory is compacted once in a
+ * while, so appending a sample has constant amortized cost no matter how
+ * long the history is.
+ */
+class RtDataStore
+{
+public:
+    typedef enum {
+        CH_TEMP_MOS = 0,
+        CH_TEMP_MOS_1,
+        CH_TEMP_MOS_2,
+        CH_TEMP_MOS_3,
+        CH_TEMP_MOTOR,
+        CH_CURRENT_IN,
+        CH_CURRENT_MOTOR,
+        CH_ID,
+        CH_IQ,
+        CH_DUTY,
+        CH_RPM,
+        CH_VD,
+        CH_VQ,
+        CH_COUNT
+    } channel_t;
+
+    explicit RtDataStore(int channels = CH_COUNT, int capacity = 500);
+
+    int channels() const;
+    int capacity() const;
+    void setCapacity(int capacity);
+    void clear();
+
+    void append(int channel, double key, double value);
+    void appendValues(double key, const MC_VALUES &values);
+
+    QSharedPointer<QCPGraphDataContainer> column(int channel) const;
+    int size(int channel) const;
+    double last(int channel) const;
+
+private:
+    QVector<QSharedPointer<QCPGraphDataContainer>> mColumns;
+    int mCapacity;
+
+    void trim(QCPGraphDataContainer *col);
+
+};
+
+#endif // RTDATASTORE_H
@@ -442,7 +442,7 @@ bool AppNunchukPage::validatePage()
 
 void AppNunchukPage::initializePage()
 {
-    mParamTab->setRowCount(0);
+    mParamTab->clearParams();
 
     mParamTab->addParamRow(mVesc->appConfig(), "app_chuk_conf.ctrl_type");
     mParamTab->addParamRow(mVesc->appConfig(), "app_chuk_conf.ramp_time_pos");
@@ -548,7 +548,7 @@ bool AppPpmMapPage::validatePage()
 
 void AppPpmMapPage::initializePage()
 {
-    mParamTab->setRowCount(0);
+    mParamTab->clearParams();
 
     mParamTab->addParamRow(mVesc->appConfig(), "app_ppm_conf.pulse_start");
     mParamTab->addParamRow(mVesc->appConfig(), "app_ppm_conf.pulse_end");
@@ -618,7 +618,7 @@ bool AppPpmPage::validatePage()
 
 void AppPpmPage::initializePage()
 {
-    mParamTab->setRowCount(0);
+    mParamTab->clearParams();
 
     mParamTab->addRowSeparator(tr("General"));
     mParamTab->addParamRow(mVesc->appConfig(), "app_ppm_conf.ctrl_type");
@@ -679,7 +679,7 @@ bool AppAdcMapPage::validatePage()
 
 void AppAdcMapPage::initializePage()
 {
-    mParamTab->setRowCount(0);
+    mParamTab->clearParams();
 
     mParamTab->addParamRow(mVesc->appConfig(), "app_adc_conf.voltage_start");
     mParamTab->addParamRow(mVesc->appConfig(), "app_adc_conf.voltage_end");
@@ -766,7 +766,7 @@ bool AppAdcPage::validatePage()
 
 void AppAdcPage::initializePage()
 {
-    mParamTab->setRowCount(0);
+    mParamTab->clearParams();
 
     mParamTab->addRowSeparator(tr("General"));
     mParamTab->addParamRow(mVesc->appConfig(), "app_adc_conf.ctrl_type");
@@ -548,7 +548,7 @@ bool BldcPage::validatePage()
 
 void BldcPage::initializePage()
 {
-    mParamTab->setRowCount(0);
+    mParamTab->clearParams();
     mParamTab->addParamRow(mVesc->mcConfig(), "sl_cycle_int_limit");
     mParamTab->addParamRow(mVesc->mcConfig(), "sl_bemf_coupling_k");
     mParamTab->addRowSeparator(tr("Hall Sensor Settings"));
@@ -0,0 +1,176 @@
+/*
+    Copyright 2016 - 2024 Benjamin Vedder	benjamin@vedder.se
+
+    This file is part of VESC Tool.
+
+    VESC Tool is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    VESC Tool is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+#include "simvescresponder.h"
+#include "commands.h"
+#include "vbytearray.h"
+#include "virtualvesc.h"
+
+#include <QTimer>
+
+SimVescResponder::SimVescResponder(Commands *commands, QObject *parent) : QObject(parent)
+{
+    mCommands = commands;
+    mLocalId = 0;
+    mLatencyMs = 5;
+    mRequests = 0;
+    mTime.start();
+
+    connect(mCommands, &Commands::dataToSend, this, &SimVescResponder::dataToSend);
+}
+
+/**
+ * @brief SimVescResponder::setLocalId
+ * Set the controller ID the simulated VESC that is connected directly
+ * reports in its values.
+ */
+void SimVescResponder::setLocalId(int id)
+{
+    mLocalId = id;
+}
+
+void SimVescResponder::setLatencyMs(int ms)
+{
+    mLatencyMs = ms;
+}
+
+/**
+ * @brief SimVescResponder::addNode
+ * Add a simulated VESC.
+ *
+ * @param canId
+ * CAN ID of the VESC, or -1 for the VESC that is connected directly.
+ *
+ * @param detectMs
+ * Time the FOC detection takes.
+ *
+ * @param result
+ * Result the FOC detection replies with. For -100 + fault code the fault
+ * is also reported in the values during the second half of the detection.
+ */
+void SimVescResponder::addNode(int canId, int detectMs, int result)
+{
+    SimNode n;
+    n.detectMs = detectMs;
+    n.result = result;
+    n.busy = false;
+    n.startMs = 0;
+    n.tachometer = 0;
+    mNodes.insert(canId, n);
+}
+
+int SimVescResponder::requestCount() const
+{
+    return mRequests;
+}
+
+void SimVescResponder::dataToSend(QByteArray &data)
+{
+    VByteArray vb(data);
+    int canId = -1;
+
+    if (vb.size() >= 2 && quint8(vb.at(0)) == COMM_FORWARD_CAN) {
+        vb.vbPopFrontUint8();
+        canId = vb.vbPopFrontUint8();
+    }
+
+    // Nodes that do not exist do not reply
+    if (vb.isEmpty() || !mNodes.contains(canId)) {
+        return;
+    }
+
+    mRequests++;
+    COMM_PACKET_ID id = COMM_PACKET_ID(vb.vbPopFrontUint8());
+
+    switch (id) {
+    case COMM_GET_VALUES_SELECTIVE:
+        reply(valuesReply(canId, vb.vbPopFrontUint32()));
+        break;
+
+    case COMM_DETECT_APPLY_ALL_FOC: {
+        SimNode &n = mNodes[canId];
+        if (n.busy) {
+            break;
+        }
+
+        n.busy = true;
+        n.startMs = mTime.elapsed();
+
+        QTimer::singleShot(n.detectMs, this, [this, canId]() {
+            SimNode &n = mNodes[canId];
+            n.busy = false;
+
+            VByteArray vbRes;
+            vbRes.vbAppendInt8(COMM_DETECT_APPLY_ALL_FOC);
+            vbRes.vbAppendInt16(n.result);
+            reply(vbRes);
+        });
+    } break;
+
+    default:
+        break;
+    }
+}
+
+void SimVescResponder::reply(const QByteArray &data)
+{
+    Commands *commands = mCommands;
+    QTimer::singleShot(mLatencyMs, commands, [commands, data]() {
+        commands->processPacket(data);
+    });
+}
+
+QByteArray SimVescResponder::valuesReply(int canId, unsigned int mask)
+{
+    SimNode &n = mNodes[canId];
+
+    double current = 0.0;
+    double rpm = 0.0;
+    mc_fault_code fault = FAULT_CODE_NONE;
+
+    if (n.busy) {
+        double progress = double(mTime.elapsed() - n.startMs) / double(n.detectMs);
+        current = 5.0 + double(qMax(canId, 0) % 3);
+        rpm = progress > 0.5 ? 2000.0 * progress : 0.0;
+        n.tachometer += int(rpm / 100.0);
+
+        if (progress > 0.5 && n.result <= -100) {
+            fault = mc_fault_code(n.result + 100);
+        }
+    }
+
+    MC_VALUES v;
+    v.temp_mos = 25.0;
+    v.temp_mos_1 = 25.0;
+    v.temp_mos_2 = 25.0;
+    v.temp_mos_3 = 25.0;
+    v.temp_motor = 25.0;
+    v.current_motor = current;
+    v.current_in = current * 0.1;
+    v.iq = current;
+    v.duty_now = rpm > 0.0 ? 0.1 : 0.0;
+    v.rpm = rpm;
+    v.v_in = 48.0;
+    v.tachometer = n.tachometer;
+    v.tachometer_abs = n.tachometer;
+    v.fault_code = fault;
+    v.vesc_id = canId < 0 ? mLocalId : canId;
+
+    return VirtualVesc::valuesReply(v, true, mask);
+}
@@ -0,0 +1,75 @@
+/*
+    Copyright 2016 - 2024 Benjamin Vedder	benjamin@vedder.se
+
+    This file is part of VESC Tool.
+
+    VESC Tool is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    VESC Tool is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+#ifndef SIMVESCRESPONDER_H
+#define SIMVESCRESPONDER_H
+
+#include <QObject>
+#include <QMap>
+#include <QElapsedTimer>
+#include "datatypes.h"
+
+class Commands;
+
+/**
+ * @brief The SimVescResponder class
+ * Answers the packets a Commands object sends as a set of VESCs on a CAN
+ * bus would, without any hardware. Only the commands needed for FOC
+ * detection are simulated: COMM_DETECT_APPLY_ALL_FOC replies after the
+ * configured time with the configured result, and COMM_GET_VALUES_SELECTIVE
+ * reports current, speed and fault code while a detection is running. The
+ * values are encoded the same way as by VirtualVesc.
+ */
+class SimVescResponder : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit SimVescResponder(Commands *commands, QObject *parent = nullptr);
+
+    void setLocalId(int id);
+    void setLatencyMs(int ms);
+    void addNode(int canId, int detectMs, int result);
+    int requestCount() const;
+
+private slots:
+    void dataToSend(QByteArray &data);
+
+private:
+    struct SimNode {
+        int detectMs;
+        int result;
+        bool busy;
+        qint64 startMs;
+        int tachometer;
+    };
+
+    Commands *mCommands;
+    QMap<int, SimNode> mNodes;
+    QElapsedTimer mTime;
+    int mLocalId;
+    int mLatencyMs;
+    int mRequests;
+
+    void reply(const QByteArray &data);
+    QByteArray valuesReply(int canId, unsigned int mask);
+
+};
+
+#endif // SIMVESCRESPONDER_H
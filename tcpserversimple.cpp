@@ -38,8 +38,11 @@ TcpServerSimple::TcpServerSimple(QObject *parent) : QObject(parent)
 
 bool TcpServerSimple::startServer(int port, QHostAddress addr)
 {
-    mLastPort = port;
-    return mTcpServer->listen(addr,  port);
+    bool res = mTcpServer->listen(addr,  port);
+
+    // Port 0 picks a free port
+    mLastPort = res ? int(mTcpServer->serverPort()) : port;
+    return res;
 }
 
 bool TcpServerSimple::connectToHub(QString server, int port, QString id, QString pass)
@@ -0,0 +1,92 @@
+/*
+    Copyright 2016 - 2024 Benjamin Vedder	benjamin@vedder.se
+
+    This file is part of VESC Tool.
+
+    VESC Tool is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    VESC Tool is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+#include "focdetectortests.h"
+#include "commands.h"
+#include "simvescresponder.h"
+
+/**
+ * @brief FocDetectorTests::run
+ * Detect the local VESC and one VESC over CAN per result in parallel.
+ *
+ * @param results
+ * The detection result of every node, starting with the local VESC.
+ *
+ * @return
+ * The nodes when the detection has finished.
+ */
+QVector<FocDetector::Node> FocDetectorTests::run(const QVector<int> &results)
+{
+    Commands commands;
+    SimVescResponder sim(&commands);
+    sim.setLocalId(100);
+
+    // Long enough for the fault to be polled in the second half
+    const int detectMs = 1500;
+
+    QVector<FocDetector::Node> nodes;
+    for (int i = 0;i < results.size();i++) {
+        FocDetector::Node n;
+        n.canId = i == 0 ? -1 : i;
+        n.group = i;
+        nodes.append(n);
+        sim.addNode(n.canId, detectMs, results.at(i));
+    }
+
+    FocDetector::Params params;
+    params.maxConcurrent = results.size();
+    params.timeoutMs = 10000;
+
+    FocDetector detector(&commands);
+    QSignalSpy finished(&detector, &FocDetector::finished);
+    if (!detector.start(nodes, params)) {
+        return QVector<FocDetector::Node>();
+    }
+
+    finished.wait(params.timeoutMs + 1000);
+    return detector.nodes();
+}
+
+void FocDetectorTests::allNodesSucceed()
+{
+    auto nodes = run({0, 0, 0, 0});
+    QCOMPARE(nodes.size(), 4);
+
+    for (const auto &n: nodes) {
+        QCOMPARE(int(n.state), int(FocDetector::NODE_OK));
+    }
+}
+
+void FocDetectorTests::oneNodeFaults()
+{
+    const int fault = -100 + FAULT_CODE_UNDER_VOLTAGE;
+    auto nodes = run({0, 0, fault, 0});
+    QCOMPARE(nodes.size(), 4);
+
+    // The fault is matched to the node that reported it, and the other
+    // nodes in the same wave are not blamed for it
+    for (int i = 0;i < nodes.size();i++) {
+        if (i == 2) {
+            QCOMPARE(int(nodes.at(i).state), int(FocDetector::NODE_FAILED));
+            QCOMPARE(nodes.at(i).result, fault);
+        } else {
+            QCOMPARE(int(nodes.at(i).state), int(FocDetector::NODE_OK));
+        }
+    }
+}
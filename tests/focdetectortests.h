@@ -0,0 +1,43 @@
+/*
+    Copyright 2016 - 2024 Benjamin Vedder	benjamin@vedder.se
+
+    This file is part of VESC Tool.
+
+    VESC Tool is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    VESC Tool is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+#ifndef FOCDETECTORTESTS_H
+#define FOCDETECTORTESTS_H
+
+#include <QtTest>
+#include "focdetector.h"
+
+/**
+ * @brief The FocDetectorTests class
+ * Runs FocDetector against simulated VESCs on a CAN-bus.
+ */
+class FocDetectorTests : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void allNodesSucceed();
+    void oneNodeFaults();
+
+private:
+    QVector<FocDetector::Node> run(const QVector<int> &results);
+
+};
+
+#endif // FOCDETECTORTESTS_H
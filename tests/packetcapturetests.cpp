@@ -0,0 +1,94 @@
+/*
+    Copyright 2016 - 2024 Benjamin Vedder	benjamin@vedder.se
+
+    This file is part of VESC Tool.
+
+    VESC Tool is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    VESC Tool is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+#include "packetcapturetests.h"
+#include "packetcapture.h"
+
+namespace {
+// Not ASCII, to check that the names are read with the encoding they are
+// written with
+const QStringList transportNames = {"Serial", QString::fromUtf8("BLE \xc3\xa4")};
+}
+
+/**
+ * @brief PacketCaptureTests::writeCapture
+ * Capture one record per transport and direction, with increasing sizes.
+ *
+ * @return
+ * True if the capture could be opened.
+ */
+bool PacketCaptureTests::writeCapture(const QString &path)
+{
+    PacketCapture cap;
+    if (!cap.open(path, transportNames)) {
+        return false;
+    }
+
+    for (int i = 0;i < 4;i++) {
+        cap.record(i / 2, i % 2, QByteArray(10 + i * 100, char('a' + i)));
+    }
+
+    cap.close();
+    return true;
+}
+
+void PacketCaptureTests::roundTrip()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    QString path = dir.filePath("test.vcap");
+    QVERIFY(writeCapture(path));
+
+    QVector<PacketCapture::Record> records;
+    QStringList transports;
+    QDateTime start;
+    QVERIFY(PacketCapture::load(path, records, &transports, &start));
+
+    QCOMPARE(transports, transportNames);
+    QVERIFY(qAbs(start.msecsTo(QDateTime::currentDateTimeUtc())) < 60000);
+    QCOMPARE(records.size(), 4);
+
+    qint64 lastUs = 0;
+    for (int i = 0;i < records.size();i++) {
+        const auto &r = records.at(i);
+        QCOMPARE(r.transport, i / 2);
+        QCOMPARE(r.outbound, bool(i % 2));
+        QCOMPARE(r.data, QByteArray(10 + i * 100, char('a' + i)));
+        QVERIFY(r.timeUs >= lastUs);
+        lastUs = r.timeUs;
+    }
+}
+
+void PacketCaptureTests::truncatedLastRecord()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    QString path = dir.filePath("test.vcap");
+    QVERIFY(writeCapture(path));
+
+    // Cut the data of the last record short, as when the program is closed
+    // while capturing
+    QFile file(path);
+    QVERIFY(file.resize(file.size() - 5));
+
+    QVector<PacketCapture::Record> records;
+    QVERIFY(PacketCapture::load(path, records));
+    QCOMPARE(records.size(), 3);
+    QCOMPARE(records.last().data, QByteArray(210, 'c'));
+}
@@ -0,0 +1,23 @@
+#-------------------------------------------------
+#
+# Unit tests
+#
+#-------------------------------------------------
+
+# Build and run from a separate directory, e.g.
+#   mkdir build_tests && cd build_tests
+#   qmake ../tests/tests.pro && make -j8
+#   ./vesc_tool_tests
+
+include(../vesc_tool_testlib.pri)
+
+TARGET = vesc_tool_tests
+
+SOURCES += \
+    $$PWD/main.cpp \
+    $$PWD/focdetectortests.cpp \
+    $$PWD/packetcapturetests.cpp
+
+HEADERS += \
+    $$PWD/focdetectortests.h \
+    $$PWD/packetcapturetests.h
@@ -18,6 +18,7 @@
     */
 
 #include "utility.h"
+#include "configstore.h"
 #ifdef Q_OS_IOS
 #include "ios/src/setIosParameters.h"
 #endif
@@ -35,7 +36,7 @@
 #include <QFileInfo>
 #include <QtGlobal>
 #include <QNetworkInterface>
-#include <QDirIterator>
+#include <QElapsedTimer>
 #include <QPixmapCache>
 
 #ifdef Q_OS_ANDROID
@@ -423,6 +424,96 @@ void Utility::sleepWithEventLoop(int timeMs)
     QObject::disconnect(conn1);
 }
 
+/**
+ * @brief Utility::detectAllFocSummary
+ * Read back the motor configuration of the given VESCs after a detection
+ * and summarize the detected parameters.
+ *
+ * @param vesc
+ * Pointer to a connected VescInterface instance.
+ *
+ * @param includeCurrent
+ * Include the VESC that commands are currently sent to.
+ *
+ * @param canDevs
+ * CAN IDs of further VESCs to include.
+ *
+ * @return
+ * The summary.
+ */
+QString Utility::detectAllFocSummary(VescInterface *vesc, bool includeCurrent, QVector<int> canDevs)
+{
+    QString res;
+    ConfigParams *p = vesc->mcConfig();
+    ConfigParams *ap = vesc->appConfig();
+
+    // MCConf should have been sent after the detection
+    vesc->commands()->getAppConf();
+    waitSignal(ap, SIGNAL(updated()), 4000);
+
+    auto genRes = [&p, &ap]() {
+        QString sensors;
+        switch (p->getParamEnum("foc_sensor_mode")) {
+        case 0: sensors = "Sensorless"; break;
+        case 1: sensors = "Encoder"; break;
+        case 2: sensors = "Hall Sensors"; break;
+        default: break; }
+        return QString("VESC ID            : %1\n"
+                       "Motor current      : %2 A\n"
+                       "Motor R            : %3 mΩ\n"
+                       "Motor L            : %4 µH\n"
+                       "Motor Lq-Ld        : %5 µH\n"
+                       "Motor Flux Linkage : %6 mWb\n"
+                       "Temp Comp          : %7\n"
+                       "Sensors            : %8").
+                arg(ap->getParamInt("controller_id")).
+                arg(p->getParamDouble("l_current_max"), 0, 'f', 2).
+                arg(p->getParamDouble("foc_motor_r") * 1e3, 0, 'f', 2).
+                arg(p->getParamDouble("foc_motor_l") * 1e6, 0, 'f', 2).
+                arg(p->getParamDouble("foc_motor_ld_lq_diff") * 1e6, 0, 'f', 2).
+                arg(p->getParamDouble("foc_motor_flux_linkage") * 1e3, 0, 'f', 2).
+                arg(p->getParamBool("foc_temp_comp") ? "True" : "False").
+                arg(sensors);
+    };
+
+    if (includeCurrent) {
+        res = genRes();
+    }
+
+    int canLastFwd = vesc->commands()->getSendCan();
+    int canLastId = vesc->commands()->getCanSendId();
+    vesc->ignoreCanChange(true);
+
+    if (!canDevs.empty()) {
+        res += "\n\nVESCs on CAN-bus:";
+    }
+
+    for (int id: canDevs) {
+        vesc->commands()->setSendCan(true, id);
+        if (!checkFwCompatibility(vesc)) {
+            vesc->emitMessageDialog("FW Versions",
+                                    "All VESCs must have the latest firmware to perform this operation.",
+                                    false, false);
+            break;
+        }
+
+        vesc->commands()->getMcconf();
+        waitSignal(p, SIGNAL(updated()), 4000);
+        vesc->commands()->getAppConf();
+        waitSignal(ap, SIGNAL(updated()), 4000);
+        res += "\n\n" + genRes();
+    }
+
+    vesc->commands()->setSendCan(canLastFwd, canLastId);
+    vesc->ignoreCanChange(false);
+    vesc->commands()->getMcconf();
+    waitSignal(p, SIGNAL(updated()), 4000);
+    vesc->commands()->getAppConf();
+    waitSignal(ap, SIGNAL(updated()), 4000);
+
+    return res;
+}
+
 QString Utility::detectAllFoc(VescInterface *vesc,
                               bool detect_can, double max_power_loss, double min_current_in,
                               double max_current_in, double openloop_rpm, double sl_erpm)
@@ -467,120 +558,14 @@ QString Utility::detectAllFoc(VescInterface *vesc,
 
     if (timeoutTimer.isActive() && pollRes.isEmpty()) {
         if (resDetect >= 0) {
-            ConfigParams *p = vesc->mcConfig();
-            ConfigParams *ap = vesc->appConfig();
-
-            // MCConf should have been sent after the detection
-            vesc->commands()->getAppConf();
-            waitSignal(ap, SIGNAL(updated()), 4000);
-
-            auto genRes = [&p, &ap]() {
-                QString sensors;
-                switch (p->getParamEnum("foc_sensor_mode")) {
-                case 0: sensors = "Sensorless"; break;
-                case 1: sensors = "Encoder"; break;
-                case 2: sensors = "Hall Sensors"; break;
-                default: break; }
-                return QString("VESC ID            : %1\n"
-                               "Motor current      : %2 A\n"
-                               "Motor R            : %3 mΩ\n"
-                               "Motor L            : %4 µH\n"
-                               "Motor Lq-Ld        : %5 µH\n"
-                               "Motor Flux Linkage : %6 mWb\n"
-                               "Temp Comp          : %7\n"
-                               "Sensors            : %8").
-                        arg(ap->getParamInt("controller_id")).
-                        arg(p->getParamDouble("l_current_max"), 0, 'f', 2).
-                        arg(p->getParamDouble("foc_motor_r") * 1e3, 0, 'f', 2).
-                        arg(p->getParamDouble("foc_motor_l") * 1e6, 0, 'f', 2).
-                        arg(p->getParamDouble("foc_motor_ld_lq_diff") * 1e6, 0, 'f', 2).
-                        arg(p->getParamDouble("foc_motor_flux_linkage") * 1e3, 0, 'f', 2).
-                        arg(p->getParamBool("foc_temp_comp") ? "True" : "False").
-                        arg(sensors);
-            };
-
             QVector<int> canDevs;
             if (detect_can) {
-                if (!vesc->commands()->getSendCan()) {
-                    res = genRes();
-                }
-
                 canDevs = Utility::scanCanVescOnly(vesc);
-            } else {
-                res = genRes();
             }
 
-            int canLastFwd = vesc->commands()->getSendCan();
-            int canLastId = vesc->commands()->getCanSendId();
-            vesc->ignoreCanChange(true);
-
-            if (!canDevs.empty()) {
-                res += "\n\nVESCs on CAN-bus:";
-            }
-
-            for (int id: canDevs) {
-                vesc->commands()->setSendCan(true, id);
-                if (!checkFwCompatibility(vesc)) {
-                    vesc->emitMessageDialog("FW Versions",
-                                            "All VESCs must have the latest firmware to perform this operation.",
-                                            false, false);
-                    break;
-                }
-
-                vesc->commands()->getMcconf();
-                waitSignal(p, SIGNAL(updated()), 4000);
-                vesc->commands()->getAppConf();
-                waitSignal(ap, SIGNAL(updated()), 4000);
-                res += "\n\n" + genRes();
-            }
-
-            vesc->commands()->setSendCan(canLastFwd, canLastId);
-            vesc->ignoreCanChange(false);
-            vesc->commands()->getMcconf();
-            waitSignal(p, SIGNAL(updated()), 4000);
-            vesc->commands()->getAppConf();
-            waitSignal(ap, SIGNAL(updated()), 4000);
+            res = detectAllFocSummary(vesc, !detect_can || !vesc->commands()->getSendCan(), canDevs);
         } else {
-            QString reason;
-            switch (resDetect) {
-            case -1: reason = "Peristent fault, check realtime data page"; break;
-            case -10: reason = "Flux linkage detection failed"; break;
-            case -50: reason = "CAN detection timeout"; break;
-            case -51: reason = "CAN detection failed"; break;
-            case -100 + FAULT_CODE_NONE: reason = "No fault, detection failed for an unknown reason"; break;
-            case -100 + FAULT_CODE_OVER_VOLTAGE: reason = "Over voltage fault, check voltage is below set limit"; break;
-            case -100 + FAULT_CODE_UNDER_VOLTAGE: reason = "Under voltage fault, check voltage is above set limit. If using a power supply make sure the current limit is high enough."; break;
-            case -100 + FAULT_CODE_DRV: reason = "DRV fault, hardware fault occured. Check there are no shorts"; break;
-            case -100 + FAULT_CODE_ABS_OVER_CURRENT: reason = "Overcurrent fault, Check there are no shorts and ABS Overcurrent limit is sensible"; break;
-            case -100 + FAULT_CODE_OVER_TEMP_FET: reason = "Mosfet Overtemperature fault, Mosfets overheated, check for shorts. Cool down device"; break;
-            case -100 + FAULT_CODE_OVER_TEMP_MOTOR: reason = "Motor Overtemperature fault, Motor overheaded, is the current limit OK?"; break;
-            case -100 + FAULT_CODE_GATE_DRIVER_OVER_VOLTAGE: reason = "Gate Driver over voltage, check for hardware failure"; break;
-            case -100 + FAULT_CODE_GATE_DRIVER_UNDER_VOLTAGE: reason = "Gate Driver under voltage, check for hardware failure"; break;
-            case -100 + FAULT_CODE_MCU_UNDER_VOLTAGE: reason = "MCU under voltage, check for hardware failure, shorts on outputs"; break;
-            case -100 + FAULT_CODE_BOOTING_FROM_WATCHDOG_RESET: reason = "Boot from watchdog reset, software locked up check for firmware corruption"; break;
-            case -100 + FAULT_CODE_ENCODER_SPI: reason = "Encoder SPI fault, check encoder connections"; break;
-            case -100 + FAULT_CODE_ENCODER_SINCOS_BELOW_MIN_AMPLITUDE: reason = "Encoder SINCOS below min amplitude, check encoder connections and magnet alignment / distance"; break;
-            case -100 + FAULT_CODE_ENCODER_SINCOS_ABOVE_MAX_AMPLITUDE: reason = "Encoder SINCOS above max amplitude, check encoder connections and magnet alignment / distance"; break;
-            case -100 + FAULT_CODE_FLASH_CORRUPTION: reason = "Flash corruption, reflash firmware immediately!"; break;
-            case -100 + FAULT_CODE_HIGH_OFFSET_CURRENT_SENSOR_1: reason = "High offset on current sensor 1, check for hardware failure"; break;
-            case -100 + FAULT_CODE_HIGH_OFFSET_CURRENT_SENSOR_2: reason = "High offset on current sensor 2, check for hardware failure"; break;
-            case -100 + FAULT_CODE_HIGH_OFFSET_CURRENT_SENSOR_3: reason = "High offset on current sensor 3, check for hardware failure"; break;
-            case -100 + FAULT_CODE_UNBALANCED_CURRENTS: reason = "Unbalanced currents, check for hardware failure"; break;
-            case -100 + FAULT_CODE_BRK: reason = "BRK, hardware protection triggered, check for shorts or possible hardware failure"; break;
-            case -100 + FAULT_CODE_RESOLVER_LOT: reason = "Encoder/Resolver: Loss of tracking"; break;
-            case -100 + FAULT_CODE_RESOLVER_DOS: reason = "Encoder/Resolver: Degradation of signal"; break;
-            case -100 + FAULT_CODE_RESOLVER_LOS: reason = "Encoder/Resolver: Loss of signal"; break;
-            case -100 + FAULT_CODE_FLASH_CORRUPTION_APP_CFG: reason = "Flash corruption, App config corrupt, rewrite app config to restore"; break;
-            case -100 + FAULT_CODE_FLASH_CORRUPTION_MC_CFG: reason = "Flash corruption, Motor config corrupt, rewrite motor config to restore"; break;
-            case -100 + FAULT_CODE_ENCODER_NO_MAGNET: reason = "Encoder no magnet, magnet is too weak or too far from the encoder"; break;
-            case -100 + FAULT_CODE_ENCODER_MAGNET_TOO_STRONG: reason = "Magnet too strong, magnet is too strong or too close to the encoder"; break;
-            case -100 + FAULT_CODE_PHASE_FILTER: reason = "Phase filter fault, invalid phase filter readings"; break;
-            case -100 + FAULT_CODE_ENCODER_FAULT: reason = "Encoder fault, check encoder connections and alignment"; break;
-
-            default: reason = QString::number(resDetect); break;
-            }
-
-            res = QString("Detection failed. Reason:\n%1").arg(reason);
+            res = QString("Detection failed. Reason:\n%1").arg(detectAllFocResultToStr(resDetect));
             detectOk = false;
         }
     } else {
@@ -601,6 +586,60 @@ QString Utility::detectAllFoc(VescInterface *vesc,
     return res;
 }
 
+/**
+ * @brief Utility::detectAllFocResultToStr
+ * Convert the result of COMM_DETECT_APPLY_ALL_FOC to a description.
+ *
+ * @param result
+ * The result code. Negative values are errors.
+ *
+ * @return
+ * Human readable reason for the result.
+ */
+QString Utility::detectAllFocResultToStr(int result)
+{
+    QString reason;
+    switch (result) {
+    case -1: reason = "Peristent fault, check realtime data page"; break;
+    case -10: reason = "Flux linkage detection failed"; break;
+    case -50: reason = "CAN detection timeout"; break;
+    case -51: reason = "CAN detection failed"; break;
+    case -100 + FAULT_CODE_NONE: reason = "No fault, detection failed for an unknown reason"; break;
+    case -100 + FAULT_CODE_OVER_VOLTAGE: reason = "Over voltage fault, check voltage is below set limit"; break;
+    case -100 + FAULT_CODE_UNDER_VOLTAGE: reason = "Under voltage fault, check voltage is above set limit. If using a power supply make sure the current limit is high enough."; break;
+    case -100 + FAULT_CODE_DRV: reason = "DRV fault, hardware fault occured. Check there are no shorts"; break;
+    case -100 + FAULT_CODE_ABS_OVER_CURRENT: reason = "Overcurrent fault, Check there are no shorts and ABS Overcurrent limit is sensible"; break;
+    case -100 + FAULT_CODE_OVER_TEMP_FET: reason = "Mosfet Overtemperature fault, Mosfets overheated, check for shorts. Cool down device"; break;
+    case -100 + FAULT_CODE_OVER_TEMP_MOTOR: reason = "Motor Overtemperature fault, Motor overheaded, is the current limit OK?"; break;
+    case -100 + FAULT_CODE_GATE_DRIVER_OVER_VOLTAGE: reason = "Gate Driver over voltage, check for hardware failure"; break;
+    case -100 + FAULT_CODE_GATE_DRIVER_UNDER_VOLTAGE: reason = "Gate Driver under voltage, check for hardware failure"; break;
+    case -100 + FAULT_CODE_MCU_UNDER_VOLTAGE: reason = "MCU under voltage, check for hardware failure, shorts on outputs"; break;
+    case -100 + FAULT_CODE_BOOTING_FROM_WATCHDOG_RESET: reason = "Boot from watchdog reset, software locked up check for firmware corruption"; break;
+    case -100 + FAULT_CODE_ENCODER_SPI: reason = "Encoder SPI fault, check encoder connections"; break;
+    case -100 + FAULT_CODE_ENCODER_SINCOS_BELOW_MIN_AMPLITUDE: reason = "Encoder SINCOS below min amplitude, check encoder connections and magnet alignment / distance"; break;
+    case -100 + FAULT_CODE_ENCODER_SINCOS_ABOVE_MAX_AMPLITUDE: reason = "Encoder SINCOS above max amplitude, check encoder connections and magnet alignment / distance"; break;
+    case -100 + FAULT_CODE_FLASH_CORRUPTION: reason = "Flash corruption, reflash firmware immediately!"; break;
+    case -100 + FAULT_CODE_HIGH_OFFSET_CURRENT_SENSOR_1: reason = "High offset on current sensor 1, check for hardware failure"; break;
+    case -100 + FAULT_CODE_HIGH_OFFSET_CURRENT_SENSOR_2: reason = "High offset on current sensor 2, check for hardware failure"; break;
+    case -100 + FAULT_CODE_HIGH_OFFSET_CURRENT_SENSOR_3: reason = "High offset on current sensor 3, check for hardware failure"; break;
+    case -100 + FAULT_CODE_UNBALANCED_CURRENTS: reason = "Unbalanced currents, check for hardware failure"; break;
+    case -100 + FAULT_CODE_BRK: reason = "BRK, hardware protection triggered, check for shorts or possible hardware failure"; break;
+    case -100 + FAULT_CODE_RESOLVER_LOT: reason = "Encoder/Resolver: Loss of tracking"; break;
+    case -100 + FAULT_CODE_RESOLVER_DOS: reason = "Encoder/Resolver: Degradation of signal"; break;
+    case -100 + FAULT_CODE_RESOLVER_LOS: reason = "Encoder/Resolver: Loss of signal"; break;
+    case -100 + FAULT_CODE_FLASH_CORRUPTION_APP_CFG: reason = "Flash corruption, App config corrupt, rewrite app config to restore"; break;
+    case -100 + FAULT_CODE_FLASH_CORRUPTION_MC_CFG: reason = "Flash corruption, Motor config corrupt, rewrite motor config to restore"; break;
+    case -100 + FAULT_CODE_ENCODER_NO_MAGNET: reason = "Encoder no magnet, magnet is too weak or too far from the encoder"; break;
+    case -100 + FAULT_CODE_ENCODER_MAGNET_TOO_STRONG: reason = "Magnet too strong, magnet is too strong or too close to the encoder"; break;
+    case -100 + FAULT_CODE_PHASE_FILTER: reason = "Phase filter fault, invalid phase filter readings"; break;
+    case -100 + FAULT_CODE_ENCODER_FAULT: reason = "Encoder fault, check encoder connections and alignment"; break;
+
+    default: reason = QString::number(result); break;
+    }
+
+    return reason;
+}
+
 QVector<double> Utility::measureRLBlocking(VescInterface *vesc)
 {
     QVector<double> res;
@@ -688,107 +727,63 @@ bool Utility::waitMotorStop(VescInterface *vesc, double erpmTres, int timeoutMs)
     return t.isActive();
 }
 
+/**
+ * @brief Utility::resetInputCan
+ * Restore the default app configuration on all VESCs on the CAN-bus (including the
+ * local one), keeping their CAN-ID and CAN status messages. VESCs that already have
+ * that configuration are not written.
+ *
+ * @param vesc
+ * VescInterface pointer
+ *
+ * @param canIds
+ * A list with CAN-IDs to reset
+ *
+ * @return
+ * True for success, false otherwise.
+ */
 bool Utility::resetInputCan(VescInterface *vesc, QVector<int> canIds)
 {
-    bool res = true;
-
-    bool canLastFwd = vesc->commands()->getSendCan();
-    int canLastId = vesc->commands()->getCanSendId();
-
-    vesc->ignoreCanChange(true);
-
-    auto update = [vesc]() {
-        bool res = true;
-        ConfigParams *ap = vesc->appConfig();
-
-        if (isConnectedToHwVesc(vesc)) {
-            if (!checkFwCompatibility(vesc)) {
-                vesc->emitMessageDialog("FW Versions",
-                                        "All VESCs must have the latest firmware to perform this operation.",
-                                        false, false);
-                res = false;
-                qWarning() << "Incompatible firmware";
-                return false;
-            }
-
-            vesc->commands()->getAppConf();
-            res = waitSignal(ap, SIGNAL(updated()), 4000);
-
-            if (!res) {
-                qWarning() << "Appconf not received";
-                return false;
-            }
-
-            int canId = ap->getParamInt("controller_id");
-
-            int canStatus;
-            int canStatus2;
-            bool has_bitfield_params = ap->hasParam("can_status_msgs_r1");
-            if (has_bitfield_params) {
-                canStatus = ap->getParamInt("can_status_msgs_r1");
-                canStatus2 = ap->getParamInt("can_status_msgs_r2");
-            } else {
-                canStatus = ap->getParamEnum("send_can_status");
-            }
-
-            vesc->commands()->getAppConfDefault();
-            res = waitSignal(ap, SIGNAL(updated()), 4000);
-
-            if (!res) {
-                qWarning() << "Default appconf not received";
-                return false;
-            }
+    ConfigParams *ap = vesc->appConfig();
 
-            ap->updateParamInt("controller_id", canId);
-            if (has_bitfield_params) {
-                ap->updateParamInt("can_status_msgs_r1", canStatus);
-                ap->updateParamInt("can_status_msgs_r2", canStatus2);
-            } else {
-                ap->updateParamEnum("send_can_status", canStatus);
-            }
+    auto prepare = [vesc, ap]() {
+        ConfigParams current;
+        current = *ap;
 
-            vesc->commands()->setAppConf();
-            res = waitSignal(vesc->commands(), SIGNAL(ackReceived(QString)), 4000);
+        int canId = ap->getParamInt("controller_id");
 
-            if (!res) {
-                qWarning() << "Appconf set no ack received";
-                return false;
-            }
+        int canStatus;
+        int canStatus2 = 0;
+        bool has_bitfield_params = ap->hasParam("can_status_msgs_r1");
+        if (has_bitfield_params) {
+            canStatus = ap->getParamInt("can_status_msgs_r1");
+            canStatus2 = ap->getParamInt("can_status_msgs_r2");
+        } else {
+            canStatus = ap->getParamEnum("send_can_status");
         }
 
-        return res;
-    };
-
-    // Local VESC first
-    vesc->commands()->setSendCan(false);
-    res = update();
-
-    // All VESCs on CAN-bus
-    if (res) {
-        for (int id: canIds) {
-            vesc->commands()->setSendCan(true, id);
-
-            res = update();
-            if (!res) {
-                break;
-            }
+        vesc->commands()->getAppConfDefault();
+        if (!waitSignal(ap, SIGNAL(updated()), 4000)) {
+            qWarning() << "Default appconf not received";
+            return -1;
         }
-    }
 
-    vesc->commands()->setSendCan(canLastFwd, canLastId);
-
-    if (isConnectedToHwVesc(vesc)) {
-        vesc->commands()->getAppConf();
-        ConfigParams *ap = vesc->appConfig();
-        if (!waitSignal(ap, SIGNAL(updated()), 4000)) {
-            qWarning() << "Appconf not received";
-            res = false;
+        ap->updateParamInt("controller_id", canId);
+        if (has_bitfield_params) {
+            ap->updateParamInt("can_status_msgs_r1", canStatus);
+            ap->updateParamInt("can_status_msgs_r2", canStatus2);
+        } else {
+            ap->updateParamEnum("send_can_status", canStatus);
         }
-    }
 
-    vesc->ignoreCanChange(false);
+        return paramsDiffer(ap, &current, ap->getParamOrder()) ? 1 : 0;
+    };
 
-    return res;
+    return writeConfigAllCan(vesc, canIds, ap, "App Configuration",
+                             [vesc]() { vesc->commands()->getAppConf(); },
+                             prepare,
+                             [vesc]() { vesc->commands()->setAppConf(); },
+                             "APPCONF Write OK");
 }
 
 bool Utility::setBatteryCutCan(VescInterface *vesc, QVector<int> canIds, double cutStart, double cutEnd)
@@ -843,87 +838,263 @@ bool Utility::setBatteryCutCanFromCurrentConfig(VescInterface *vesc, QVector<int
  * True for success, false otherwise.
  */
 bool Utility::setMcParamsFromCurrentConfigAllCan(VescInterface *vesc, QVector<int> canIds, QStringList params)
+{
+    ConfigParams *config = vesc->mcConfig();
+    ConfigParams wanted;
+    wanted = *config;
+
+    auto prepare = [config, &wanted, &params]() {
+        if (!paramsDiffer(config, &wanted, params)) {
+            return 0;
+        }
+
+        for (const auto &p: params) {
+            config->updateParamFromOther(p, wanted.getParamCopy(p), nullptr);
+        }
+
+        return 1;
+    };
+
+    return writeConfigAllCan(vesc, canIds, config, "Motor Configuration",
+                             [vesc]() { vesc->commands()->getMcconf(); },
+                             prepare,
+                             [vesc]() { vesc->commands()->setMcconf(false); },
+                             "MCCONF Write OK");
+}
+
+/**
+ * @brief Utility::writeConfigAllCan
+ * Update a configuration on all VESCs on the CAN-bus (including the local one). For
+ * each VESC the configuration is read, prepare is called to modify it, and it is
+ * only written if prepare reports a difference. The write is confirmed by its ack.
+ *
+ * The replies do not carry the CAN-ID of the sender, so requests can only be
+ * pipelined when their replies can be told apart by type. The write ack is a short
+ * single-frame reply, so the write to one VESC is left in flight while the next
+ * VESC is read. At most one write is outstanding.
+ *
+ * @param config
+ * The configuration that read and write use.
+ *
+ * @param name
+ * Name of the configuration in messages to the user.
+ *
+ * @param read
+ * Request the configuration, which then updates config.
+ *
+ * @param prepare
+ * Modify config after it has been read. Returns 1 if it has to be written, 0 if
+ * the VESC already has it and -1 on errors.
+ *
+ * @param write
+ * Send config.
+ *
+ * @param ackMsg
+ * The message of Commands::ackReceived that confirms the write.
+ *
+ * @return
+ * True for success, false otherwise.
+ */
+bool Utility::writeConfigAllCan(VescInterface *vesc, QVector<int> canIds, ConfigParams *config,
+                                QString name, std::function<void()> read,
+                                std::function<int()> prepare, std::function<void()> write,
+                                QString ackMsg)
 {
     bool res = true;
 
-    ConfigParams *config = vesc->mcConfig();
-    QVector<QPair<QString, ConfigParam>> paramVec;
+    struct NodeResult {
+        int canId;
+        QString status;
+        qint64 ms;
+    };
 
-    for (auto s: params) {
-        paramVec.append(qMakePair(s, config->getParamCopy(s)));
-    }
+    QVector<NodeResult> results;
+    int ackPending = -1;
+    QElapsedTimer totalTimer;
+    QElapsedTimer ackTimer;
+    totalTimer.start();
+
+    auto ackConn = connect(vesc->commands(), &Commands::ackReceived, [&](QString msg) {
+        if (msg == ackMsg && ackPending >= 0) {
+            results[ackPending].status = "written";
+            results[ackPending].ms += ackTimer.elapsed();
+            ackPending = -1;
+        }
+    });
 
-    auto updateConf = [&vesc, &config, &paramVec]() {
-        if (!checkFwCompatibility(vesc)) {
-            vesc->emitMessageDialog("FW Versions",
-                                    "All VESCs must have the latest firmware to perform this operation.",
+    auto waitAck = [&]() {
+        QElapsedTimer t;
+        t.start();
+        while (ackPending >= 0 && t.elapsed() < 4000) {
+            waitSignal(vesc->commands(), SIGNAL(ackReceived(QString)), 4000 - int(t.elapsed()));
+        }
+
+        if (ackPending >= 0) {
+            results[ackPending].status = "write not acknowledged";
+            ackPending = -1;
+            vesc->emitMessageDialog("Write " + name,
+                                    "Could not write " + name.toLower() + ".",
                                     false, false);
             return false;
         }
 
-        vesc->commands()->getMcconf();
+        return true;
+    };
 
-        if (!waitSignal(config, SIGNAL(updated()), 4000)) {
-            vesc->emitMessageDialog("Read Motor Configuration",
-                                    "Could not read motor configuration.",
-                                    false, false);
+    QVector<int> nodes;
+    nodes.append(-1);
+    nodes.append(canIds);
 
-            return false;
+    for (int id: nodes) {
+        QElapsedTimer t;
+        t.start();
+
+        NodeResult entry;
+        entry.canId = id;
+        entry.ms = 0;
+        results.append(entry);
+        NodeResult &node = results.last();
+
+        vesc->canTmpOverride(id >= 0, id);
+
+        // One version request answers both the hardware type and compatibility
+        FW_RX_PARAMS fw;
+        if (!getFwVersionBlocking(vesc, &fw) || fw.hwType != HW_TYPE_VESC) {
+            node.status = "skipped";
+            node.ms = t.elapsed();
+            continue;
         }
 
-        for (auto p: paramVec) {
-            config->updateParamFromOther(p.first, p.second, nullptr);
+        if (!vesc->getSupportedFirmwarePairs().contains(qMakePair(fw.major, fw.minor))) {
+            vesc->emitMessageDialog("FW Versions",
+                                    "All VESCs must have the latest firmware to perform this operation.",
+                                    false, false);
+            node.status = "incompatible firmware";
+            res = false;
+            break;
         }
 
-        vesc->commands()->setMcconf(false);
+        read();
+        int prepared = waitSignal(config, SIGNAL(updated()), 4000) ? prepare() : -1;
 
-        if (!waitSignal(vesc->commands(), SIGNAL(ackReceived(QString)), 4000)) {
-            vesc->emitMessageDialog("Write Motor Configuration",
-                                    "Could not write motor configuration.",
+        if (prepared < 0) {
+            vesc->emitMessageDialog("Read " + name,
+                                    "Could not read " + name.toLower() + ".",
                                     false, false);
+            node.status = "read failed";
+            res = false;
+            break;
+        }
 
-            return false;
+        if (prepared == 0) {
+            node.status = "unchanged";
+            node.ms = t.elapsed();
+            continue;
         }
 
-        return true;
-    };
+        // The previous write has to be confirmed before config is sent again
+        if (!waitAck()) {
+            res = false;
+            break;
+        }
 
-    // Start with local VESC
-    vesc->canTmpOverride(false, 0);
+        write();
+        node.status = "write pending";
+        node.ms = t.elapsed();
+        ackPending = results.size() - 1;
+        ackTimer.start();
+    }
 
-    if (isConnectedToHwVesc(vesc)) {
-        res = updateConf();
+    if (!waitAck()) {
+        res = false;
     }
 
-    // Now every VESC on the CAN-bus
-    if (res) {
-        for (int id: canIds) {
-            vesc->canTmpOverride(true, id);
+    disconnect(ackConn);
+    vesc->canTmpOverrideEnd();
 
-            if (isConnectedToHwVesc(vesc)) {
-                res = updateConf();
-                if (!res) {
-                    break;
-                }
-            }
+    int written = 0;
+    int unchanged = 0;
+    QStringList lines;
+    for (const auto &r: results) {
+        lines.append(QString("%1: %2 in %3 ms").
+                     arg(r.canId >= 0 ? QString("CAN %1").arg(r.canId) : QString("local")).
+                     arg(r.status).arg(r.ms));
+
+        if (r.status == "written") {
+            written++;
+        } else if (r.status == "unchanged") {
+            unchanged++;
         }
     }
+    lines.append(QString("%1 VESCs in %2 ms").arg(results.size()).arg(totalTimer.elapsed()));
 
-    vesc->canTmpOverrideEnd();
+    for (const auto &l: lines) {
+        qDebug() << name << l;
+    }
 
-    vesc->commands()->getMcconf();
+    vesc->emitStatusMessage(QString("%1: %2 written, %3 unchanged").
+                            arg(name).arg(written).arg(unchanged), res);
+
+    read();
     if (!waitSignal(config, SIGNAL(updated()), 4000)) {
         res = false;
+        vesc->emitMessageDialog("Read " + name,
+                                "Could not read " + name.toLower() + ".",
+                                false, false);
+    }
 
-        if (!res) {
-            vesc->emitMessageDialog("Read Motor Configuration",
-                                    "Could not read motor configuration.",
-                                    false, false);
+    return res;
+}
+
+/**
+ * @brief Utility::paramsDiffer
+ * Check if any of the given parameters differs between two configurations.
+ * Doubles are compared within the resolution they are sent with, so that a
+ * value that was rounded when read back from a VESC is not a difference.
+ *
+ * @return
+ * True if at least one parameter differs.
+ */
+bool Utility::paramsDiffer(ConfigParams *a, ConfigParams *b, const QStringList &params)
+{
+    for (const auto &name: params) {
+        ConfigParam *pa = a->getParam(name);
+        ConfigParam *pb = b->getParam(name);
+
+        if (!pa || !pb || !pa->transmittable) {
+            continue;
         }
-    }
 
+        switch (pa->type) {
+        case CFG_T_DOUBLE: {
+            double eps;
+            if (pa->vTx == VESC_TX_DOUBLE16 || pa->vTx == VESC_TX_DOUBLE32) {
+                eps = 0.5 / pa->vTxDoubleScale;
+            } else {
+                // Sent as a float
+                eps = qMax(fabs(pa->valDouble), fabs(pb->valDouble)) * 1e-6;
+            }
 
-    return res;
+            if (fabs(pa->valDouble - pb->valDouble) > eps) {
+                return true;
+            }
+        } break;
+
+        case CFG_T_QSTRING:
+            if (pa->valString != pb->valString) {
+                return true;
+            }
+            break;
+
+        default:
+            if (pa->valInt != pb->valInt) {
+                return true;
+            }
+            break;
+        }
+    }
+
+    return false;
 }
 
 bool Utility::setInvertDirection(VescInterface *vesc, int canId, bool inverted)
@@ -1526,6 +1697,74 @@ MC_VALUES Utility::getMcValuesBlocking(VescInterface *vesc)
     return res;
 }
 
+/**
+ * @brief Utility::getMcValuesBlockingAll
+ * Read selected values from the local VESC and from all given CAN IDs with
+ * a single round trip, see Commands::getValuesSelectiveAll.
+ *
+ * @param vesc
+ * Pointer to a connected VescInterface instance.
+ *
+ * @param canIds
+ * CAN IDs to read from in addition to the local VESC.
+ *
+ * @param mask
+ * Values to read.
+ *
+ * @param timeoutMs
+ * Maximum time to wait for all replies.
+ *
+ * @return
+ * The received values keyed by CAN ID, with the local VESC at key -1.
+ * Nodes that did not reply in time are missing.
+ */
+QMap<int, MC_VALUES> Utility::getMcValuesBlockingAll(VescInterface *vesc, QVector<int> canIds,
+                                                      unsigned int mask, int timeoutMs)
+{
+    QMap<int, MC_VALUES> res;
+    QEventLoop loop;
+    QTimer timeoutTimer;
+    timeoutTimer.setSingleShot(true);
+
+    // The local VESC replies with its own controller ID. Replies from any
+    // other node, e.g. periodic values packets, are not part of the result.
+    int localId = vesc->appConfig()->getParamInt("controller_id");
+
+    auto conn = connect(vesc->commands(), &Commands::valuesReceived,
+                        [&](MC_VALUES val, unsigned int maskRx) {
+        if (!(maskRx & (uint32_t(1) << 17)) || val.vesc_id == 255) {
+            return;
+        }
+
+        if (canIds.contains(val.vesc_id)) {
+            res.insert(val.vesc_id, val);
+        } else if (val.vesc_id == localId) {
+            res.insert(-1, val);
+        } else {
+            return;
+        }
+
+        bool allReceived = res.contains(-1);
+        for (auto id: canIds) {
+            allReceived = allReceived && res.contains(id);
+        }
+
+        if (allReceived) {
+            loop.quit();
+        }
+    });
+
+    connect(&timeoutTimer, SIGNAL(timeout()), &loop, SLOT(quit()));
+
+    vesc->commands()->getValuesSelectiveAll(canIds, mask);
+    timeoutTimer.start(timeoutMs);
+    loop.exec();
+
+    disconnect(conn);
+
+    return res;
+}
+
 bool Utility::checkFwCompatibility(VescInterface *vesc)
 {
     bool res = false;
@@ -1713,86 +1952,37 @@ void Utility::enuToLlh(const double *iLlh, const double *xyz, double *llh)
 
 bool Utility::configCheckCompatibility(int fwMajor, int fwMinor)
 {
-    QDirIterator it("://res/config");
-
-    while (it.hasNext()) {
-        QFileInfo fi(it.next());
-        QStringList names = fi.fileName().split("_o_");
-
-        if (fi.isDir()) {
-            for(auto name: names) {
-                auto parts = name.split(".");
-                if (parts.size() == 2) {
-                    int major = parts.at(0).toInt();
-                    int minor = parts.at(1).toInt();
-                    if (major == fwMajor && minor == fwMinor) {
-                        return true;
-                    }
-                }
-            }
-        }
-    }
-
-    return false;
+    return ConfigStore::bundled().hasVersion(fwMajor, fwMinor);
 }
 
 bool Utility::configLoad(VescInterface *vesc, int fwMajor, int fwMinor)
 {
-    QDirIterator it("://res/config");
-
-    while (it.hasNext()) {
-        QFileInfo fi(it.next());
-        QStringList names = fi.fileName().split("_o_");
-
-        if (fi.isDir()) {
-            for(auto name: names) {
-                auto parts = name.split(".");
-                if (parts.size() == 2) {
-                    int major = parts.at(0).toInt();
-                    int minor = parts.at(1).toInt();
-                    if (major == fwMajor && minor == fwMinor) {
-                        QFileInfo fMc(it.filePath() + "/parameters_mcconf.xml");
-                        QFileInfo fApp(it.filePath() + "/parameters_appconf.xml");
-                        QFileInfo fInfo(it.filePath() + "/info.xml");
-
-                        if (fMc.exists() && fApp.exists() && fInfo.exists()) {
-                            vesc->mcConfig()->loadParamsXml(fMc.absoluteFilePath());
-                            vesc->appConfig()->loadParamsXml(fApp.absoluteFilePath());
-                            vesc->infoConfig()->loadParamsXml(fInfo.absoluteFilePath());
-                            vesc->emitConfigurationChanged();
-                            return true;
-                        } else {
-                            qWarning() << "Configurations not found in firmware directory" << it.path();
-                            return false;
-                        }
-                    }
-                }
-            }
-        }
+    const ConfigStore &store = ConfigStore::bundled();
+
+    if (!store.hasVersion(fwMajor, fwMinor)) {
+        return false;
     }
 
-    return false;
+    QString name = QString("%1.%2").arg(fwMajor).arg(fwMinor, 2, 10, QLatin1Char('0'));
+
+    if (store.loadParams(fwMajor, fwMinor, ConfigStore::CONFIG_MCCONF, vesc->mcConfig()) &&
+            store.loadParams(fwMajor, fwMinor, ConfigStore::CONFIG_APPCONF, vesc->appConfig()) &&
+            store.loadParams(fwMajor, fwMinor, ConfigStore::CONFIG_INFO, vesc->infoConfig())) {
+        vesc->emitConfigurationChanged();
+        return true;
+    } else {
+        qWarning() << "Could not load configuration for FW" << name << "from the config store";
+        return false;
+    }
 }
 
 QPair<int, int> Utility::configLatestSupported()
 {
     QPair<int, int> res = qMakePair(-1, -1);
-    QDirIterator it("://res/config");
-
-    while (it.hasNext()) {
-        QFileInfo fi(it.next());
-        QStringList names = fi.fileName().split("_o_");
-
-        if (fi.isDir()) {
-            for(auto name: names) {
-                auto parts = name.split(".");
-                if (parts.size() == 2) {
-                    QPair<int, int> ver = qMakePair(parts.at(0).toInt(), parts.at(1).toInt());
-                    if (ver > res) {
-                        res = ver;
-                    }
-                }
-            }
+
+    for (auto ver: ConfigStore::bundled().versions()) {
+        if (ver > res) {
+            res = ver;
         }
     }
 
@@ -1813,26 +2003,7 @@ bool Utility::configLoadLatest(VescInterface *vesc)
 
 QVector<QPair<int, int> > Utility::configSupportedFws()
 {
-    QVector<QPair<int, int>> res;
-    QDirIterator it("://res/config");
-
-    while (it.hasNext()) {
-        QFileInfo fi(it.next());
-        QStringList names = fi.fileName().split("_o_");
-
-        if (fi.isDir()) {
-            for(auto name: names) {
-                auto parts = name.split(".");
-                if (parts.size() == 2) {
-                    int major = parts.at(0).toInt();
-                    int minor = parts.at(1).toInt();
-                    res.append(qMakePair(major, minor));
-                }
-            }
-        }
-    }
-
-    return res;
+    return ConfigStore::bundled().versions();
 }
 
 bool Utility::configLoadCompatible(VescInterface *vesc, QString &uuidRx)
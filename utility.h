@@ -23,6 +23,7 @@
 #include <QObject>
 #include <QMetaEnum>
 #include <cstdint>
+#include <functional>
 #include <QQuickWindow>
 #include <QtGui/qpa/qplatformwindow.h>
 #include "vescinterface.h"
@@ -61,6 +62,8 @@ public:
     Q_INVOKABLE static QString detectAllFoc(VescInterface *vesc,
                                             bool detect_can, double max_power_loss, double min_current_in,
                                             double max_current_in, double openloop_rpm, double sl_erpm);
+    static QString detectAllFocSummary(VescInterface *vesc, bool includeCurrent, QVector<int> canDevs);
+    static QString detectAllFocResultToStr(int result);
     Q_INVOKABLE static QVector<double> measureRLBlocking(VescInterface *vesc);
     Q_INVOKABLE static double measureLinkageOpenloopBlocking(VescInterface *vesc, double current, double erpm_per_sec, double low_duty,
                                                              double resistance, double inductance);
@@ -86,6 +89,8 @@ public:
     Q_INVOKABLE static FW_RX_PARAMS getFwVersionBlocking(VescInterface *vesc);
     Q_INVOKABLE static FW_RX_PARAMS getFwVersionBlockingCan(VescInterface *vesc, int canId);
     Q_INVOKABLE static MC_VALUES getMcValuesBlocking(VescInterface *vesc);
+    static QMap<int, MC_VALUES> getMcValuesBlockingAll(VescInterface *vesc, QVector<int> canIds,
+                                                       unsigned int mask, int timeoutMs);
     static bool checkFwCompatibility(VescInterface *vesc);
     Q_INVOKABLE static QVariantList getNetworkAddresses();
     Q_INVOKABLE static void startGnssForegroundService();
@@ -147,6 +152,11 @@ private:
     static void serialFunc(ConfigParams *params, QTextStream &s);
     static void deserialFunc(ConfigParams *params, QTextStream &s);
     static void defaultFunc(ConfigParams *params, QTextStream &s);
+    static bool writeConfigAllCan(VescInterface *vesc, QVector<int> canIds, ConfigParams *config,
+                                  QString name, std::function<void()> read,
+                                  std::function<int()> prepare, std::function<void()> write,
+                                  QString ackMsg);
+    static bool paramsDiffer(ConfigParams *a, ConfigParams *b, const QStringList &params);
 
     static QMap<QString,QColor> mAppColors;
     static bool isDark;
@@ -28,7 +28,8 @@ DEFINES += VT_IS_TEST_VERSION=$$VT_IS_TEST_VERSION
 QT_LOGGING_RULES="qt.qml.connections=false"
 #CONFIG += qtquickcompiler
 
-CONFIG += c++11
+# std::ranges is used by the anticogging calibration
+CONFIG += c++2a
 CONFIG += resources_big
 ios: {
     QMAKE_CXXFLAGS_DEBUG += -Wall
@@ -100,6 +101,7 @@ unix: {
 QT       += core gui
 QT       += widgets
 QT       += network
+QT       += concurrent
 QT       += quick
 QT       += quickcontrols2
 QT       += quickwidgets
@@ -206,7 +208,23 @@ SOURCES += main.cpp\
     codeloader.cpp \
     mainwindow.cpp \
     boardsetupwindow.cpp \
+    boardsetup.cpp \
     packet.cpp \
+    iothread.cpp \
+    packetbridge.cpp \
+    experimentrunner.cpp \
+    productionline.cpp \
+    focdetector.cpp \
+    simvescresponder.cpp \
+    rtdatastore.cpp \
+    anticoggingmodel.cpp \
+    configstore.cpp \
+    devicedatacache.cpp \
+    connectsequence.cpp \
+    commandreply.cpp \
+    linkstats.cpp \
+    virtualvesc.cpp \
+    packetcapture.cpp \
     preferences.cpp \
     tcphub.cpp \
     udpserversimple.cpp \
@@ -217,6 +235,7 @@ SOURCES += main.cpp\
     vescinterface.cpp \
     parametereditor.cpp \
     digitalfiltering.cpp \
+    fftw3wrapper.cpp \
     setupwizardapp.cpp \
     setupwizardmotor.cpp \
     startupwizard.cpp \
@@ -228,7 +247,23 @@ HEADERS  += mainwindow.h \
     bleuartdummy.h \
     codeloader.h \
     boardsetupwindow.h \
+    boardsetup.h \
     packet.h \
+    iothread.h \
+    packetbridge.h \
+    experimentrunner.h \
+    productionline.h \
+    focdetector.h \
+    simvescresponder.h \
+    rtdatastore.h \
+    anticoggingmodel.h \
+    configstore.h \
+    devicedatacache.h \
+    connectsequence.h \
+    commandreply.h \
+    linkstats.h \
+    virtualvesc.h \
+    packetcapture.h \
     preferences.h \
     tcphub.h \
     udpserversimple.h \
@@ -240,6 +275,7 @@ HEADERS  += mainwindow.h \
     vescinterface.h \
     parametereditor.h \
     digitalfiltering.h \
+    fftw3wrapper.h \
     setupwizardapp.h \
     setupwizardmotor.h \
     startupwizard.h \
@@ -252,6 +288,11 @@ FORMS    += mainwindow.ui \
     parametereditor.ui \
     preferences.ui
 
+# The Visual Studio project links FFTW on its own
+!win32-msvc*: {
+    LIBS += -lfftw3
+}
+
 contains(DEFINES, HAS_BLUETOOTH) {
     SOURCES += bleuart.cpp
     HEADERS += bleuart.h
@@ -272,6 +313,19 @@ RESOURCES += res.qrc \
     res_qml.qrc
 RESOURCES += res_config.qrc
 
+# res_config.qrc bundles the packed configurations instead of the XML files.
+# Fail the build if they were not packed again after an XML file changed.
+win32: VT_PYTHON = python
+else: VT_PYTHON = python3
+config_check.target = $$OUT_PWD/config_store.stamp
+config_check.depends = $$PWD/res/config/pack_configs.py \
+    $$PWD/res/config/config_store.bin \
+    $$files($$PWD/res/config/*.xml, true)
+config_check.commands = $$VT_PYTHON $$shell_path($$PWD/res/config/pack_configs.py) \
+    --check $$shell_path($$OUT_PWD/config_store.stamp)
+QMAKE_EXTRA_TARGETS += config_check
+PRE_TARGETDEPS += $$OUT_PWD/config_store.stamp
+
 !exclude_fw {
     RESOURCES += res_fw_bms.qrc
     RESOURCES += res/firmwares/res_fw.qrc
@@ -0,0 +1,29 @@
+#-------------------------------------------------
+#
+# QtTest programs built against the application
+#
+#-------------------------------------------------
+
+# Included by tests/tests.pro and benchmarks/benchmarks.pro. The programs
+# are built against the same sources and options as the application,
+# except for its main file.
+
+VT_ROOT = $$PWD
+
+include($$VT_ROOT/vesc_tool.pro)
+
+# vesc_tool.pro lists its own files relative to the directory it is in
+for(var, $$list(SOURCES HEADERS FORMS RESOURCES)) {
+    files = $$eval($$var)
+    $$var =
+    for(f, files): $$var += $$absolute_path($$f, $$VT_ROOT)
+}
+
+SOURCES -= $$VT_ROOT/main.cpp
+INCLUDEPATH += $$VT_ROOT
+
+QT += testlib
+CONFIG += console testcase
+CONFIG -= app_bundle
+
+DESTDIR =
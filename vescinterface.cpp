@@ -23,6 +23,7 @@
 #include <QFileInfo>
 #include <QThread>
 #include <QEventLoop>
+#include <QQueue>
 #include <cmath>
 #include <QRegularExpression>
 #include <QDateTime>
@@ -51,6 +52,9 @@
 #define VT_INTRO_VERSION 1
 #endif
 
+// Indexed by conn_t
+static const char *connTypeNames[] = {"None", "Serial", "CAN bus", "TCP", "BLE", "UDP", "TCP Hub"};
+
 VescInterface::VescInterface(QObject* parent) : QObject(parent)
 {
 	mMcConfig = new ConfigParams(this);
@@ -62,8 +66,18 @@ VescInterface::VescInterface(QObject* parent) : QObject(parent)
 	mQmlHwLoaded = false;
 	mQmlAppLoaded = false;
 	mPacket = new Packet(this);
+	mIo = new IoThread(this);
 	mCommands = new Commands(this);
 
+	// Created after the I/O thread, so that it is deleted after the thread has stopped
+	mCapture = new PacketCapture(this);
+	mIo->setCapture(mCapture, CONN_SERIAL);
+	mCaptureReplay = new CaptureReplay(this);
+	mCaptureReplay->setPacket(mPacket);
+	connect(mCaptureReplay, &CaptureReplay::finished, [this]() {
+		emitStatusMessage(tr("Capture replay finished"), true);
+		});
+
 	// Compatible firmwares
 	mFwVersionReceived = false;
 	mFwRetries = 0;
@@ -130,14 +144,11 @@ VescInterface::VescInterface(QObject* parent) : QObject(parent)
 
 	// Serial
 #ifdef HAS_SERIALPORT
-	mSerialPort = new QSerialPort(this);
 	mLastSerialPort = mSettings.value("serial_port", "").toString();
 	mLastSerialBaud = mSettings.value("serial_baud", 115200).toInt();
 
-	connect(mSerialPort, SIGNAL(readyRead()),
-		this, SLOT(serialDataAvailable()));
-	connect(mSerialPort, SIGNAL(error(QSerialPort::SerialPortError)),
-		this, SLOT(serialPortError(QSerialPort::SerialPortError)));
+	connect(mIo, SIGNAL(serialError(QString)),
+		this, SLOT(serialPortError(QString)));
 #endif
 
 	// CANbus
@@ -217,29 +228,30 @@ VescInterface::VescInterface(QObject* parent) : QObject(parent)
 	connect(mPacket, &Packet::packetReceived, [this](QByteArray& packet) {
 		mTcpServer->packet()->sendPacket(packet);
 		});
+	connect(mIo, &IoThread::packetReceived, [this](QByteArray& packet) {
+		mTcpServer->packet()->sendPacket(packet);
+		});
 
 	mTimerBroadcast = new QTimer(this);
 	mTimerBroadcast->setInterval(1000);
 	mTimerBroadcast->start();
 	connect(mTimerBroadcast, &QTimer::timeout, [this]() {
-		if (mTcpServer->isServerRunning() && isPortConnected()) {
+		if (mBridge->isTcpRunning() && isPortConnected()) {
 			QUdpSocket* udp = new QUdpSocket(this);
 			QString dgram = QString("%1::%2::%3").
 				arg(getLastFwRxParams().hw).
 				arg(Utility::getNetworkAddresses().first().toString()).
-				arg(mTcpServer->lastPort());
+				arg(mBridge->lastTcpPort());
 			udp->writeDatagram(dgram.toLocal8Bit().data(), dgram.size(), QHostAddress::Broadcast, 65109);
 		}
 		});
 
-	mUdpServer = new UdpServerSimple(this);
-	mUdpServer->setUsePacket(true);
-	connect(mUdpServer->packet(), &Packet::packetReceived, [this](QByteArray& packet) {
-		mPacket->sendPacket(packet);
-		});
-	connect(mPacket, &Packet::packetReceived, [this](QByteArray& packet) {
-		mUdpServer->packet()->sendPacket(packet);
+	mBridge = new PacketBridge(this);
+	mBridge->setIoThread(mIo);
+	connect(mBridge, &PacketBridge::frameToVesc, [this](QByteArray frame) {
+		packetDataToSend(frame);
 		});
+	connect(mIo, &IoThread::frameReceived, mBridge, &PacketBridge::vescFrame, Qt::DirectConnection);
 
 	{
 		int size = mSettings.beginReadArray("profiles");
@@ -314,12 +326,24 @@ VescInterface::VescInterface(QObject* parent) : QObject(parent)
 	mCommands->setAppConfig(mAppConfig);
 	mCommands->setMcConfig(mMcConfig);
 
+	mConnectSequence = new ConnectSequence(mCommands, mMcConfig, mAppConfig, &mDeviceDataCache, this);
+	connect(mConnectSequence, &ConnectSequence::stageFinished, this, &VescInterface::connectStageFinished);
+	connect(mConnectSequence, &ConnectSequence::interactive, [this](QString transport, qint64 ms) {
+		emitStatusMessage(tr("Ready after %1 ms over %2").arg(ms).arg(transport), true);
+		});
+	connect(mConnectSequence, &ConnectSequence::finished, [this]() {
+		qCDebug(lcConnect) << "Device data cache:" << mDeviceDataCache.statsString();
+		qCDebug(lcConnect).noquote() << "Time to interactive per transport:\n" + mConnectSequence->transportReport();
+		});
+
 	// Other signals/slots
 	connect(mTimer, SIGNAL(timeout()), this, SLOT(timerSlot()));
 	connect(mPacket, SIGNAL(dataToSend(QByteArray&)),
 		this, SLOT(packetDataToSend(QByteArray&)));
 	connect(mPacket, SIGNAL(packetReceived(QByteArray&)),
 		this, SLOT(packetReceived(QByteArray&)));
+	connect(mIo, SIGNAL(packetReceived(QByteArray&)),
+		this, SLOT(packetReceived(QByteArray&)));
 	connect(mCommands, SIGNAL(dataToSend(QByteArray&)),
 		this, SLOT(cmdDataToSend(QByteArray&)));
 	connect(mCommands, SIGNAL(fwVersionReceived(FW_RX_PARAMS)),
@@ -517,6 +541,7 @@ VescInterface::~VescInterface()
 {
 	storeSettings();
 	closeRtLogFile();
+	closeCaptureFile();
 
 	if (mWakeLockActive) {
 		setWakeLock(false);
@@ -530,6 +555,21 @@ Commands* VescInterface::commands() const
 	return mCommands;
 }
 
+IoThread* VescInterface::ioThread() const
+{
+	return mIo;
+}
+
+/**
+ * @brief VescInterface::sendPacket
+ * Send a payload that already is encoded, e.g. by something that does not
+ * go through Commands. CAN forwarding is not added.
+ */
+void VescInterface::sendPacket(const QByteArray &data)
+{
+	mPacket->sendPacket(data);
+}
+
 ConfigParams* VescInterface::mcConfig()
 {
 	return mMcConfig;
@@ -1027,7 +1067,7 @@ bool VescInterface::swdEraseFlash()
 }
 
 bool VescInterface::swdUploadFw(QByteArray newFirmware, uint32_t startAddr,
-	bool verify, bool isLzo)
+	bool verify, bool isLzo, int pipelineDepth)
 {
 	bool supportsLzo = mCommands->getLimitedCompatibilityCommands().
 		contains(int(COMM_BM_WRITE_FLASH_LZO));
@@ -1036,6 +1076,13 @@ bool VescInterface::swdUploadFw(QByteArray newFirmware, uint32_t startAddr,
 		supportsLzo = false;
 	}
 
+	if (verify && mCommands->isLimitedMode() &&
+		!mCommands->getLimitedCompatibilityCommands().contains(int(COMM_BM_MEM_READ))) {
+		verify = false;
+	}
+
+	pipelineDepth = qMax(pipelineDepth, 1);
+
 	auto waitBmWriteRes = [this]() {
 		int res = -10;
 
@@ -1055,32 +1102,25 @@ bool VescInterface::swdUploadFw(QByteArray newFirmware, uint32_t startAddr,
 		return res;
 		};
 
-	auto writeChunk = [this, &waitBmWriteRes, &verify]
-	(uint32_t addr, QByteArray chunk, QByteArray chunkLzo) {
-		for (int i = 0; i < 3; i++) {
-			if (chunkLzo.isEmpty()) {
-				mCommands->bmWriteFlash(addr, chunk);
-			}
-			else {
-				mCommands->bmWriteFlashLzo(addr, quint16(chunk.size()), chunkLzo);
-			}
-
-			int res = waitBmWriteRes();
-
-			if (verify && (!mCommands->isLimitedMode() ||
-				mCommands->getLimitedCompatibilityCommands().
-				contains(int(COMM_BM_MEM_READ)))) {
-				QByteArray rdData = mCommands->bmReadMemWait(addr, quint16(chunk.size()));
-
-				if (rdData.size() != chunk.size()) {
-					return -11;
-				}
+	struct SwdChunk {
+		uint32_t addr;
+		QByteArray data;
+		QByteArray dataLzo;
+	};
 
-				if (rdData != chunk) {
-					return -12;
-				}
-			}
+	auto sendChunk = [this](const SwdChunk &c) {
+		if (c.dataLzo.isEmpty()) {
+			mCommands->bmWriteFlash(c.addr, c.data);
+		}
+		else {
+			mCommands->bmWriteFlashLzo(c.addr, quint16(c.data.size()), c.dataLzo);
+		}
+		};
 
+	auto writeChunk = [&sendChunk, &waitBmWriteRes](const SwdChunk &c) {
+		for (int i = 0; i < 3; i++) {
+			sendChunk(c);
+			int res = waitBmWriteRes();
 			if (res != -10) {
 				return res;
 			}
@@ -1089,80 +1129,252 @@ bool VescInterface::swdUploadFw(QByteArray newFirmware, uint32_t startAddr,
 		return -20;
 		};
 
+	auto errorMsg = [](int res) {
+		QString msg = "Unknown failure";
+
+		if (res == -20) {
+			msg = "Timed out";
+		}
+		else if (res == -2) {
+			msg = "Write failed";
+		}
+		else if (res == -1) {
+			msg = "Not connected to target";
+		}
+		else if (res == -11) {
+			msg = "Verification failed (-11)";
+		}
+		else if (res == -12) {
+			msg = "Verification failed (-12)";
+		}
+
+		return msg;
+		};
+
 	mCancelSwdUpload = false;
-	int addr = int(startAddr);
 	int szTot = newFirmware.size();
 	int uploadSize = 2;
 	int compChunks = 0;
 	int nonCompChunks = 0;
 
-	while (newFirmware.size() > 0) {
-		const int chunkSize = 400;
+	QVector<SwdChunk> chunks;
+	const int chunkSize = 400;
 
-		int sz = newFirmware.size() > chunkSize ? chunkSize : newFirmware.size();
+	for (int pos = 0; pos < szTot; pos += chunkSize) {
+		int sz = qMin(chunkSize, szTot - pos);
+
+		SwdChunk c;
+		c.addr = startAddr + uint32_t(pos);
+		c.data = newFirmware.mid(pos, sz);
 
-		QByteArray in = newFirmware.mid(0, sz);
 		std::size_t outMaxSize = chunkSize + chunkSize / 16 + 64 + 3;
 		unsigned char out[1000];
 		std::size_t out_len = sz;
 
 		if (supportsLzo && isLzo) {
-			lzokay::EResult error = lzokay::compress((const uint8_t*)in.constData(), sz, out, outMaxSize, out_len);
+			lzokay::EResult error = lzokay::compress((const uint8_t*)c.data.constData(), sz, out, outMaxSize, out_len);
 			if (error < lzokay::EResult::Success) {
 				qWarning() << "LZO Compress Error" << int(error);
 				isLzo = false;
 			}
 		}
 
-		int res = 1;
 		if (supportsLzo && isLzo && (out_len + 2) < uint32_t(sz)) {
 			compChunks++;
 			uploadSize += out_len + 2;
-			res = writeChunk(uint32_t(addr), in, QByteArray((const char*)out, int(out_len)));
+			c.dataLzo = QByteArray((const char*)out, int(out_len));
 		}
 		else {
 			nonCompChunks++;
 			uploadSize += sz;
-			res = writeChunk(uint32_t(addr), in, QByteArray());
 		}
 
-		newFirmware.remove(0, sz);
-		addr += sz;
+		chunks.append(c);
+	}
 
-		if (res == 1) {
-			emit fwUploadStatus("Uploading firmware over SWD", double(addr - startAddr) / double(szTot), true);
+	// Keep up to pipelineDepth writes in flight. The bridge answers in order,
+	// so replies are matched to the oldest outstanding chunk.
+	QQueue<int> pending;
+	QQueue<int> replies;
+	QEventLoop loop;
+	QTimer timeoutTimer;
+	timeoutTimer.setSingleShot(true);
+	connect(&timeoutTimer, SIGNAL(timeout()), &loop, SLOT(quit()));
+	auto conn = connect(mCommands, &Commands::bmWriteFlashRes, [&replies, &loop](int wrRes) {
+		replies.enqueue(wrRes);
+		loop.quit();
+		});
+
+	int next = 0;
+	int done = 0;
+	int res = 1;
+
+	while (res == 1 && (next < chunks.size() || !pending.isEmpty())) {
+		while (next < chunks.size() && pending.size() < pipelineDepth) {
+			sendChunk(chunks.at(next));
+			pending.enqueue(next++);
+		}
+
+		if (replies.isEmpty()) {
+			timeoutTimer.start(3000);
+			loop.exec();
+		}
+
+		if (replies.isEmpty()) {
+			// A reply got lost. Let the rest of the pipeline drain, then
+			// rewrite whatever is still outstanding one chunk at a time.
+			disconnect(conn);
+			Utility::sleepWithEventLoop(100);
+			replies.clear();
+
+			while (!pending.isEmpty() && res == 1) {
+				res = writeChunk(chunks.at(pending.dequeue()));
+				done++;
+			}
+
+			conn = connect(mCommands, &Commands::bmWriteFlashRes, [&replies, &loop](int wrRes) {
+				replies.enqueue(wrRes);
+				loop.quit();
+				});
 		}
 		else {
-			QString msg = "Unknown failure";
+			res = replies.dequeue();
+			pending.dequeue();
+			done++;
+		}
 
-			if (res == -20) {
-				msg = "Timed out";
+		if (res == 1) {
+			double progress = double(done) / double(chunks.size());
+			if (verify) {
+				progress *= 0.5;
 			}
-			else if (res == -2) {
-				msg = "Write failed";
+			emit fwUploadStatus("Uploading firmware over SWD", progress, true);
+		}
+
+		if (mCancelSwdUpload) {
+			disconnect(conn);
+			emit fwUploadStatus("Upload cancelled", 0.0, false);
+			return false;
+		}
+	}
+
+	disconnect(conn);
+
+	if (res == 1 && verify) {
+		// Deferred verification: read everything back with several reads in
+		// flight and only deal with the chunks that do not match.
+		QQueue<QByteArray> readReplies;
+		auto connRead = connect(mCommands, &Commands::bmReadMemRes,
+			[&readReplies, &loop](int rdRes, QByteArray data) {
+				(void)rdRes;
+				readReplies.enqueue(data);
+				loop.quit();
+			});
+
+		QVector<QByteArray> readBack(chunks.size());
+		next = 0;
+		done = 0;
+		pending.clear();
+
+		while (next < chunks.size() || !pending.isEmpty()) {
+			while (next < chunks.size() && pending.size() < pipelineDepth) {
+				mCommands->bmReadMem(chunks.at(next).addr, quint16(chunks.at(next).data.size()));
+				pending.enqueue(next++);
 			}
-			else if (res == -1) {
-				msg = "Not connected to target";
+
+			if (readReplies.isEmpty()) {
+				timeoutTimer.start(3000);
+				loop.exec();
 			}
-			else if (res == -11) {
-				msg = "Verification failed (-11)";
+
+			if (readReplies.isEmpty()) {
+				disconnect(connRead);
+				Utility::sleepWithEventLoop(100);
+				readReplies.clear();
+
+				while (!pending.isEmpty()) {
+					int ind = pending.dequeue();
+					readBack[ind] = mCommands->bmReadMemWait(chunks.at(ind).addr,
+						quint16(chunks.at(ind).data.size()));
+					done++;
+				}
+
+				connRead = connect(mCommands, &Commands::bmReadMemRes,
+					[&readReplies, &loop](int rdRes, QByteArray data) {
+						(void)rdRes;
+						readReplies.enqueue(data);
+						loop.quit();
+					});
 			}
-			else if (res == -12) {
-				msg = "Verification failed (-12)";
+			else {
+				readBack[pending.dequeue()] = readReplies.dequeue();
+				done++;
 			}
 
-			emitMessageDialog("SWD Upload", msg, false, false);
-			emit fwUploadStatus(msg, 0.0, false);
+			emit fwUploadStatus("Verifying firmware over SWD",
+				0.5 + 0.5 * double(done) / double(chunks.size()), true);
 
-			return false;
+			if (mCancelSwdUpload) {
+				disconnect(connRead);
+				emit fwUploadStatus("Upload cancelled", 0.0, false);
+				return false;
+			}
 		}
 
-		if (mCancelSwdUpload) {
-			emit fwUploadStatus("Upload cancelled", 0.0, false);
-			return false;
+		disconnect(connRead);
+
+		int rewritten = 0;
+		for (int i = 0; i < chunks.size() && res == 1; i++) {
+			const auto &c = chunks.at(i);
+			if (readBack.at(i) == c.data) {
+				continue;
+			}
+
+			if (readBack.at(i).size() != c.data.size()) {
+				readBack[i] = mCommands->bmReadMemWait(c.addr, quint16(c.data.size()));
+				if (readBack.at(i).size() != c.data.size()) {
+					res = -11;
+					break;
+				}
+			}
+
+			// Flash cannot be rewritten without an erase, so only chunks
+			// that never got written can be repaired.
+			bool isErased = true;
+			for (auto b : readBack.at(i)) {
+				if (b != (char)0xff) {
+					isErased = false;
+					break;
+				}
+			}
+
+			if (readBack.at(i) != c.data && !isErased) {
+				res = -12;
+				break;
+			}
+
+			if (readBack.at(i) != c.data) {
+				res = writeChunk(c);
+				rewritten++;
+
+				if (res == 1 && mCommands->bmReadMemWait(c.addr, quint16(c.data.size())) != c.data) {
+					res = -12;
+				}
+			}
+		}
+
+		if (rewritten > 0) {
+			qDebug() << "SWD verification rewrote" << rewritten << "chunks";
 		}
 	}
 
+	if (res != 1) {
+		QString msg = errorMsg(res);
+		emitMessageDialog("SWD Upload", msg, false, false);
+		emit fwUploadStatus(msg, 0.0, false);
+		return false;
+	}
+
 	if (supportsLzo && isLzo) {
 		qDebug() << "Uploaded:" << uploadSize << "Initial Size:" << szTot << "Compression Ratio:"
 			<< double(uploadSize) / double(szTot) << "Compressed chunks:" << compChunks
@@ -1226,29 +1438,15 @@ bool VescInterface::swdReboot()
 
 bool VescInterface::fwEraseNewApp(bool fwdCan, quint32 fwSize)
 {
-	auto waitEraseRes = [this]() {
-		int res = -10;
-
-		QEventLoop loop;
-		QTimer timeoutTimer;
-		timeoutTimer.setSingleShot(true);
-		timeoutTimer.start(20000);
-		auto conn = connect(mCommands, &Commands::eraseNewAppResReceived,
-			[&res, &loop](bool erRes) {
-				res = erRes ? 1 : -1;
-				loop.quit();
-			});
-
-		connect(&timeoutTimer, SIGNAL(timeout()), &loop, SLOT(quit()));
-		loop.exec();
-
-		disconnect(conn);
-		return res;
-		};
-
-	mCommands->eraseNewApp(fwdCan, fwSize, mLastFwParams.hwType, mLastFwParams.hw);
+	auto reply = mCommands->request(COMM_ERASE_NEW_APP, [=]() {
+		mCommands->eraseNewApp(fwdCan, fwSize, mLastFwParams.hwType, mLastFwParams.hw);
+		}, nullptr, 20000, 1);
 	emit fwUploadStatus("Erasing buffer...", 0.0, true);
-	int erRes = waitEraseRes();
+	int erRes = -10;
+	if (reply->waitForFinished()) {
+		erRes = (!reply->data().isEmpty() && reply->data().at(0)) ? 1 : -1;
+	}
+	reply->deleteLater();
 	if (erRes != 1) {
 		QString msg = QString("Unknown failure: %1").arg(erRes);
 
@@ -1272,29 +1470,15 @@ bool VescInterface::fwEraseNewApp(bool fwdCan, quint32 fwSize)
 
 bool VescInterface::fwEraseBootloader(bool fwdCan)
 {
-	auto waitEraseRes = [this]() {
-		int res = -10;
-
-		QEventLoop loop;
-		QTimer timeoutTimer;
-		timeoutTimer.setSingleShot(true);
-		timeoutTimer.start(20000);
-		auto conn = connect(mCommands, &Commands::eraseBootloaderResReceived,
-			[&res, &loop](bool erRes) {
-				res = erRes ? 1 : -1;
-				loop.quit();
-			});
-
-		connect(&timeoutTimer, SIGNAL(timeout()), &loop, SLOT(quit()));
-		loop.exec();
-
-		disconnect(conn);
-		return res;
-		};
-
-	mCommands->eraseBootloader(fwdCan, mLastFwParams.hwType, mLastFwParams.hw);
+	auto reply = mCommands->request(COMM_ERASE_BOOTLOADER, [=]() {
+		mCommands->eraseBootloader(fwdCan, mLastFwParams.hwType, mLastFwParams.hw);
+		}, nullptr, 20000, 1);
 	emit fwUploadStatus("Erasing bootloader...", 0.0, true);
-	int erRes = waitEraseRes();
+	int erRes = -10;
+	if (reply->waitForFinished()) {
+		erRes = (!reply->data().isEmpty() && reply->data().at(0)) ? 1 : -1;
+	}
+	reply->deleteLater();
 	if (erRes != 1) {
 		QString msg = "Unknown failure";
 
@@ -1407,41 +1591,34 @@ bool VescInterface::fwUpload(QByteArray& newFirmware, bool isBootloader, bool fw
 	}
 
 	auto writeChunk = [this, &fwdCan](uint32_t addr, QByteArray chunk, bool fwIsLzo, quint16 decompressedLen) {
-		for (int i = 0; i < 3; i++) {
-			int res = -10;
-			QEventLoop loop;
-			QTimer timeoutTimer;
-			timeoutTimer.setSingleShot(true);
-			timeoutTimer.start(3000);
-			auto conn = connect(mCommands, &Commands::writeNewAppDataResReceived,
-				[&res, &loop](bool ok, bool hasOffset, quint32 offset) {
-					(void)offset;
-					(void)hasOffset;
-					res = ok ? 1 : -1;
-					loop.quit();
-				});
-
+		auto send = [this, fwdCan, addr, chunk, fwIsLzo, decompressedLen]() {
 			if (fwIsLzo) {
 				mCommands->writeNewAppDataLzo(chunk, addr, decompressedLen, fwdCan);
 			}
 			else {
 				mCommands->writeNewAppData(chunk, addr, fwdCan, mLastFwParams.hwType, mLastFwParams.hw);
 			}
+			};
 
-			connect(&timeoutTimer, SIGNAL(timeout()), &loop, SLOT(quit()));
-			loop.exec();
-			disconnect(conn);
+		// Replies from newer firmwares carry the offset, so that a late reply to
+		// an earlier chunk is not taken for this one.
+		auto match = [addr](VByteArray vb) {
+			vb.vbPopFrontInt8();
+			return vb.size() < 4 || vb.vbPopFrontUint32() == addr;
+			};
 
-			if (res != 1) {
-				qDebug() << "Write chunk failed:" << res << "LZO:" << fwIsLzo << "Addr:" << addr << "Size:" << chunk.size();
-			}
+		auto reply = mCommands->request(COMM_WRITE_NEW_APP_DATA, send, match, 3000, 3);
+		int res = -20;
+		if (reply->waitForFinished()) {
+			res = (!reply->data().isEmpty() && reply->data().at(0)) ? 1 : -1;
+		}
 
-			if (res != -10) {
-				return res;
-			}
+		if (res != 1) {
+			qDebug() << "Write chunk failed:" << res << "LZO:" << fwIsLzo << "Addr:" << addr << "Size:" << chunk.size() << "Tries:" << reply->tries();
 		}
 
-		return -20;
+		reply->deleteLater();
+		return res;
 		};
 
 	int addr = 0;
@@ -1956,6 +2133,113 @@ LOG_DATA VescInterface::getRtLogSampleAtValTimeFromStart(int time)
 	return d;
 }
 
+/**
+ * @brief VescInterface::openCaptureFile
+ * Record all raw data sent and received on the link to a capture file
+ * until closeCaptureFile is called. See PacketCapture for the format.
+ *
+ * @param path
+ * The file to write.
+ *
+ * @return
+ * True if the file could be opened.
+ */
+bool VescInterface::openCaptureFile(QString path)
+{
+	if (path.startsWith("file:/")) {
+		path.remove(0, 6);
+	}
+
+	QStringList transports;
+	for (auto name : connTypeNames) {
+		transports.append(name);
+	}
+
+	if (!mCapture->open(path, transports)) {
+		emitMessageDialog(tr("Packet Capture"),
+			tr("Could not open %1 for writing").arg(path),
+			false, false);
+		return false;
+	}
+
+	return true;
+}
+
+void VescInterface::closeCaptureFile()
+{
+	mCapture->close();
+}
+
+bool VescInterface::isCaptureOpen()
+{
+	return mCapture->isOpen();
+}
+
+QString VescInterface::captureFilePath()
+{
+	return mCapture->path();
+}
+
+/**
+ * @brief VescInterface::replayCaptureFile
+ * Feed the received data in a capture file to the packet decoder, so that
+ * the pages, plots and logging get the data of the captured session
+ * without a VESC. Only possible while disconnected.
+ *
+ * @param path
+ * The capture file.
+ *
+ * @param realTime
+ * Keep the original timing, otherwise replay as fast as possible.
+ *
+ * @return
+ * True if the replay was started.
+ */
+bool VescInterface::replayCaptureFile(QString path, bool realTime)
+{
+	if (path.startsWith("file:/")) {
+		path.remove(0, 6);
+	}
+
+	if (isPortConnected()) {
+		emitMessageDialog(tr("Replay Capture"),
+			tr("Disconnect before replaying a capture."),
+			false, false);
+		return false;
+	}
+
+	if (!mCaptureReplay->load(path)) {
+		emitMessageDialog(tr("Replay Capture"),
+			tr("Could not read capture %1").arg(path),
+			false, false);
+		return false;
+	}
+
+	return mCaptureReplay->start(realTime);
+}
+
+void VescInterface::stopCaptureReplay()
+{
+	mCaptureReplay->stop();
+}
+
+/**
+ * @brief VescInterface::endCaptureReplay
+ * Called at the start of every connect path. Stops a running replay and
+ * drops what the replay left in the packet decoder, so that replayed data
+ * is not mixed with data from the new connection.
+ */
+void VescInterface::endCaptureReplay()
+{
+	mCaptureReplay->stop();
+	mPacket->resetState();
+}
+
+bool VescInterface::isCaptureReplaying()
+{
+	return mCaptureReplay->isRunning();
+}
+
 bool VescInterface::useImperialUnits()
 {
 	return mUseImperialUnits;
@@ -2127,7 +2411,7 @@ bool VescInterface::isPortConnected()
 	bool res = false;
 
 #ifdef HAS_SERIALPORT
-	if (mSerialPort->isOpen()) {
+	if (mIo->isSerialOpen()) {
 		res = true;
 	}
 #endif
@@ -2158,9 +2442,8 @@ bool VescInterface::isPortConnected()
 void VescInterface::disconnectPort()
 {
 #ifdef HAS_SERIALPORT
-	if (mSerialPort->isOpen()) {
-		mSerialPort->flush();
-		mSerialPort->close();
+	if (mIo->isSerialOpen()) {
+		mIo->closeSerial();
 		updateFwRx(false);
 	}
 #endif
@@ -2192,6 +2475,8 @@ void VescInterface::disconnectPort()
 	}
 #endif
 
+	// Nothing can answer pending requests any more
+	mCommands->cancelRequests();
 	mFwRetries = 0;
 }
 
@@ -2289,9 +2574,9 @@ bool VescInterface::autoconnect()
 			continue;
 		}
 
-		mSerialPort->flush();
+		mIo->flush();
 		Utility::sleepWithEventLoop(100);
-		mPacket->resetState();
+		mIo->resetState();
 
 		QEventLoop loop;
 		QTimer timeoutTimer;
@@ -2329,8 +2614,8 @@ QString VescInterface::getConnectedPortName()
 	bool connected = false;
 
 #ifdef HAS_SERIALPORT
-	if (mSerialPort->isOpen()) {
-		res = tr("Connected (serial) to %1").arg(mSerialPort->portName());
+	if (mIo->isSerialOpen()) {
+		res = tr("Connected (serial) to %1").arg(mIo->serialPortName());
 		connected = true;
 	}
 #endif
@@ -2374,6 +2659,8 @@ QString VescInterface::getConnectedPortName()
 
 bool VescInterface::connectSerial(QString port, int baudrate)
 {
+	endCaptureReplay();
+
 #ifdef HAS_SERIALPORT
 	bool found = false;
 	for (auto ser : listSerialPorts()) {
@@ -2388,7 +2675,7 @@ bool VescInterface::connectSerial(QString port, int baudrate)
 		return false;
 	}
 
-	if (!mSerialPort->isOpen()) {
+	if (!mIo->isSerialOpen()) {
 		// TODO: Maybe this test works on other OSes as well
 #ifdef Q_OS_UNIX
 		QFileInfo fi(port);
@@ -2401,18 +2688,9 @@ bool VescInterface::connectSerial(QString port, int baudrate)
 		}
 #endif
 
-		mSerialPort->setPortName(port);
-		mSerialPort->open(QIODevice::ReadWrite);
-
-		if (!mSerialPort->isOpen()) {
+		if (!mIo->openSerial(port, baudrate)) {
 			return false;
 		}
-
-		mSerialPort->setBaudRate(baudrate);
-		mSerialPort->setDataBits(QSerialPort::Data8);
-		mSerialPort->setParity(QSerialPort::NoParity);
-		mSerialPort->setStopBits(QSerialPort::OneStop);
-		mSerialPort->setFlowControl(QSerialPort::NoFlowControl);
 	}
 
 	mLastSerialPort = port;
@@ -2504,6 +2782,8 @@ QList<QString> VescInterface::listCANbusInterfaces()
 
 bool VescInterface::connectCANbus(QString backend, QString ifName, int bitrate)
 {
+	endCaptureReplay();
+
 #ifdef HAS_CANBUS
 	QString errorString;
 
@@ -2584,6 +2864,8 @@ void VescInterface::setCANbusReceiverID(int node_ID)
 
 void VescInterface::connectTcp(QString server, int port)
 {
+	endCaptureReplay();
+
 	mLastTcpServer = server;
 	mLastTcpPort = port;
 	mLastTcpHubVescID = "";
@@ -2607,6 +2889,8 @@ void VescInterface::connectTcp(QString server, int port)
 
 void VescInterface::connectTcpHub(QString server, int port, QString id, QString pass)
 {
+	endCaptureReplay();
+
 	mLastTcpHubServer = server;
 	mLastTcpHubPort = port;
 	mLastTcpHubVescID = id;
@@ -2630,6 +2914,8 @@ void VescInterface::connectTcpHub(QString server, int port, QString id, QString
 
 void VescInterface::connectUdp(QString server, int port)
 {
+	endCaptureReplay();
+
 	QHostAddress host;
 	host.setAddress(server);
 
@@ -2654,6 +2940,8 @@ void VescInterface::connectUdp(QString server, int port)
 
 void VescInterface::connectBle(QString address)
 {
+	endCaptureReplay();
+
 #ifdef HAS_BLUETOOTH
 	mBleUart->startConnect(address);
 	mLastBleAddr = address;
@@ -2810,35 +3098,42 @@ void VescInterface::canTmpOverrideEnd()
 
 bool VescInterface::tcpServerStart(int port)
 {
-	bool res = mTcpServer->startServer(port);
+	bool res = mBridge->startTcp(port);
 
 	if (!res) {
 		emitMessageDialog("Start TCP Server",
-			"Could not start TCP server: " + mTcpServer->errorString(),
+			"Could not start TCP server: " + mBridge->errorString(),
 			false, false);
 	}
 
+	updateBridgeForwarding();
 	return res;
 }
 
 void VescInterface::tcpServerStop()
 {
+	mBridge->stopTcp();
 	mTcpServer->stopServer();
+	updateBridgeForwarding();
 }
 
 bool VescInterface::tcpServerIsRunning()
 {
-	return mTcpServer->isServerRunning();
+	return mBridge->isTcpRunning() || mTcpServer->isServerRunning();
 }
 
 bool VescInterface::tcpServerIsClientConnected()
 {
-	return mTcpServer->isClientConnected();
+	return !mBridge->tcpClients().isEmpty() || mTcpServer->isClientConnected();
 }
 
 QString VescInterface::tcpServerClientIp()
 {
-	return mTcpServer->getConnectedClientIp();
+	QStringList clients = mBridge->tcpClients();
+	if (mTcpServer->isClientConnected()) {
+		clients.append(mTcpServer->getConnectedClientIp());
+	}
+	return clients.join(", ");
 }
 
 bool VescInterface::tcpServerConnectToHub(QString server, int port, QString id, QString pass)
@@ -2862,71 +3157,67 @@ bool VescInterface::tcpServerConnectToHub(QString server, int port, QString id,
 
 bool VescInterface::udpServerStart(int port)
 {
-	bool res = mUdpServer->startServer(port);
+	bool res = mBridge->startUdp(port);
 
 	if (!res) {
 		emitMessageDialog("Start UDP Server",
-			"Could not start UDP server: " + mUdpServer->errorString(),
+			"Could not start UDP server: " + mBridge->errorString(),
 			false, false);
 	}
 
+	updateBridgeForwarding();
 	return res;
 }
 
 void VescInterface::udpServerStop()
 {
-	mUdpServer->stopServer();
+	mBridge->stopUdp();
+	updateBridgeForwarding();
 }
 
 bool VescInterface::udpServerIsRunning()
 {
-	return mUdpServer->isServerRunning();
+	return mBridge->isUdpRunning();
 }
 
 bool VescInterface::udpServerIsClientConnected()
 {
-	return mUdpServer->isClientConnected();
+	return !mBridge->udpClients().isEmpty();
 }
 
 QString VescInterface::udpServerClientIp()
 {
-	return mUdpServer->getConnectedClientIp();
+	return mBridge->udpClients().join(", ");
 }
 
-void VescInterface::emitConfigurationChanged()
+void VescInterface::updateBridgeForwarding()
 {
-	emit configurationChanged();
-}
+	bool on = mBridge->isTcpRunning() || mBridge->isUdpRunning();
 
-#ifdef HAS_SERIALPORT
-void VescInterface::serialDataAvailable()
-{
-	while (mSerialPort->bytesAvailable() > 0) {
-		mPacket->processData(mSerialPort->readAll());
+	// Raw frames are only kept by the decoders while someone listens
+	mIo->setFrameForwarding(on);
+	if (on && !mBridgeFrameConn) {
+		mBridgeFrameConn = connect(mPacket, &Packet::frameReceived, [this](QByteArray &frame) {
+			mBridge->vescFrame(frame);
+			});
+	} else if (!on && mBridgeFrameConn) {
+		disconnect(mBridgeFrameConn);
+		mBridgeFrameConn = QMetaObject::Connection();
 	}
 }
 
-void VescInterface::serialPortError(QSerialPort::SerialPortError error)
+void VescInterface::emitConfigurationChanged()
 {
-	QString message;
-	switch (error) {
-	case QSerialPort::NoError:
-		break;
-
-	default:
-		message = "Serial port error: " + mSerialPort->errorString();
-		break;
-	}
-
-	if (!message.isEmpty()) {
-		emit statusMessage(message, false);
-
-		if (mSerialPort->isOpen()) {
-			mSerialPort->close();
-		}
+	emit configurationChanged();
+}
 
-		updateFwRx(false);
-	}
+#ifdef HAS_SERIALPORT
+void VescInterface::serialPortError(QString errorString)
+{
+	// The I/O thread has already closed the port
+	emit statusMessage("Serial port error: " + errorString, false);
+	mCommands->cancelRequests();
+	updateFwRx(false);
 }
 #endif
 
@@ -2963,6 +3254,7 @@ void VescInterface::CANbusDataAvailable()
 				payload.append((unsigned char)(crc >> 8));
 				payload.append((unsigned char)(crc & 0xFF));
 				payload.append(3);
+				mCapture->record(CONN_CANBUS, false, payload);
 				mPacket->processData(payload);
 				break;
 
@@ -3009,6 +3301,7 @@ void VescInterface::CANbusDataAvailable()
 						mCanRxBuffer.append(crc_high);
 						mCanRxBuffer.append(crc_low);
 						mCanRxBuffer.append(3);
+						mCapture->record(CONN_CANBUS, false, mCanRxBuffer);
 						mPacket->processData(mCanRxBuffer);
 						break;
 					case 2:
@@ -3093,13 +3386,16 @@ void VescInterface::tcpInputConnected()
 void VescInterface::tcpInputDisconnected()
 {
 	mTcpConnected = false;
+	mCommands->cancelRequests();
 	updateFwRx(false);
 }
 
 void VescInterface::tcpInputDataAvailable()
 {
 	while (mTcpSocket->bytesAvailable() > 0) {
-		mPacket->processData(mTcpSocket->readAll());
+		QByteArray data = mTcpSocket->readAll();
+		mCapture->record(mLastConnType == CONN_TCP_HUB ? CONN_TCP_HUB : CONN_TCP, false, data);
+		mPacket->processData(data);
 	}
 }
 
@@ -3107,6 +3403,7 @@ void VescInterface::udpInputDataAvailable()
 {
 	while (mUdpSocket->hasPendingDatagrams()) {
 		QNetworkDatagram datagram = mUdpSocket->receiveDatagram();
+		mCapture->record(CONN_UDP, false, datagram.data());
 		mPacket->processData(datagram.data());
 	}
 }
@@ -3135,23 +3432,22 @@ void VescInterface::udpInputError(QAbstractSocket::SocketError socketError)
 #ifdef HAS_BLUETOOTH
 void VescInterface::bleDataRx(QByteArray data)
 {
+	mCapture->record(CONN_BLE, false, data);
 	mPacket->processData(data);
 }
 
 void VescInterface::bleUnintentionalDisconnect()
 {
+	mCommands->cancelRequests();
 	emit unintentionalBleDisconnect();
 }
 #endif
 
 void VescInterface::timerSlot()
 {
-	// Poll the serial port as well since readyRead is not emitted recursively. This
-	// can be a problem when waiting for input with an additional event loop, such as
-	// when using QMessageBox.
-#ifdef HAS_SERIALPORT
-	serialDataAvailable();
-#endif
+	// Poll as well since readyRead is not emitted recursively. This can be a problem
+	// when waiting for input with an additional event loop, such as when using
+	// QMessageBox. The serial port is read on the I/O thread, so it does not need this.
 #ifdef HAS_CANBUS
 	if (mCanDevice != nullptr) {
 		CANbusDataAvailable();
@@ -3254,9 +3550,11 @@ void VescInterface::timerSlot()
 
 void VescInterface::packetDataToSend(QByteArray& data)
 {
+	mCapture->record(mLastConnType, true, data);
+
 #ifdef HAS_SERIALPORT
-	if (mSerialPort->isOpen()) {
-		mSerialPort->write(data);
+	if (mIo->isSerialOpen()) {
+		mIo->write(data);
 	}
 #endif
 
@@ -3779,115 +4077,87 @@ void VescInterface::fwVersionReceived(FW_RX_PARAMS params)
 			false, false);
 	}
 
-	// Read custom configs
+	mDeviceDataCache.setDevice(params.uuid, params.major, params.minor);
+
 	if (params.customConfigNum > 0) {
 		while (!mCustomConfigs.isEmpty()) {
 			mCustomConfigs.last()->deleteLater();
 			mCustomConfigs.removeLast();
 		}
+	}
 
-		bool readConfigsOk = true;
-		for (int i = 0; i < params.customConfigNum; i++) {
-			QByteArray configData;
-			int confIndLast = 0;
-			int lenConfLast = -1;
-			auto conn = connect(mCommands, &Commands::customConfigChunkRx,
-				[&](int confInd, int lenConf, int ofsConf, QByteArray data) {
-					if (configData.size() <= ofsConf) {
-						configData.append(data);
-					}
-					confIndLast = confInd;
-					lenConfLast = lenConf;
-				});
+	// Read the configurations, custom configs and qmlui concurrently. The
+	// results are applied in connectStageFinished as they arrive.
+	if (isPortConnected()) {
+		mConnectSequence->start(params,
+			mFwVersionReceived && params.hwType == HW_TYPE_VESC && !mCommands->isLimitedMode(),
+			mLoadQmlUiOnConnect);
+	}
+	else {
+		if (params.hasQmlApp || params.hasQmlHw) {
+			emit qmlLoadDone();
+		}
 
-			auto getChunk = [&](int size, int offset, int tries, int timeout) {
-				bool res = false;
+		mCustomConfigRxDone = true;
+		emit customConfigLoadDone();
+	}
+}
 
-				for (int j = 0; j < tries; j++) {
-					mCommands->customConfigGetChunk(i, size, offset);
-					res = Utility::waitSignal(mCommands, SIGNAL(customConfigChunkRx(int, int, int, QByteArray)), timeout);
-					if (res) {
-						break;
-					}
-				}
-				return res;
-				};
+void VescInterface::connectStageFinished(int stage, bool ok)
+{
+	(void)ok;
+	const FW_RX_PARAMS &params = mLastFwParams;
 
-			if (getChunk(10, 0, 5, 1500)) {
-				while (configData.size() < lenConfLast) {
-					int dataLeft = lenConfLast - configData.size();
-					if (!getChunk(dataLeft > 400 ? 400 : dataLeft, configData.size(), 5, 1500)) {
-						break;
-					}
-				}
+	if (stage == ConnectSequence::STAGE_CUSTOM_CONFIG) {
+		if (params.customConfigNum > 0) {
+			bool readConfigsOk = true;
+			for (int i = 0; i < params.customConfigNum; i++) {
+				int lenConf = -1;
+				QByteArray configData = mConnectSequence->data(DeviceDataCache::DATA_CUSTOM_CONFIG, i, &lenConf);
+
+				if (lenConf >= 0) {
+					if (configData.size() == lenConf) {
+						mCustomConfigs.append(new ConfigParams(this));
+						connect(mCustomConfigs.last(), &ConfigParams::updateRequested, [this]() {
+							mCommands->customConfigGet(mCustomConfigs.size() - 1, false);
+							});
+						connect(mCustomConfigs.last(), &ConfigParams::updateRequestDefault, [this]() {
+							mCommands->customConfigGet(mCustomConfigs.size() - 1, true);
+							});
 
-				if (configData.size() == lenConfLast) {
-					mCustomConfigs.append(new ConfigParams(this));
-					connect(mCustomConfigs.last(), &ConfigParams::updateRequested, [this]() {
-						mCommands->customConfigGet(mCustomConfigs.size() - 1, false);
-						});
-					connect(mCustomConfigs.last(), &ConfigParams::updateRequestDefault, [this]() {
-						mCommands->customConfigGet(mCustomConfigs.size() - 1, true);
-						});
+						if (!mCustomConfigs.last()->loadCompressedParamsXml(configData)) {
+							readConfigsOk = false;
+							break;
+						}
 
-					if (!mCustomConfigs.last()->loadCompressedParamsXml(configData)) {
+						emitStatusMessage(QString("Got custom config %1").arg(i), true);
+					}
+					else {
+						emitMessageDialog("Get Custom Config",
+							"Could not read custom config from hardware",
+							false, false);
 						readConfigsOk = false;
-						disconnect(conn);
 						break;
 					}
-
-					emitStatusMessage(QString("Got custom config %1").arg(i), true);
-				}
-				else {
-					emitMessageDialog("Get Custom Config",
-						"Could not read custom config from hardware",
-						false, false);
-					readConfigsOk = false;
-					disconnect(conn);
-					break;
 				}
 			}
 
-			disconnect(conn);
+			mCustomConfigsLoaded = readConfigsOk;
 		}
 
-		mCustomConfigsLoaded = readConfigsOk;
-	}
-
-	// Read qmlui
-	if (mLoadQmlUiOnConnect && params.hasQmlHw) {
-		QByteArray qmlData;
-		int lenQmlLast = -1;
-		auto conn = connect(mCommands, &Commands::qmluiHwRx,
-			[&](int lenQml, int ofsQml, QByteArray data) {
-				if (qmlData.size() <= ofsQml) {
-					qmlData.append(data);
-				}
-				lenQmlLast = lenQml;
-			});
-
-		auto getQmlChunk = [&](int size, int offset, int tries, int timeout) {
-			bool res = false;
-
-			for (int j = 0; j < tries; j++) {
-				mCommands->qmlUiHwGet(size, offset);
-				res = Utility::waitSignal(mCommands, SIGNAL(qmluiHwRx(int, int, QByteArray)), timeout);
-				if (res) {
-					break;
-				}
-			}
-			return res;
-			};
+		for (int i = 0; i < mCustomConfigs.size(); i++) {
+			commands()->customConfigGet(i, false);
+		}
 
-		if (getQmlChunk(10, 0, 5, 1500)) {
-			while (qmlData.size() < lenQmlLast) {
-				int dataLeft = lenQmlLast - qmlData.size();
-				if (!getQmlChunk(dataLeft > 400 ? 400 : dataLeft, qmlData.size(), 5, 1500)) {
-					break;
-				}
-			}
+		mCustomConfigRxDone = true;
+		emit customConfigLoadDone();
+	}
+	else if (stage == ConnectSequence::STAGE_QML) {
+		int lenQml = -1;
+		QByteArray qmlData = mConnectSequence->data(DeviceDataCache::DATA_QML_HW, 0, &lenQml);
 
-			if (qmlData.size() == lenQmlLast) {
+		if (lenQml >= 0) {
+			if (qmlData.size() == lenQml) {
 				mQmlHw = QString::fromUtf8(qUncompress(qmlData));
 				mQmlHwLoaded = true;
 				emitStatusMessage("Got qmlui HW", true);
@@ -3897,46 +4167,13 @@ void VescInterface::fwVersionReceived(FW_RX_PARAMS params)
 				emitMessageDialog("Get qmlui HW",
 					"Could not read qmlui HW from hardware",
 					false, false);
-				disconnect(conn);
 			}
 		}
 
-		disconnect(conn);
-	}
+		qmlData = mConnectSequence->data(DeviceDataCache::DATA_QML_APP, 0, &lenQml);
 
-	if (mLoadQmlUiOnConnect && params.hasQmlApp) {
-		QByteArray qmlData;
-		int lenQmlLast = -1;
-		auto conn = connect(mCommands, &Commands::qmluiAppRx,
-			[&](int lenQml, int ofsQml, QByteArray data) {
-				if (qmlData.size() <= ofsQml) {
-					qmlData.append(data);
-				}
-				lenQmlLast = lenQml;
-			});
-
-		auto getQmlChunk = [&](int size, int offset, int tries, int timeout) {
-			bool res = false;
-
-			for (int j = 0; j < tries; j++) {
-				mCommands->qmlUiAppGet(size, offset);
-				res = Utility::waitSignal(mCommands, SIGNAL(qmluiAppRx(int, int, QByteArray)), timeout);
-				if (res) {
-					break;
-				}
-			}
-			return res;
-			};
-
-		if (getQmlChunk(10, 0, 5, 1500)) {
-			while (qmlData.size() < lenQmlLast) {
-				int dataLeft = lenQmlLast - qmlData.size();
-				if (!getQmlChunk(dataLeft > 400 ? 400 : dataLeft, qmlData.size(), 5, 1500)) {
-					break;
-				}
-			}
-
-			if (qmlData.size() == lenQmlLast) {
+		if (lenQml >= 0) {
+			if (qmlData.size() == lenQml) {
 				mQmlApp = QString::fromUtf8(qUncompress(qmlData));
 				mQmlAppLoaded = true;
 				emitStatusMessage("Got qmlui App", true);
@@ -3946,23 +4183,23 @@ void VescInterface::fwVersionReceived(FW_RX_PARAMS params)
 				emitMessageDialog("Get qmlui App",
 					"Could not read qmlui App from hardware",
 					false, false);
-				disconnect(conn);
 			}
 		}
-
-		disconnect(conn);
 	}
-
-	if (params.hasQmlApp || params.hasQmlHw) {
-		emit qmlLoadDone();
+	else {
+		return;
 	}
 
-	for (int i = 0; i < mCustomConfigs.size(); i++) {
-		commands()->customConfigGet(i, false);
-	}
+	// The qmlui can use the custom configs, so it is announced after them
+	auto finished = [this](ConnectSequence::STAGE s) {
+		auto state = mConnectSequence->stageState(s);
+		return state != ConnectSequence::STATE_WAITING && state != ConnectSequence::STATE_RUNNING;
+	};
 
-	mCustomConfigRxDone = true;
-	emit customConfigLoadDone();
+	if ((params.hasQmlApp || params.hasQmlHw) &&
+		finished(ConnectSequence::STAGE_CUSTOM_CONFIG) && finished(ConnectSequence::STAGE_QML)) {
+		emit qmlLoadDone();
+	}
 }
 
 void VescInterface::appconfUpdated()
@@ -4475,6 +4712,11 @@ bool VescInterface::customConfigRxDone()
 	return mCustomConfigRxDone;
 }
 
+ConnectSequence *VescInterface::connectSequence()
+{
+	return mConnectSequence;
+}
+
 ConfigParams* VescInterface::customConfig(int configNum)
 {
 	if (customConfigsLoaded() && configNum < mCustomConfigs.size()) {
@@ -4514,6 +4756,7 @@ void VescInterface::updateFwRx(bool fwRx)
 	}
 
 	if (!mFwVersionReceived) {
+		mConnectSequence->abort();
 		mCustomConfigsLoaded = false;
 		mCustomConfigRxDone = false;
 		mQmlHwLoaded = false;
@@ -4525,4 +4768,7 @@ void VescInterface::setLastConnectionType(conn_t type)
 {
 	mLastConnType = type;
 	mSettings.setValue("connection_type", type);
+
+	mConnectSequence->begin(connTypeNames[type]);
+	mCommands->linkStats()->setTransport(connTypeNames[type]);
 }
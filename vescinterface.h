@@ -43,8 +43,12 @@
 #include "configparams.h"
 #include "commands.h"
 #include "packet.h"
+#include "iothread.h"
 #include "tcpserversimple.h"
-#include "udpserversimple.h"
+#include "packetbridge.h"
+#include "devicedatacache.h"
+#include "connectsequence.h"
+#include "packetcapture.h"
 
 #ifdef HAS_BLUETOOTH
 #include "bleuart.h"
@@ -69,6 +73,8 @@ public:
     explicit VescInterface(QObject *parent = nullptr);
     ~VescInterface();
     Q_INVOKABLE Commands *commands() const;
+    IoThread *ioThread() const;
+    void sendPacket(const QByteArray &data);
     Q_INVOKABLE ConfigParams *mcConfig();
     Q_INVOKABLE ConfigParams *appConfig();
     Q_INVOKABLE ConfigParams *infoConfig();
@@ -122,7 +128,7 @@ public:
     // SWD Programming
     bool swdEraseFlash();
     bool swdUploadFw(QByteArray newFirmware, uint32_t startAddr = 0,
-                     bool verify = false, bool isLzo = true);
+                     bool verify = false, bool isLzo = true, int pipelineDepth = 4);
     void swdCancel();
     bool swdReboot();
 
@@ -146,6 +152,15 @@ public:
     Q_INVOKABLE LOG_DATA getRtLogSample(double progress);
     Q_INVOKABLE LOG_DATA getRtLogSampleAtValTimeFromStart(int time);
 
+    // Packet capture
+    Q_INVOKABLE bool openCaptureFile(QString path);
+    Q_INVOKABLE void closeCaptureFile();
+    Q_INVOKABLE bool isCaptureOpen();
+    Q_INVOKABLE QString captureFilePath();
+    Q_INVOKABLE bool replayCaptureFile(QString path, bool realTime);
+    Q_INVOKABLE void stopCaptureReplay();
+    Q_INVOKABLE bool isCaptureReplaying();
+
     // Persistent settings
     Q_INVOKABLE bool useImperialUnits();
     Q_INVOKABLE void setUseImperialUnits(bool useImperialUnits);
@@ -239,6 +254,7 @@ public:
     Q_INVOKABLE int customConfigNum();
     Q_INVOKABLE bool customConfigsLoaded();
     Q_INVOKABLE bool customConfigRxDone();
+    ConnectSequence *connectSequence();
     Q_INVOKABLE ConfigParams *customConfig(int configNum);
 
     Q_INVOKABLE bool qmlHwLoaded();
@@ -287,8 +303,7 @@ public slots:
 
 private slots:
 #ifdef HAS_SERIALPORT
-    void serialDataAvailable();
-    void serialPortError(QSerialPort::SerialPortError error);
+    void serialPortError(QString errorString);
 #endif
 
 #ifdef HAS_CANBUS
@@ -318,6 +333,7 @@ private slots:
     void mcconfUpdated();
     void ackReceived(QString ackType);
     void customConfigRx(int confId, QByteArray data);
+    void connectStageFinished(int stage, bool ok);
 
 private:
     typedef enum {
@@ -337,7 +353,8 @@ private:
     QVariantList mProfiles;
     QStringList mPairedUuids;
     TcpServerSimple *mTcpServer;
-    UdpServerSimple *mUdpServer;
+    PacketBridge *mBridge;
+    QMetaObject::Connection mBridgeFrameConn;
     QTimer *mTimerBroadcast;
     QVariantList mTcpHubDevs;
 
@@ -353,10 +370,15 @@ private:
     QString mQmlHw;
     bool mQmlAppLoaded;
     QString mQmlApp;
+    DeviceDataCache mDeviceDataCache;
+    ConnectSequence *mConnectSequence;
 
     QTimer *mTimer;
     Packet *mPacket;
+    IoThread *mIo;
     Commands *mCommands;
+    PacketCapture *mCapture;
+    CaptureReplay *mCaptureReplay;
     bool mFwVersionReceived;
     bool mDeserialFailedMessageShown;
     int mFwRetries;
@@ -380,7 +402,6 @@ private:
     conn_t mLastConnType;
 
 #ifdef HAS_SERIALPORT
-    QSerialPort *mSerialPort;
     QString mLastSerialPort;
     int mLastSerialBaud;
 #endif
@@ -462,6 +483,8 @@ private:
 
     void updateFwRx(bool fwRx);
     void setLastConnectionType(conn_t type);
+    void updateBridgeForwarding();
+    void endCaptureReplay();
 
 };
 
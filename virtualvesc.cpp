@@ -0,0 +1,625 @@
+/*
+    Copyright 2016 - 2024 Benjamin Vedder	benjamin@vedder.se
+
+    This file is part of VESC Tool.
+
+    VESC Tool is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    VESC Tool is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+#include "virtualvesc.h"
+#include "configstore.h"
+#include "utility.h"
+#include "lzokay/lzokay.hpp"
+
+#include <QTimer>
+#include <QDir>
+
+namespace {
+// Largest payload of the file list and read replies, as on the ESP32
+const int maxReplyData = 400;
+}
+
+VirtualVesc::VirtualVesc(QObject *parent) : QObject(parent)
+{
+    mServer = new TcpServerSimple(this);
+    mServer->setUsePacket(true);
+    mTime.start();
+    mRandom.seed(1);
+
+    mFwMajor = -1;
+    mFwMinor = -1;
+    mHw = "60";
+    mUuid = QByteArray("VIRTUALVESC", 11).append(char(0));
+
+    mValues.v_in = 48.0;
+    mValues.temp_mos = 25.0;
+    mValues.temp_mos_1 = 25.0;
+    mValues.temp_mos_2 = 25.0;
+    mValues.temp_mos_3 = 25.0;
+    mValues.temp_motor = 25.0;
+    mValues.vesc_id = 0;
+
+    mLatencyMs = 0;
+    mBytesPerSecond = 0;
+    mLossRate = 0.0;
+    mRxFreeUs = 0;
+    mTxFreeUs = 0;
+
+    mRequests = 0;
+    mDropped = 0;
+    mBytesIn = 0;
+    mBytesOut = 0;
+
+    auto latest = Utility::configLatestSupported();
+    setFirmware(latest.first, latest.second);
+
+    connect(mServer->packet(), &Packet::packetReceived, this, &VirtualVesc::packetReceived);
+    connect(mServer, &TcpServerSimple::connectionChanged, [this](bool connected, QString address) {
+        (void)connected;
+        (void)address;
+        mServer->packet()->resetState();
+        mRxFreeUs = 0;
+        mTxFreeUs = 0;
+    });
+}
+
+/**
+ * @brief VirtualVesc::listen
+ * Start accepting a connection.
+ *
+ * @param port
+ * TCP port, or 0 to use any free port. See port().
+ *
+ * @param addr
+ * The address to listen on.
+ *
+ * @return
+ * True on success.
+ */
+bool VirtualVesc::listen(int port, const QHostAddress &addr)
+{
+    return mServer->startServer(port, addr);
+}
+
+void VirtualVesc::close()
+{
+    mServer->stopServer();
+}
+
+int VirtualVesc::port() const
+{
+    return mServer->lastPort();
+}
+
+bool VirtualVesc::isClientConnected()
+{
+    return mServer->isClientConnected();
+}
+
+/**
+ * @brief VirtualVesc::setFirmware
+ * Set the firmware version to report and load its configurations from the
+ * bundled config store.
+ *
+ * @return
+ * False if the version is not in the config store.
+ */
+bool VirtualVesc::setFirmware(int major, int minor)
+{
+    mFwMajor = major;
+    mFwMinor = minor;
+
+    const ConfigStore &store = ConfigStore::bundled();
+    return store.loadParams(major, minor, ConfigStore::CONFIG_MCCONF, &mMcConfig) &&
+            store.loadParams(major, minor, ConfigStore::CONFIG_APPCONF, &mAppConfig);
+}
+
+void VirtualVesc::setHw(const QString &hw)
+{
+    mHw = hw;
+}
+
+void VirtualVesc::setValues(const MC_VALUES &values)
+{
+    mValues = values;
+}
+
+MC_VALUES VirtualVesc::values() const
+{
+    return mValues;
+}
+
+ConfigParams *VirtualVesc::mcConfig()
+{
+    return &mMcConfig;
+}
+
+ConfigParams *VirtualVesc::appConfig()
+{
+    return &mAppConfig;
+}
+
+/**
+ * @brief VirtualVesc::setLatencyMs
+ * Time from processing a request until its reply starts to be sent.
+ */
+void VirtualVesc::setLatencyMs(int ms)
+{
+    mLatencyMs = ms;
+}
+
+/**
+ * @brief VirtualVesc::setBandwidth
+ * Limit the bytes per second in each direction, 0 for no limit. Packets
+ * are delayed by the time their frames would take on such a link.
+ */
+void VirtualVesc::setBandwidth(int bytesPerSecond)
+{
+    mBytesPerSecond = bytesPerSecond;
+}
+
+/**
+ * @brief VirtualVesc::setLossRate
+ * Probability that a packet is lost, for requests and replies separately.
+ * The seed makes the losses repeatable.
+ */
+void VirtualVesc::setLossRate(double rate, quint32 seed)
+{
+    mLossRate = rate;
+    mRandom.seed(seed);
+}
+
+void VirtualVesc::setFile(const QString &path, const QByteArray &data)
+{
+    mFiles.insert(cleanPath(path), data);
+}
+
+QByteArray VirtualVesc::file(const QString &path) const
+{
+    return mFiles.value(cleanPath(path));
+}
+
+QByteArray VirtualVesc::lispCode() const
+{
+    return mLispCode;
+}
+
+QByteArray VirtualVesc::newAppData() const
+{
+    return mNewApp;
+}
+
+int VirtualVesc::requestCount() const
+{
+    return mRequests;
+}
+
+int VirtualVesc::droppedCount() const
+{
+    return mDropped;
+}
+
+QString VirtualVesc::statsString() const
+{
+    return QString("%1 requests, %2 packets dropped, %3 bytes in, %4 bytes out").
+            arg(mRequests).arg(mDropped).arg(mBytesIn).arg(mBytesOut);
+}
+
+void VirtualVesc::packetReceived(QByteArray &packet)
+{
+    mRequests++;
+    mBytesIn += packet.size();
+
+    if (lost()) {
+        mDropped++;
+        return;
+    }
+
+    // The request is processed when it would have arrived over the link
+    qint64 nowUs = mTime.nsecsElapsed() / 1000;
+    qint64 delayMs = (linkDoneUs(mRxFreeUs, nowUs, packet.size()) - nowUs) / 1000;
+    VByteArray vb(packet);
+
+    if (delayMs <= 0) {
+        processPacket(vb);
+    } else {
+        QTimer::singleShot(int(delayMs), this, [this, vb]() {
+            processPacket(vb);
+        });
+    }
+}
+
+bool VirtualVesc::lost()
+{
+    return mLossRate > 0.0 && mRandom.generateDouble() < mLossRate;
+}
+
+/**
+ * @brief VirtualVesc::linkDoneUs
+ * Time when a packet that is ready to be sent at startUs has passed the
+ * link, given that the link is busy until freeUs. Updates freeUs.
+ */
+qint64 VirtualVesc::linkDoneUs(qint64 &freeUs, qint64 startUs, int bytes)
+{
+    if (mBytesPerSecond <= 0) {
+        return startUs;
+    }
+
+    // Start byte, length, CRC and stop byte
+    int frameBytes = bytes + (bytes <= 255 ? 5 : 6);
+    freeUs = qMax(freeUs, startUs) + (qint64(frameBytes) * 1000000) / mBytesPerSecond;
+    return freeUs;
+}
+
+void VirtualVesc::processPacket(VByteArray vb)
+{
+    auto id = COMM_PACKET_ID(vb.vbPopFrontUint8());
+
+    switch (id) {
+    case COMM_FW_VERSION: {
+        VByteArray r;
+        r.vbAppendUint8(COMM_FW_VERSION);
+        r.vbAppendInt8(mFwMajor);
+        r.vbAppendInt8(mFwMinor);
+        r.vbAppendString(mHw);
+        r.append(mUuid);
+        r.vbAppendInt8(0); // Paired
+        r.vbAppendInt8(0); // Test version
+        r.vbAppendInt8(HW_TYPE_VESC);
+        r.vbAppendInt8(0); // Custom configs
+        r.vbAppendInt8(1); // Phase filters
+        r.vbAppendInt8(0); // QML HW
+        r.vbAppendInt8(0); // QML App
+        r.vbAppendUint8(0); // NRF flags
+        r.vbAppendString("Virtual VESC");
+        reply(r);
+    } break;
+
+    case COMM_GET_VALUES:
+        reply(valuesReply(mValues, false, 0xFFFFFFFF));
+        break;
+
+    case COMM_GET_VALUES_SELECTIVE:
+        reply(valuesReply(mValues, true, vb.vbPopFrontUint32()));
+        break;
+
+    case COMM_GET_MCCONF:
+    case COMM_GET_MCCONF_DEFAULT:
+    case COMM_GET_APPCONF:
+    case COMM_GET_APPCONF_DEFAULT: {
+        bool isMc = id == COMM_GET_MCCONF || id == COMM_GET_MCCONF_DEFAULT;
+        VByteArray r;
+        r.vbAppendUint8(id);
+        (isMc ? mMcConfig : mAppConfig).serialize(r);
+        reply(r);
+    } break;
+
+    case COMM_SET_MCCONF:
+    case COMM_SET_APPCONF:
+    case COMM_SET_APPCONF_NO_STORE:
+        if ((id == COMM_SET_MCCONF ? mMcConfig : mAppConfig).deSerialize(vb)) {
+            reply(QByteArray(1, char(id)));
+        }
+        break;
+
+    case COMM_PING_CAN:
+        reply(QByteArray(1, char(COMM_PING_CAN)));
+        break;
+
+    case COMM_FILE_LIST: {
+        QString path = vb.vbPopFrontString();
+        QString from = vb.vbPopFrontString();
+        reply(fileListReply(path, from));
+    } break;
+
+    case COMM_FILE_READ: {
+        QString path = cleanPath(vb.vbPopFrontString());
+        qint32 offset = vb.vbPopFrontInt32();
+        QByteArray data = mFiles.value(path);
+
+        VByteArray r;
+        r.vbAppendUint8(COMM_FILE_READ);
+        r.vbAppendInt32(offset);
+        r.vbAppendInt32(data.size());
+        r.append(data.mid(offset, maxReplyData));
+        reply(r);
+    } break;
+
+    case COMM_FILE_WRITE: {
+        QString path = cleanPath(vb.vbPopFrontString());
+        qint32 offset = vb.vbPopFrontInt32();
+        vb.vbPopFrontInt32(); // Total size
+
+        if (offset == 0) {
+            mFiles.insert(path, QByteArray());
+        }
+
+        bool ok = mFiles.contains(path) && offset <= mFiles.value(path).size();
+        if (ok) {
+            mFiles[path].replace(offset, vb.size(), vb);
+        }
+
+        VByteArray r;
+        r.vbAppendUint8(COMM_FILE_WRITE);
+        r.vbAppendInt32(offset);
+        r.vbAppendInt8(ok);
+        reply(r);
+    } break;
+
+    case COMM_FILE_MKDIR: {
+        mDirs.insert(cleanPath(vb.vbPopFrontString()));
+
+        VByteArray r;
+        r.vbAppendUint8(COMM_FILE_MKDIR);
+        r.vbAppendInt8(1);
+        reply(r);
+    } break;
+
+    case COMM_FILE_REMOVE: {
+        QString path = cleanPath(vb.vbPopFrontString());
+        bool ok = mFiles.remove(path) > 0 || mDirs.remove(path);
+
+        // Everything in a removed directory goes with it
+        QString prefix = path + "/";
+        for (auto it = mFiles.begin();it != mFiles.end();) {
+            if (it.key().startsWith(prefix)) {
+                it = mFiles.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        for (auto it = mDirs.begin();it != mDirs.end();) {
+            if (it->startsWith(prefix)) {
+                it = mDirs.erase(it);
+            } else {
+                ++it;
+            }
+        }
+
+        VByteArray r;
+        r.vbAppendUint8(COMM_FILE_REMOVE);
+        r.vbAppendInt8(ok);
+        reply(r);
+    } break;
+
+    case COMM_LISP_ERASE_CODE: {
+        mLispCode.clear();
+
+        VByteArray r;
+        r.vbAppendUint8(COMM_LISP_ERASE_CODE);
+        r.vbAppendInt8(1);
+        reply(r);
+    } break;
+
+    case COMM_LISP_WRITE_CODE: {
+        quint32 offset = vb.vbPopFrontUint32();
+        bool ok = int(offset) <= mLispCode.size();
+        if (ok) {
+            mLispCode.replace(int(offset), vb.size(), vb);
+        }
+
+        VByteArray r;
+        r.vbAppendUint8(COMM_LISP_WRITE_CODE);
+        r.vbAppendInt8(ok);
+        r.vbAppendUint32(offset);
+        reply(r);
+    } break;
+
+    case COMM_LISP_READ_CODE: {
+        qint32 len = vb.vbPopFrontInt32();
+        qint32 offset = vb.vbPopFrontInt32();
+
+        VByteArray r;
+        r.vbAppendUint8(COMM_LISP_READ_CODE);
+        r.vbAppendInt32(mLispCode.size());
+        r.vbAppendInt32(offset);
+        r.append(mLispCode.mid(offset, qMin(len, maxReplyData)));
+        reply(r);
+    } break;
+
+    case COMM_ERASE_NEW_APP:
+    case COMM_ERASE_NEW_APP_ALL_CAN:
+    case COMM_ERASE_NEW_APP_ALL_CAN_HW: {
+        mNewApp.clear();
+
+        VByteArray r;
+        r.vbAppendUint8(COMM_ERASE_NEW_APP);
+        r.vbAppendInt8(1);
+        reply(r);
+    } break;
+
+    case COMM_ERASE_BOOTLOADER:
+    case COMM_ERASE_BOOTLOADER_ALL_CAN:
+    case COMM_ERASE_BOOTLOADER_ALL_CAN_HW: {
+        VByteArray r;
+        r.vbAppendUint8(COMM_ERASE_BOOTLOADER);
+        r.vbAppendInt8(1);
+        reply(r);
+    } break;
+
+    case COMM_WRITE_NEW_APP_DATA:
+    case COMM_WRITE_NEW_APP_DATA_ALL_CAN:
+    case COMM_WRITE_NEW_APP_DATA_ALL_CAN_HW:
+    case COMM_WRITE_NEW_APP_DATA_LZO:
+    case COMM_WRITE_NEW_APP_DATA_ALL_CAN_LZO: {
+        if (id == COMM_WRITE_NEW_APP_DATA_ALL_CAN_HW) {
+            vb.vbPopFrontUint8();
+            vb.vbPopFrontString();
+        }
+
+        quint32 offset = vb.vbPopFrontUint32();
+        QByteArray data = vb;
+        bool ok = true;
+
+        if (id == COMM_WRITE_NEW_APP_DATA_LZO || id == COMM_WRITE_NEW_APP_DATA_ALL_CAN_LZO) {
+            quint16 decompressedLen = vb.vbPopFrontUint16();
+            data.resize(decompressedLen);
+            std::size_t outLen = 0;
+            ok = lzokay::decompress((const uint8_t*)vb.constData(), std::size_t(vb.size()),
+                                    (uint8_t*)data.data(), decompressedLen, outLen) ==
+                    lzokay::EResult::Success && outLen == decompressedLen;
+        }
+
+        if (ok) {
+            // Chunks with only 0xFF are skipped by the uploader
+            if (int(offset) > mNewApp.size()) {
+                mNewApp.append(QByteArray(int(offset) - mNewApp.size(), char(0xFF)));
+            }
+            mNewApp.replace(int(offset), data.size(), data);
+        }
+
+        VByteArray r;
+        r.vbAppendUint8(COMM_WRITE_NEW_APP_DATA);
+        r.vbAppendInt8(ok);
+        r.vbAppendUint32(offset);
+        reply(r);
+    } break;
+
+    default:
+        break;
+    }
+}
+
+void VirtualVesc::reply(const QByteArray &data)
+{
+    if (lost()) {
+        mDropped++;
+        return;
+    }
+
+    mBytesOut += data.size();
+
+    qint64 nowUs = mTime.nsecsElapsed() / 1000;
+    qint64 doneUs = linkDoneUs(mTxFreeUs, nowUs + qint64(mLatencyMs) * 1000, data.size());
+    qint64 delayMs = (doneUs - nowUs) / 1000;
+
+    if (delayMs <= 0) {
+        mServer->packet()->sendPacket(data);
+    } else {
+        QTimer::singleShot(int(delayMs), this, [this, data]() {
+            mServer->packet()->sendPacket(data);
+        });
+    }
+}
+
+/**
+ * @brief VirtualVesc::valuesReply
+ * Encode values as the firmware does, in the same order and scaling as
+ * Commands::processPacket decodes them.
+ *
+ * @param v
+ * The values to encode.
+ *
+ * @param selective
+ * True for a COMM_GET_VALUES_SELECTIVE reply, false for COMM_GET_VALUES.
+ *
+ * @param mask
+ * The fields of a selective reply.
+ *
+ * @return
+ * The reply, starting with the command.
+ */
+QByteArray VirtualVesc::valuesReply(const MC_VALUES &v, bool selective, uint32_t mask)
+{
+    VByteArray vb;
+    vb.vbAppendUint8(selective ? COMM_GET_VALUES_SELECTIVE : COMM_GET_VALUES);
+    if (selective) {
+        vb.vbAppendUint32(mask);
+    }
+
+    auto has = [mask](int bit) { return mask & (uint32_t(1) << bit); };
+
+    if (has(0)) vb.vbAppendDouble16(v.temp_mos, 1e1);
+    if (has(1)) vb.vbAppendDouble16(v.temp_motor, 1e1);
+    if (has(2)) vb.vbAppendDouble32(v.current_motor, 1e2);
+    if (has(3)) vb.vbAppendDouble32(v.current_in, 1e2);
+    if (has(4)) vb.vbAppendDouble32(v.id, 1e2);
+    if (has(5)) vb.vbAppendDouble32(v.iq, 1e2);
+    if (has(6)) vb.vbAppendDouble16(v.duty_now, 1e3);
+    if (has(7)) vb.vbAppendDouble32(v.rpm, 1e0);
+    if (has(8)) vb.vbAppendDouble16(v.v_in, 1e1);
+    if (has(9)) vb.vbAppendDouble32(v.amp_hours, 1e4);
+    if (has(10)) vb.vbAppendDouble32(v.amp_hours_charged, 1e4);
+    if (has(11)) vb.vbAppendDouble32(v.watt_hours, 1e4);
+    if (has(12)) vb.vbAppendDouble32(v.watt_hours_charged, 1e4);
+    if (has(13)) vb.vbAppendInt32(v.tachometer);
+    if (has(14)) vb.vbAppendInt32(v.tachometer_abs);
+    if (has(15)) vb.vbAppendInt8(v.fault_code);
+    if (has(16)) vb.vbAppendDouble32(v.position, 1e6);
+    if (has(17)) vb.vbAppendUint8(v.vesc_id);
+    if (has(18)) {
+        vb.vbAppendDouble16(v.temp_mos_1, 1e1);
+        vb.vbAppendDouble16(v.temp_mos_2, 1e1);
+        vb.vbAppendDouble16(v.temp_mos_3, 1e1);
+    }
+    if (has(19)) vb.vbAppendDouble32(v.vd, 1e3);
+    if (has(20)) vb.vbAppendDouble32(v.vq, 1e3);
+    if (has(21)) vb.vbAppendUint8((v.has_timeout ? 1 : 0) | (v.kill_sw_active ? 2 : 0));
+
+    return vb;
+}
+
+QByteArray VirtualVesc::fileListReply(const QString &path, const QString &from) const
+{
+    QString dir = cleanPath(path);
+    auto parentOf = [](const QString &p) {
+        int ind = p.lastIndexOf('/');
+        return ind <= 0 ? QString("/") : p.left(ind);
+    };
+
+    // Name and size of the entries in the directory, -1 for directories
+    QMap<QString, qint32> entries;
+    for (auto it = mFiles.constBegin();it != mFiles.constEnd();++it) {
+        if (parentOf(it.key()) == dir) {
+            entries.insert(it.key().mid(it.key().lastIndexOf('/') + 1), it.value().size());
+        }
+    }
+    for (const auto &d: mDirs) {
+        if (parentOf(d) == dir) {
+            entries.insert(d.mid(d.lastIndexOf('/') + 1), -1);
+        }
+    }
+
+    VByteArray list;
+    bool hasMore = false;
+    for (auto it = entries.constBegin();it != entries.constEnd();++it) {
+        if (!from.isEmpty() && it.key() <= from) {
+            continue;
+        }
+
+        VByteArray entry;
+        entry.vbAppendInt8(it.value() < 0);
+        entry.vbAppendInt32(qMax(it.value(), 0));
+        entry.vbAppendString(it.key());
+
+        if ((list.size() + entry.size()) > maxReplyData) {
+            hasMore = true;
+            break;
+        }
+
+        list.append(entry);
+    }
+
+    VByteArray vb;
+    vb.vbAppendUint8(COMM_FILE_LIST);
+    vb.vbAppendInt8(hasMore);
+    vb.append(list);
+    return vb;
+}
+
+QString VirtualVesc::cleanPath(const QString &path)
+{
+    QString res = QDir::cleanPath("/" + path);
+    return res.isEmpty() ? QString("/") : res;
+}
@@ -0,0 +1,119 @@
+/*
+    Copyright 2016 - 2024 Benjamin Vedder	benjamin@vedder.se
+
+    This file is part of VESC Tool.
+
+    VESC Tool is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    VESC Tool is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+#ifndef VIRTUALVESC_H
+#define VIRTUALVESC_H
+
+#include <QObject>
+#include <QMap>
+#include <QSet>
+#include <QElapsedTimer>
+#include <QRandomGenerator>
+#include <QHostAddress>
+#include "datatypes.h"
+#include "vbytearray.h"
+#include "configparams.h"
+#include "tcpserversimple.h"
+
+/**
+ * @brief The VirtualVesc class
+ * A simulated VESC that accepts connections over TCP, so that VescInterface
+ * can be connected to it with connectTcp. It answers the firmware version,
+ * values, configuration, file, Lisp and firmware upload commands from its
+ * state in memory. All other commands are ignored.
+ *
+ * The link can be made worse with a fixed latency before every reply, a
+ * bandwidth limit in each direction and random packet loss in each
+ * direction, to see how the protocol stack behaves on slow links.
+ */
+class VirtualVesc : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit VirtualVesc(QObject *parent = nullptr);
+
+    bool listen(int port = 0, const QHostAddress &addr = QHostAddress::LocalHost);
+    void close();
+    int port() const;
+    bool isClientConnected();
+
+    bool setFirmware(int major, int minor);
+    void setHw(const QString &hw);
+    void setValues(const MC_VALUES &values);
+    MC_VALUES values() const;
+    ConfigParams *mcConfig();
+    ConfigParams *appConfig();
+
+    void setLatencyMs(int ms);
+    void setBandwidth(int bytesPerSecond);
+    void setLossRate(double rate, quint32 seed = 1);
+
+    void setFile(const QString &path, const QByteArray &data);
+    QByteArray file(const QString &path) const;
+    QByteArray lispCode() const;
+    QByteArray newAppData() const;
+
+    int requestCount() const;
+    int droppedCount() const;
+    QString statsString() const;
+
+    static QByteArray valuesReply(const MC_VALUES &v, bool selective, uint32_t mask);
+
+private slots:
+    void packetReceived(QByteArray &packet);
+
+private:
+    TcpServerSimple *mServer;
+    QElapsedTimer mTime;
+    QRandomGenerator mRandom;
+
+    int mFwMajor;
+    int mFwMinor;
+    QString mHw;
+    QByteArray mUuid;
+    MC_VALUES mValues;
+    ConfigParams mMcConfig;
+    ConfigParams mAppConfig;
+    QMap<QString, QByteArray> mFiles;
+    QSet<QString> mDirs;
+    QByteArray mLispCode;
+    QByteArray mNewApp;
+
+    int mLatencyMs;
+    int mBytesPerSecond;
+    double mLossRate;
+    qint64 mRxFreeUs;
+    qint64 mTxFreeUs;
+
+    int mRequests;
+    int mDropped;
+    qint64 mBytesIn;
+    qint64 mBytesOut;
+
+    bool lost();
+    qint64 linkDoneUs(qint64 &freeUs, qint64 startUs, int bytes);
+    void processPacket(VByteArray vb);
+    void reply(const QByteArray &data);
+    QByteArray fileListReply(const QString &path, const QString &from) const;
+    static QString cleanPath(const QString &path);
+
+};
+
+#endif // VIRTUALVESC_H
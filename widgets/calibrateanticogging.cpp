@@ -1,6 +1,7 @@
 #include "calibrateanticogging.h"
 #include "ui_calibrateanticogging.h"
 #include "utility.h"
+#include "anticoggingmodel.h"
 #include <QDebug>
 #include <ranges>
 
@@ -11,6 +12,7 @@ CalibrateAnticogging::CalibrateAnticogging(QWidget* parent) :
 
 	auto csvMenu = new QMenu(this);
 	csvMenu->addActions({ ui->actionImportCSV, ui->actionExportCSV });
+	csvMenu->addAction(tr("Export Harmonic Model..."), this, &CalibrateAnticogging::exportHarmonicModel);
 	ui->csvToolButton->setMenu(csvMenu);
 
 	acDegreeAxis.resize(3600);
@@ -112,35 +114,26 @@ void CalibrateAnticogging::on_readCalDataButton_clicked() {
 		AC_WAIT_TIMEOUT,
 		AC_WAIT_ERROR
 	};
-	auto waitForData = [this] {
-		QEventLoop loop;
-		QTimer timeoutTimer;
-		timeoutTimer.setSingleShot(true);
-		timeoutTimer.start(3000);
-		AC_WAIT_RESULT res = AC_WAIT_OK;
+	auto readBack = [this](ANTICOGGING_BLOCK_TRANSMISSION_STATE state, uint32_t offset, uint32_t len) {
+		auto reply = mVesc->commands()->focAnticoggingReadBackCalDataRequest(state, offset, len);
+		AC_WAIT_RESULT res = AC_WAIT_TIMEOUT;
 		VByteArray payload;
-		auto conn = connect(mVesc->commands(), &Commands::focAnticoggingCalDataReadBackReceived,
-			[&](bool valid, VByteArray data) {
-				if (!valid) {
-					res = AC_WAIT_ERROR;
-				}
-				else {
-					payload = std::move(data);
-					res = AC_WAIT_OK;
-				}
-				loop.quit();
-			});
-		connect(&timeoutTimer, &QTimer::timeout, [&] {
-			res = AC_WAIT_TIMEOUT;
-			loop.quit();
-			});
-		loop.exec();
-		disconnect(conn);
+		if (reply->waitForFinished()) {
+			VByteArray vb(reply->data());
+			vb.vbPopFrontUint8();
+			if (state == AC_BLOCK_START && !vb.vbPopFrontInt8()) {
+				res = AC_WAIT_ERROR;
+			}
+			else {
+				payload = std::move(vb);
+				res = AC_WAIT_OK;
+			}
+		}
+		reply->deleteLater();
 		return std::pair{ res , payload };
 		};
-	mVesc->commands()->focAnticoggingReadBackCalData(AC_BLOCK_START, 0, 0);
 	{
-		auto [res, payload] = waitForData();
+		auto [res, payload] = readBack(AC_BLOCK_START, 0, 0);
 		switch (res) {
 		case AC_WAIT_OK:
 			break;
@@ -158,11 +151,10 @@ void CalibrateAnticogging::on_readCalDataButton_clicked() {
 	ui->progressBar->setMaximum(3600 * 4 * 2);
 	ui->progressBar->setValue(data.length());
 	while (data.length() < 3600 * 4 * 2) {
-		mVesc->commands()->focAnticoggingReadBackCalData(
+		auto [res, payload] = readBack(
 			AC_BLOCK_ONGOING, data.length(),
 			std::min(500, 3600 * 4 * 2 - data.length())
 		);
-		auto [res, payload] = waitForData();
 		switch (res) {
 		case AC_WAIT_OK:
 			std::ranges::copy(payload, std::back_inserter(data));
@@ -195,26 +187,20 @@ void CalibrateAnticogging::on_readCalDataButton_clicked() {
 }
 
 void CalibrateAnticogging::on_downloadCalDataButton_clicked() {
-	auto waitForAck = [this] {
-		QEventLoop loop;
-		QTimer timeoutTimer;
-		timeoutTimer.setSingleShot(true);
-		timeoutTimer.start(3000);
+	auto download = [this](ANTICOGGING_BLOCK_TRANSMISSION_STATE state, uint32_t offset, QByteArray payload) {
+		auto reply = mVesc->commands()->focAnticoggingDownloadCalDataRequest(state, offset, payload);
 		bool res = false;
-		auto conn = connect(mVesc->commands(), &Commands::focAnticoggingCalDataAckReceived,
-			[&res, &loop](bool res_) {
-				res = res_;
-				loop.quit();
-			});
-		connect(&timeoutTimer, SIGNAL(timeout()), &loop, SLOT(quit()));
-		loop.exec();
-		disconnect(conn);
+		if (reply->waitForFinished()) {
+			VByteArray vb(reply->data());
+			vb.vbPopFrontUint8();
+			res = vb.vbPopFrontUint8();
+		}
+		reply->deleteLater();
 		return res;
 		};
 	VByteArray vb;
 	// start
-	mVesc->commands()->focAnticoggingDownloadCalData(AC_BLOCK_START, 0, {});
-	if (!waitForAck()) {
+	if (!download(AC_BLOCK_START, 0, {})) {
 		QMessageBox::critical(this, "Error", "Upload failed or timeout.");
 		return;
 	}
@@ -248,8 +234,7 @@ void CalibrateAnticogging::on_downloadCalDataButton_clicked() {
 	const uint32_t packet_max_len = 500; // less than 512
 	uint32_t offset = 0;
 	for (auto x : vb | std::views::chunk(packet_max_len)) {
-		mVesc->commands()->focAnticoggingDownloadCalData(AC_BLOCK_ONGOING, offset, x);
-		if (!waitForAck()) {
+		if (!download(AC_BLOCK_ONGOING, offset, QByteArray(x.data(), int(x.size())))) {
 			QMessageBox::critical(this, "Error", "Upload failed or timeout.");
 			return;
 		}
@@ -260,8 +245,7 @@ void CalibrateAnticogging::on_downloadCalDataButton_clicked() {
 	ui->progressBar->setValue(vb.length());
 	// end
 	vb.clear();
-	mVesc->commands()->focAnticoggingDownloadCalData(AC_BLOCK_END, 0, {});
-	if (!waitForAck()) {
+	if (!download(AC_BLOCK_END, 0, {})) {
 		QMessageBox::critical(this, "Error", "Upload failed or timeout.");
 	}
 	else {
@@ -606,6 +590,58 @@ void CalibrateAnticogging::on_actionExportCSV_triggered() {
 	}
 }
 
+void CalibrateAnticogging::exportHarmonicModel() {
+	// Without the cutoff all bins are kept, which reproduces the data exactly
+	int cm_bins = ui->cutOffCheckBox->isChecked() ? ui->cmFreqBox->value() : 3600 / 2 + 1;
+	int dm_bins = ui->cutOffCheckBox->isChecked() ? ui->dmFreqBox->value() : 3600 / 2 + 1;
+
+	AnticoggingModel model;
+	model.addRun(0.0, 0.0, acDataForward, acDataReverse);
+	model.fit(cm_bins, dm_bins);
+	auto run = model.run(0);
+
+	QString fileName = QFileDialog::getSaveFileName(this,
+		tr("Save Harmonic Model"), "",
+		tr("CSV Files (*.csv)"));
+
+	if (!fileName.isEmpty()) {
+		if (!fileName.toLower().endsWith(".csv")) {
+			fileName.append(".csv");
+		}
+
+		QFile file(fileName);
+		if (!file.open(QIODevice::WriteOnly)) {
+			QMessageBox::critical(this, "Save CSV File",
+				"Could not open\n" + fileName + "\nfor writing");
+			return;
+		}
+
+		QTextStream stream(&file);
+		stream.setCodec("UTF-8");
+
+		stream << "harmonic, cm_cos, cm_sin, dm_cos, dm_sin\n";
+		stream << "0, " << QString::number(run.commonMode.offset, 'g', 9) << ", 0, " <<
+			QString::number(run.diffMode.offset, 'g', 9) << ", 0\n";
+
+		int harmonics = std::max(run.commonMode.harmonics(), run.diffMode.harmonics());
+		for (int k = 0; k < harmonics; k++) {
+			auto coeff = [k](const QVector<double>& c) {
+				return QString::number(k < c.size() ? c.at(k) : 0.0, 'g', 9);
+			};
+			stream << k + 1 << ", " << coeff(run.commonMode.cosCoeffs) << ", " <<
+				coeff(run.commonMode.sinCoeffs) << ", " << coeff(run.diffMode.cosCoeffs) << ", " <<
+				coeff(run.diffMode.sinCoeffs) << "\n";
+		}
+
+		file.close();
+
+		if (mVesc) {
+			mVesc->emitStatusMessage(tr("Harmonic model: %1 bytes instead of %2 bytes").
+				arg(model.coeffTable().size()).arg(3600 * 4 * 2), true);
+		}
+	}
+}
+
 CalibrateAnticogging::~CalibrateAnticogging() {
 	delete ui;
 }
@@ -36,6 +36,7 @@ private slots:
 	void on_cmFreqBox_valueChanged(int);
 	void on_dmFreqBox_valueChanged(int);
 	void on_cutOffCheckBox_clicked();
+	void exportHarmonicModel();
 
 signals:
 	void focAnticoggingCancelDownloadCalData();
@@ -24,6 +24,7 @@
 #include "utility.h"
 
 #include <QMessageBox>
+#include <QEventLoop>
 
 DetectAllFocDialog::DetectAllFocDialog(VescInterface *vesc, QWidget *parent) :
     QDialog(parent),
@@ -272,8 +273,14 @@ void DetectAllFocDialog::runDetect(bool can)
     mVesc->commands()->setMcconf(false);
     Utility::waitSignal(mVesc->commands(), SIGNAL(ackReceived(QString)), 2000);
     QVector<int> canDevs;
+    QVector<FocDetector::Node> nodes;
     if (can) {
-        canDevs = Utility::scanCanVescOnly(mVesc);
+        nodes = FocDetector::discoverNodes(mVesc);
+        for (const auto &n: nodes) {
+            if (n.canId >= 0) {
+                canDevs.append(n.canId);
+            }
+        }
     }
 
     if (mVesc->commands()->getLimitedCompatibilityCommands().contains(COMM_SET_BATTERY_CUT)) {
@@ -295,12 +302,17 @@ void DetectAllFocDialog::runDetect(bool can)
         }
     }
 
-    QString res = Utility::detectAllFoc(mVesc, can,
-                                        ui->maxPowerLossBox->value(),
-                                        ui->currentInMinBox->value(),
-                                        ui->currentInMaxBox->value(),
-                                        ui->openloopErpmBox->value(),
-                                        ui->sensorlessErpmBox->value());
+    QString res;
+    if (nodes.size() > 1) {
+        res = detectParallel(nodes, canDevs);
+    } else {
+        res = Utility::detectAllFoc(mVesc, can,
+                                    ui->maxPowerLossBox->value(),
+                                    ui->currentInMinBox->value(),
+                                    ui->currentInMaxBox->value(),
+                                    ui->openloopErpmBox->value(),
+                                    ui->sensorlessErpmBox->value());
+    }
 
     if (res.startsWith("Success!")) {
         Utility::setBatteryCutCanFromCurrentConfig(mVesc, canDevs);
@@ -322,3 +334,56 @@ void DetectAllFocDialog::runDetect(bool can)
         ui->dirSetup->scanVescs(can);
     }
 }
+
+QString DetectAllFocDialog::detectParallel(const QVector<FocDetector::Node> &nodes, const QVector<int> &canDevs)
+{
+    FocDetector detector(mVesc->commands());
+    FocDetector::Params params;
+    params.maxPowerLoss = ui->maxPowerLossBox->value();
+    params.minCurrentIn = ui->currentInMinBox->value();
+    params.maxCurrentIn = ui->currentInMaxBox->value();
+    params.openloopRpm = ui->openloopErpmBox->value();
+    params.slErpm = ui->sensorlessErpmBox->value();
+    params.maxConcurrent = ui->parallelBox->value();
+
+    ui->progressBar->setRange(0, nodes.size());
+    ui->progressBar->setValue(0);
+
+    QEventLoop loop;
+    bool ok = false;
+
+    auto conn1 = connect(&detector, &FocDetector::nodeUpdated, [this, &detector]() {
+        int done = 0;
+        for (const auto &n: detector.nodes()) {
+            if (n.state == FocDetector::NODE_OK || n.state == FocDetector::NODE_FAILED) {
+                done++;
+            }
+        }
+        ui->progressBar->setValue(done);
+    });
+    auto conn2 = connect(&detector, &FocDetector::finished, [&loop, &ok](bool okRx) {
+        ok = okRx;
+        loop.quit();
+    });
+    auto conn3 = connect(mVesc, &VescInterface::portConnectedChanged, [this, &detector]() {
+        if (!mVesc->isPortConnected()) {
+            detector.cancel();
+        }
+    });
+
+    if (detector.start(nodes, params)) {
+        loop.exec();
+    }
+
+    disconnect(conn1);
+    disconnect(conn2);
+    disconnect(conn3);
+
+    if (!ok) {
+        return "Detection failed.\n\n" + detector.report();
+    }
+
+    return "Success!\n\n" +
+            Utility::detectAllFocSummary(mVesc, !mVesc->commands()->getSendCan(), canDevs) +
+            "\n\n" + detector.report();
+}
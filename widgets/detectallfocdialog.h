@@ -22,6 +22,7 @@
 
 #include <QDialog>
 #include "vescinterface.h"
+#include "focdetector.h"
 
 namespace Ui {
 class DetectAllFocDialog;
@@ -93,6 +94,7 @@ private:
     int mPulleyWheelOld;
 
     void runDetect(bool can);
+    QString detectParallel(const QVector<FocDetector::Node> &nodes, const QVector<int> &canDevs);
 
 };
 
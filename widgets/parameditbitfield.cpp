@@ -81,8 +81,9 @@ void ParamEditBitfield::setConfig(ConfigParams *config)
         ui->b7Box->setVisible(ui->b7Box->text().toLower() != "unused");
     }
 
-    connect(mConfig, SIGNAL(paramChangedInt(QObject*,QString,int)),
-            this, SLOT(paramChangedInt(QObject*,QString,int)));
+    mConfig->subscribe(mName, this, [this](QObject *src, const ConfigParam &p) {
+        paramChangedInt(src, mName, p.valInt);
+    });
 }
 
 QString ParamEditBitfield::name() const
@@ -51,8 +51,9 @@ void ParamEditBool::setConfig(ConfigParams *config)
         ui->valueBox->setCurrentIndex(param->valInt ? 1 : 0);
     }
 
-    connect(mConfig, SIGNAL(paramChangedBool(QObject*,QString,bool)),
-            this, SLOT(paramChangedBool(QObject*,QString,bool)));
+    mConfig->subscribe(mName, this, [this](QObject *src, const ConfigParam &p) {
+        paramChangedBool(src, mName, p.valInt);
+    });
 }
 
 QString ParamEditBool::name() const
@@ -97,8 +97,9 @@ void ParamEditDouble::setConfig(ConfigParams *config)
         }
     }
 
-    connect(mConfig, SIGNAL(paramChangedDouble(QObject*,QString,double)),
-            this, SLOT(paramChangedDouble(QObject*,QString,double)));
+    mConfig->subscribe(mName, this, [this](QObject *src, const ConfigParam &p) {
+        paramChangedDouble(src, mName, p.valDouble);
+    });
 }
 
 QString ParamEditDouble::name() const
@@ -57,8 +57,9 @@ void ParamEditEnum::setConfig(ConfigParams *config)
         }
     }
 
-    connect(mConfig, SIGNAL(paramChangedEnum(QObject*,QString,int)),
-            this, SLOT(paramChangedEnum(QObject*,QString,int)));
+    mConfig->subscribe(mName, this, [this](QObject *src, const ConfigParam &p) {
+        paramChangedEnum(src, mName, p.valInt);
+    });
 }
 
 QString ParamEditEnum::name() const
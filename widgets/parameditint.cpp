@@ -96,8 +96,9 @@ void ParamEditInt::setConfig(ConfigParams *config)
         }
     }
 
-    connect(mConfig, SIGNAL(paramChangedInt(QObject*,QString,int)),
-            this, SLOT(paramChangedInt(QObject*,QString,int)));
+    mConfig->subscribe(mName, this, [this](QObject *src, const ConfigParam &p) {
+        paramChangedInt(src, mName, p.valInt);
+    });
 }
 
 QString ParamEditInt::name() const
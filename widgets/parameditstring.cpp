@@ -53,8 +53,9 @@ void ParamEditString::setConfig(ConfigParams *config)
         }
     }
 
-    connect(mConfig, SIGNAL(paramChangedQString(QObject*,QString,QString)),
-            this, SLOT(paramChangedQString(QObject*,QString,QString)));
+    mConfig->subscribe(mName, this, [this](QObject *src, const ConfigParam &p) {
+        paramChangedQString(src, mName, p.valString);
+    });
 }
 
 QString ParamEditString::name() const
@@ -21,87 +21,402 @@
 #include "utility.h"
 #include <QDebug>
 #include <QHeaderView>
-#include <QLabel>
+#include <QPainter>
+#include <QTimer>
 
-ParamTable::ParamTable(QWidget *parent) : QTableWidget(parent)
+// Rows below the visible area that get their editors in advance, so that
+// scrolling does not show rows without editors.
+#define EDITOR_PREFETCH_ROWS    8
+#define SEPARATOR_MARGIN        3
+
+ParamTableModel::ParamTableModel(QObject *parent) : QAbstractTableModel(parent)
+{
+
+}
+
+int ParamTableModel::rowCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : mRows.size();
+}
+
+int ParamTableModel::columnCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : 2;
+}
+
+QVariant ParamTableModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid() || index.row() >= mRows.size() || role != Qt::DisplayRole) {
+        return QVariant();
+    }
+
+    const Row &r = mRows.at(index.row());
+
+    if (index.column() == 0 || r.separator) {
+        return r.text;
+    }
+
+    // Shown until the editor of the row has been created
+    if (!r.params) {
+        return QVariant();
+    }
+
+    ConfigParam *p = r.params->getParam(r.name);
+    if (!p) {
+        return QVariant();
+    }
+
+    switch (p->type) {
+    case CFG_T_DOUBLE:
+        return QString::number(p->valDouble * p->editorScale, 'f', p->editorDecimalsDouble) + p->suffix;
+
+    case CFG_T_INT:
+        return QString::number(int(double(p->valInt) * p->editorScale)) + p->suffix;
+
+    case CFG_T_QSTRING:
+        return p->valString;
+
+    case CFG_T_ENUM:
+        return p->enumNames.value(p->valInt);
+
+    case CFG_T_BOOL:
+        return p->valInt ? "True" : "False";
+
+    default:
+        return QVariant();
+    }
+}
+
+Qt::ItemFlags ParamTableModel::flags(const QModelIndex &index) const
+{
+    if (!index.isValid()) {
+        return Qt::NoItemFlags;
+    }
+
+    return Qt::ItemIsEnabled;
+}
+
+void ParamTableModel::appendRows(const QVector<ParamTableModel::Row> &rows)
+{
+    if (rows.isEmpty()) {
+        return;
+    }
+
+    beginInsertRows(QModelIndex(), mRows.size(), mRows.size() + rows.size() - 1);
+    mRows.append(rows);
+    endInsertRows();
+}
+
+void ParamTableModel::clear()
 {
-    setColumnCount(2);
+    beginResetModel();
+    mRows.clear();
+    endResetModel();
+}
+
+const ParamTableModel::Row &ParamTableModel::row(int row) const
+{
+    return mRows.at(row);
+}
+
+ParamTableDelegate::ParamTableDelegate(ParamTableModel *model, QObject *parent) :
+    QStyledItemDelegate(parent), mModel(model)
+{
+
+}
+
+void ParamTableDelegate::paint(QPainter *painter, const QStyleOptionViewItem &option, const QModelIndex &index) const
+{
+    if (!mModel->row(index.row()).separator) {
+        QStyledItemDelegate::paint(painter, option, index);
+        return;
+    }
+
+    QLinearGradient grad(option.rect.topLeft(), option.rect.topRight());
+    grad.setColorAt(0.0, Utility::getAppQColor("lightAccent"));
+    grad.setColorAt(0.2, Utility::getAppQColor("darkAccent"));
+    grad.setColorAt(0.8, Utility::getAppQColor("darkAccent"));
+    grad.setColorAt(1.0, Utility::getAppQColor("lightAccent"));
+
+    QFont font = option.font;
+    font.setBold(true);
+
+    painter->save();
+    painter->fillRect(option.rect, grad);
+    painter->setFont(font);
+    painter->setPen(Qt::white);
+    painter->drawText(option.rect, Qt::AlignCenter, mModel->row(index.row()).text);
+    painter->restore();
+}
 
-    QStringList headers;
-    headers.append("Name");
-    headers.append("Edit");
+QSize ParamTableDelegate::sizeHint(const QStyleOptionViewItem &option, const QModelIndex &index) const
+{
+    if (!mModel->row(index.row()).separator) {
+        return QStyledItemDelegate::sizeHint(option, index);
+    }
+
+    QFont font = option.font;
+    font.setBold(true);
+    QFontMetrics fm(font);
 
-    setHorizontalHeaderLabels(headers);
+    // The separator spans both columns, so it should not widen the name column
+    return QSize(0, fm.height() + 2 * SEPARATOR_MARGIN);
+}
+
+QWidget *ParamTableDelegate::createEditor(QWidget *parent, const QStyleOptionViewItem &option, const QModelIndex &index) const
+{
+    (void)option;
+
+    const ParamTableModel::Row &r = mModel->row(index.row());
+
+    if (r.separator || !r.params || index.column() != 1) {
+        return nullptr;
+    }
+
+    return r.params->getEditor(r.name, parent);
+}
+
+void ParamTableDelegate::setEditorData(QWidget *editor, const QModelIndex &index) const
+{
+    (void)editor;
+    (void)index;
+}
+
+void ParamTableDelegate::setModelData(QWidget *editor, QAbstractItemModel *model, const QModelIndex &index) const
+{
+    (void)editor;
+    (void)model;
+    (void)index;
+}
+
+ParamTable::ParamTable(QWidget *parent) : QTableView(parent)
+{
+    mModel = new ParamTableModel(this);
+    mDelegate = new ParamTableDelegate(mModel, this);
+    mEditorsEnabled = true;
+    mLayoutPending = false;
+    mResizeNameColumn = false;
+    mEditorRowHeight = -1;
+
+    setModel(mModel);
+    setItemDelegate(mDelegate);
+    setEditTriggers(QAbstractItemView::NoEditTriggers);
     setSelectionBehavior(QAbstractItemView::SelectRows);
     setSelectionMode(QAbstractItemView::NoSelection);
+    setWordWrap(false);
     horizontalHeader()->setStretchLastSection(true);
     horizontalHeader()->setVisible(false);
     verticalHeader()->setVisible(false);
+    verticalHeader()->setSectionResizeMode(QHeaderView::Fixed);
 }
 
 bool ParamTable::addParamRow(ConfigParams *params, QString paramName)
 {
-    bool res = false;
-    QWidget *editor = params->getEditor(paramName);
-    QString name = params->getLongName(paramName);
+    ConfigParam *p = params->getParam(paramName);
 
-    if (editor) {
-        int row = rowCount();
-        setRowCount(row + 1);
-        QTableWidgetItem *item = new QTableWidgetItem(name);
-        item->setFlags(item->flags() & ~Qt::ItemIsEditable);
-        setItem(row, 0, item);
-        setCellWidget(row, 1, editor);
-        res = true;
-
-        resizeColumnToContents(0);
-        resizeRowsToContents();
+    if (!p || p->type == CFG_T_UNDEFINED) {
+        qWarning() << "no editor for" << paramName << "could be created";
+        return false;
     }
 
-    return res;
+    ParamTableModel::Row r;
+    r.params = params;
+    r.name = paramName;
+    r.text = params->getLongName(paramName);
+    appendRows({r});
+
+    return true;
 }
 
 void ParamTable::addRowSeparator(QString text)
 {
-    int row = rowCount();
-    setRowCount(row + 1);
-
-    QLabel *label = new QLabel(text);
-    label->setAlignment(Qt::AlignCenter);
-    QFont font;
-    font.setBold(true);
-
-    label->setStyleSheet("QLabel { background: qlineargradient(x1: 0, y1: 0, x2: 1.0, y2: 0, stop: 0.0" + Utility::getAppHexColor("lightAccent") +
-                         ", stop: 0.2 " + Utility::getAppHexColor("darkAccent") +
-                         ", stop: 0.8 " + Utility::getAppHexColor("darkAccent") +
-                         ", stop: 1.0 " + Utility::getAppHexColor("lightAccent") +");" +
-                         " color : white; border: none;}");
-    label->setFont(font);
-    label->setMargin(3);
-
-    setCellWidget(row, 0, label);
-    setSpan(row, 0, 1, 2);
-
-    resizeColumnToContents(0);
-    resizeRowsToContents();
+    ParamTableModel::Row r;
+    r.text = text;
+    r.separator = true;
+    appendRows({r});
 }
 
 void ParamTable::addParamSubgroup(ConfigParams *params, QString groupName, QString subgroupName)
 {
-    setUpdatesEnabled(false);
+    QVector<ParamTableModel::Row> rows;
+
     foreach (auto p, params->getParamsFromSubgroup(groupName, subgroupName)) {
+        ParamTableModel::Row r;
+
         if (p.startsWith("::sep::")) {
-            addRowSeparator(p.mid(7));
+            r.text = p.mid(7);
+            r.separator = true;
         } else {
-            addParamRow(params, p);
+            ConfigParam *param = params->getParam(p);
+            if (!param || param->type == CFG_T_UNDEFINED) {
+                qWarning() << "no editor for" << p << "could be created";
+                continue;
+            }
+
+            r.params = params;
+            r.name = p;
+            r.text = params->getLongName(p);
         }
+
+        rows.append(r);
     }
-    QTimer::singleShot(0, [this]() {
-        setUpdatesEnabled(true);
-    });
+
+    appendRows(rows);
 }
 
 void ParamTable::clearParams()
 {
-    setRowCount(0);
+    // Resetting the model deletes the editors
+    mModel->clear();
+    mEditors.clear();
+}
+
+/**
+ * @brief ParamTable::setEditorsEnabled
+ * Enable or disable the editors of all rows, including the ones that have
+ * not been created yet.
+ */
+void ParamTable::setEditorsEnabled(bool enabled)
+{
+    mEditorsEnabled = enabled;
+
+    for (auto e: mEditors) {
+        if (e) {
+            e->setEnabled(enabled);
+        }
+    }
+}
+
+void ParamTable::resizeEvent(QResizeEvent *event)
+{
+    QTableView::resizeEvent(event);
+    scheduleLayout(false);
+}
+
+void ParamTable::showEvent(QShowEvent *event)
+{
+    QTableView::showEvent(event);
+    scheduleLayout(false);
+}
+
+void ParamTable::scrollContentsBy(int dx, int dy)
+{
+    QTableView::scrollContentsBy(dx, dy);
+
+    if (dy != 0) {
+        createVisibleEditors();
+    }
+}
+
+void ParamTable::currentChanged(const QModelIndex &current, const QModelIndex &previous)
+{
+    QTableView::currentChanged(current, previous);
+
+    if (current.isValid()) {
+        createEditor(current.row());
+    }
+}
+
+void ParamTable::layoutRows()
+{
+    mLayoutPending = false;
+
+    if (mResizeNameColumn) {
+        mResizeNameColumn = false;
+        resizeColumnToContents(0);
+    }
+
+    createVisibleEditors();
+}
+
+void ParamTable::appendRows(const QVector<ParamTableModel::Row> &rows)
+{
+    int first = mModel->rowCount();
+    mModel->appendRows(rows);
+    mEditors.resize(mModel->rowCount());
+
+    QStyleOptionViewItem opt = viewOptions();
+    for (int i = first;i < mModel->rowCount();i++) {
+        if (mModel->row(i).separator) {
+            setSpan(i, 0, 1, 2);
+            verticalHeader()->resizeSection(i, mDelegate->sizeHint(opt, mModel->index(i, 0)).height());
+        }
+    }
+
+    scheduleLayout(true);
+}
+
+void ParamTable::scheduleLayout(bool resizeNameColumn)
+{
+    mResizeNameColumn |= resizeNameColumn;
+
+    if (!mLayoutPending) {
+        mLayoutPending = true;
+        QTimer::singleShot(0, this, &ParamTable::layoutRows);
+    }
+}
+
+void ParamTable::createEditor(int row)
+{
+    if (row < 0 || row >= mEditors.size() || mEditors.at(row) ||
+            mModel->row(row).separator) {
+        return;
+    }
+
+    QModelIndex index = mModel->index(row, 1);
+    openPersistentEditor(index);
+    QWidget *editor = indexWidget(index);
+
+    if (!editor) {
+        return;
+    }
+
+    mEditors[row] = editor;
+    editor->setEnabled(mEditorsEnabled);
+
+    int height = editor->sizeHint().height();
+
+    if (mEditorRowHeight < 0) {
+        // All editors are about the same height, so the first one gives the
+        // default row height. That resizes every row, so the separators
+        // have to be sized again.
+        mEditorRowHeight = height;
+        verticalHeader()->setDefaultSectionSize(height);
+
+        QStyleOptionViewItem opt = viewOptions();
+        for (int i = 0;i < mModel->rowCount();i++) {
+            if (mModel->row(i).separator) {
+                verticalHeader()->resizeSection(i, mDelegate->sizeHint(opt, mModel->index(i, 0)).height());
+            }
+        }
+    } else if (height > rowHeight(row)) {
+        verticalHeader()->resizeSection(row, height);
+    }
+}
+
+void ParamTable::createVisibleEditors()
+{
+    if (!isVisible() || mModel->rowCount() == 0) {
+        return;
+    }
+
+    int rowHeightBefore = mEditorRowHeight;
+    int first = qMax(rowAt(0), 0);
+    int last = rowAt(viewport()->height() - 1);
+
+    if (last < 0) {
+        last = mModel->rowCount() - 1;
+    }
+
+    last = qMin(last + EDITOR_PREFETCH_ROWS, mModel->rowCount() - 1);
+
+    for (int i = first;i <= last;i++) {
+        createEditor(i);
+    }
+
+    // The first editor sets the row height, which changes how many rows
+    // fit into the view.
+    if (rowHeightBefore < 0 && mEditorRowHeight >= 0) {
+        createVisibleEditors();
+    }
 }
@@ -21,17 +21,108 @@
 #define PARAMTABLE_H
 
 #include <QWidget>
-#include <QTableWidget>
+#include <QTableView>
+#include <QAbstractTableModel>
+#include <QStyledItemDelegate>
+#include <QPointer>
+#include <QVector>
 #include "configparams.h"
 
-class ParamTable : public QTableWidget
+/**
+ * @brief The ParamTableModel class
+ * Rows of a ParamTable. A row is either a parameter of a ConfigParams or a
+ * separator with a caption.
+ */
+class ParamTableModel : public QAbstractTableModel
 {
+    Q_OBJECT
+public:
+    struct Row {
+        QPointer<ConfigParams> params;
+        QString name;
+        QString text;
+        bool separator = false;
+    };
+
+    explicit ParamTableModel(QObject *parent = nullptr);
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+    Qt::ItemFlags flags(const QModelIndex &index) const override;
+
+    void appendRows(const QVector<Row> &rows);
+    void clear();
+    const Row &row(int row) const;
+
+private:
+    QVector<Row> mRows;
+
+};
+
+/**
+ * @brief The ParamTableDelegate class
+ * Paints the separators and creates the parameter editors of a ParamTable.
+ * The editors write to their ConfigParams directly, so nothing is passed
+ * through the model.
+ */
+class ParamTableDelegate : public QStyledItemDelegate
+{
+    Q_OBJECT
+public:
+    explicit ParamTableDelegate(ParamTableModel *model, QObject *parent = nullptr);
+
+    void paint(QPainter *painter, const QStyleOptionViewItem &option, const QModelIndex &index) const override;
+    QSize sizeHint(const QStyleOptionViewItem &option, const QModelIndex &index) const override;
+    QWidget *createEditor(QWidget *parent, const QStyleOptionViewItem &option, const QModelIndex &index) const override;
+    void setEditorData(QWidget *editor, const QModelIndex &index) const override;
+    void setModelData(QWidget *editor, QAbstractItemModel *model, const QModelIndex &index) const override;
+
+private:
+    ParamTableModel *mModel;
+
+};
+
+/**
+ * @brief The ParamTable class
+ * Table with a name and an editor for each parameter. The editor widgets
+ * are only created when their rows are scrolled into view or get focus,
+ * and the table is laid out once per batch of added rows rather than for
+ * every row.
+ */
+class ParamTable : public QTableView
+{
+    Q_OBJECT
 public:
     ParamTable(QWidget *parent = nullptr);
     bool addParamRow(ConfigParams *params, QString paramName);
     void addRowSeparator(QString text);
     void addParamSubgroup(ConfigParams *params, QString groupName, QString subgroupName);
     void clearParams();
+    void setEditorsEnabled(bool enabled);
+
+protected:
+    void resizeEvent(QResizeEvent *event) override;
+    void showEvent(QShowEvent *event) override;
+    void scrollContentsBy(int dx, int dy) override;
+    void currentChanged(const QModelIndex &current, const QModelIndex &previous) override;
+
+private slots:
+    void layoutRows();
+
+private:
+    ParamTableModel *mModel;
+    ParamTableDelegate *mDelegate;
+    QVector<QWidget*> mEditors;
+    bool mEditorsEnabled;
+    bool mLayoutPending;
+    bool mResizeNameColumn;
+    int mEditorRowHeight;
+
+    void appendRows(const QVector<ParamTableModel::Row> &rows);
+    void scheduleLayout(bool resizeNameColumn);
+    void createEditor(int row);
+    void createVisibleEditors();
 
 };
 